@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2017-2021 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include <vm.c>
+#include <test/vm_test.h>
+
+#define NEVALS 200000
+#define NDRAINS 20000
+#define NEVENTS 64 // per sequence and period
+
+typedef struct _graph_t graph_t;
+
+struct _graph_t {
+	const char *label;
+	vm_command_t cmds [ITEMS_MAX];
+};
+
+static graph_t graphs [] = {
+	{
+		.label = "add",
+		.cmds = {
+			I(0), O(OP_CTRL), I(1), O(OP_CTRL), O(OP_ADD)
+		}
+	},
+	{
+		.label = "sumLinear",
+		.cmds = {
+			I(0), O(OP_CTRL), I(1), O(OP_CTRL), I(2), O(OP_CTRL), I(3), O(OP_CTRL),
+			I(4), O(OP_CTRL), I(5), O(OP_CTRL), I(6), O(OP_CTRL), I(7), O(OP_CTRL),
+			O(OP_ADD), O(OP_ADD), O(OP_ADD), O(OP_ADD), O(OP_ADD), O(OP_ADD), O(OP_ADD)
+		}
+	},
+	{
+		.label = "select",
+		.cmds = {
+			F(1.f), F(-1.f), I(0), O(OP_CTRL), I(1), O(OP_CTRL), O(OP_LT), O(OP_TER)
+		}
+	},
+	{
+		.label = "mixed x3"
+	},
+	{
+		.label = "mixed x6"
+	}
+};
+
+// representative editor output: inputs scaled, shaped and accumulated
+static void
+_graph_mixed(vm_command_t *cmds, unsigned nrepeats)
+{
+	static const vm_command_t pattern [] = {
+		I(0), O(OP_CTRL), F(0.5f), O(OP_MUL), F(0.25f), O(OP_ADD),
+		I(1), O(OP_CTRL), O(OP_ABS), O(OP_MAXI), F(-1.f), F(1.f), O(OP_SWAP),
+		O(OP_POP), O(OP_MINI), O(OP_ADD)
+	};
+	const unsigned npattern = sizeof(pattern) / sizeof(vm_command_t);
+	unsigned i = 0;
+
+	cmds[i++] = (vm_command_t)F(0.f);
+
+	for(unsigned r = 0; r < nrepeats; r++)
+	{
+		for(unsigned j = 0; j < npattern; j++)
+			cmds[i++] = pattern[j];
+	}
+}
+
+static double
+_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+// dense midi-like input on all sequences
+static void
+_seqs_fill(LV2_URID_Map *map, uint8_t bufs [MERGE_MAX][NEVENTS*32],
+	const LV2_Atom_Sequence *seqs [MERGE_MAX], uint32_t nsamples)
+{
+	LV2_Atom_Forge forge;
+	uint32_t seed = 0x12345678;
+
+	lv2_atom_forge_init(&forge, map);
+
+	for(unsigned i = 0; i < MERGE_MAX; i++)
+	{
+		LV2_Atom_Forge_Frame frame;
+		int64_t frames = 0;
+
+		lv2_atom_forge_set_buffer(&forge, bufs[i], NEVENTS*32);
+		lv2_atom_forge_sequence_head(&forge, &frame, 0);
+
+		for(unsigned e = 0; e < NEVENTS; e++)
+		{
+			seed = seed*1103515245 + 12345;
+			frames += (seed >> 16) % (nsamples / NEVENTS); // all within period
+
+			lv2_atom_forge_frame_time(&forge, frames);
+			lv2_atom_forge_int(&forge, e);
+		}
+
+		lv2_atom_forge_pop(&forge, &frame);
+		seqs[i] = (const LV2_Atom_Sequence *)bufs[i];
+	}
+}
+
+// linear rescan of all sequences per event, as in former run_atom/run_midi
+static uint64_t
+_drain_scan(const LV2_Atom_Sequence *seqs [MERGE_MAX], uint32_t nsamples)
+{
+	const LV2_Atom_Event *evs [MERGE_MAX];
+	uint64_t sum = 0;
+
+	for(unsigned i = 0; i < MERGE_MAX; i++)
+		evs[i] = lv2_atom_sequence_begin(&seqs[i]->body);
+
+	while(true)
+	{
+		int nxt = -1;
+		int64_t frames = nsamples;
+
+		for(unsigned i = 0; i < MERGE_MAX; i++)
+		{
+			if(!evs[i] || lv2_atom_sequence_is_end(&seqs[i]->body, seqs[i]->atom.size, evs[i]))
+			{
+				evs[i] = NULL;
+				continue;
+			}
+
+			if(evs[i]->time.frames < frames)
+			{
+				frames = evs[i]->time.frames;
+				nxt = i;
+			}
+		}
+
+		if(nxt == -1)
+			break;
+
+		sum = sum*31 + nxt*nsamples + frames;
+		evs[nxt] = lv2_atom_sequence_next(evs[nxt]);
+	}
+
+	return sum;
+}
+
+static uint64_t
+_drain_merge(const LV2_Atom_Sequence *seqs [MERGE_MAX], uint32_t nsamples)
+{
+	vm_merge_t merge;
+	uint64_t sum = 0;
+
+	vm_merge_init(&merge, seqs, MERGE_MAX);
+
+	while(true)
+	{
+		unsigned nxt;
+		const LV2_Atom_Event *ev = vm_merge_peek(&merge, &nxt);
+
+		if(!ev || (ev->time.frames >= nsamples))
+			break;
+
+		sum = sum*31 + nxt*nsamples + ev->time.frames;
+		vm_merge_next(&merge);
+	}
+
+	return sum;
+}
+
+static bool
+_bench_merge(LV2_URID_Map *map)
+{
+	static uint8_t bufs [MERGE_MAX][NEVENTS*32] __attribute__((aligned(8)));
+	const LV2_Atom_Sequence *seqs [MERGE_MAX];
+	const uint32_t nsamples = 1024;
+	uint64_t sums [2] = { 0, 0 };
+
+	_seqs_fill(map, bufs, seqs, nsamples);
+
+	for(unsigned m = 0; m < 2; m++)
+	{
+		for(unsigned i = 0; i < NDRAINS / 10; i++) // warm up
+			sums[m] += m ? _drain_merge(seqs, nsamples) : _drain_scan(seqs, nsamples);
+
+		const double t0 = _now();
+		for(unsigned i = 0; i < NDRAINS; i++)
+			sums[m] += m ? _drain_merge(seqs, nsamples) : _drain_scan(seqs, nsamples);
+		const double t1 = _now();
+
+		const double ns_drain = (t1 - t0) / NDRAINS;
+		const double ns_event = ns_drain / (NEVENTS * MERGE_MAX);
+
+		fprintf(stdout, "%-8s %-10s %4u seqs  %10.2f ns/drain %7.3f ns/event\n",
+			m ? "heap" : "scan", "merge", MERGE_MAX, ns_drain, ns_event);
+	}
+
+	if(sums[0] != sums[1])
+	{
+		fprintf(stderr, "merge: event order differs from scan\n");
+		return false;
+	}
+
+	return true;
+}
+
+int
+main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
+{
+	LV2_URID_Map map = {
+		.handle = NULL,
+		.map = _map
+	};
+	const LV2_Feature feature_map = {
+		.URI = LV2_URID__map,
+		.data = &map
+	};
+	const LV2_Feature *const features [] = {
+		&feature_map,
+		NULL
+	};
+
+	plughandle_t *handle = instantiate(&vm_cv, 48000.0, NULL, features);
+	if(!handle)
+		return 1;
+
+	_graph_mixed(graphs[3].cmds, 3);
+	_graph_mixed(graphs[4].cmds, 6);
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+		handle->in0[i] = 0.1f * i;
+
+#if defined(VM_DISPATCH_THREADED)
+	const char *dispatch = "threaded";
+#else
+	const char *dispatch = "switch";
+#endif
+
+	for(unsigned g = 0; g < sizeof(graphs) / sizeof(graph_t); g++)
+	{
+		graph_t *graph = &graphs[g];
+
+		vm_graph_compile(&handle->exec->prog, graph->cmds, VM_STATUS_STATIC);
+		vm_prog_optimize(&handle->exec->prog);
+
+		for(unsigned i = 0; i < NEVALS / 10; i++) // warm up
+			run_prog(handle);
+
+		const double t0 = _now();
+		for(unsigned i = 0; i < NEVALS; i++)
+			run_prog(handle);
+		const double t1 = _now();
+
+		const double ns_eval = (t1 - t0) / NEVALS;
+		const double ns_inst = ns_eval / handle->exec->prog.ninst;
+
+		fprintf(stdout, "%-8s %-10s %4"PRIu32" insts %10.2f ns/eval %8.3f ns/inst\n",
+			dispatch, graph->label, handle->exec->prog.ninst, ns_eval, ns_inst);
+
+		// register form, then with superinstructions, insts counts dispatches
+		vm_prog_verify(&handle->exec->prog, NULL, NULL);
+		for(unsigned fuse = 0; fuse < 2; fuse++)
+		{
+			vm_ir_t *ir = &handle->exec->ir;
+
+			if(!vm_ir_build(ir, &handle->exec->prog))
+				break;
+			if(fuse)
+				vm_ir_fuse(ir, true);
+
+			for(unsigned i = 0; i < NEVALS / 10; i++) // warm up
+				run_prog(handle);
+
+			const double t4 = _now();
+			for(unsigned i = 0; i < NEVALS; i++)
+				run_prog(handle);
+			const double t5 = _now();
+
+			const double ns_eval_ir = (t5 - t4) / NEVALS;
+			const double ns_inst_ir = ns_eval_ir / ir->ninst;
+
+			fprintf(stdout, "%-8s %-10s %4"PRIu32" insts %10.2f ns/eval %8.3f ns/inst\n",
+				fuse ? "fused" : "register", graph->label, ir->ninst, ns_eval_ir, ns_inst_ir);
+
+			ir->enabled = false;
+		}
+
+#if defined(VM_JIT)
+		if(!vm_jit_compile(&handle->exec->jit, &handle->exec->prog, _jit_rand, handle))
+			continue;
+
+		for(unsigned i = 0; i < NEVALS / 10; i++) // warm up
+			run_jit(handle);
+
+		const double t2 = _now();
+		for(unsigned i = 0; i < NEVALS; i++)
+			run_jit(handle);
+		const double t3 = _now();
+
+		const double ns_eval_jit = (t3 - t2) / NEVALS;
+		const double ns_inst_jit = ns_eval_jit / handle->exec->prog.ninst;
+
+		fprintf(stdout, "%-8s %-10s %4"PRIu32" insts %10.2f ns/eval %8.3f ns/inst\n",
+			"jit", graph->label, handle->exec->prog.ninst, ns_eval_jit, ns_inst_jit);
+#endif
+	}
+
+	const bool merged = _bench_merge(&map);
+
+	cleanup(handle);
+
+	return merged ? 0 : 1;
+}
@@ -0,0 +1,460 @@
+/*
+ * Copyright (c) 2017-2021 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include <vm.c>
+#include <test/vm_test.h>
+
+#define NPERIODS 200 // timed periods per configuration
+#define NWARMUPS 20
+#define NEVENTS 8 // per input sequence and period
+#define NSAMPLES_MAX 1024
+#define SEQ_SIZE 0x2000
+#define NOTIFY_SIZE 0x10000
+
+typedef struct _graph_t graph_t;
+typedef struct _host_t host_t;
+
+struct _graph_t {
+	const char *label;
+	vm_command_t cmds [ITEMS_MAX];
+};
+
+struct _host_t {
+	LV2_URID_Map map;
+	LV2_Log_Log log;
+	LV2_Atom_Forge forge;
+	vm_api_impl_t api [OP_MAX];
+
+	LV2_URID vm_graph;
+	LV2_URID midi_MidiEvent;
+	LV2_URID time_position;
+	LV2_URID time_barBeat;
+	LV2_URID time_bar;
+	LV2_URID time_beatUnit;
+	LV2_URID time_beatsPerBar;
+	LV2_URID time_beatsPerMinute;
+	LV2_URID time_frame;
+	LV2_URID time_speed;
+
+	uint32_t seed;
+};
+
+static const uint32_t block_sizes [] = {
+	64, 256, NSAMPLES_MAX
+};
+
+static const double sample_rates [] = {
+	44100.0, 48000.0, 96000.0
+};
+
+static uint8_t ctrl [SEQ_SIZE] __attribute__((aligned(8)));
+static uint8_t notify [NOTIFY_SIZE] __attribute__((aligned(8)));
+static uint8_t ins [CTRL_MAX][SEQ_SIZE] __attribute__((aligned(8)));
+static uint8_t outs [CTRL_MAX][SEQ_SIZE] __attribute__((aligned(8)));
+
+static int
+_vprintf(LV2_Log_Handle instance __attribute__((unused)),
+	LV2_URID type __attribute__((unused)), const char *fmt, va_list args)
+{
+	return vfprintf(stderr, fmt, args);
+}
+
+static int
+_printf(LV2_Log_Handle instance, LV2_URID type, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	const int ret = _vprintf(instance, type, fmt, args);
+	va_end(args);
+
+	return ret;
+}
+
+static graph_t graphs [] = {
+	{
+		.label = "add",
+		.cmds = {
+			I(0), O(OP_CTRL), I(1), O(OP_CTRL), O(OP_ADD)
+		}
+	},
+	{
+		.label = "sumLinear",
+		.cmds = {
+			I(0), O(OP_CTRL), I(1), O(OP_CTRL), I(2), O(OP_CTRL), I(3), O(OP_CTRL),
+			I(4), O(OP_CTRL), I(5), O(OP_CTRL), I(6), O(OP_CTRL), I(7), O(OP_CTRL),
+			O(OP_ADD), O(OP_ADD), O(OP_ADD), O(OP_ADD), O(OP_ADD), O(OP_ADD), O(OP_ADD)
+		}
+	},
+	{
+		.label = "barBeat",
+		.cmds = {
+			O(OP_BAR_BEAT), F(1.f), O(OP_MOD), I(0), O(OP_CTRL), O(OP_MUL)
+		}
+	},
+	{
+		.label = "rand",
+		.cmds = {
+			O(OP_RAND), I(0), O(OP_CTRL), O(OP_MUL)
+		}
+	},
+	{
+		.label = "mixed x6"
+	}
+};
+
+// representative editor output: inputs scaled, shaped and accumulated
+static void
+_graph_mixed(vm_command_t *cmds, unsigned nrepeats)
+{
+	static const vm_command_t pattern [] = {
+		I(0), O(OP_CTRL), F(0.5f), O(OP_MUL), F(0.25f), O(OP_ADD),
+		I(1), O(OP_CTRL), O(OP_ABS), O(OP_MAXI), F(-1.f), F(1.f), O(OP_SWAP),
+		O(OP_POP), O(OP_MINI), O(OP_ADD)
+	};
+	const unsigned npattern = sizeof(pattern) / sizeof(vm_command_t);
+	unsigned i = 0;
+
+	cmds[i++] = (vm_command_t)F(0.f);
+
+	for(unsigned r = 0; r < nrepeats; r++)
+	{
+		for(unsigned j = 0; j < npattern; j++)
+			cmds[i++] = pattern[j];
+	}
+}
+
+static double
+_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static uint32_t
+_rand(host_t *host)
+{
+	host->seed = host->seed*1103515245 + 12345;
+
+	return host->seed >> 16;
+}
+
+static void
+_host_init(host_t *host)
+{
+	host->map.handle = NULL;
+	host->map.map = _map;
+	host->log.handle = NULL;
+	host->log.printf = _printf;
+	host->log.vprintf = _vprintf;
+	host->seed = 0x12345678;
+
+	lv2_atom_forge_init(&host->forge, &host->map);
+	vm_api_init(host->api, &host->map);
+
+	host->vm_graph = _map(NULL, VM__graph);
+	host->midi_MidiEvent = _map(NULL, LV2_MIDI__MidiEvent);
+	host->time_position = _map(NULL, LV2_TIME__Position);
+	host->time_barBeat = _map(NULL, LV2_TIME__barBeat);
+	host->time_bar = _map(NULL, LV2_TIME__bar);
+	host->time_beatUnit = _map(NULL, LV2_TIME__beatUnit);
+	host->time_beatsPerBar = _map(NULL, LV2_TIME__beatsPerBar);
+	host->time_beatsPerMinute = _map(NULL, LV2_TIME__beatsPerMinute);
+	host->time_frame = _map(NULL, LV2_TIME__frame);
+	host->time_speed = _map(NULL, LV2_TIME__speed);
+}
+
+// graph and rolling transport on first period, empty control sequence after
+static void
+_ctrl_fill(host_t *host, const graph_t *graph, bool first)
+{
+	LV2_Atom_Forge *forge = &host->forge;
+	LV2_Atom_Forge_Frame seq_frame;
+	LV2_Atom_Forge_Frame obj_frame;
+
+	lv2_atom_forge_set_buffer(forge, ctrl, SEQ_SIZE);
+	lv2_atom_forge_sequence_head(forge, &seq_frame, 0);
+
+	if(first)
+	{
+		lv2_atom_forge_frame_time(forge, 0);
+		lv2_atom_forge_object(forge, &obj_frame, 0, _map(NULL, LV2_PATCH__Set));
+		lv2_atom_forge_key(forge, _map(NULL, LV2_PATCH__property));
+		lv2_atom_forge_urid(forge, host->vm_graph);
+		lv2_atom_forge_key(forge, _map(NULL, LV2_PATCH__value));
+		vm_graph_serialize(host->api, forge, graph->cmds);
+		lv2_atom_forge_pop(forge, &obj_frame);
+
+		lv2_atom_forge_frame_time(forge, 0);
+		lv2_atom_forge_object(forge, &obj_frame, 0, host->time_position);
+		lv2_atom_forge_key(forge, host->time_barBeat);
+		lv2_atom_forge_float(forge, 0.f);
+		lv2_atom_forge_key(forge, host->time_bar);
+		lv2_atom_forge_long(forge, 0);
+		lv2_atom_forge_key(forge, host->time_beatUnit);
+		lv2_atom_forge_int(forge, 4);
+		lv2_atom_forge_key(forge, host->time_beatsPerBar);
+		lv2_atom_forge_float(forge, 4.f);
+		lv2_atom_forge_key(forge, host->time_beatsPerMinute);
+		lv2_atom_forge_float(forge, 120.f);
+		lv2_atom_forge_key(forge, host->time_frame);
+		lv2_atom_forge_long(forge, 0);
+		lv2_atom_forge_key(forge, host->time_speed);
+		lv2_atom_forge_float(forge, 1.f);
+		lv2_atom_forge_pop(forge, &obj_frame);
+	}
+
+	lv2_atom_forge_pop(forge, &seq_frame);
+}
+
+// fresh input values for a period, returns number of input events
+static uint32_t
+_ins_fill(host_t *host, vm_plug_enum_t vm_plug, uint32_t nsamples, uint64_t off)
+{
+	LV2_Atom_Forge *forge = &host->forge;
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		float *flt = (float *)ins[i];
+
+		switch(vm_plug)
+		{
+			case VM_PLUG_CONTROL:
+			{
+				flt[0] = sinf(0.01f * (off / nsamples + i));
+			} break;
+			case VM_PLUG_CV:
+			case VM_PLUG_AUDIO:
+			{
+				for(uint32_t f = 0; f < nsamples; f++)
+					flt[f] = sinf(0.001f * (off + f) * (i + 1));
+			} break;
+			case VM_PLUG_ATOM:
+			case VM_PLUG_MIDI:
+			{
+				LV2_Atom_Forge_Frame frame;
+				int64_t frames = 0;
+
+				lv2_atom_forge_set_buffer(forge, ins[i], SEQ_SIZE);
+				lv2_atom_forge_sequence_head(forge, &frame, 0);
+
+				for(unsigned e = 0; e < NEVENTS; e++)
+				{
+					frames += _rand(host) % (nsamples / NEVENTS); // all within period
+
+					lv2_atom_forge_frame_time(forge, frames);
+
+					if(vm_plug == VM_PLUG_ATOM)
+					{
+						lv2_atom_forge_float(forge, (float)(_rand(host) % 0x100) / 0xff);
+					}
+					else
+					{
+						const uint8_t msg [3] = {
+							LV2_MIDI_MSG_CONTROLLER, 0x0, _rand(host) % 0x80
+						};
+
+						lv2_atom_forge_atom(forge, sizeof(msg), host->midi_MidiEvent);
+						lv2_atom_forge_write(forge, msg, sizeof(msg));
+					}
+				}
+
+				lv2_atom_forge_pop(forge, &frame);
+			} break;
+		}
+	}
+
+	return ( (vm_plug == VM_PLUG_ATOM) || (vm_plug == VM_PLUG_MIDI) )
+		? NEVENTS * CTRL_MAX
+		: 0;
+}
+
+static void
+_seqs_reset(void)
+{
+	LV2_Atom_Sequence *seq = (LV2_Atom_Sequence *)notify;
+	seq->atom.size = NOTIFY_SIZE - sizeof(LV2_Atom);
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		seq = (LV2_Atom_Sequence *)outs[i];
+		seq->atom.size = SEQ_SIZE - sizeof(LV2_Atom);
+	}
+}
+
+// mean time of run per sample and per input event, as a host would see it
+static int
+_cmp(const void *a, const void *b)
+{
+	const double *x = a;
+	const double *y = b;
+
+	return (*x > *y) - (*x < *y);
+}
+
+static bool
+_bench_run(host_t *host, const LV2_Descriptor *desc, const graph_t *graph,
+	double rate, uint32_t nsamples, double *ns_sample, double *ns_event)
+{
+	const LV2_Feature feature_map = {
+		.URI = LV2_URID__map,
+		.data = &host->map
+	};
+	const LV2_Feature feature_log = {
+		.URI = LV2_LOG__log,
+		.data = &host->log
+	};
+	const LV2_Feature *const features [] = {
+		&feature_map,
+		&feature_log,
+		NULL
+	};
+
+	LV2_Handle instance = desc->instantiate(desc, rate, NULL, features);
+	if(!instance)
+		return false;
+
+	const vm_plug_enum_t vm_plug = vm_plug_type(desc->URI);
+
+	desc->connect_port(instance, 0, ctrl);
+	desc->connect_port(instance, 1, notify);
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		desc->connect_port(instance, 2 + i, ins[i]);
+		desc->connect_port(instance, 10 + i, outs[i]);
+	}
+
+	if(desc->activate)
+		desc->activate(instance);
+
+	double times [NPERIODS];
+	uint64_t nevents = 0;
+	uint64_t off = 0;
+
+	for(unsigned p = 0; p < NWARMUPS + NPERIODS; p++)
+	{
+		_ctrl_fill(host, graph, p == 0);
+		const uint32_t n = _ins_fill(host, vm_plug, nsamples, off);
+		_seqs_reset();
+
+		const double t0 = _now();
+		desc->run(instance, nsamples);
+		const double t1 = _now();
+
+		if(p >= NWARMUPS)
+		{
+			times[p - NWARMUPS] = t1 - t0;
+			nevents += n;
+		}
+
+		off += nsamples;
+	}
+
+	if(desc->deactivate)
+		desc->deactivate(instance);
+	desc->cleanup(instance);
+
+	// median period is robust against scheduler hiccups
+	qsort(times, NPERIODS, sizeof(double), _cmp);
+	const double ns = times[NPERIODS / 2];
+
+	*ns_sample = ns / nsamples;
+	*ns_event = nevents ? ns * NPERIODS / nevents : 0.0;
+
+	return true;
+}
+
+int
+main(int argc, char **argv)
+{
+	static host_t host;
+	FILE *json = NULL;
+
+	_host_init(&host);
+	_graph_mixed(graphs[4].cmds, 6);
+
+	if(argc > 1) // machine-readable results for regression tracking
+	{
+		json = fopen(argv[1], "w");
+		if(!json)
+		{
+			fprintf(stderr, "failed to open %s\n", argv[1]);
+			return 1;
+		}
+
+		fprintf(json, "{\n\t\"version\": \"%s\",\n\t\"results\": [", VM_VERSION);
+	}
+
+	const LV2_Descriptor *desc;
+	bool first = true;
+	bool success = true;
+
+	for(uint32_t d = 0; (desc = lv2_descriptor(d)); d++)
+	{
+		const char *plug = strrchr(desc->URI, '#') + 1;
+
+		for(unsigned g = 0; g < sizeof(graphs) / sizeof(graph_t); g++)
+		{
+			const graph_t *graph = &graphs[g];
+
+			for(unsigned r = 0; r < sizeof(sample_rates) / sizeof(double); r++)
+			{
+				const double rate = sample_rates[r];
+
+				for(unsigned b = 0; b < sizeof(block_sizes) / sizeof(uint32_t); b++)
+				{
+					const uint32_t nsamples = block_sizes[b];
+					double ns_sample;
+					double ns_event;
+
+					if(!_bench_run(&host, desc, graph, rate, nsamples, &ns_sample, &ns_event))
+					{
+						fprintf(stderr, "%s: instantiation failed\n", desc->URI);
+						success = false;
+						continue;
+					}
+
+					fprintf(stdout, "%-8s %-10s %6.0f Hz %5"PRIu32" frames %9.3f ns/sample %9.3f ns/event\n",
+						plug, graph->label, rate, nsamples, ns_sample, ns_event);
+
+					if(json)
+					{
+						fprintf(json, "%s\n\t\t{\"plugin\": \"%s\", \"graph\": \"%s\", \"rate\": %.0f, "
+							"\"block\": %"PRIu32", \"ns_per_sample\": %.3f, \"ns_per_event\": %.3f}",
+							first ? "" : ",", plug, graph->label, rate, nsamples, ns_sample, ns_event);
+						first = false;
+					}
+				}
+			}
+		}
+	}
+
+	if(json)
+	{
+		fprintf(json, "\n\t]\n}\n");
+		fclose(json);
+	}
+
+	return success ? 0 : 1;
+}
@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2017-2021 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+
+#include <vm.c>
+#include <test/vm_test.h>
+
+#define NPERIODS 256
+#define NSAMPLES 1024
+#define NINPUTS 4 // input events per period
+#define SEQ_SIZE 0x10000
+#define POS_SIZE 0x100
+#define BPM 333.f // bar of 34594.6 frames at 48 kHz
+
+typedef struct _graph_t graph_t;
+typedef struct _event_t event_t;
+typedef struct _host_t host_t;
+
+struct _graph_t {
+	const char *label;
+	float interval; // decimation of first output in milliseconds, 0 for none
+	vm_command_t cmds [ITEMS_MAX];
+};
+
+struct _event_t {
+	uint32_t frames;
+	const LV2_Atom_Object *pos; // transport, else input value
+	float value;
+};
+
+struct _host_t {
+	plughandle_t *handle;
+	float pin [CTRL_MAX];
+	float pout [CTRL_MAX];
+	const float *in [CTRL_MAX];
+	float *out [CTRL_MAX];
+	forge_t forgs [CTRL_MAX];
+	uint8_t seqs [CTRL_MAX][SEQ_SIZE] __attribute__((aligned(8)));
+};
+
+typedef void (*advance_t)(plughandle_t *handle, const LV2_Atom_Object *obj,
+	uint32_t from, uint32_t to, const float *in [CTRL_MAX], float *out [CTRL_MAX],
+	forge_t forgs [CTRL_MAX]);
+
+static const graph_t graphs [] = {
+	{
+		.label = "bar",
+		.cmds = {
+			O(OP_BAR), F(4.f), O(OP_MOD), F(0.25f), O(OP_MUL)
+		}
+	},
+	{
+		.label = "bar held",
+		.interval = 10.f,
+		.cmds = {
+			O(OP_BAR), F(4.f), O(OP_MOD), F(0.25f), O(OP_MUL), I(0), O(OP_CTRL), O(OP_ADD)
+		}
+	},
+	{
+		.label = "barBeat",
+		.cmds = {
+			O(OP_BAR_BEAT), F(0.25f), O(OP_MUL)
+		}
+	},
+	{
+		.label = "barBeat held",
+		.interval = 20.f,
+		.cmds = {
+			O(OP_BAR_BEAT), F(0.25f), O(OP_MUL)
+		}
+	},
+	{
+		.label = "input held",
+		.interval = 10.f,
+		.cmds = {
+			I(0), O(OP_CTRL), F(0.5f), O(OP_MUL), O(OP_BPM), F(1e-3f), O(OP_MUL), O(OP_ADD)
+		}
+	},
+	{
+		.label = "rand",
+		.cmds = {
+			O(OP_RAND)
+		}
+	},
+	{
+		.label = "accumulate",
+		.cmds = {
+			I(0), O(OP_LOAD), F(1e-3f), O(OP_ADD), O(OP_BAR), F(1e-6f), O(OP_MUL), O(OP_ADD),
+			F(1.f), O(OP_MOD), O(OP_PUSH), I(0), O(OP_STORE)
+		}
+	}
+};
+
+static host_t hosts [2]; // per-frame reference, event-driven
+
+static const LV2_Atom_Object *
+_position(LV2_Atom_Forge *forge, uint8_t *buf, float speed, int64_t bar, float bar_beat)
+{
+	LV2_Atom_Forge_Frame frame;
+
+	lv2_atom_forge_set_buffer(forge, buf, POS_SIZE);
+	lv2_atom_forge_object(forge, &frame, 0, _map(NULL, LV2_TIME__Position));
+	lv2_atom_forge_key(forge, _map(NULL, LV2_TIME__bar));
+	lv2_atom_forge_long(forge, bar);
+	lv2_atom_forge_key(forge, _map(NULL, LV2_TIME__barBeat));
+	lv2_atom_forge_float(forge, bar_beat);
+	lv2_atom_forge_key(forge, _map(NULL, LV2_TIME__beatUnit));
+	lv2_atom_forge_int(forge, 4);
+	lv2_atom_forge_key(forge, _map(NULL, LV2_TIME__beatsPerBar));
+	lv2_atom_forge_float(forge, 4.f);
+	lv2_atom_forge_key(forge, _map(NULL, LV2_TIME__beatsPerMinute));
+	lv2_atom_forge_float(forge, BPM);
+	lv2_atom_forge_key(forge, _map(NULL, LV2_TIME__speed));
+	lv2_atom_forge_float(forge, speed);
+	lv2_atom_forge_pop(forge, &frame);
+
+	return (const LV2_Atom_Object *)buf;
+}
+
+// as run_atom did before evaluating at events only
+static void
+_run_frames(plughandle_t *handle, const LV2_Atom_Object *obj,
+	uint32_t from, uint32_t to, const float *in [CTRL_MAX], float *out [CTRL_MAX],
+	forge_t forgs [CTRL_MAX])
+{
+	if(from == to) // just run timely_advance for void range
+	{
+		timely_advance(&handle->timely, obj, from, to);
+		return;
+	}
+
+	for(uint32_t i = from; i < to; i++)
+	{
+		if(timely_advance(&handle->timely, obj, i, i + 1))
+			obj = NULL; // invalidate obj for further steps if handled
+
+		run_internal(handle, i, in, out, forgs);
+	}
+}
+
+// as run_atom, with input and transport events given instead of sequences
+static void
+_run_period(host_t *host, advance_t advance, const event_t *events, unsigned nevents)
+{
+	plughandle_t *handle = host->handle;
+	uint32_t last_t = 0;
+
+	handle->starved = 0;
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		forge_t *forg = &host->forgs[i];
+
+		lv2_atom_forge_set_buffer(&forg->forge, host->seqs[i], SEQ_SIZE);
+		forg->ref = lv2_atom_forge_sequence_head(&forg->forge, &forg->frame, 0);
+	}
+
+	for(unsigned e = 0; e < nevents; e++)
+	{
+		const event_t *ev = &events[e];
+
+		if(!ev->pos)
+			host->pin[0] = ev->value;
+
+		advance(handle, ev->pos, last_t, ev->frames, host->in, host->out, host->forgs);
+
+		last_t = ev->frames;
+	}
+	advance(handle, NULL, last_t, NSAMPLES, host->in, host->out, host->forgs);
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		forge_t *forg = &host->forgs[i];
+
+		if(forg->ref)
+			lv2_atom_forge_pop(&forg->forge, &forg->frame);
+	}
+
+	handle->off += NSAMPLES;
+}
+
+static bool
+_check_period(const graph_t *graph, unsigned p)
+{
+	const plughandle_t *ref = hosts[0].handle;
+	const plughandle_t *evt = hosts[1].handle;
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		const LV2_Atom *seq0 = (const LV2_Atom *)hosts[0].seqs[i];
+		const LV2_Atom *seq1 = (const LV2_Atom *)hosts[1].seqs[i];
+
+		if(  (hosts[0].forgs[i].ref == 0) || (hosts[1].forgs[i].ref == 0)
+			|| (seq0->size != seq1->size)
+			|| memcmp(seq0, seq1, lv2_atom_total_size(seq0)) )
+		{
+			fprintf(stderr, "%s: output %u differs in period %u\n", graph->label, i, p);
+			return false;
+		}
+	}
+
+	if(memcmp(hosts[0].pout, hosts[1].pout, sizeof(hosts[0].pout)))
+	{
+		fprintf(stderr, "%s: output values differ in period %u\n", graph->label, p);
+		return false;
+	}
+
+	if(memcmp(ref->stack.regs, evt->stack.regs, sizeof(ref->stack.regs)))
+	{
+		fprintf(stderr, "%s: registers differ in period %u\n", graph->label, p);
+		return false;
+	}
+
+	return true;
+}
+
+// event-driven evaluation must send what per-frame evaluation sends
+static bool
+_check_graph(const graph_t *graph, const LV2_Feature *const *features)
+{
+	static uint8_t buf [GRAPH_SIZE];
+	static uint8_t pos [3][POS_SIZE] __attribute__((aligned(8)));
+	LV2_Atom_Forge forge;
+	uint32_t seed = 0x87654321;
+	bool success = true;
+
+	for(unsigned h = 0; h < 2; h++)
+	{
+		host_t *host = &hosts[h];
+
+		if(!(host->handle = instantiate(&vm_atom, 48000.0, NULL, features)))
+			return false;
+
+		plughandle_t *handle = host->handle;
+		vm_exec_t *exec = _exec_idle(handle);
+
+		lv2_atom_forge_set_buffer(&handle->forge, buf, sizeof(buf));
+		vm_graph_serialize(handle->api, &handle->forge, graph->cmds);
+		const LV2_Atom *atom = (const LV2_Atom *)buf;
+
+		if(!_exec_compile(handle, exec, atom->size, LV2_ATOM_BODY_CONST(atom), true))
+		{
+			fprintf(stderr, "%s: not compiled\n", graph->label);
+			cleanup(handle);
+			return false;
+		}
+		_exec_swap(handle, exec);
+
+		handle->decimation[0].interval = graph->interval;
+		vm_rand_seed(&handle->rand, 0x12345678); // instead of per instance
+
+		for(unsigned i = 0; i < CTRL_MAX; i++)
+		{
+			host->pin[i] = handle->in0[i];
+			host->pout[i] = handle->out0[i];
+			host->in[i] = &host->pin[i];
+			host->out[i] = &host->pout[i];
+		}
+	}
+
+	lv2_atom_forge_init(&forge, hosts[0].handle->map);
+
+	const LV2_Atom_Object *roll = _position(&forge, pos[0], 1.f, 0, 0.f);
+	const LV2_Atom_Object *stop = _position(&forge, pos[1], 0.f, 3, 1.5f);
+	const LV2_Atom_Object *jump = _position(&forge, pos[2], 1.f, 7, 2.75f);
+
+	for(unsigned p = 0; success && (p < NPERIODS); p++)
+	{
+		event_t events [NINPUTS + 1];
+		unsigned nevents = 0;
+		uint32_t frames = 0;
+
+		for(unsigned e = 0; e < NINPUTS; e++)
+		{
+			frames += _rand_u32(&seed) % (NSAMPLES / NINPUTS);
+
+			// rolling, stopped in third quarter, relocated while rolling in last one
+			if( (e == 1) && ( (p == 0) || (p == NPERIODS/2) || (p == NPERIODS*3/4) ) )
+			{
+				events[nevents++] = (event_t){
+					.frames = frames,
+					.pos = (p == 0) ? roll : (p == NPERIODS/2) ? stop : jump
+				};
+			}
+
+			events[nevents++] = (event_t){
+				.frames = frames,
+				.value = _rand_float(&seed)
+			};
+		}
+
+		_run_period(&hosts[0], _run_frames, events, nevents);
+		_run_period(&hosts[1], run_event_advance, events, nevents);
+
+		success &= _check_period(graph, p);
+	}
+
+	for(unsigned h = 0; h < 2; h++)
+		cleanup(hosts[h].handle);
+
+	return success;
+}
+
+int
+main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
+{
+	LV2_URID_Map map = {
+		.handle = NULL,
+		.map = _map
+	};
+	const LV2_Feature feature_map = {
+		.URI = LV2_URID__map,
+		.data = &map
+	};
+	const LV2_Feature *const features [] = {
+		&feature_map,
+		NULL
+	};
+	bool success = true;
+
+	for(unsigned g = 0; g < sizeof(graphs) / sizeof(graph_t); g++)
+		success &= _check_graph(&graphs[g], features);
+
+	fprintf(stdout, "%u graphs over %u periods\n",
+		(unsigned)(sizeof(graphs) / sizeof(graph_t)), NPERIODS);
+
+	return success ? 0 : 1;
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2017-2021 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+
+#include <vm.c>
+#include <test/vm_test.h>
+
+#define NPROGS 20000
+#define NINPUTS 16
+
+// loops over registers with a backward goto
+static const vm_command_t count [ITEMS_MAX] = {
+	F(0.f), I(0), O(OP_STORE), F(0.f), I(1), O(OP_STORE),
+	I(0), O(OP_LOAD), I(1), O(OP_CTRL), O(OP_ADD), I(0), O(OP_STORE),
+	I(1), O(OP_LOAD), F(1.f), O(OP_ADD), O(OP_PUSH), I(1), O(OP_STORE),
+	I(6), O(OP_SWAP), F(10.f), O(OP_LT), O(OP_GOTO),
+	I(0), O(OP_LOAD), I(1), O(OP_LOAD)
+};
+
+// never leaves its loop, cut off by budget
+static const vm_command_t spin [ITEMS_MAX] = {
+	F(0.f), F(1.f), O(OP_ADD), I(1), I(1), O(OP_GOTO)
+};
+
+// split into fill and timed parts reading hidden registers
+static const vm_command_t lfo [ITEMS_MAX] = {
+	I(0), O(OP_CTRL), I(2), O(OP_MUL), O(OP_PI), O(OP_MUL), O(OP_BPM), O(OP_MUL),
+	O(OP_SIN), I(1), O(OP_CTRL), O(OP_MUL)
+};
+
+static bool
+_check(plughandle_t *handle, uint32_t *seed, const char *label)
+{
+	num_t regs [REG_MAX];
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+		handle->in0[i] = _rand_float(seed);
+	for(unsigned i = 0; i < REG_MAX; i++)
+		regs[i] = _rand_float(seed);
+
+	const unsigned rseed = _rand_u32(seed);
+
+	memcpy(handle->stack.regs, regs, sizeof(regs));
+	vm_rand_seed(&handle->rand, rseed);
+	run_prog(handle);
+
+	const vm_stack_t ref = handle->stack;
+	num_t out0 [CTRL_MAX];
+	memcpy(out0, handle->out0, sizeof(out0));
+
+	memcpy(handle->stack.regs, regs, sizeof(regs));
+	vm_rand_seed(&handle->rand, rseed);
+	run_jit(handle);
+
+	if(  memcmp(out0, handle->out0, sizeof(out0))
+		|| memcmp(ref.regs, handle->stack.regs, sizeof(ref.regs))
+		|| (ref.ptr != handle->stack.ptr) )
+	{
+		fprintf(stderr, "%s: mismatch\n", label);
+
+		for(unsigned i = 0; i < handle->exec->prog.ninst; i++)
+		{
+			const vm_inst_t *inst = &handle->exec->prog.inst[i];
+
+			fprintf(stderr, "  %3u: %3"PRIu16" %g %"PRIu32"\n",
+				i, inst->op, inst->imm, inst->target);
+		}
+
+		for(unsigned i = 0; i < CTRL_MAX; i++)
+			fprintf(stderr, "  out%u: %a %a\n", i, out0[i], handle->out0[i]);
+
+		return false;
+	}
+
+	return true;
+}
+
+int
+main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
+{
+	LV2_URID_Map map = {
+		.handle = NULL,
+		.map = _map
+	};
+	const LV2_Feature feature_map = {
+		.URI = LV2_URID__map,
+		.data = &map
+	};
+	const LV2_Feature *const features [] = {
+		&feature_map,
+		NULL
+	};
+
+	plughandle_t *handle = instantiate(&vm_cv, 48000.0, NULL, features);
+	if(!handle)
+		return 1;
+
+	if(!handle->exec->jit.code[0])
+	{
+		fprintf(stdout, "JIT not available, skipping\n");
+		cleanup(handle);
+		return 77;
+	}
+
+	vm_command_t cmds [ITEMS_MAX];
+	uint32_t seed = 0x12345678;
+	unsigned ncompiled = 0;
+	bool success = true;
+
+	vm_graph_compile(&handle->exec->prog, count, VM_STATUS_STATIC);
+	if(!vm_jit_compile(&handle->exec->jit, &handle->exec->prog, _jit_rand, handle))
+	{
+		fprintf(stderr, "count: not compiled\n");
+		success = false;
+	}
+	else
+	{
+		for(unsigned j = 0; j < NINPUTS; j++)
+			success &= _check(handle, &seed, "count");
+	}
+
+	// native code is only generated on worker, in-place compilation interprets
+	static uint8_t buf [GRAPH_SIZE + 0x100];
+	vm_exec_t *idle = _exec_idle(handle);
+	const LV2_Atom *graph = (const LV2_Atom *)buf;
+
+	lv2_atom_forge_set_buffer(&handle->forge, buf, sizeof(buf));
+	vm_graph_serialize(handle->api, &handle->forge, count);
+	if(  !_exec_compile(handle, idle, graph->size, LV2_ATOM_BODY_CONST(graph), false)
+		|| idle->jit.fn
+		|| !_exec_compile(handle, idle, graph->size, LV2_ATOM_BODY_CONST(graph), true)
+		|| !idle->jit.fn)
+	{
+		fprintf(stderr, "count: native code generated in place\n");
+		success = false;
+	}
+
+	vm_graph_compile(&handle->exec->prog, spin, VM_STATUS_STATIC);
+	if(!vm_jit_compile(&handle->exec->jit, &handle->exec->prog, _jit_rand, handle))
+	{
+		fprintf(stderr, "spin: not compiled\n");
+		success = false;
+	}
+	else
+	{
+		handle->state.overruns = 0;
+		success &= _check(handle, &seed, "spin");
+
+		if(handle->state.overruns != 2) // by interpreter and native code
+		{
+			fprintf(stderr, "spin: %"PRIi32" overruns\n", handle->state.overruns);
+			success = false;
+		}
+	}
+
+	vm_graph_compile(&handle->exec->prog, lfo, VM_STATUS_HAS_TIME);
+	handle->exec->split = vm_prog_split(&handle->exec->prog, &handle->exec->fill, &handle->exec->timed);
+	if(!handle->exec->split || !vm_jit_compile(&handle->exec->jit, &handle->exec->timed, _jit_rand, handle))
+	{
+		fprintf(stderr, "lfo: not split and compiled\n");
+		success = false;
+	}
+	else
+	{
+		handle->filled = false;
+		run_fill(handle);
+
+		for(unsigned j = 0; j < NINPUTS; j++)
+			success &= _check(handle, &seed, "lfo");
+	}
+	handle->exec->split = false;
+
+	for(unsigned p = 0; success && (p < NPROGS); p++)
+	{
+		char label [32];
+
+		_graph_random(cmds, &seed, ITEMS_PRE);
+		vm_graph_compile(&handle->exec->prog, cmds, VM_STATUS_STATIC);
+		if(!vm_jit_compile(&handle->exec->jit, &handle->exec->prog, _jit_rand, handle))
+			continue;
+
+		ncompiled++;
+		snprintf(label, sizeof(label), "random #%u", p);
+
+		for(unsigned j = 0; success && (j < NINPUTS); j++)
+			success &= _check(handle, &seed, label);
+	}
+
+	fprintf(stdout, "%u/%u random programs compiled\n", ncompiled, NPROGS);
+
+	cleanup(handle);
+
+	return success ? 0 : 1;
+}
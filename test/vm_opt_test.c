@@ -0,0 +1,933 @@
+/*
+ * Copyright (c) 2017-2021 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdio.h>
+
+#include <vm.c>
+#include <test/vm_test.h>
+
+#define NPROGS 20000
+#define NLONG 1000
+#define NINPUTS 8
+
+typedef struct _graph_t graph_t;
+
+struct _graph_t {
+	const char *label;
+	uint32_t ninst; // expected after optimization
+	uint8_t deps [CTRL_MAX]; // expected outputs affected by each input
+	uint32_t ntimed; // expected in time-varying part, zero if not split
+	vm_command_t cmds [ITEMS_MAX];
+};
+
+static const graph_t graphs [] = {
+	{
+		.label = "constant",
+		.ninst = 1,
+		.cmds = {
+			O(OP_PI), I(2), O(OP_MUL)
+		}
+	},
+	{
+		.label = "push pop",
+		.ninst = 3,
+		.deps = { 0x01 },
+		.cmds = {
+			I(0), O(OP_CTRL), O(OP_PUSH), O(OP_POP), O(OP_SIN)
+		}
+	},
+	{
+		.label = "swap swap",
+		.ninst = 5,
+		.deps = { 0x01, 0x01 },
+		.cmds = {
+			I(0), O(OP_CTRL), I(1), O(OP_CTRL), O(OP_SWAP), O(OP_SWAP), O(OP_SUB)
+		}
+	},
+	{
+		.label = "dead result",
+		.ninst = 2,
+		.deps = { 0x01 },
+		.cmds = {
+			I(0), O(OP_CTRL), I(1), O(OP_CTRL), O(OP_COS), O(OP_POP)
+		}
+	},
+	{
+		.label = "break",
+		.ninst = 2,
+		.deps = { 0x01 },
+		.cmds = {
+			I(0), O(OP_CTRL), I(1), O(OP_BREAK), I(1), O(OP_CTRL), O(OP_ADD)
+		}
+	},
+	{
+		.label = "goto",
+		.ninst = 2,
+		.deps = { 0x01 },
+		.cmds = {
+			I(0), O(OP_CTRL), I(8), I(1), O(OP_GOTO), I(1), O(OP_CTRL), O(OP_ADD)
+		}
+	},
+	{
+		.label = "two outputs",
+		.ninst = 7,
+		.deps = { 0x02, 0x01, 0x01 },
+		.cmds = {
+			I(0), O(OP_CTRL), I(1), O(OP_CTRL), I(2), O(OP_CTRL), O(OP_ADD)
+		}
+	},
+	{
+		.label = "accumulate",
+		.ninst = 8,
+		.deps = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff },
+		.cmds = {
+			I(0), O(OP_LOAD), I(0), O(OP_CTRL), O(OP_ADD), O(OP_PUSH), I(0), O(OP_STORE)
+		}
+	},
+	{
+		.label = "lfo",
+		.ninst = 12,
+		.deps = { 0x01, 0x01 },
+		.ntimed = 6,
+		.cmds = {
+			I(0), O(OP_CTRL), I(2), O(OP_MUL), O(OP_PI), O(OP_MUL), O(OP_BPM), O(OP_MUL),
+			O(OP_SIN), I(1), O(OP_CTRL), O(OP_MUL)
+		}
+	}
+};
+
+// ninst: expected register instructions after fusion
+static const graph_t fused [] = {
+	{
+		.label = "multiply-add",
+		.ninst = 4,
+		.cmds = {
+			I(0), O(OP_CTRL), I(1), O(OP_CTRL), O(OP_MUL), I(2), O(OP_CTRL), O(OP_ADD)
+		}
+	},
+	{
+		.label = "clamp",
+		.ninst = 4,
+		.cmds = {
+			I(0), O(OP_CTRL), F(-0.5f), O(OP_MAXI), F(0.5f), O(OP_MINI)
+		}
+	},
+	{
+		.label = "select",
+		.ninst = 5,
+		.cmds = {
+			F(1.f), F(-1.f), I(0), O(OP_CTRL), I(1), O(OP_CTRL), O(OP_LT), O(OP_TER)
+		}
+	}
+};
+
+static bool
+_has_goto(const vm_prog_t *prog)
+{
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		if(prog->inst[i].op == OP_GOTO)
+			return true;
+	}
+
+	return false;
+}
+
+static bool
+_check(plughandle_t *handle, const vm_prog_t *ref, const vm_prog_t *opt,
+	uint32_t *seed, const char *label)
+{
+	num_t regs [REG_MAX];
+	num_t out0 [CTRL_MAX];
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+		handle->in0[i] = _rand_float(seed);
+	for(unsigned i = 0; i < REG_MAX; i++)
+		regs[i] = _rand_float(seed);
+
+	const unsigned rseed = _rand_u32(seed);
+
+	vm_prog_copy(&handle->exec->prog, ref);
+	memcpy(handle->stack.regs, regs, sizeof(regs));
+	vm_rand_seed(&handle->rand, rseed);
+	run_prog(handle);
+
+	const vm_stack_t stack = handle->stack;
+	memcpy(out0, handle->out0, sizeof(out0));
+
+	vm_prog_copy(&handle->exec->prog, opt);
+	memcpy(handle->stack.regs, regs, sizeof(regs));
+	vm_rand_seed(&handle->rand, rseed);
+	run_prog(handle);
+
+	if(  memcmp(out0, handle->out0, sizeof(out0))
+		|| memcmp(stack.regs, handle->stack.regs, sizeof(stack.regs))
+		|| (stack.ptr != handle->stack.ptr) )
+	{
+		fprintf(stderr, "%s: mismatch\n", label);
+
+		for(unsigned i = 0; i < ref->ninst; i++)
+		{
+			fprintf(stderr, "  %3u: %3"PRIu16" %g %"PRIu32"\n",
+				i, ref->inst[i].op, ref->inst[i].imm, ref->inst[i].target);
+		}
+
+		fprintf(stderr, "  --\n");
+
+		for(unsigned i = 0; i < opt->ninst; i++)
+		{
+			fprintf(stderr, "  %3u: %3"PRIu16" %g %"PRIu32"\n",
+				i, opt->inst[i].op, opt->inst[i].imm, opt->inst[i].target);
+		}
+
+		for(unsigned i = 0; i < CTRL_MAX; i++)
+			fprintf(stderr, "  out%u: %a %a\n", i, out0[i], handle->out0[i]);
+
+		return false;
+	}
+
+	return true;
+}
+
+// register IR must evaluate like the stack program it was built from
+static bool
+_check_ir(plughandle_t *handle, const vm_prog_t *ref, const vm_prog_t *opt,
+	uint32_t *seed, const char *label)
+{
+	num_t regs [REG_MAX];
+	num_t out0 [CTRL_MAX];
+
+	if(!vm_ir_build(&handle->exec->ir, opt))
+		return true; // stays on stack
+
+	vm_ir_fuse(&handle->exec->ir, false); // bit-exact without contraction
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+		handle->in0[i] = _rand_float(seed);
+	for(unsigned i = 0; i < REG_MAX; i++)
+		regs[i] = _rand_float(seed);
+
+	const unsigned rseed = _rand_u32(seed);
+
+	handle->exec->ir.enabled = false;
+	vm_prog_copy(&handle->exec->prog, ref);
+	memcpy(handle->stack.regs, regs, sizeof(regs));
+	vm_rand_seed(&handle->rand, rseed);
+	run_prog(handle);
+
+	const vm_stack_t stack = handle->stack;
+	memcpy(out0, handle->out0, sizeof(out0));
+
+	handle->exec->ir.enabled = true;
+	memcpy(handle->stack.regs, regs, sizeof(regs));
+	vm_rand_seed(&handle->rand, rseed);
+	run_prog(handle);
+	handle->exec->ir.enabled = false;
+
+	if(  memcmp(out0, handle->out0, sizeof(out0))
+		|| memcmp(stack.regs, handle->stack.regs, sizeof(stack.regs)) )
+	{
+		fprintf(stderr, "%s: register IR mismatch\n", label);
+
+		for(unsigned i = 0; i < handle->exec->ir.ninst; i++)
+		{
+			const vm_ir_inst_t *inst = &handle->exec->ir.inst[i];
+
+			fprintf(stderr, "  %3u: %3"PRIu16" %3u %3u <- %3u %3u %3u %g %"PRIu16"\n",
+				i, inst->op, inst->dst[0], inst->dst[1],
+				inst->src[0], inst->src[1], inst->src[2], inst->imm, inst->target);
+		}
+
+		for(unsigned i = 0; i < CTRL_MAX; i++)
+			fprintf(stderr, "  out%u: %a %a\n", i, out0[i], handle->out0[i]);
+
+		return false;
+	}
+
+	return true;
+}
+
+// goto targets wrap at 128 for graphs not longer than before, at 4096 otherwise
+static bool
+_check_wrap(vm_prog_t *prog)
+{
+	static vm_command_t cmds [ITEMS_MAX];
+	bool success = true;
+
+	for(unsigned n = ITEMS_LEGACY; n <= ITEMS_LEGACY*2; n += ITEMS_LEGACY)
+	{
+		const uint32_t target = (n == ITEMS_LEGACY) ? 4 : ITEMS_LEGACY + 4;
+
+		memset(cmds, 0x0, sizeof(cmds));
+		cmds[0] = (vm_command_t)I(ITEMS_LEGACY + 4);
+		cmds[1] = (vm_command_t)I(1);
+		cmds[2] = (vm_command_t)O(OP_GOTO);
+		for(unsigned i = 3; i < n; i++)
+			cmds[i] = (vm_command_t)F(0.f);
+
+		vm_graph_compile(prog, cmds, VM_STATUS_STATIC);
+
+		if( (prog->inst[2].op != INST_JMP) || (prog->inst[2].target != target) )
+		{
+			fprintf(stderr, "wrap: goto of %u commands not resolved to %"PRIu32"\n",
+				n, target);
+			success = false;
+		}
+	}
+
+	return success;
+}
+
+// stores into parameter registers are flagged, all of them if index is dynamic
+static bool
+_check_params(vm_prog_t *prog)
+{
+	static const vm_command_t stores [][ITEMS_MAX] = {
+		{ F(0.5f), I(3), O(OP_STORE), F(0.5f), I(9), O(OP_STORE) },
+		{ F(0.5f), I(REG_MAX + 6), O(OP_STORE) },
+		{ F(0.5f), I(2), O(OP_CTRL), O(OP_STORE) },
+		{ F(0.5f), I(0), O(OP_LOAD), O(OP_POP) }
+	};
+	static const uint8_t params [] = {
+		1U << 3,
+		1U << 6,
+		(1U << PARAM_MAX) - 1,
+		0
+	};
+	bool success = true;
+
+	for(unsigned i = 0; i < sizeof(params) / sizeof(uint8_t); i++)
+	{
+		vm_graph_compile(prog, stores[i], VM_STATUS_STATIC);
+
+		if(prog->params != params[i])
+		{
+			fprintf(stderr, "params: graph %u flags 0x%02"PRIx8" instead of 0x%02"PRIx8"\n",
+				i, prog->params, params[i]);
+			success = false;
+		}
+	}
+
+	return success;
+}
+
+// graph storage grows off the audio thread and keeps value and stash on adoption
+static bool
+_check_store(plughandle_t *handle)
+{
+	props_impl_t *impl = _props_impl_get(&handle->props, handle->vm_graph);
+	bool success = true;
+
+	for(uint32_t i = 0; i < GRAPH_PRE; i++)
+		handle->graph[i] = i;
+	impl->value.size = GRAPH_PRE;
+	impl->stash.size = 0;
+
+	for(uint32_t max_size = GRAPH_PRE*2; max_size <= GRAPH_PRE*4; max_size *= 2)
+	{
+		_store_offer(handle, _store_new(GRAPH_PRE), false); // outgrown, retired
+		_store_adopt(handle);
+		_store_grow(handle, max_size / 2);
+		_store_adopt(handle);
+
+		if( (handle->defs[0].max_size != max_size) || (impl->value.body != handle->graph)
+			|| (handle->graph != handle->store->value) || handle->grown )
+		{
+			fprintf(stderr, "store: not grown to %"PRIu32" bytes\n", max_size);
+			success = false;
+		}
+
+		for(uint32_t i = 0; i < GRAPH_PRE; i++)
+		{
+			if(handle->graph[i] != (uint8_t)i)
+			{
+				fprintf(stderr, "store: value lost at %"PRIu32" bytes\n", max_size);
+				success = false;
+				break;
+			}
+		}
+	}
+
+	vm_store_t *store = _store_new(GRAPH_PRE);
+	memset(store->value, 0x0, GRAPH_PRE);
+	store->size = 16;
+	_store_offer(handle, store, true);
+	_store_adopt(handle);
+
+	if( (handle->graph_size != 16) || !handle->pending || (impl->stash.size != 16)
+		|| (handle->defs[0].max_size != GRAPH_PRE) )
+	{
+		fprintf(stderr, "store: restored graph not adopted\n");
+		success = false;
+	}
+
+	_store_reap(handle);
+	if(handle->retired)
+	{
+		fprintf(stderr, "store: retired storage left\n");
+		success = false;
+	}
+
+	impl->value.size = 0;
+	handle->graph_size = 0;
+	handle->pending = false;
+	handle->resync = false;
+
+	return success;
+}
+
+// graphs beyond capacity are rejected where storage may not grow
+static bool
+_check_reject(plughandle_t *handle)
+{
+	static vm_command_t cmds [ITEMS_MAX];
+	static uint8_t buf [GRAPH_SIZE + 0x100];
+	vm_exec_t *exec = _exec_idle(handle);
+	bool success = true;
+
+	for(unsigned i = 0; i < ITEMS_PRE*2; i++)
+		cmds[i] = (vm_command_t)I(i);
+
+	lv2_atom_forge_set_buffer(&handle->forge, buf, sizeof(buf));
+	vm_graph_serialize(handle->api, &handle->forge, cmds);
+	const LV2_Atom *graph = (const LV2_Atom *)buf;
+
+	if(_exec_compile(handle, exec, graph->size, LV2_ATOM_BODY_CONST(graph), false)
+		|| (exec->nitems != ITEMS_PRE) || (exec->prog.ninst != 0) )
+	{
+		fprintf(stderr, "reject: graph of %u commands truncated\n", ITEMS_PRE*2);
+		success = false;
+	}
+
+	if(!_exec_compile(handle, exec, graph->size, LV2_ATOM_BODY_CONST(graph), true)
+		|| (exec->nitems < ITEMS_PRE*2) )
+	{
+		fprintf(stderr, "reject: graph of %u commands not grown to\n", ITEMS_PRE*2);
+		success = false;
+	}
+
+	memset(cmds, 0x0, sizeof(cmds));
+	cmds[0] = (vm_command_t)O(OP_PI);
+
+	lv2_atom_forge_set_buffer(&handle->forge, buf, sizeof(buf));
+	vm_graph_serialize(handle->api, &handle->forge, cmds);
+
+	if(!_exec_compile(handle, exec, graph->size, LV2_ATOM_BODY_CONST(graph), true)
+		|| (exec->prog.ninst != 1) )
+	{
+		fprintf(stderr, "reject: shorter graph compiled with tail of longer one\n");
+		success = false;
+	}
+
+	return success;
+}
+
+static const LV2_Atom_Object *
+_patch_forge(plughandle_t *handle, LV2_Atom_Forge *forge, uint8_t *buf, uint32_t size,
+	int32_t base, int32_t idx, int32_t nrem, int32_t add)
+{
+	LV2_Atom_Forge_Frame obj_frame;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Frame tup_frame;
+
+	lv2_atom_forge_set_buffer(forge, buf, size);
+	lv2_atom_forge_object(forge, &obj_frame, 0, handle->props.urid.patch_patch);
+	if(base)
+	{
+		lv2_atom_forge_key(forge, handle->props.urid.patch_sequence);
+		lv2_atom_forge_int(forge, base);
+	}
+	lv2_atom_forge_key(forge, handle->props.urid.patch_remove);
+	lv2_atom_forge_object(forge, &frame, 0, 0);
+	lv2_atom_forge_key(forge, handle->vm_graph);
+	lv2_atom_forge_tuple(forge, &tup_frame);
+	lv2_atom_forge_int(forge, idx);
+	lv2_atom_forge_int(forge, nrem);
+	lv2_atom_forge_pop(forge, &tup_frame);
+	lv2_atom_forge_pop(forge, &frame);
+	lv2_atom_forge_key(forge, handle->props.urid.patch_add);
+	lv2_atom_forge_object(forge, &frame, 0, 0);
+	lv2_atom_forge_key(forge, handle->vm_graph);
+	lv2_atom_forge_tuple(forge, &tup_frame);
+	lv2_atom_forge_int(forge, idx);
+	lv2_atom_forge_int(forge, add);
+	lv2_atom_forge_pop(forge, &tup_frame);
+	lv2_atom_forge_pop(forge, &frame);
+	lv2_atom_forge_pop(forge, &obj_frame);
+
+	return (const LV2_Atom_Object *)buf;
+}
+
+// applied patches are echoed with their revision, stale ones trigger a resync
+static bool
+_check_patch(plughandle_t *handle)
+{
+	props_impl_t *impl = _props_impl_get(&handle->props, handle->vm_graph);
+	static vm_command_t cmds [ITEMS_MAX];
+	static uint8_t buf [0x200];
+	static uint8_t notify [0x200];
+	LV2_Atom_Forge forge;
+	bool success = true;
+
+	lv2_atom_forge_init(&forge, handle->map);
+
+	for(unsigned i = 0; i < 4; i++)
+		cmds[i] = (vm_command_t)I(10 + i);
+
+	lv2_atom_forge_set_buffer(&forge, buf, sizeof(buf));
+	vm_graph_serialize(handle->api, &forge, cmds);
+	const LV2_Atom *graph = (const LV2_Atom *)buf;
+	memcpy(handle->graph, LV2_ATOM_BODY_CONST(graph), graph->size);
+	impl->value.size = graph->size;
+
+	const struct {
+		const char *label;
+		bool stale;
+		bool unchecked;
+		int32_t result [4];
+	} steps [] = {
+		{ "applied", false, false, { 10, 42, 13, 0 } },
+		{ "stale", true, false, { 10, 42, 13, 0 } },
+		{ "unchecked", false, true, { 10, 42, 0, 0 } }
+	};
+
+	for(unsigned s = 0; s < sizeof(steps) / sizeof(*steps); s++)
+	{
+		const int32_t rev = handle->graph_rev;
+		const int32_t base = steps[s].unchecked ? 0 : (steps[s].stale ? rev - 1 : rev);
+		const LV2_Atom_Object *obj = _patch_forge(handle, &forge, buf, sizeof(buf),
+			base, 1, 2, 42);
+
+		lv2_atom_forge_set_buffer(&handle->forge, notify, sizeof(notify));
+		handle->ref = 1;
+		handle->resync = false;
+		_control_advance(handle, 0, obj);
+
+		vm_graph_deserialize(handle->api, &forge, cmds, ITEMS_MAX, impl->value.size,
+			(const LV2_Atom *)handle->graph);
+
+		for(unsigned i = 0; i < 4; i++)
+		{
+			if(  (steps[s].result[i] && (cmds[i].i32 != steps[s].result[i]))
+				|| (!steps[s].result[i] && (cmds[i].type != COMMAND_NOP)) )
+			{
+				fprintf(stderr, "patch: %s graph differs at %u\n", steps[s].label, i);
+				success = false;
+				break;
+			}
+		}
+
+		// echo of patch:Patch after its patch:Ack, if any
+		const LV2_Atom_Event *ev = (const LV2_Atom_Event *)notify;
+		if(base)
+			ev = (const LV2_Atom_Event *)&notify[lv2_atom_pad_size(
+				sizeof(LV2_Atom_Event) + ev->body.size)];
+		const LV2_Atom_Object *echo = (const LV2_Atom_Object *)&ev->body;
+		const LV2_Atom_Int *sequence = NULL;
+
+		if(steps[s].stale)
+		{
+			if( (handle->graph_rev != rev) || !handle->resync )
+			{
+				fprintf(stderr, "patch: %s not rejected\n", steps[s].label);
+				success = false;
+			}
+		}
+		else
+		{
+			lv2_atom_object_get(echo, handle->props.urid.patch_sequence, &sequence, 0);
+
+			if(  (handle->graph_rev != rev + 1) || handle->resync
+				|| (echo->body.otype != handle->props.urid.patch_patch)
+				|| !sequence || (sequence->body != handle->graph_rev) )
+			{
+				fprintf(stderr, "patch: %s not echoed\n", steps[s].label);
+				success = false;
+			}
+		}
+	}
+
+	impl->value.size = 0;
+	handle->graph_size = 0;
+	handle->pending = false;
+	handle->patched = false;
+	handle->resync = false;
+
+	return success;
+}
+
+// superinstructions replace their sequences, multiply-add rounds once
+static bool
+_check_fused(plughandle_t *handle, const graph_t *graph, uint32_t *seed)
+{
+	vm_ir_t *ir = &handle->exec->ir;
+	static vm_inst_t inst [ITEMS_MAX];
+	vm_prog_t prog;
+
+	vm_prog_init(&prog, inst, ITEMS_MAX, &handle->exec->arena);
+	vm_graph_compile(&prog, graph->cmds, VM_STATUS_STATIC);
+	vm_prog_optimize(&prog);
+	vm_prog_verify(&prog, NULL, NULL);
+
+	if(!vm_ir_build(ir, &prog))
+	{
+		fprintf(stderr, "%s: not in register form\n", graph->label);
+		return false;
+	}
+
+	vm_ir_fuse(ir, true);
+	ir->enabled = false;
+
+	if(ir->ninst != graph->ninst)
+	{
+		fprintf(stderr, "%s: %"PRIu32" instead of %"PRIu32" register instructions\n",
+			graph->label, ir->ninst, graph->ninst);
+		return false;
+	}
+
+	for(unsigned j = 0; j < NINPUTS; j++)
+	{
+		for(unsigned i = 0; i < CTRL_MAX; i++)
+			handle->in0[i] = _rand_float(seed);
+
+		_run_ir(handle, ir, handle->out0);
+
+		const num_t madd = fma(handle->in0[0], handle->in0[1], handle->in0[2]);
+
+		if( (ir->inst[ir->ninst - 1].op == IR_MADD)
+			&& memcmp(&madd, &handle->out0[0], sizeof(num_t)) )
+		{
+			fprintf(stderr, "%s: %a instead of %a\n", graph->label,
+				handle->out0[0], madd);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// compiled programs round like their other engines, without contraction
+static bool
+_check_contract(plughandle_t *handle, const graph_t *graph)
+{
+	static uint8_t buf [0x400];
+	vm_exec_t *exec = _exec_idle(handle);
+
+	lv2_atom_forge_set_buffer(&handle->forge, buf, sizeof(buf));
+	vm_graph_serialize(handle->api, &handle->forge, graph->cmds);
+	const LV2_Atom *atom = (const LV2_Atom *)buf;
+
+	if(!_exec_compile(handle, exec, atom->size, LV2_ATOM_BODY_CONST(atom), false))
+	{
+		fprintf(stderr, "%s: not compiled\n", graph->label);
+		return false;
+	}
+
+	for(unsigned k = 0; exec->ir.enabled && (k < exec->ir.ninst); k++)
+	{
+		if(exec->ir.inst[k].op == IR_MADD)
+		{
+			fprintf(stderr, "%s: contracted in compiled program\n", graph->label);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// changing a single input must only change its dependent outputs
+static bool
+_check_deps(plughandle_t *handle, const vm_prog_t *prog, uint32_t *seed,
+	const char *label)
+{
+	num_t regs [REG_MAX];
+	num_t out0 [CTRL_MAX];
+	num_t out1 [CTRL_MAX];
+
+	if(prog->status != VM_STATUS_STATIC) // always fully recalculated
+		return true;
+
+	vm_prog_copy(&handle->exec->prog, prog);
+	_slice_prepare(handle->exec);
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+		handle->in0[i] = _rand_float(seed);
+	for(unsigned i = 0; i < REG_MAX; i++)
+		regs[i] = _rand_float(seed);
+
+	memcpy(handle->stack.regs, regs, sizeof(regs));
+	run_prog(handle);
+	memcpy(out0, handle->out0, sizeof(out0));
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		const float in0 = handle->in0[i];
+		const uint8_t deps = handle->exec->deps[i];
+
+		handle->in0[i] = _rand_float(seed);
+
+		memcpy(handle->stack.regs, regs, sizeof(regs));
+		run_prog(handle);
+		memcpy(out1, handle->out0, sizeof(out1));
+
+		memcpy(handle->out0, out0, sizeof(out0));
+		memcpy(handle->stack.regs, regs, sizeof(regs));
+		run_slice(handle, i);
+
+		for(unsigned j = 0; j < CTRL_MAX; j++)
+		{
+			const num_t *ref = (deps & (1U << j)) ? &out1[j] : &out0[j];
+
+			if(  memcmp(ref, &out1[j], sizeof(num_t))
+				|| memcmp(ref, &handle->out0[j], sizeof(num_t)) )
+			{
+				fprintf(stderr, "%s: input %u affects output %u, deps 0x%02"PRIx8"\n",
+					label, i, j, deps);
+				return false;
+			}
+		}
+
+		handle->in0[i] = in0;
+		memcpy(handle->out0, out0, sizeof(out0));
+	}
+
+	return true;
+}
+
+// fill and timed parts of split program must match the whole
+static bool
+_check_split(plughandle_t *handle, const vm_prog_t *prog, uint32_t *seed,
+	const char *label)
+{
+	num_t regs [REG_MAX];
+	num_t out0 [CTRL_MAX];
+
+	if(!vm_prog_split(prog, &handle->exec->fill, &handle->exec->timed))
+		return true;
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+		handle->in0[i] = _rand_float(seed);
+	for(unsigned i = 0; i < REG_MAX; i++)
+		regs[i] = _rand_float(seed);
+
+	const unsigned rseed = _rand_u32(seed);
+
+	vm_prog_copy(&handle->exec->prog, prog);
+	handle->exec->split = false;
+	memcpy(handle->stack.regs, regs, sizeof(regs));
+	vm_rand_seed(&handle->rand, rseed);
+	run_prog(handle);
+
+	const vm_stack_t stack = handle->stack;
+	memcpy(out0, handle->out0, sizeof(out0));
+
+	handle->exec->split = true;
+	handle->filled = false;
+	memcpy(handle->stack.regs, regs, sizeof(regs));
+	vm_rand_seed(&handle->rand, rseed);
+	run_fill(handle);
+	run_prog(handle);
+	handle->exec->split = false;
+
+	if(  memcmp(out0, handle->out0, sizeof(out0))
+		|| memcmp(stack.regs, handle->stack.regs, sizeof(regs))
+		|| (stack.ptr != handle->stack.ptr) )
+	{
+		fprintf(stderr, "%s: split mismatch\n", label);
+
+		for(unsigned i = 0; i < CTRL_MAX; i++)
+			fprintf(stderr, "  out%u: %a %a\n", i, out0[i], handle->out0[i]);
+
+		return false;
+	}
+
+	return true;
+}
+
+int
+main(int argc __attribute__((unused)), char **argv __attribute__((unused)))
+{
+	LV2_URID_Map map = {
+		.handle = NULL,
+		.map = _map
+	};
+	const LV2_Feature feature_map = {
+		.URI = LV2_URID__map,
+		.data = &map
+	};
+	const LV2_Feature *const features [] = {
+		&feature_map,
+		NULL
+	};
+
+	plughandle_t *handle = instantiate(&vm_cv, 48000.0, NULL, features);
+	if(!handle)
+		return 1;
+
+	static vm_inst_t ref_inst [ITEMS_MAX];
+	static vm_inst_t opt_inst [ITEMS_MAX];
+	static vm_prog_t ref;
+	static vm_prog_t opt;
+	static vm_ir_t ir;
+	vm_command_t cmds [ITEMS_MAX];
+	uint32_t seed = 0x87654321;
+	uint32_t ninst_ref = 0;
+	uint32_t ninst_opt = 0;
+	uint32_t nverified = 0;
+	uint32_t nregister = 0;
+	uint32_t ninst_ir = 0;
+	uint32_t ninst_fused = 0;
+	uint32_t nprogs = 0;
+	uint32_t nlong = 0;
+	bool success = true;
+
+	vm_prog_init(&ref, ref_inst, ITEMS_MAX, &handle->exec->arena);
+	vm_prog_init(&opt, opt_inst, ITEMS_MAX, &handle->exec->arena);
+
+	if(!_exec_reserve(handle->exec, ITEMS_MAX))
+	{
+		cleanup(handle);
+		return 1;
+	}
+
+	success &= _check_wrap(&ref);
+	success &= _check_params(&ref);
+	success &= _check_store(handle);
+	success &= _check_reject(handle);
+	success &= _check_patch(handle);
+	success &= _check_contract(handle, &fused[0]);
+
+	for(unsigned g = 0; g < sizeof(graphs) / sizeof(graph_t); g++)
+	{
+		const graph_t *graph = &graphs[g];
+
+		vm_graph_compile(&ref, graph->cmds, VM_STATUS_STATIC);
+		vm_prog_copy(&opt, &ref);
+		vm_prog_optimize(&opt);
+		vm_prog_verify(&opt, NULL, NULL);
+
+		if(opt.ninst != graph->ninst)
+		{
+			fprintf(stderr, "%s: %"PRIu32" instead of %"PRIu32" instructions\n",
+				graph->label, opt.ninst, graph->ninst);
+			success = false;
+		}
+
+		vm_prog_deps(&opt, handle->exec->deps);
+		if(memcmp(handle->exec->deps, graph->deps, CTRL_MAX))
+		{
+			fprintf(stderr, "%s: unexpected dependencies\n", graph->label);
+			success = false;
+		}
+
+		const uint32_t ntimed = vm_prog_split(&opt, &handle->exec->fill, &handle->exec->timed)
+			? handle->exec->timed.ninst
+			: 0;
+		if(ntimed != graph->ntimed)
+		{
+			fprintf(stderr, "%s: %"PRIu32" instead of %"PRIu32" timed instructions\n",
+				graph->label, ntimed, graph->ntimed);
+			success = false;
+		}
+
+		for(unsigned j = 0; success && (j < NINPUTS); j++)
+		{
+			success &= _check(handle, &ref, &opt, &seed, graph->label);
+			success &= _check_ir(handle, &ref, &opt, &seed, graph->label);
+			success &= _check_deps(handle, &opt, &seed, graph->label);
+			success &= _check_split(handle, &opt, &seed, graph->label);
+		}
+	}
+
+	for(unsigned g = 0; g < sizeof(fused) / sizeof(graph_t); g++)
+		success &= _check_fused(handle, &fused[g], &seed);
+
+	for(unsigned p = 0; success && (p < NPROGS); p++)
+	{
+		char label [32];
+
+		_graph_random(cmds, &seed, ITEMS_PRE);
+		vm_graph_compile(&ref, cmds, VM_STATUS_STATIC);
+		if(_has_goto(&ref)) // dynamic targets may loop forever
+			continue;
+
+		nprogs++;
+		vm_prog_copy(&opt, &ref);
+		vm_prog_optimize(&opt);
+		vm_prog_verify(&opt, NULL, NULL);
+
+		ninst_ref += ref.ninst;
+		ninst_opt += opt.ninst;
+		nverified += opt.verified;
+		if(vm_ir_build(&ir, &opt))
+		{
+			nregister++;
+			ninst_ir += ir.ninst;
+			vm_ir_fuse(&ir, true);
+			ninst_fused += ir.ninst;
+		}
+		snprintf(label, sizeof(label), "random #%u", p);
+
+		for(unsigned j = 0; success && (j < NINPUTS); j++)
+		{
+			success &= _check(handle, &ref, &opt, &seed, label);
+			success &= _check_ir(handle, &ref, &opt, &seed, label);
+			success &= _check_deps(handle, &opt, &seed, label);
+			success &= _check_split(handle, &opt, &seed, label);
+		}
+	}
+
+	// programs beyond preallocated capacity
+	for(unsigned p = 0; success && (p < NLONG); p++)
+	{
+		char label [32];
+
+		_graph_random(cmds, &seed, ITEMS_MAX);
+		vm_graph_compile(&ref, cmds, VM_STATUS_STATIC);
+		if(_has_goto(&ref))
+			continue;
+
+		nlong++;
+		vm_prog_copy(&opt, &ref);
+		vm_prog_optimize(&opt);
+		vm_prog_verify(&opt, NULL, NULL);
+		snprintf(label, sizeof(label), "long #%u", p);
+
+		for(unsigned j = 0; success && (j < NINPUTS); j++)
+		{
+			success &= _check(handle, &ref, &opt, &seed, label);
+			success &= _check_ir(handle, &ref, &opt, &seed, label);
+			success &= _check_deps(handle, &opt, &seed, label);
+			success &= _check_split(handle, &opt, &seed, label);
+		}
+	}
+
+	fprintf(stdout, "%"PRIu32" of %"PRIu32" instructions left\n",
+		ninst_opt, ninst_ref);
+	fprintf(stdout, "%"PRIu32" of %"PRIu32" programs verified\n",
+		nverified, nprogs);
+	fprintf(stdout, "%"PRIu32" of %"PRIu32" programs in register form\n",
+		nregister, nprogs);
+	fprintf(stdout, "%"PRIu32" of %"PRIu32" register instructions left after fusion\n",
+		ninst_fused, ninst_ir);
+	fprintf(stdout, "%"PRIu32" of %"PRIu32" long programs checked\n",
+		nlong, NLONG);
+
+	cleanup(handle);
+
+	return success ? 0 : 1;
+}
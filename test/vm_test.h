@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2017-2021 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _VM_TEST_H
+#define _VM_TEST_H
+
+// fixtures shared by tests and benchmarks, included after vm.c
+
+#define URIS_MAX 256
+
+#define I(V) { .type = COMMAND_INT, .i32 = (V) }
+#define F(V) { .type = COMMAND_FLOAT, .f32 = (V) }
+#define O(OP) { .type = COMMAND_OPCODE, .op = (OP) }
+
+static const char *uris [URIS_MAX];
+static unsigned nuris;
+
+static inline LV2_URID
+_map(LV2_URID_Map_Handle instance __attribute__((unused)), const char *uri)
+{
+	for(unsigned i = 0; i < nuris; i++)
+	{
+		if(!strcmp(uris[i], uri))
+			return i + 1;
+	}
+
+	if(nuris >= URIS_MAX)
+		return 0;
+
+	uris[nuris++] = uri;
+	return nuris;
+}
+
+static inline uint32_t
+_rand_u32(uint32_t *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+
+	return *seed;
+}
+
+static inline float
+_rand_float(uint32_t *seed)
+{
+	static const float specials [] = {
+		0.f, -0.f, 1.f, -1.f, 0.5f, 2.f, 1e10f, -1e10f, 3e38f, INFINITY, -INFINITY, NAN
+	};
+	const uint32_t r = _rand_u32(seed);
+
+	if( (r & 0x7) == 0)
+		return specials[(r >> 3) % (sizeof(specials) / sizeof(float))];
+
+	return ((float)(r >> 8) / 0x800000 - 1.f) * ( (r & 0x8) ? 100.f : 1.f);
+}
+
+// random programs of up to nitems commands, rich in immediates and stack
+// traffic, forward gotos only
+static inline void
+_graph_random(vm_command_t *cmds, uint32_t *seed, unsigned nitems)
+{
+	static const vm_opcode_enum_t traffic [] = {
+		OP_PUSH, OP_POP, OP_SWAP, OP_PI, OP_CTRL, OP_LOAD, OP_STORE, OP_BREAK
+	};
+	const unsigned n = 1 + _rand_u32(seed) % (nitems - 1);
+
+	memset(cmds, 0x0, sizeof(vm_command_t)*ITEMS_MAX);
+
+	for(unsigned i = 0; i < n; i++)
+	{
+		const uint32_t r = _rand_u32(seed);
+
+		switch(r % 16)
+		{
+			case 0:
+			case 1:
+			case 2:
+			case 3:
+			{
+				cmds[i] = (vm_command_t)I((int)(r >> 8) % 12 - 2);
+			} break;
+			case 4:
+			case 5:
+			{
+				cmds[i] = (vm_command_t)F(_rand_float(seed));
+			} break;
+			case 6:
+			case 7:
+			case 8:
+			{
+				cmds[i] = (vm_command_t)O(traffic[(r >> 8) % (sizeof(traffic) / sizeof(vm_opcode_enum_t))]);
+			} break;
+			case 9:
+			{
+				if(i + 3 < n) // target, condition, goto
+				{
+					const int target = i + 3 + (r >> 8) % (n - i - 2);
+
+					cmds[i++] = (vm_command_t)I(target);
+					cmds[i++] = (vm_command_t)I((r >> 16) % 2);
+					cmds[i] = (vm_command_t)O(OP_GOTO);
+					break;
+				}
+			} // fall-through
+			default:
+			{
+				vm_opcode_enum_t op = 1 + (r >> 8) % (OP_MAX - 1);
+
+				if(op == OP_GOTO)
+					op = OP_BREAK;
+
+				cmds[i] = (vm_command_t)O(op);
+			} break;
+		}
+	}
+}
+
+#endif // _VM_TEST_H
@@ -19,24 +19,29 @@
 #include <stdatomic.h>
 #include <math.h>
 #include <inttypes.h>
+#include <time.h>
 
 #include <timely.lv2/timely.h>
 
 #include <vm.h>
+#if defined(VM_JIT)
+#	include <vm_jit.h>
+#endif
 
-#define SLOT_MAX  0x20
-#define SLOT_MASK (SLOT_MAX - 1)
+#define BLOCK_MAX 0x40
 
-#define REG_MAX   0x20
-#define REG_MASK  (REG_MAX - 1)
+#define TIME_MAX  (OP_SPEED - OP_BAR_BEAT + 1)
 
 typedef union _vm_port_t vm_port_t;
 typedef union _vm_const_port_t vm_const_port_t;
 typedef struct _vm_stack_t vm_stack_t;
+typedef struct _vm_layout_t vm_layout_t;
+typedef struct _vm_block_t vm_block_t;
+typedef struct _vm_exec_t vm_exec_t;
 typedef struct _plughandle_t plughandle_t;
 typedef struct _forge_t forge_t;
-
-typedef double num_t;
+typedef struct _vm_env_t vm_env_t;
+typedef struct _vm_store_t vm_store_t;
 
 union _vm_port_t {
 	float *flt;
@@ -50,16 +55,72 @@ union _vm_const_port_t {
 
 struct _vm_stack_t {
 	num_t slots [SLOT_MAX];
-	num_t regs [REG_MAX];
+	num_t regs [REG_MAX + HIDDEN_MAX]; // hidden registers above REG_MAX
 	int ptr;
 };
 
+struct _vm_layout_t {
+	uint32_t zero; // mask of slots read before being written
+	uint32_t spread_end; // mask of output slots to broadcast after last command
+	uint8_t *ptr; // static stack pointer before each instruction
+	bool *once; // evaluated on first frame of sub-block only
+	uint32_t *spread; // mask of slots to broadcast before instruction
+};
+
+struct _vm_block_t {
+	bool enabled; // program can be evaluated on whole sub-blocks
+	uint32_t time; // mask of time opcodes in use
+	uint8_t end; // static stack pointer after last command
+	vm_layout_t steady; // program with inputs constant over sub-block
+	vm_layout_t varying; // program with inputs changing within sub-block
+	vm_layout_t timed; // time-varying part of split program, steady inputs
+
+	float in [CTRL_MAX][BLOCK_MAX];
+	num_t clk [TIME_MAX][BLOCK_MAX];
+	num_t slots [SLOT_MAX][BLOCK_MAX];
+};
+
+struct _vm_exec_t {
+	vm_arena_t arena; // backs commands, programs, layouts and scratch space
+	uint32_t nitems; // capacity of commands and each program
+	vm_command_t *cmds;
+	vm_prog_t prog;
+	uint8_t deps [CTRL_MAX]; // outputs affected by each input
+	vm_prog_t slice [CTRL_MAX]; // program sliced to outputs of each input
+	bool split; // time-varying program split into fill and timed parts
+	vm_prog_t fill;
+	vm_prog_t timed;
+	vm_ir_t ir; // register form of program run by run_prog
+	vm_block_t block;
+	bool every; // needs evaluation on every frame in event modes
+#if defined(VM_JIT)
+	vm_jit_t jit;
+#endif
+};
+
 struct _forge_t {
 	LV2_Atom_Forge forge;
 	LV2_Atom_Forge_Frame frame;
 	LV2_Atom_Forge_Ref ref;
 };
 
+// min, max and energy of a port since last notification
+struct _vm_env_t {
+	float min;
+	float max;
+	double sum2;
+	uint32_t count;
+};
+
+// value and stash of serialized graphs beyond GRAPH_PRE, allocated off the audio thread
+struct _vm_store_t {
+	vm_store_t *next; // retired storage, freed off the audio thread
+	uint32_t max_size;
+	uint32_t size; // of restored graph already held in value and stash, else 0
+	uint8_t *value;
+	uint8_t *stash;
+};
+
 struct _plughandle_t {
 	LV2_URID_Map *map;
 	LV2_Atom_Forge forge;
@@ -68,11 +129,22 @@ struct _plughandle_t {
 	vm_plug_enum_t vm_plug;
 
 	LV2_URID vm_graph;
+	LV2_URID vm_overruns;
 	LV2_URID midi_MidiEvent;
 
 	LV2_Log_Log *log;
 	LV2_Log_Logger logger;
 
+	LV2_Worker_Schedule *sched;
+	bool busy; // compilation in flight on worker
+	bool pending; // graph set or patched since last compilation, compiled in run_post
+	bool patched; // graph edited by patch:Patch, state to be saved
+	bool resync; // whole graph to be sent, as patch:Patch was rejected or requested
+	int32_t graph_rev; // revision of graph, bumped by every change
+	int32_t patch_base; // revision indices of current patch:Patch refer to, 0 if unchecked
+	bool patch_spliced; // current patch:Patch changed graph
+	bool patch_failed; // current patch:Patch stale or not applicable
+
 	const LV2_Atom_Sequence *control;
 	LV2_Atom_Sequence *notify;
 	vm_const_port_t in [CTRL_MAX];
@@ -84,27 +156,48 @@ struct _plughandle_t {
 	float outm [CTRL_MAX];
 	bool inf [CTRL_MAX];
 	bool outf [CTRL_MAX];
+	int64_t notify_due; // frame of next batched notification
+	vm_env_t inenv [CTRL_MAX];
+	vm_env_t outenv [CTRL_MAX];
 	forge_t forgs [CTRL_MAX];
 
 	PROPS_T(props, MAX_NPROPS);
+	props_def_t defs [MAX_NPROPS]; // max_size of vm:graph grows with its storage
 	plugstate_t state;
 	plugstate_t stash;
 
+	uint8_t *graph; // value of vm:graph, inline in state or in store
 	uint32_t graph_size;
+	uint32_t graph_need; // size of graph that did not fit, grown to by worker
+	vm_store_t *store; // NULL while graph is inline in state
+	vm_store_t *grown; // larger storage handed to audio thread
+	vm_store_t *retired;
 	uint32_t sourceFilter_size;
 	uint32_t destinationFilter_size;
 	vm_api_impl_t api [OP_MAX];
 	vm_filter_t sourceFilter [CTRL_MAX];
 	vm_filter_t destinationFilter [CTRL_MAX];
 	vm_filter_impl_t filt;
+	uint32_t decimation_size;
+	vm_decim_t decimation [CTRL_MAX];
+	vm_decim_impl_t decim;
+
+	float rate;
+	float sent [CTRL_MAX]; // last value sent on atom and midi output ports
+	int64_t sent_t [CTRL_MAX]; // frame of last event sent
+	uint32_t held; // outputs with a change not sent yet
+	uint32_t starved; // outputs out of sequence capacity in this period
 
 	vm_stack_t stack;
+	vm_rand_t rand;
 	bool needs_recalc;
-	vm_status_t status;
 
 	int64_t off;
 
-	vm_command_t cmds [ITEMS_MAX];
+	vm_exec_t execs [2];
+	vm_exec_t *exec; // run by audio thread, other one compiled by worker
+	bool filled; // hidden registers are up to date with inputs
+	bool overrun; // budget ran out since last notification
 
 	timely_t timely;
 };
@@ -170,1004 +263,3335 @@ _dirty(plughandle_t *handle)
 	}
 }
 
-static void
-_intercept_graph(void *data, int64_t frames __attribute__((unused)),
-	props_impl_t *impl)
+// static stack pointers, slots read before being written and rates
+static int
+_block_layout(vm_layout_t *layout, const vm_prog_t *prog, bool varying)
 {
-	plughandle_t *handle = data;
+	VM_SCRATCH_SCOPE(prog);
+	uint8_t *rates = VM_SCRATCH(prog, uint8_t); // nothing hoisted without
+	uint32_t written = 0;
+	uint32_t uniform = 0; // slots only valid on first frame
+	int ptr = 0;
 
-	handle->graph_size = impl->value.size;
+	if(rates)
+		vm_prog_rates(prog, varying, rates);
+	layout->zero = 0;
 
-	handle->status = vm_graph_deserialize(handle->api, &handle->forge, handle->cmds,
-		impl->value.size, impl->value.body);
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		const vm_inst_t *inst = &prog->inst[i];
+		const unsigned nreads = (inst->op == OP_POP) ? 0 : inst->npops;
+		uint32_t reads = 0;
+		uint32_t writes = 0;
 
-	handle->needs_recalc = true;
-	_dirty(handle);
+		// slots read before being written evaluate to zero
+		for(unsigned j = 0; j < nreads; j++)
+		{
+			const uint32_t bit = 1U << ((ptr + j) & SLOT_MASK);
+
+			if(!(written & bit))
+				layout->zero |= bit;
+
+			reads |= bit;
+		}
+
+		layout->ptr[i] = ptr;
+		ptr = (ptr + inst->npops - inst->npushs) & SLOT_MASK;
+
+		for(unsigned j = 0; j < inst->npushs; j++)
+			writes |= 1U << ((ptr + j) & SLOT_MASK);
+
+		written |= writes;
+
+		// hoist block rate work, broadcast its results to sample rate work
+		layout->once[i] = rates && (rates[i] != VM_RATE_SAMPLE);
+		layout->spread[i] = layout->once[i] ? 0 : reads & uniform;
+
+		if(layout->once[i])
+			uniform |= writes;
+		else
+			uniform &= ~(reads | writes);
+	}
+
+	layout->spread_end = 0;
+
+	for(unsigned j = 0; j < CTRL_MAX; j++)
+	{
+		const uint32_t bit = 1U << ((ptr + j) & SLOT_MASK);
+
+		if(!(written & bit))
+			layout->zero |= bit;
+
+		layout->spread_end |= uniform & bit;
+	}
+
+	return ptr;
 }
 
 static void
-_intercept_sourceFilter(void *data, int64_t frames __attribute__((unused)),
-	props_impl_t *impl)
+_block_prepare(vm_block_t *block, const vm_prog_t *prog, const vm_prog_t *timed)
 {
-	plughandle_t *handle = data;
+	bool has_store = false;
+	bool has_load = false;
 
-	handle->sourceFilter_size = impl->value.size;
+	block->enabled = true;
+	block->time = 0;
 
-	const int status = vm_filter_deserialize(&handle->forge, &handle->filt,
-		handle->sourceFilter, impl->value.size, impl->value.body);
-	(void)status; //FIXME
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		const vm_inst_t *inst = &prog->inst[i];
 
-	handle->needs_recalc = true;
-	_dirty(handle);
+		switch(inst->op)
+		{
+			case OP_BREAK:
+			case OP_GOTO:
+			case INST_JMP:
+			{
+				block->enabled = false; // control flow may differ per frame
+			} break;
+			case OP_STORE:
+			{
+				has_store = true;
+			} break;
+			case OP_LOAD:
+			{
+				has_load = true;
+			} break;
+			default:
+			{
+				if( (inst->op >= OP_BAR_BEAT) && (inst->op <= OP_SPEED) )
+					block->time |= 1U << (inst->op - OP_BAR_BEAT);
+			} break;
+		}
+	}
+
+	block->end = _block_layout(&block->steady, prog, false);
+	_block_layout(&block->varying, prog, true);
+
+	if(timed)
+		_block_layout(&block->timed, timed, false);
+
+	// registers written and read back carry state from frame to frame
+	if(has_store && has_load)
+		block->enabled = false;
 }
 
-static void
-_intercept_destinationFilter(void *data, int64_t frames __attribute__((unused)),
-	props_impl_t *impl)
+static bool
+_layout_alloc(vm_layout_t *layout, vm_arena_t *arena, uint32_t nitems)
 {
-	plughandle_t *handle = data;
+	layout->ptr = vm_arena_alloc(arena, sizeof(uint8_t)*nitems);
+	layout->once = vm_arena_alloc(arena, sizeof(bool)*nitems);
+	layout->spread = vm_arena_alloc(arena, sizeof(uint32_t)*nitems);
 
-	handle->destinationFilter_size = impl->value.size;
-
-	const int status = vm_filter_deserialize(&handle->forge, &handle->filt,
-		handle->destinationFilter, impl->value.size, impl->value.body);
-	(void)status; //FIXME
+	return layout->ptr && layout->once && layout->spread;
+}
 
-	handle->needs_recalc = true;
-	_dirty(handle);
+static vm_inst_t *
+_inst_alloc(vm_arena_t *arena, uint32_t nitems)
+{
+	return vm_arena_alloc(arena, sizeof(vm_inst_t)*nitems);
 }
 
-static const props_def_t defs [MAX_NPROPS] = {
-	{
-		.property = VM__graph,
-		.offset = offsetof(plugstate_t, graph),
-		.type = LV2_ATOM__Tuple,
-		.max_size = GRAPH_SIZE,
-		.event_cb = _intercept_graph,
-	},
-	{
-		.property = VM__sourceFilter,
-		.offset = offsetof(plugstate_t, sourceFilter),
-		.type = LV2_ATOM__Tuple,
-		.max_size = FILTER_SIZE,
-		.event_cb = _intercept_sourceFilter,
-	},
+// carve storage for graphs of nitems commands from arena, not real-time safe
+static bool
+_exec_reserve(vm_exec_t *exec, uint32_t nitems)
+{
+	const size_t nprogs = 3 + CTRL_MAX;
+	const size_t nallocs = 1 + nprogs + 3*3;
+	size_t size = nallocs*0x10 + nitems*(sizeof(vm_command_t)
+		+ nprogs*sizeof(vm_inst_t)
+		+ 3*(sizeof(uint8_t) + sizeof(bool) + sizeof(uint32_t)))
+		+ SCRATCH_SIZE(nitems); // left free for analysis passes
+#if defined(VM_JIT)
+	size += 0x10 + sizeof(vm_jit_emit_t); // emitter state, taken from scratch
+#endif
+	vm_arena_t *arena = &exec->arena;
+	bool success = true;
+
+	exec->nitems = 0;
+
+	if(!vm_arena_reserve(arena, size))
+		return false;
+
+	success &= (exec->cmds = vm_arena_alloc(arena, sizeof(vm_command_t)*nitems)) != NULL;
+
+	vm_prog_init(&exec->prog, _inst_alloc(arena, nitems), nitems, arena);
+	vm_prog_init(&exec->fill, _inst_alloc(arena, nitems), nitems, arena);
+	vm_prog_init(&exec->timed, _inst_alloc(arena, nitems), nitems, arena);
+	success &= exec->prog.inst && exec->fill.inst && exec->timed.inst;
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
 	{
-		.property = VM__destinationFilter,
-		.offset = offsetof(plugstate_t, destinationFilter),
-		.type = LV2_ATOM__Tuple,
-		.max_size = FILTER_SIZE,
-		.event_cb = _intercept_destinationFilter,
+		vm_prog_init(&exec->slice[i], _inst_alloc(arena, nitems), nitems, arena);
+		success &= exec->slice[i].inst != NULL;
 	}
-};
 
-static void
-_cb(timely_t *timely __attribute__((unused)), int64_t frames __attribute__((unused)),
-	LV2_URID type __attribute__((unused)), void *data __attribute__((unused)))
-{
-	// nothing to do
+	success &= _layout_alloc(&exec->block.steady, arena, nitems);
+	success &= _layout_alloc(&exec->block.varying, arena, nitems);
+	success &= _layout_alloc(&exec->block.timed, arena, nitems);
+
+	if(success)
+		exec->nitems = nitems;
+
+	return success;
 }
 
-static LV2_Handle
-instantiate(const LV2_Descriptor* descriptor, num_t rate,
-	const char *bundle_path __attribute__((unused)),
-	const LV2_Feature *const *features)
+// random draws and register state advance with each evaluation
+static bool
+_event_every(const vm_prog_t *prog)
 {
-	plughandle_t *handle = calloc(1, sizeof(plughandle_t));
-	if(!handle)
-		return NULL;
+	bool has_store = false;
+	bool has_load = false;
 
-	handle->vm_plug = vm_plug_type(descriptor->URI);
+	if(prog->status & VM_STATUS_HAS_RAND)
+		return true;
 
-	for(unsigned i=0; features[i]; i++)
+	for(unsigned i = 0; i < prog->ninst; i++)
 	{
-		if(!strcmp(features[i]->URI, LV2_URID__map))
-			handle->map = features[i]->data;
-		else if(!strcmp(features[i]->URI, LV2_LOG__log))
-			handle->log = features[i]->data;
+		if(prog->inst[i].op == OP_STORE)
+			has_store = true;
+		else if(prog->inst[i].op == OP_LOAD)
+			has_load = true;
 	}
 
-	if(!handle->map)
-	{
-		fprintf(stderr,
-			"%s: Host does not support urid:map\n", descriptor->URI);
-		free(handle);
-		return NULL;
-	}
+	return (prog->status != VM_STATUS_STATIC) && has_store && has_load;
+}
 
-	if(handle->log)
-		lv2_log_logger_init(&handle->logger, handle->map, handle->log);
+static void
+_slice_prepare(vm_exec_t *exec)
+{
+	vm_prog_deps(&exec->prog, exec->deps);
 
-	handle->vm_graph = handle->map->map(handle->map->handle, VM__graph);
-	handle->midi_MidiEvent = handle->map->map(handle->map->handle, LV2_MIDI__MidiEvent);
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		vm_prog_copy(&exec->slice[i], &exec->prog);
 
-	handle->filt.midi_Controller = handle->map->map(handle->map->handle, LV2_MIDI__Controller);
-	handle->filt.midi_Bender = handle->map->map(handle->map->handle, LV2_MIDI__Bender);
-	handle->filt.midi_ProgramChange = handle->map->map(handle->map->handle, LV2_MIDI__ProgramChange);
-	handle->filt.midi_ChannelPressure = handle->map->map(handle->map->handle, LV2_MIDI__ChannelPressure);
-	handle->filt.midi_NotePressure = handle->map->map(handle->map->handle, LV2_MIDI__Aftertouch);
-	handle->filt.midi_NoteOn = handle->map->map(handle->map->handle, LV2_MIDI__NoteOn);
-	handle->filt.midi_channel = handle->map->map(handle->map->handle, LV2_MIDI__channel);
-	handle->filt.midi_controllerNumber = handle->map->map(handle->map->handle, LV2_MIDI__controllerNumber);
-	handle->filt.midi_noteNumber = handle->map->map(handle->map->handle, LV2_MIDI__noteNumber);
-	handle->filt.midi_velocity = handle->map->map(handle->map->handle, LV2_MIDI__velocity);
+		if(exec->deps[i] != (1U << CTRL_MAX) - 1)
+			vm_prog_slice(&exec->slice[i], exec->deps[i]);
+	}
+}
 
-	lv2_atom_forge_init(&handle->forge, handle->map);
-	for(unsigned i = 0; i < CTRL_MAX; i++)
-		lv2_atom_forge_init(&handle->forgs[i].forge, handle->map);
+#if defined(VM_JIT)
+static num_t
+_jit_rand(void *data)
+{
+	plughandle_t *handle = data;
 
-	vm_api_init(handle->api, handle->map);
-	timely_init(&handle->timely, handle->map, rate, 0, _cb, handle);
+	return vm_rand_next(&handle->rand);
+}
+#endif
 
-	const int nprops = handle->vm_plug == VM_PLUG_MIDI
-		? MAX_NPROPS
-		: 1;
+// runs on worker thread if available, exec must not be in use by audio thread,
+// storage only grows and native code is only generated on the worker,
+// graph is rejected if it does not fit otherwise
+static bool
+_exec_compile(plughandle_t *handle, vm_exec_t *exec, uint32_t size,
+	const void *body, bool worker)
+{
+	const uint32_t nitems = vm_graph_items(size);
 
-	if(!props_init(&handle->props, descriptor->URI,
-		defs, nprops,
-		&handle->state, &handle->stash, handle->map, handle))
+	if(nitems > exec->nitems)
 	{
-		fprintf(stderr, "props_init failed\n");
-		free(handle);
-		return NULL;
+		uint32_t pot = ITEMS_PRE;
+		while(pot < nitems)
+			pot <<= 1;
+
+		if(!worker || !_exec_reserve(exec, pot))
+		{
+			if(handle->log)
+				lv2_log_warning(&handle->logger, "graph of %"PRIu32" bytes rejected, "
+					"keeping previous program\n", size);
+
+			return false;
+		}
 	}
 
-	handle->needs_recalc = true;
+	const vm_status_t status = vm_graph_deserialize(handle->api, &handle->forge,
+		exec->cmds, nitems, size, body);
+	if(nitems < exec->nitems) // tail of a longer predecessor stays behind otherwise
+		exec->cmds[nitems].type = COMMAND_NOP;
+	vm_graph_compile(&exec->prog, exec->cmds, status);
+	if(exec->prog.params && handle->log)
+		lv2_log_note(&handle->logger, "graph stores into parameter registers 0x%02"PRIx8"\n", exec->prog.params);
+	vm_prog_optimize(&exec->prog);
+	_slice_prepare(exec);
+	exec->split = vm_prog_split(&exec->prog, &exec->fill, &exec->timed);
+	_block_prepare(&exec->block, &exec->prog,
+		exec->split ? &exec->timed : NULL);
+	exec->every = _event_every(&exec->prog);
+
+	vm_prog_verify(&exec->prog, NULL, NULL);
+	vm_prog_verify(&exec->fill, NULL, NULL);
+	vm_prog_verify(&exec->timed, NULL, NULL);
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+		vm_prog_verify(&exec->slice[i], NULL, NULL);
+	vm_ir_build(&exec->ir, exec->split ? &exec->timed : &exec->prog);
+	vm_ir_fuse(&exec->ir, false); // slice, block and JIT round multiply-add twice
+#if defined(VM_JIT)
+	if(worker) // mprotect is no business of the audio thread
+		vm_jit_compile(&exec->jit, exec->split ? &exec->timed : &exec->prog,
+			_jit_rand, handle);
+	else
+		exec->jit.fn = NULL; // left to the interpreters
+#endif
 
-	return handle;
+	return true;
+}
+
+static vm_exec_t *
+_exec_idle(plughandle_t *handle)
+{
+	vm_exec_t *exec = __atomic_load_n(&handle->exec, __ATOMIC_ACQUIRE);
+
+	return (exec == &handle->execs[0])
+		? &handle->execs[1]
+		: &handle->execs[0];
 }
 
 static void
-connect_port(LV2_Handle instance, uint32_t port, void *data)
+_exec_swap(plughandle_t *handle, vm_exec_t *exec)
 {
-	plughandle_t *handle = instance;
+	__atomic_store_n(&handle->exec, exec, __ATOMIC_RELEASE);
 
-	switch(port)
-	{
-		case 0:
-			handle->control = data;
-			break;
-		case 1:
-			handle->notify = data;
-			break;
-		case 2:
-		case 3:
-		case 4:
-		case 5:
-		case 6:
-		case 7:
-		case 8:
-		case 9:
-			handle->in[port - 2].flt = data;
-			break;
-		case 10:
-		case 11:
-		case 12:
-		case 13:
-		case 14:
-		case 15:
-		case 16:
-		case 17:
-			handle->out[port - 10].flt = data;
-			break;
-	}
+	handle->filled = false;
+	handle->needs_recalc = true;
+	_dirty(handle);
 }
 
-#define CLIP(a, v, b) fmin(fmax(a, v), b)
+// next revision of changed graph, skipping 0, as it marks unchecked patches
+static void
+_graph_bump(plughandle_t *handle)
+{
+	handle->graph_rev = (handle->graph_rev < INT32_MAX) ? handle->graph_rev + 1 : 1;
+}
+
+static vm_store_t *
+_store_new(uint32_t max_size)
+{
+	vm_store_t *store = calloc(1, sizeof(vm_store_t) + 2*max_size);
+	if(!store)
+		return NULL;
 
+	store->max_size = max_size;
+	store->value = (uint8_t *)&store[1];
+	store->stash = store->value + max_size;
+
+	return store;
+}
+
+// free storage retired by audio thread, off the audio thread only
 static void
-run_pre(plughandle_t *handle)
+_store_reap(plughandle_t *handle)
 {
-	// reset maximum values and notification flags
-	for(unsigned i = 0; i < CTRL_MAX; i++)
+	vm_store_t *store = __atomic_exchange_n(&handle->retired, NULL, __ATOMIC_ACQUIRE);
+
+	while(store)
 	{
-		handle->inm[i] = 0.f;
-		handle->outm[i] = 0.f;
+		vm_store_t *next = store->next;
+
+		free(store);
+		store = next;
 	}
 }
 
+// hand storage to audio thread, restored graphs replace any pending storage,
+// grown storage waits for a pending one to be taken
 static void
-run_post(plughandle_t *handle, uint32_t frames)
+_store_offer(plughandle_t *handle, vm_store_t *store, bool restored)
 {
-	for(unsigned i = 0; i < CTRL_MAX; i++)
+	if(restored)
 	{
-		if(handle->inf[i]) // port needs notification
+		free(__atomic_exchange_n(&handle->grown, store, __ATOMIC_ACQ_REL));
+	}
+	else
+	{
+		vm_store_t *pending = NULL;
+
+		if(!__atomic_compare_exchange_n(&handle->grown, &pending, store, false,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED))
 		{
-			LV2_Atom_Forge_Frame tup_frame;
-			if(handle->ref)
-				handle->ref = lv2_atom_forge_frame_time(&handle->forge, frames);
-			if(handle->ref)
-				handle->ref = lv2_atom_forge_tuple(&handle->forge, &tup_frame);
-			if(handle->ref)
-				handle->ref = lv2_atom_forge_int(&handle->forge, i + 2);
-			if(handle->ref)
-				handle->ref = lv2_atom_forge_float(&handle->forge, handle->inm[i]);
-			if(handle->ref)
-				lv2_atom_forge_pop(&handle->forge, &tup_frame);
-
-			handle->inf[i] = false;
+			free(store);
 		}
+	}
+}
 
-		if(handle->outf[i]) // port needs notification
-		{
-			LV2_Atom_Forge_Frame tup_frame;
-			if(handle->ref)
-				handle->ref = lv2_atom_forge_frame_time(&handle->forge, frames);
-			if(handle->ref)
-				handle->ref = lv2_atom_forge_tuple(&handle->forge, &tup_frame);
-			if(handle->ref)
-				handle->ref = lv2_atom_forge_int(&handle->forge, i + 10);
-			if(handle->ref)
-				handle->ref = lv2_atom_forge_float(&handle->forge, handle->outm[i]);
-			if(handle->ref)
-				lv2_atom_forge_pop(&handle->forge, &tup_frame);
-
-			handle->outf[i] = false;
-		}
+// double storage ahead of edits while graph takes up more than half of it,
+// on worker thread
+static void
+_store_grow(plughandle_t *handle, uint32_t size)
+{
+	const uint32_t max_size = __atomic_load_n(&handle->defs[0].max_size, __ATOMIC_ACQUIRE);
+	const uint32_t need = __atomic_load_n(&handle->graph_need, __ATOMIC_RELAXED);
+	uint32_t pot = max_size;
+
+	while( (pot < GRAPH_SIZE) && ( (pot < 2*size) || (pot < need) ) )
+		pot <<= 1;
+
+	if(pot == max_size)
+		return;
+
+	vm_store_t *store = _store_new(pot);
+	if(store)
+		_store_offer(handle, store, false);
+}
+
+static void
+_store_retire(plughandle_t *handle, vm_store_t *store)
+{
+	store->next = __atomic_load_n(&handle->retired, __ATOMIC_RELAXED);
+
+	while(!__atomic_compare_exchange_n(&handle->retired, &store->next, store, true,
+		__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	{
+		// store->next updated to current head
 	}
 }
 
-static LV2_Atom_Forge_Ref
-send_chunk(LV2_Atom_Forge *forge, uint32_t frames, LV2_URID type,
-	const uint8_t *msg, uint32_t sz)
+// switch vm:graph to storage handed over by worker or restore, audio thread only
+static void
+_store_adopt(plughandle_t *handle)
 {
-	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
-	if(ref)
-		ref = lv2_atom_forge_atom(forge, sz, type);
-	if(ref)
-		ref = lv2_atom_forge_write(forge, msg, sz);
+	if(!__atomic_load_n(&handle->grown, __ATOMIC_RELAXED))
+		return;
+
+	props_impl_t *impl = _props_impl_get(&handle->props, handle->vm_graph);
+
+	if(!impl || !_props_impl_try_lock(impl, PROP_STATE_NONE, PROP_STATE_LOCK))
+		return; // stash in use or restore pending, retried next period
+
+	vm_store_t *store = __atomic_exchange_n(&handle->grown, NULL, __ATOMIC_ACQUIRE);
+
+	if(!store->size && (store->max_size <= handle->defs[0].max_size))
+	{
+		_props_impl_unlock(impl, PROP_STATE_NONE);
+		_store_retire(handle, store); // outgrown meanwhile
+
+		return;
+	}
+
+	if(store->size) // restored graph
+	{
+		impl->value.size = store->size;
+		impl->stash.size = store->size;
+	}
+	else
+	{
+		memcpy(store->value, impl->value.body, impl->value.size);
+		memcpy(store->stash, impl->stash.body, impl->stash.size);
+	}
+
+	impl->value.body = store->value;
+	impl->stash.body = store->stash;
+
+	_props_impl_unlock(impl, PROP_STATE_NONE);
+
+	__atomic_store_n(&handle->defs[0].max_size, store->max_size, __ATOMIC_RELEASE);
+	handle->graph = store->value;
+
+	if(handle->store)
+		_store_retire(handle, handle->store);
+	handle->store = store;
+
+	if(store->size)
+	{
+		handle->graph_size = store->size;
+		handle->pending = true;
+		handle->resync = true;
+		_graph_bump(handle);
+	}
+}
+
+// hand latest graph to worker, compile in place without one,
+// audio thread only, as busy and pending are not shared with other threads
+static void
+_graph_schedule(plughandle_t *handle)
+{
+	handle->pending = false;
+
+	if(handle->sched)
+	{
+		if(handle->sched->schedule_work(handle->sched->handle,
+			handle->graph_size, handle->graph) == LV2_WORKER_SUCCESS)
+		{
+			handle->busy = true;
+			return;
+		}
+
+		if(handle->log)
+			lv2_log_trace(&handle->logger, "schedule_work failed, compiling in place\n");
+	}
+
+	// fallback is not realtime-safe: optimizer, deps, split and IR passes run
+	// within run(), bounded by program capacity, but without an upper time limit
+	vm_exec_t *exec = _exec_idle(handle);
+
+	if(_exec_compile(handle, exec, handle->graph_size, handle->graph, false))
+		_exec_swap(handle, exec);
+}
+
+// reached via props_idle and props_advance in run only, props_restore just
+// stashes the value, compilation is scheduled in run_post
+static void
+_intercept_graph(void *data, int64_t frames __attribute__((unused)),
+	props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	handle->graph_size = impl->value.size;
+	handle->pending = true;
+	handle->resync = true; // as forwarded by props without revision
+	_graph_bump(handle);
+}
+
+// indexed graph edits, remove: (index count), add: (index item ...)
+static void
+_graph_patch(void *data, props_dyn_ev_t ev, LV2_URID subj __attribute__((unused)),
+	LV2_URID property, const LV2_Atom *value)
+{
+	plughandle_t *handle = data;
+	props_impl_t *impl = _props_impl_get(&handle->props, handle->vm_graph);
+
+	if( !impl || (property != handle->vm_graph) || (ev == PROPS_DYN_EV_SET) )
+		return; // patch:Set handled as whole graph
+
+	if(handle->patch_failed) // rest of a stale or failed patch
+		return;
+
+	uint32_t size = impl->value.size;
+	uint32_t need = 0;
+
+	if(  (handle->patch_base && (handle->patch_base != handle->graph_rev))
+		|| !vm_graph_patch(&handle->forge, ev, value, handle->graph, &size,
+			handle->defs[0].max_size, &need) )
+	{
+		if(need && handle->sched) // let worker grow storage to fit
+		{
+			__atomic_store_n(&handle->graph_need, need, __ATOMIC_RELAXED);
+			handle->pending = true;
+		}
+
+		handle->patch_failed = true;
+		return;
+	}
+
+	impl->value.size = size;
+	handle->graph_size = size;
+
+	// stashed once in next period instead of after every splice
+	impl->stashing = true;
+	handle->props.stashing = true;
+
+	// removal and insertion of one patch get compiled once in run_post
+	handle->pending = true;
+	handle->patched = true;
+	handle->patch_spliced = true;
+}
+
+// forward vm:graph of patch:remove or patch:add
+static LV2_Atom_Forge_Ref
+_graph_echo_edit(plughandle_t *handle, LV2_URID key, const LV2_Atom_Object *edit,
+	LV2_Atom_Forge_Ref ref)
+{
+	LV2_Atom_Forge_Frame frame;
+	const LV2_Atom *value = NULL;
+
+	if(edit && lv2_atom_forge_is_object_type(&handle->forge, edit->atom.type))
+		lv2_atom_object_get(edit, handle->vm_graph, &value, 0);
+
+	if(ref)
+		ref = lv2_atom_forge_key(&handle->forge, key);
+	if(ref)
+		ref = lv2_atom_forge_object(&handle->forge, &frame, 0, 0);
+	if(ref && value)
+	{
+		ref = lv2_atom_forge_key(&handle->forge, handle->vm_graph);
+		if(ref)
+			ref = lv2_atom_forge_write(&handle->forge, value, lv2_atom_total_size(value));
+	}
+	if(ref)
+		lv2_atom_forge_pop(&handle->forge, &frame);
+
+	return ref;
+}
+
+// send applied patch on, with revision it leads to as patch:sequenceNumber
+static void
+_graph_echo(plughandle_t *handle, uint32_t frames, const LV2_Atom_Object *rem,
+	const LV2_Atom_Object *add)
+{
+	LV2_Atom_Forge_Frame obj_frame;
+
+	LV2_Atom_Forge_Ref ref = handle->ref;
+
+	if(ref)
+		ref = lv2_atom_forge_frame_time(&handle->forge, frames);
+	if(ref)
+		ref = lv2_atom_forge_object(&handle->forge, &obj_frame, 0,
+			handle->props.urid.patch_patch);
+	if(ref)
+		ref = lv2_atom_forge_key(&handle->forge, handle->props.urid.patch_sequence);
+	if(ref)
+		ref = lv2_atom_forge_int(&handle->forge, handle->graph_rev);
+	ref = _graph_echo_edit(handle, handle->props.urid.patch_remove, rem, ref);
+	ref = _graph_echo_edit(handle, handle->props.urid.patch_add, add, ref);
+	if(ref)
+		lv2_atom_forge_pop(&handle->forge, &obj_frame);
+
+	if(!ref) // senders would wait for it forever
+		handle->resync = true;
+
+	handle->ref = ref;
+}
+
+// patch:Patch of vm:graph gives revision its indices refer to as
+// patch:sequenceNumber, applied patches are echoed, stale or failed ones and
+// patch:Get get answered with whole graph in run_pre
+static void
+_control_advance(plughandle_t *handle, uint32_t frames, const LV2_Atom_Object *obj)
+{
+	const LV2_Atom_Int *sequence = NULL;
+	const LV2_Atom_URID *property = NULL;
+	const LV2_Atom_Object *rem = NULL;
+	const LV2_Atom_Object *add = NULL;
+
+	if(!lv2_atom_forge_is_object_type(&handle->forge, obj->atom.type))
+		return;
+
+	lv2_atom_object_get(obj,
+		handle->props.urid.patch_sequence, &sequence,
+		handle->props.urid.patch_property, &property,
+		handle->props.urid.patch_remove, &rem,
+		handle->props.urid.patch_add, &add,
+		0);
+
+	if(obj->body.otype == handle->props.urid.patch_get)
+	{
+		if(!property)
+			handle->resync = true;
+		else if( (property->atom.type == handle->forge.URID)
+			&& (property->body == handle->vm_graph) )
+		{
+			handle->resync = true;
+			return; // with revision instead of by props
+		}
+	}
+
+	handle->patch_base = (sequence && (sequence->atom.type == handle->forge.Int))
+		? sequence->body
+		: 0;
+	handle->patch_spliced = false;
+	handle->patch_failed = false;
+
+	props_advance(&handle->props, &handle->forge, frames, obj, &handle->ref);
+
+	if(obj->body.otype != handle->props.urid.patch_patch)
+		return;
+
+	if(handle->patch_spliced)
+		_graph_bump(handle);
+
+	if(handle->patch_failed)
+		handle->resync = true;
+	else if(handle->patch_spliced)
+		_graph_echo(handle, frames, rem, add);
+}
+
+static const props_dyn_t dyn = {
+	.prop = _graph_patch
+};
+
+static void
+_intercept_seed(void *data, int64_t frames __attribute__((unused)),
+	props_impl_t *impl __attribute__((unused)))
+{
+	plughandle_t *handle = data;
+
+	vm_rand_seed(&handle->rand, handle->state.seed);
+
+	handle->needs_recalc = true;
+}
+
+// parameter only overwrites its register, graph stays as it is,
+// a graph storing into the register overrides it until set again
+static void
+_intercept_param(void *data, int64_t frames __attribute__((unused)),
+	props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+	const float *param = impl->value.body;
+	const unsigned idx = param - handle->state.params;
+
+	handle->stack.regs[idx] = *param;
+
+	handle->needs_recalc = true;
+}
+
+static void
+_intercept_decimation(void *data, int64_t frames __attribute__((unused)),
+	props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	handle->decimation_size = impl->value.size;
+
+	const int status = vm_decim_deserialize(&handle->forge, &handle->decim,
+		handle->decimation, impl->value.size, impl->value.body);
+	(void)status; //FIXME
+
+	handle->held = (1U << CTRL_MAX) - 1; // reconsider values held back so far
+	_dirty(handle);
+}
+
+static void
+_intercept_sourceFilter(void *data, int64_t frames __attribute__((unused)),
+	props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	handle->sourceFilter_size = impl->value.size;
+
+	const int status = vm_filter_deserialize(&handle->forge, &handle->filt,
+		handle->sourceFilter, impl->value.size, impl->value.body);
+	(void)status; //FIXME
+
+	handle->needs_recalc = true;
+	_dirty(handle);
+}
+
+static void
+_intercept_destinationFilter(void *data, int64_t frames __attribute__((unused)),
+	props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	handle->destinationFilter_size = impl->value.size;
+
+	const int status = vm_filter_deserialize(&handle->forge, &handle->filt,
+		handle->destinationFilter, impl->value.size, impl->value.body);
+	(void)status; //FIXME
+
+	handle->needs_recalc = true;
+	_dirty(handle);
+}
+
+static const props_def_t defs [MAX_NPROPS] = {
+	{
+		.property = VM__graph,
+		.offset = offsetof(plugstate_t, graph),
+		.type = LV2_ATOM__Tuple,
+		.max_size = GRAPH_SIZE,
+		.event_cb = _intercept_graph,
+	},
+	{
+		.property = VM__seed,
+		.offset = offsetof(plugstate_t, seed),
+		.type = LV2_ATOM__Long,
+		.event_cb = _intercept_seed,
+	},
+	{
+		.property = VM__budget,
+		.offset = offsetof(plugstate_t, budget),
+		.type = LV2_ATOM__Float,
+	},
+	{
+		.property = VM__overruns,
+		.offset = offsetof(plugstate_t, overruns),
+		.type = LV2_ATOM__Int,
+		.access = LV2_PATCH__readable,
+	},
+	{
+		.property = VM__updateRate,
+		.offset = offsetof(plugstate_t, update_rate),
+		.type = LV2_ATOM__Float,
+	},
+	{
+		.property = VM__param0,
+		.offset = offsetof(plugstate_t, params[0]),
+		.type = LV2_ATOM__Float,
+		.event_cb = _intercept_param,
+	},
+	{
+		.property = VM__param1,
+		.offset = offsetof(plugstate_t, params[1]),
+		.type = LV2_ATOM__Float,
+		.event_cb = _intercept_param,
+	},
+	{
+		.property = VM__param2,
+		.offset = offsetof(plugstate_t, params[2]),
+		.type = LV2_ATOM__Float,
+		.event_cb = _intercept_param,
+	},
+	{
+		.property = VM__param3,
+		.offset = offsetof(plugstate_t, params[3]),
+		.type = LV2_ATOM__Float,
+		.event_cb = _intercept_param,
+	},
+	{
+		.property = VM__param4,
+		.offset = offsetof(plugstate_t, params[4]),
+		.type = LV2_ATOM__Float,
+		.event_cb = _intercept_param,
+	},
+	{
+		.property = VM__param5,
+		.offset = offsetof(plugstate_t, params[5]),
+		.type = LV2_ATOM__Float,
+		.event_cb = _intercept_param,
+	},
+	{
+		.property = VM__param6,
+		.offset = offsetof(plugstate_t, params[6]),
+		.type = LV2_ATOM__Float,
+		.event_cb = _intercept_param,
+	},
+	{
+		.property = VM__param7,
+		.offset = offsetof(plugstate_t, params[7]),
+		.type = LV2_ATOM__Float,
+		.event_cb = _intercept_param,
+	},
+	{
+		.property = VM__decimation,
+		.offset = offsetof(plugstate_t, decimation),
+		.type = LV2_ATOM__Tuple,
+		.max_size = DECIM_SIZE,
+		.event_cb = _intercept_decimation,
+	},
+	{
+		.property = VM__sourceFilter,
+		.offset = offsetof(plugstate_t, sourceFilter),
+		.type = LV2_ATOM__Tuple,
+		.max_size = FILTER_SIZE,
+		.event_cb = _intercept_sourceFilter,
+	},
+	{
+		.property = VM__destinationFilter,
+		.offset = offsetof(plugstate_t, destinationFilter),
+		.type = LV2_ATOM__Tuple,
+		.max_size = FILTER_SIZE,
+		.event_cb = _intercept_destinationFilter,
+	}
+};
+
+static void
+_cb(timely_t *timely __attribute__((unused)), int64_t frames __attribute__((unused)),
+	LV2_URID type __attribute__((unused)), void *data __attribute__((unused)))
+{
+	// nothing to do
+}
+
+#define ENV_LANES 8
+
+static inline void
+_env_reset(vm_env_t *env)
+{
+	env->min = INFINITY;
+	env->max = -INFINITY;
+	env->sum2 = 0.0;
+	env->count = 0;
+}
+
+// lane-wise partial results keep the loops vectorizable without reassociation
+static inline void
+_env_reduce(vm_env_t *env, const float *src, uint32_t n, bool clip)
+{
+	float lmin [ENV_LANES];
+	float lmax [ENV_LANES];
+	float lsum [ENV_LANES];
+	const uint32_t m = n - n % ENV_LANES;
+
+	for(unsigned l = 0; l < ENV_LANES; l++)
+	{
+		lmin[l] = env->min;
+		lmax[l] = env->max;
+		lsum[l] = 0.f;
+	}
+
+	for(uint32_t f = 0; f < m; f += ENV_LANES)
+	{
+		for(unsigned l = 0; l < ENV_LANES; l++)
+		{
+			float x = src[f + l];
+
+			if(clip)
+				x = (x < VM_MIN) ? VM_MIN : (x > VM_MAX) ? VM_MAX : x;
+
+			lmin[l] = (x < lmin[l]) ? x : lmin[l];
+			lmax[l] = (x > lmax[l]) ? x : lmax[l];
+			lsum[l] += x*x;
+		}
+	}
+
+	for(uint32_t f = m; f < n; f++)
+	{
+		float x = src[f];
+
+		if(clip)
+			x = (x < VM_MIN) ? VM_MIN : (x > VM_MAX) ? VM_MAX : x;
+
+		lmin[0] = (x < lmin[0]) ? x : lmin[0];
+		lmax[0] = (x > lmax[0]) ? x : lmax[0];
+		lsum[0] += x*x;
+	}
+
+	for(unsigned l = 0; l < ENV_LANES; l++)
+	{
+		env->min = (lmin[l] < env->min) ? lmin[l] : env->min;
+		env->max = (lmax[l] > env->max) ? lmax[l] : env->max;
+		env->sum2 += lsum[l];
+	}
+
+	env->count += n;
+}
+
+// distinct per instance, overridden by restored vm:seed for reproducible renders
+static uint64_t
+_seed_default(plughandle_t *handle)
+{
+	struct timespec ts;
+	uint64_t x = (uintptr_t)handle;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	x ^= (uint64_t)ts.tv_sec*1000000000ULL + (uint64_t)ts.tv_nsec;
+
+	return _vm_rand_splitmix(&x);
+}
+
+static LV2_Handle
+instantiate(const LV2_Descriptor* descriptor, num_t rate,
+	const char *bundle_path __attribute__((unused)),
+	const LV2_Feature *const *features)
+{
+	plughandle_t *handle = calloc(1, sizeof(plughandle_t));
+	if(!handle)
+		return NULL;
+
+	handle->vm_plug = vm_plug_type(descriptor->URI);
+
+	for(unsigned i=0; features[i]; i++)
+	{
+		if(!strcmp(features[i]->URI, LV2_URID__map))
+			handle->map = features[i]->data;
+		else if(!strcmp(features[i]->URI, LV2_LOG__log))
+			handle->log = features[i]->data;
+		else if(!strcmp(features[i]->URI, LV2_WORKER__schedule))
+			handle->sched = features[i]->data;
+	}
+
+	if(!handle->map)
+	{
+		fprintf(stderr,
+			"%s: Host does not support urid:map\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+
+	if(handle->log)
+		lv2_log_logger_init(&handle->logger, handle->map, handle->log);
+
+	handle->vm_graph = handle->map->map(handle->map->handle, VM__graph);
+	handle->midi_MidiEvent = handle->map->map(handle->map->handle, LV2_MIDI__MidiEvent);
+
+	handle->filt.midi_Controller = handle->map->map(handle->map->handle, LV2_MIDI__Controller);
+	handle->filt.midi_Bender = handle->map->map(handle->map->handle, LV2_MIDI__Bender);
+	handle->filt.midi_ProgramChange = handle->map->map(handle->map->handle, LV2_MIDI__ProgramChange);
+	handle->filt.midi_ChannelPressure = handle->map->map(handle->map->handle, LV2_MIDI__ChannelPressure);
+	handle->filt.midi_NotePressure = handle->map->map(handle->map->handle, LV2_MIDI__Aftertouch);
+	handle->filt.midi_NoteOn = handle->map->map(handle->map->handle, LV2_MIDI__NoteOn);
+	handle->filt.midi_channel = handle->map->map(handle->map->handle, LV2_MIDI__channel);
+	handle->filt.midi_controllerNumber = handle->map->map(handle->map->handle, LV2_MIDI__controllerNumber);
+	handle->filt.midi_noteNumber = handle->map->map(handle->map->handle, LV2_MIDI__noteNumber);
+	handle->filt.midi_velocity = handle->map->map(handle->map->handle, LV2_MIDI__velocity);
+
+	handle->decim.vm_Decimation = handle->map->map(handle->map->handle, VM__Decimation);
+	handle->decim.vm_interval = handle->map->map(handle->map->handle, VM__interval);
+	handle->decim.vm_deadband = handle->map->map(handle->map->handle, VM__deadband);
+	handle->decim.vm_quantized = handle->map->map(handle->map->handle, VM__quantized);
+
+	handle->rate = rate;
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+		handle->sent_t[i] = INT64_MIN / 2; // long ago
+
+	lv2_atom_forge_init(&handle->forge, handle->map);
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+		lv2_atom_forge_init(&handle->forgs[i].forge, handle->map);
+
+	vm_api_init(handle->api, handle->map);
+	timely_init(&handle->timely, handle->map, rate, 0, _cb, handle);
+
+	const int nprops = handle->vm_plug == VM_PLUG_MIDI
+		? MAX_NPROPS
+		: handle->vm_plug == VM_PLUG_ATOM
+			? MAX_NPROPS - 2
+			: MAX_NPROPS - 3;
+
+	handle->state.seed = (int64_t)_seed_default(handle);
+	handle->state.budget = VM_SHARE;
+	handle->state.update_rate = VM_UPDATE_RATE;
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		_env_reset(&handle->inenv[i]);
+		_env_reset(&handle->outenv[i]);
+	}
+
+	// props_save sizes its buffer by GRAPH_SIZE, storage starts out inline
+	memcpy(handle->defs, defs, sizeof(defs));
+	handle->graph = handle->state.graph;
+	handle->graph_rev = 1;
+
+	if(!props_init(&handle->props, descriptor->URI,
+		handle->defs, nprops,
+		&handle->state, &handle->stash, handle->map, handle))
+	{
+		fprintf(stderr, "props_init failed\n");
+		free(handle);
+		return NULL;
+	}
+
+	handle->defs[0].max_size = GRAPH_PRE;
+
+	props_dyn(&handle->props, &dyn);
+
+	handle->vm_overruns = props_map(&handle->props, VM__overruns);
+
+	vm_rand_seed(&handle->rand, handle->state.seed);
+
+	handle->exec = &handle->execs[0];
+
+	for(unsigned i = 0; i < 2; i++)
+	{
+		if(!_exec_reserve(&handle->execs[i], ITEMS_PRE))
+		{
+			fprintf(stderr, "_exec_reserve failed\n");
+			vm_arena_deinit(&handle->execs[0].arena);
+			vm_arena_deinit(&handle->execs[1].arena);
+			free(handle);
+			return NULL;
+		}
+	}
+
+#if defined(VM_JIT)
+	if( (!vm_jit_init(&handle->execs[0].jit) || !vm_jit_init(&handle->execs[1].jit))
+		&& handle->log)
+		lv2_log_note(&handle->logger, "JIT not available, using interpreter\n");
+#endif
+
+	handle->needs_recalc = true;
+
+	return handle;
+}
+
+static void
+connect_port(LV2_Handle instance, uint32_t port, void *data)
+{
+	plughandle_t *handle = instance;
+
+	switch(port)
+	{
+		case 0:
+			handle->control = data;
+			break;
+		case 1:
+			handle->notify = data;
+			break;
+		case 2:
+		case 3:
+		case 4:
+		case 5:
+		case 6:
+		case 7:
+		case 8:
+		case 9:
+			handle->in[port - 2].flt = data;
+			break;
+		case 10:
+		case 11:
+		case 12:
+		case 13:
+		case 14:
+		case 15:
+		case 16:
+		case 17:
+			handle->out[port - 10].flt = data;
+			break;
+	}
+}
+
+#define CLIP(a, v, b) fmin(fmax(a, v), b)
+
+static inline num_t
+_timely_value(timely_t *timely, vm_opcode_enum_t op)
+{
+	switch(op)
+	{
+		case OP_BAR_BEAT:
+			return TIMELY_BAR_BEAT(timely);
+		case OP_BAR:
+			return TIMELY_BAR(timely);
+		case OP_BEAT:
+		{
+			const num_t bar = TIMELY_BAR(timely);
+			const num_t beats_per_bar = TIMELY_BEATS_PER_BAR(timely);
+			const num_t bar_beat = TIMELY_BAR_BEAT(timely);
+			return bar*beats_per_bar + bar_beat;
+		}
+		case OP_BEAT_UNIT:
+			return TIMELY_BEAT_UNIT(timely);
+		case OP_BPB:
+			return TIMELY_BEATS_PER_BAR(timely);
+		case OP_BPM:
+			return TIMELY_BEATS_PER_MINUTE(timely);
+		case OP_FRAME:
+			return TIMELY_FRAME(timely);
+		case OP_FPS:
+			return TIMELY_FRAMES_PER_SECOND(timely);
+		case OP_SPEED:
+			return TIMELY_SPEED(timely);
+		default:
+			return 0.0;
+	}
+}
+
+static void
+run_pre(plughandle_t *handle)
+{
+	_store_adopt(handle); // before props_idle copies a restored stash
+
+	if(handle->patched) // let host know to save graph edits
+	{
+		LV2_Atom_Forge_Frame obj_frame;
+
+		if(handle->ref)
+			handle->ref = lv2_atom_forge_frame_time(&handle->forge, 0);
+		if(handle->ref)
+			handle->ref = lv2_atom_forge_object(&handle->forge, &obj_frame, 0,
+				handle->props.urid.state_StateChanged);
+		if(handle->ref)
+			lv2_atom_forge_pop(&handle->forge, &obj_frame);
+
+		handle->patched = false;
+	}
+
+	if(handle->resync) // with revision indices of further patches refer to
+	{
+		props_impl_t *impl = _props_impl_get(&handle->props, handle->vm_graph);
+
+		if(impl && handle->ref)
+			handle->ref = _props_patch_set(&handle->props, &handle->forge, 0, impl,
+				handle->graph_rev);
+
+		if(handle->ref)
+			handle->resync = false;
+	}
+}
+
+// batch port values changed since last notification, at most at update rate
+static void
+_notify(plughandle_t *handle, uint32_t frames)
+{
+	const int64_t now = handle->off + frames + 1;
+
+	if(now < handle->notify_due)
+		return;
+
+	const float update_rate = handle->state.update_rate;
+	const bool has_env = (handle->vm_plug == VM_PLUG_CV)
+		|| (handle->vm_plug == VM_PLUG_AUDIO);
+	const unsigned nsecs = has_env ? NOTIFY_ENV_MAX : NOTIFY_MIN;
+	float vals [NOTIFY_ENV_MAX][CTRL_MAX*2];
+	uint32_t dirty = 0;
+
+	handle->notify_due = (update_rate > 0.f)
+		? now + (int64_t)(handle->rate / update_rate)
+		: now;
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		vals[NOTIFY_LAST][i] = handle->inm[i];
+		vals[NOTIFY_LAST][CTRL_MAX + i] = handle->outm[i];
+
+		if(handle->inf[i]) // port needs notification
+			dirty |= 1U << i;
+		if(handle->outf[i])
+			dirty |= 1U << (CTRL_MAX + i);
+
+		handle->inf[i] = false;
+		handle->outf[i] = false;
+	}
+
+	for(unsigned j = 0; has_env && (j < CTRL_MAX*2); j++)
+	{
+		vm_env_t *env = (j < CTRL_MAX) ? &handle->inenv[j] : &handle->outenv[j - CTRL_MAX];
+
+		if(env->count)
+		{
+			vals[NOTIFY_MIN][j] = env->min;
+			vals[NOTIFY_MAX][j] = env->max;
+			vals[NOTIFY_RMS][j] = sqrt(env->sum2 / env->count);
+		}
+		else
+		{
+			const float last = vals[NOTIFY_LAST][j];
+
+			vals[NOTIFY_MIN][j] = last;
+			vals[NOTIFY_MAX][j] = last;
+			vals[NOTIFY_RMS][j] = fabsf(last);
+		}
+
+		_env_reset(env);
+	}
+
+	LV2_Atom_Forge_Frame tup_frame;
+	if(handle->ref)
+		handle->ref = lv2_atom_forge_frame_time(&handle->forge, frames);
+	if(handle->ref)
+		handle->ref = lv2_atom_forge_tuple(&handle->forge, &tup_frame);
+	if(handle->ref)
+		handle->ref = lv2_atom_forge_long(&handle->forge, handle->off);
+	if(handle->ref)
+		handle->ref = lv2_atom_forge_int(&handle->forge, dirty);
+	if(handle->ref)
+		handle->ref = lv2_atom_forge_vector(&handle->forge, sizeof(float),
+			handle->forge.Float, nsecs*CTRL_MAX*2, vals);
+	if(handle->ref)
+		lv2_atom_forge_pop(&handle->forge, &tup_frame);
+}
+
+static void
+run_post(plughandle_t *handle, uint32_t frames)
+{
+	_notify(handle, frames);
+
+	// only one compilation in flight, retried once worker has responded
+	if(handle->pending && !handle->busy)
+		_graph_schedule(handle);
+
+	if(handle->overrun) // program was cut off
+	{
+		props_set(&handle->props, &handle->forge, frames, handle->vm_overruns,
+			&handle->ref);
+
+		handle->overrun = false;
+	}
+}
+
+static LV2_Atom_Forge_Ref
+send_chunk(LV2_Atom_Forge *forge, uint32_t frames, LV2_URID type,
+	const uint8_t *msg, uint32_t sz)
+{
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_frame_time(forge, frames);
+	if(ref)
+		ref = lv2_atom_forge_atom(forge, sz, type);
+	if(ref)
+		ref = lv2_atom_forge_write(forge, msg, sz);
+
+	return ref;
+}
+
+#if defined(VM_DISPATCH_THREADED)
+#	define VM_CASE(OP) lbl_##OP
+#	define VM_LABEL(OP) [OP] = &&lbl_##OP
+#	define VM_BREAK \
+		if(pc >= prog->ninst) \
+			goto done; \
+		inst = &prog->inst[pc++]; \
+		sp = &handle->stack.slots[inst->ptr]; \
+		goto *dispatch[inst->op]
+#	define VM_SWITCH \
+		VM_BREAK;
+#	define VM_SWITCH_END \
+	done:
+#else
+#	define VM_CASE(OP) case OP
+#	define VM_BREAK break
+#	define VM_SWITCH \
+	while(pc < prog->ninst) \
+	{ \
+		inst = &prog->inst[pc++]; \
+		sp = &handle->stack.slots[inst->ptr]; \
+		switch(inst->op) \
+		{
+#	define VM_SWITCH_END \
+		} \
+	}
+#endif
+
+// verified programs address the stack at fixed offsets, others as ring
+#define VM_POP() \
+	(fixed ? *sp++ : _stack_pop(&handle->stack))
+#define VM_PEEK() \
+	(fixed ? *sp : _stack_peek(&handle->stack))
+#define VM_PUSH(VAL) \
+	do { \
+		if(fixed) \
+			*--sp = (VAL); \
+		else \
+			_stack_push(&handle->stack, (VAL)); \
+	} while(0)
+#define VM_POP_NUM(VAL, NUM) \
+	do { \
+		if(fixed) \
+		{ \
+			for(int j = 0; j < (NUM); j++) \
+				(VAL)[j] = *sp++; \
+		} \
+		else \
+			_stack_pop_num(&handle->stack, (VAL), (NUM)); \
+	} while(0)
+#define VM_PUSH_NUM(VAL, NUM) \
+	do { \
+		if(fixed) \
+		{ \
+			for(int j = 0; j < (NUM); j++) \
+				sp[-j - 1] = (VAL)[j]; \
+			sp -= (NUM); \
+		} \
+		else \
+			_stack_push_num(&handle->stack, (VAL), (NUM)); \
+	} while(0)
+
+static inline void
+_overrun(plughandle_t *handle)
+{
+	handle->state.overruns += 1;
+	handle->overrun = true;
+}
+
+// backward jumps draw on budget, false and counted as overrun once exhausted
+static inline bool
+_budget_charge(plughandle_t *handle, uint32_t *budget, uint32_t cost)
+{
+	if(*budget < cost)
+	{
+		_overrun(handle);
+		return false;
+	}
+
+	*budget -= cost;
+	return true;
+}
+
+#if defined(VM_DISPATCH_THREADED)
+#	pragma GCC diagnostic push
+#	pragma GCC diagnostic ignored "-Wpedantic" // labels as values
+#endif
+
+// leaves the outputs on the stack
+static void
+_run_prog(plughandle_t *handle, const vm_prog_t *prog)
+{
+	const bool fixed = prog->verified;
+	const vm_inst_t *inst;
+	num_t *sp;
+	uint32_t pc = 0;
+	uint32_t budget = VM_BUDGET;
+
+#if defined(VM_DISPATCH_THREADED)
+	static const void *const dispatch [INST_MAX] = {
+		VM_LABEL(OP_NOP),
+
+		VM_LABEL(OP_CTRL),
+		VM_LABEL(OP_PUSH),
+		VM_LABEL(OP_POP),
+		VM_LABEL(OP_SWAP),
+		VM_LABEL(OP_STORE),
+		VM_LABEL(OP_LOAD),
+		VM_LABEL(OP_BREAK),
+		VM_LABEL(OP_GOTO),
+
+		VM_LABEL(OP_RAND),
+
+		VM_LABEL(OP_ADD),
+		VM_LABEL(OP_SUB),
+		VM_LABEL(OP_MUL),
+		VM_LABEL(OP_DIV),
+		VM_LABEL(OP_MOD),
+		VM_LABEL(OP_POW),
+
+		VM_LABEL(OP_NEG),
+		VM_LABEL(OP_ABS),
+		VM_LABEL(OP_SQRT),
+		VM_LABEL(OP_CBRT),
+
+		VM_LABEL(OP_FLOOR),
+		VM_LABEL(OP_CEIL),
+		VM_LABEL(OP_ROUND),
+		VM_LABEL(OP_RINT),
+		VM_LABEL(OP_TRUNC),
+		VM_LABEL(OP_MODF),
+
+		VM_LABEL(OP_EXP),
+		VM_LABEL(OP_EXP_2),
+		VM_LABEL(OP_LD_EXP),
+		VM_LABEL(OP_FR_EXP),
+		VM_LABEL(OP_LOG),
+		VM_LABEL(OP_LOG_2),
+		VM_LABEL(OP_LOG_10),
+
+		VM_LABEL(OP_PI),
+		VM_LABEL(OP_SIN),
+		VM_LABEL(OP_COS),
+		VM_LABEL(OP_TAN),
+		VM_LABEL(OP_ASIN),
+		VM_LABEL(OP_ACOS),
+		VM_LABEL(OP_ATAN),
+		VM_LABEL(OP_ATAN2),
+		VM_LABEL(OP_SINH),
+		VM_LABEL(OP_COSH),
+		VM_LABEL(OP_TANH),
+		VM_LABEL(OP_ASINH),
+		VM_LABEL(OP_ACOSH),
+		VM_LABEL(OP_ATANH),
+
+		VM_LABEL(OP_EQ),
+		VM_LABEL(OP_LT),
+		VM_LABEL(OP_GT),
+		VM_LABEL(OP_LE),
+		VM_LABEL(OP_GE),
+		VM_LABEL(OP_TER),
+		VM_LABEL(OP_MINI),
+		VM_LABEL(OP_MAXI),
+
+		VM_LABEL(OP_AND),
+		VM_LABEL(OP_OR),
+		VM_LABEL(OP_NOT),
+
+		VM_LABEL(OP_BAND),
+		VM_LABEL(OP_BOR),
+		VM_LABEL(OP_BNOT),
+		VM_LABEL(OP_LSHIFT),
+		VM_LABEL(OP_RSHIFT),
+
+		VM_LABEL(OP_BAR_BEAT),
+		VM_LABEL(OP_BAR),
+		VM_LABEL(OP_BEAT),
+		VM_LABEL(OP_BEAT_UNIT),
+		VM_LABEL(OP_BPB),
+		VM_LABEL(OP_BPM),
+		VM_LABEL(OP_FRAME),
+		VM_LABEL(OP_FPS),
+		VM_LABEL(OP_SPEED),
+
+		VM_LABEL(INST_IMM),
+		VM_LABEL(INST_JMP),
+		VM_LABEL(INST_HLOAD),
+		VM_LABEL(INST_HSAVE),
+		VM_LABEL(INST_SKIP)
+	};
+#endif
+
+	_stack_clear(&handle->stack);
+	sp = handle->stack.slots;
+
+	VM_SWITCH
+		VM_CASE(INST_IMM):
+		{
+			VM_PUSH(inst->imm);
+		} VM_BREAK;
+		VM_CASE(INST_HLOAD):
+		{
+			VM_PUSH(handle->stack.regs[REG_MAX + inst->target]);
+		} VM_BREAK;
+		VM_CASE(INST_HSAVE):
+		{
+			const int idx = handle->stack.ptr + (int)inst->imm;
+			handle->stack.regs[REG_MAX + inst->target] = fixed
+				? sp[(int)inst->imm]
+				: handle->stack.slots[idx & SLOT_MASK];
+		} VM_BREAK;
+		VM_CASE(INST_SKIP):
+		{
+			if(fixed)
+				sp += inst->npops - inst->npushs;
+			else
+				handle->stack.ptr = (handle->stack.ptr + inst->npops - inst->npushs) & SLOT_MASK;
+		} VM_BREAK;
+		VM_CASE(INST_JMP):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			if(ab[0])
+			{
+				pc = ( (inst->target >= pc) || _budget_charge(handle, &budget, pc - inst->target) )
+					? inst->target
+					: prog->ninst; // cut off
+			}
+		} VM_BREAK;
+
+		VM_CASE(OP_CTRL):
+		{
+			const int idx = floor(VM_POP());
+			const num_t c = handle->in0[idx & CTRL_MASK];
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_PUSH):
+		{
+			const num_t c = VM_PEEK();
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_POP):
+		{
+			const num_t c = VM_POP();
+			(void)c;
+		} VM_BREAK;
+		VM_CASE(OP_SWAP):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			VM_PUSH_NUM(ab, 2);
+		} VM_BREAK;
+		VM_CASE(OP_STORE):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const int idx = floorf(ab[0]);
+			handle->stack.regs[idx & REG_MASK] = ab[1];
+		} VM_BREAK;
+		VM_CASE(OP_LOAD):
+		{
+			const num_t a = VM_POP();
+			const int idx = floorf(a);
+			const num_t c = handle->stack.regs[idx & REG_MASK];
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_BREAK):
+		{
+			const bool a = VM_POP();
+			if(a)
+				pc = prog->ninst;
+		} VM_BREAK;
+		VM_CASE(OP_GOTO):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			if(ab[0])
+			{
+				const int idx = ab[1];
+				const uint32_t target = idx & prog->wrap;
+
+				pc = ( (target >= pc) || _budget_charge(handle, &budget, pc - target) )
+					? target
+					: prog->ninst; // cut off
+			}
+		} VM_BREAK;
+
+		VM_CASE(OP_RAND):
+		{
+			const num_t c = vm_rand_next(&handle->rand);
+			VM_PUSH(c);
+		} VM_BREAK;
+
+		VM_CASE(OP_ADD):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const num_t c = ab[1] + ab[0];
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_SUB):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const num_t c = ab[1] - ab[0];
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_MUL):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const num_t c = ab[1] * ab[0];
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_DIV):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const num_t c = ab[0] == 0.0
+				? 0.0
+				: ab[1] / ab[0];
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_MOD):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const num_t c = ab[0] == 0.0
+				? 0.0
+				: fmod(ab[1], ab[0]);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_POW):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const num_t c = pow(ab[1], ab[0]);
+			VM_PUSH(c);
+		} VM_BREAK;
+
+		VM_CASE(OP_NEG):
+		{
+			const num_t a = VM_POP();
+			const num_t c = -a;
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_ABS):
+		{
+			const num_t a = VM_POP();
+			const num_t c = fabs(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_SQRT):
+		{
+			const num_t a = VM_POP();
+			const num_t c = sqrt(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_CBRT):
+		{
+			const num_t a = VM_POP();
+			const num_t c = cbrt(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+
+		VM_CASE(OP_FLOOR):
+		{
+			const num_t a = VM_POP();
+			const num_t c = floor(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_CEIL):
+		{
+			const num_t a = VM_POP();
+			const num_t c = ceil(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_ROUND):
+		{
+			const num_t a = VM_POP();
+			const num_t c = round(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_RINT):
+		{
+			const num_t a = VM_POP();
+			const num_t c = rint(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_TRUNC):
+		{
+			const num_t a = VM_POP();
+			const num_t c = trunc(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_MODF):
+		{
+			const num_t a = VM_POP();
+			num_t d;
+			const num_t c = modf(a, &d);
+			VM_PUSH(c);
+			VM_PUSH(d);
+		} VM_BREAK;
+
+		VM_CASE(OP_EXP):
+		{
+			const num_t a = VM_POP();
+			const num_t c = exp(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_EXP_2):
+		{
+			const num_t a = VM_POP();
+			const num_t c = exp2(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_LD_EXP):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const num_t c = ldexp(ab[1], ab[0]);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_FR_EXP):
+		{
+			const num_t a = VM_POP();
+			int d;
+			const num_t c = frexp(a, &d);
+			VM_PUSH(c);
+			VM_PUSH(d);
+		} VM_BREAK;
+		VM_CASE(OP_LOG):
+		{
+			const num_t a = VM_POP();
+			const num_t c = log(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_LOG_2):
+		{
+			const num_t a = VM_POP();
+			const num_t c = log2(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_LOG_10):
+		{
+			const num_t a = VM_POP();
+			const num_t c = log10(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+
+		VM_CASE(OP_PI):
+		{
+			num_t c = M_PI;
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_SIN):
+		{
+			const num_t a = VM_POP();
+			const num_t c = sin(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_COS):
+		{
+			const num_t a = VM_POP();
+			const num_t c = cos(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_TAN):
+		{
+			const num_t a = VM_POP();
+			const num_t c = tan(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_ASIN):
+		{
+			const num_t a = VM_POP();
+			const num_t c = asin(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_ACOS):
+		{
+			const num_t a = VM_POP();
+			const num_t c = acos(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_ATAN):
+		{
+			const num_t a = VM_POP();
+			const num_t c = atan(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_ATAN2):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const num_t c = atan2(ab[1], ab[0]);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_SINH):
+		{
+			const num_t a = VM_POP();
+			const num_t c = sinh(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_COSH):
+		{
+			const num_t a = VM_POP();
+			const num_t c = cosh(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_TANH):
+		{
+			const num_t a = VM_POP();
+			const num_t c = tanh(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_ASINH):
+		{
+			const num_t a = VM_POP();
+			const num_t c = asinh(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_ACOSH):
+		{
+			const num_t a = VM_POP();
+			const num_t c = acosh(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_ATANH):
+		{
+			const num_t a = VM_POP();
+			const num_t c = atanh(a);
+			VM_PUSH(c);
+		} VM_BREAK;
+
+		VM_CASE(OP_EQ):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const bool c = ab[1] == ab[0];
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_LT):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const bool c = ab[1] < ab[0];
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_GT):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const bool c = ab[1] > ab[0];
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_LE):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const bool c = ab[1] <= ab[0];
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_GE):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const bool c = ab[1] >= ab[0];
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_TER):
+		{
+			num_t ab [3];
+			VM_POP_NUM(ab, 3);
+			const bool c = ab[0];
+			VM_PUSH(c ? ab[2] : ab[1]);
+		} VM_BREAK;
+		VM_CASE(OP_MINI):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const num_t c = vm_mini(ab[1], ab[0]);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_MAXI):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const num_t c = vm_maxi(ab[1], ab[0]);
+			VM_PUSH(c);
+		} VM_BREAK;
+
+		VM_CASE(OP_AND):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const bool c = ab[1] && ab[0];
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_OR):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const bool c = ab[1] || ab[0];
+			VM_PUSH(c);
+		} VM_BREAK;
+
+		VM_CASE(OP_NOT):
+		{
+			const int a = VM_POP();
+			const bool c = !a;
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_BAND):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const unsigned a = ab[1];
+			const unsigned b = ab[0];
+			const unsigned c = a & b;
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_BOR):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const unsigned a = ab[1];
+			const unsigned b = ab[0];
+			const unsigned c = a | b;
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_BNOT):
+		{
+			const unsigned a = VM_POP();
+			const unsigned c = ~a;
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_LSHIFT):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const unsigned a = ab[1];
+			const unsigned b = ab[0];
+			const unsigned c = a <<  b;
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_RSHIFT):
+		{
+			num_t ab [2];
+			VM_POP_NUM(ab, 2);
+			const unsigned a = ab[1];
+			const unsigned b = ab[0];
+			const unsigned c = a >>  b;
+			VM_PUSH(c);
+		} VM_BREAK;
+
+		// time
+		VM_CASE(OP_BAR_BEAT):
+		{
+			const num_t c = TIMELY_BAR_BEAT(&handle->timely);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_BAR):
+		{
+			const num_t c = TIMELY_BAR(&handle->timely);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_BEAT):
+		{
+			const num_t bar = TIMELY_BAR(&handle->timely);
+			const num_t beats_per_bar = TIMELY_BEATS_PER_BAR(&handle->timely);
+			const num_t bar_beat = TIMELY_BAR_BEAT(&handle->timely);
+			const num_t c = bar*beats_per_bar + bar_beat;
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_BEAT_UNIT):
+		{
+			const num_t c = TIMELY_BEAT_UNIT(&handle->timely);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_BPB):
+		{
+			const num_t c = TIMELY_BEATS_PER_BAR(&handle->timely);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_BPM):
+		{
+			const num_t c = TIMELY_BEATS_PER_MINUTE(&handle->timely);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_FRAME):
+		{
+			const num_t c = TIMELY_FRAME(&handle->timely);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_FPS):
+		{
+			const num_t c = TIMELY_FRAMES_PER_SECOND(&handle->timely);
+			VM_PUSH(c);
+		} VM_BREAK;
+		VM_CASE(OP_SPEED):
+		{
+			const num_t c = TIMELY_SPEED(&handle->timely);
+			VM_PUSH(c);
+		} VM_BREAK;
+
+		VM_CASE(OP_NOP):
+		{
+			// no operation
+		} VM_BREAK;
+	VM_SWITCH_END
+
+	if(fixed) // hand outputs over at ring position
+	{
+		const int top = sp - handle->stack.slots;
+		num_t out [CTRL_MAX];
+
+		for(unsigned i = 0; i < CTRL_MAX; i++) // cut off loops may end near top
+			out[i] = handle->stack.slots[(top + i) & SLOT_MASK];
+		handle->stack.ptr = (top - prog->base) & SLOT_MASK;
+
+		for(unsigned i = 0; i < CTRL_MAX; i++)
+			handle->stack.slots[(handle->stack.ptr + i) & SLOT_MASK] = out[i];
+	}
+}
+
+#define VM_IR_SRC(J) v[inst->src[(J)]]
+#define VM_IR_DST(J) v[inst->dst[(J)]]
+
+// register IR counterpart of _run_prog, outputs bypass the stack
+static void
+_run_ir(plughandle_t *handle, const vm_ir_t *ir, num_t *out0)
+{
+	num_t v [IR_VALS_MAX];
+	uint32_t pc = 0;
+
+	v[IR_ZERO] = 0.0;
+
+	while(pc < ir->ninst)
+	{
+		const vm_ir_inst_t *inst = &ir->inst[pc++];
+
+		switch(inst->op)
+		{
+			case INST_IMM:
+			{
+				VM_IR_DST(0) = inst->imm;
+			} break;
+			case INST_HLOAD:
+			{
+				VM_IR_DST(0) = handle->stack.regs[REG_MAX + inst->target];
+			} break;
+			case INST_HSAVE:
+			{
+				handle->stack.regs[REG_MAX + inst->target] = VM_IR_SRC(0);
+			} break;
+			case IR_MOVE:
+			{
+				VM_IR_DST(0) = VM_IR_SRC(0);
+			} break;
+			case IR_JMP:
+			{
+				pc = inst->target;
+			} break;
+			case IR_JMP_IF:
+			{
+				if(VM_IR_SRC(0))
+					pc = inst->target;
+			} break;
+			case IR_JMP_NOT:
+			{
+				if(!VM_IR_SRC(0))
+					pc = inst->target;
+			} break;
+
+			case IR_CTRL_K:
+			{
+				VM_IR_DST(0) = handle->in0[inst->target];
+			} break;
+			case IR_MADD:
+			{
+				VM_IR_DST(0) = fma(VM_IR_SRC(1), VM_IR_SRC(0), VM_IR_SRC(2));
+			} break;
+			case IR_MINI_MAXI:
+			{
+				const num_t a = vm_maxi(VM_IR_SRC(1), VM_IR_SRC(0));
+				VM_IR_DST(0) = vm_mini(a, VM_IR_SRC(2));
+			} break;
+			case IR_MAXI_MINI:
+			{
+				const num_t a = vm_mini(VM_IR_SRC(1), VM_IR_SRC(0));
+				VM_IR_DST(0) = vm_maxi(a, VM_IR_SRC(2));
+			} break;
+			case IR_SEL_EQ:
+			{
+				const bool c = VM_IR_SRC(1) == VM_IR_SRC(0);
+				VM_IR_DST(0) = c ? VM_IR_SRC(3) : VM_IR_SRC(2);
+			} break;
+			case IR_SEL_LT:
+			{
+				const bool c = VM_IR_SRC(1) < VM_IR_SRC(0);
+				VM_IR_DST(0) = c ? VM_IR_SRC(3) : VM_IR_SRC(2);
+			} break;
+			case IR_SEL_GT:
+			{
+				const bool c = VM_IR_SRC(1) > VM_IR_SRC(0);
+				VM_IR_DST(0) = c ? VM_IR_SRC(3) : VM_IR_SRC(2);
+			} break;
+			case IR_SEL_LE:
+			{
+				const bool c = VM_IR_SRC(1) <= VM_IR_SRC(0);
+				VM_IR_DST(0) = c ? VM_IR_SRC(3) : VM_IR_SRC(2);
+			} break;
+			case IR_SEL_GE:
+			{
+				const bool c = VM_IR_SRC(1) >= VM_IR_SRC(0);
+				VM_IR_DST(0) = c ? VM_IR_SRC(3) : VM_IR_SRC(2);
+			} break;
+
+			case OP_CTRL:
+			{
+				const int idx = floor(VM_IR_SRC(0));
+				VM_IR_DST(0) = handle->in0[idx & CTRL_MASK];
+			} break;
+			case OP_STORE:
+			{
+				const int idx = floorf(VM_IR_SRC(0));
+				handle->stack.regs[idx & REG_MASK] = VM_IR_SRC(1);
+			} break;
+			case OP_LOAD:
+			{
+				const int idx = floorf(VM_IR_SRC(0));
+				VM_IR_DST(0) = handle->stack.regs[idx & REG_MASK];
+			} break;
+
+			case OP_RAND:
+			{
+				VM_IR_DST(0) = vm_rand_next(&handle->rand);
+			} break;
+
+			case OP_ADD:
+			{
+				VM_IR_DST(0) = VM_IR_SRC(1) + VM_IR_SRC(0);
+			} break;
+			case OP_SUB:
+			{
+				VM_IR_DST(0) = VM_IR_SRC(1) - VM_IR_SRC(0);
+			} break;
+			case OP_MUL:
+			{
+				VM_IR_DST(0) = VM_IR_SRC(1) * VM_IR_SRC(0);
+			} break;
+			case OP_DIV:
+			{
+				VM_IR_DST(0) = VM_IR_SRC(0) == 0.0
+					? 0.0
+					: VM_IR_SRC(1) / VM_IR_SRC(0);
+			} break;
+			case OP_MOD:
+			{
+				VM_IR_DST(0) = VM_IR_SRC(0) == 0.0
+					? 0.0
+					: fmod(VM_IR_SRC(1), VM_IR_SRC(0));
+			} break;
+			case OP_POW:
+			{
+				VM_IR_DST(0) = pow(VM_IR_SRC(1), VM_IR_SRC(0));
+			} break;
+
+			case OP_NEG:
+			{
+				VM_IR_DST(0) = -VM_IR_SRC(0);
+			} break;
+			case OP_ABS:
+			{
+				VM_IR_DST(0) = fabs(VM_IR_SRC(0));
+			} break;
+			case OP_SQRT:
+			{
+				VM_IR_DST(0) = sqrt(VM_IR_SRC(0));
+			} break;
+			case OP_CBRT:
+			{
+				VM_IR_DST(0) = cbrt(VM_IR_SRC(0));
+			} break;
+
+			case OP_FLOOR:
+			{
+				VM_IR_DST(0) = floor(VM_IR_SRC(0));
+			} break;
+			case OP_CEIL:
+			{
+				VM_IR_DST(0) = ceil(VM_IR_SRC(0));
+			} break;
+			case OP_ROUND:
+			{
+				VM_IR_DST(0) = round(VM_IR_SRC(0));
+			} break;
+			case OP_RINT:
+			{
+				VM_IR_DST(0) = rint(VM_IR_SRC(0));
+			} break;
+			case OP_TRUNC:
+			{
+				VM_IR_DST(0) = trunc(VM_IR_SRC(0));
+			} break;
+			case OP_MODF:
+			{
+				num_t d;
+				const num_t c = modf(VM_IR_SRC(0), &d);
+				VM_IR_DST(0) = d;
+				VM_IR_DST(1) = c;
+			} break;
+
+			case OP_EXP:
+			{
+				VM_IR_DST(0) = exp(VM_IR_SRC(0));
+			} break;
+			case OP_EXP_2:
+			{
+				VM_IR_DST(0) = exp2(VM_IR_SRC(0));
+			} break;
+			case OP_LD_EXP:
+			{
+				VM_IR_DST(0) = ldexp(VM_IR_SRC(1), VM_IR_SRC(0));
+			} break;
+			case OP_FR_EXP:
+			{
+				int d;
+				const num_t c = frexp(VM_IR_SRC(0), &d);
+				VM_IR_DST(0) = d;
+				VM_IR_DST(1) = c;
+			} break;
+			case OP_LOG:
+			{
+				VM_IR_DST(0) = log(VM_IR_SRC(0));
+			} break;
+			case OP_LOG_2:
+			{
+				VM_IR_DST(0) = log2(VM_IR_SRC(0));
+			} break;
+			case OP_LOG_10:
+			{
+				VM_IR_DST(0) = log10(VM_IR_SRC(0));
+			} break;
+
+			case OP_PI:
+			{
+				VM_IR_DST(0) = M_PI;
+			} break;
+			case OP_SIN:
+			{
+				VM_IR_DST(0) = sin(VM_IR_SRC(0));
+			} break;
+			case OP_COS:
+			{
+				VM_IR_DST(0) = cos(VM_IR_SRC(0));
+			} break;
+			case OP_TAN:
+			{
+				VM_IR_DST(0) = tan(VM_IR_SRC(0));
+			} break;
+			case OP_ASIN:
+			{
+				VM_IR_DST(0) = asin(VM_IR_SRC(0));
+			} break;
+			case OP_ACOS:
+			{
+				VM_IR_DST(0) = acos(VM_IR_SRC(0));
+			} break;
+			case OP_ATAN:
+			{
+				VM_IR_DST(0) = atan(VM_IR_SRC(0));
+			} break;
+			case OP_ATAN2:
+			{
+				VM_IR_DST(0) = atan2(VM_IR_SRC(1), VM_IR_SRC(0));
+			} break;
+			case OP_SINH:
+			{
+				VM_IR_DST(0) = sinh(VM_IR_SRC(0));
+			} break;
+			case OP_COSH:
+			{
+				VM_IR_DST(0) = cosh(VM_IR_SRC(0));
+			} break;
+			case OP_TANH:
+			{
+				VM_IR_DST(0) = tanh(VM_IR_SRC(0));
+			} break;
+			case OP_ASINH:
+			{
+				VM_IR_DST(0) = asinh(VM_IR_SRC(0));
+			} break;
+			case OP_ACOSH:
+			{
+				VM_IR_DST(0) = acosh(VM_IR_SRC(0));
+			} break;
+			case OP_ATANH:
+			{
+				VM_IR_DST(0) = atanh(VM_IR_SRC(0));
+			} break;
+
+			case OP_EQ:
+			{
+				VM_IR_DST(0) = VM_IR_SRC(1) == VM_IR_SRC(0);
+			} break;
+			case OP_LT:
+			{
+				VM_IR_DST(0) = VM_IR_SRC(1) < VM_IR_SRC(0);
+			} break;
+			case OP_GT:
+			{
+				VM_IR_DST(0) = VM_IR_SRC(1) > VM_IR_SRC(0);
+			} break;
+			case OP_LE:
+			{
+				VM_IR_DST(0) = VM_IR_SRC(1) <= VM_IR_SRC(0);
+			} break;
+			case OP_GE:
+			{
+				VM_IR_DST(0) = VM_IR_SRC(1) >= VM_IR_SRC(0);
+			} break;
+			case OP_TER:
+			{
+				const bool c = VM_IR_SRC(0);
+				VM_IR_DST(0) = c ? VM_IR_SRC(2) : VM_IR_SRC(1);
+			} break;
+			case OP_MINI:
+			{
+				VM_IR_DST(0) = vm_mini(VM_IR_SRC(1), VM_IR_SRC(0));
+			} break;
+			case OP_MAXI:
+			{
+				VM_IR_DST(0) = vm_maxi(VM_IR_SRC(1), VM_IR_SRC(0));
+			} break;
+
+			case OP_AND:
+			{
+				VM_IR_DST(0) = VM_IR_SRC(1) && VM_IR_SRC(0);
+			} break;
+			case OP_OR:
+			{
+				VM_IR_DST(0) = VM_IR_SRC(1) || VM_IR_SRC(0);
+			} break;
+			case OP_NOT:
+			{
+				const int a = VM_IR_SRC(0);
+				VM_IR_DST(0) = !a;
+			} break;
+
+			case OP_BAND:
+			{
+				const unsigned a = VM_IR_SRC(1);
+				const unsigned b = VM_IR_SRC(0);
+				VM_IR_DST(0) = a & b;
+			} break;
+			case OP_BOR:
+			{
+				const unsigned a = VM_IR_SRC(1);
+				const unsigned b = VM_IR_SRC(0);
+				VM_IR_DST(0) = a | b;
+			} break;
+			case OP_BNOT:
+			{
+				const unsigned a = VM_IR_SRC(0);
+				VM_IR_DST(0) = ~a;
+			} break;
+			case OP_LSHIFT:
+			{
+				const unsigned a = VM_IR_SRC(1);
+				const unsigned b = VM_IR_SRC(0);
+				VM_IR_DST(0) = a << b;
+			} break;
+			case OP_RSHIFT:
+			{
+				const unsigned a = VM_IR_SRC(1);
+				const unsigned b = VM_IR_SRC(0);
+				VM_IR_DST(0) = a >> b;
+			} break;
+
+			// time
+			case OP_BAR_BEAT:
+			{
+				VM_IR_DST(0) = TIMELY_BAR_BEAT(&handle->timely);
+			} break;
+			case OP_BAR:
+			{
+				VM_IR_DST(0) = TIMELY_BAR(&handle->timely);
+			} break;
+			case OP_BEAT:
+			{
+				const num_t bar = TIMELY_BAR(&handle->timely);
+				const num_t beats_per_bar = TIMELY_BEATS_PER_BAR(&handle->timely);
+				const num_t bar_beat = TIMELY_BAR_BEAT(&handle->timely);
+				VM_IR_DST(0) = bar*beats_per_bar + bar_beat;
+			} break;
+			case OP_BEAT_UNIT:
+			{
+				VM_IR_DST(0) = TIMELY_BEAT_UNIT(&handle->timely);
+			} break;
+			case OP_BPB:
+			{
+				VM_IR_DST(0) = TIMELY_BEATS_PER_BAR(&handle->timely);
+			} break;
+			case OP_BPM:
+			{
+				VM_IR_DST(0) = TIMELY_BEATS_PER_MINUTE(&handle->timely);
+			} break;
+			case OP_FRAME:
+			{
+				VM_IR_DST(0) = TIMELY_FRAME(&handle->timely);
+			} break;
+			case OP_FPS:
+			{
+				VM_IR_DST(0) = TIMELY_FRAMES_PER_SECOND(&handle->timely);
+			} break;
+			case OP_SPEED:
+			{
+				VM_IR_DST(0) = TIMELY_SPEED(&handle->timely);
+			} break;
+		}
+	}
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+		out0[i] = v[ir->out[i]];
+}
+
+#undef VM_IR_SRC
+#undef VM_IR_DST
+
+static void
+run_prog(plughandle_t *handle)
+{
+	if(handle->exec->ir.enabled)
+	{
+		_run_ir(handle, &handle->exec->ir, handle->out0);
+		return;
+	}
+
+	_run_prog(handle, handle->exec->split ? &handle->exec->timed : &handle->exec->prog);
+	_stack_pop_num(&handle->stack, handle->out0, CTRL_MAX);
+}
+
+// refresh hidden registers of split program from current inputs
+static void
+run_fill(plughandle_t *handle)
+{
+	if(!handle->filled)
+	{
+		_run_prog(handle, &handle->exec->fill);
+		handle->filled = true;
+	}
+}
+
+// only updates the outputs affected by given input
+static void
+run_slice(plughandle_t *handle, unsigned i)
+{
+	num_t out0 [CTRL_MAX];
+
+	_run_prog(handle, &handle->exec->slice[i]);
+	_stack_pop_num(&handle->stack, out0, CTRL_MAX);
+
+	for(unsigned j = 0; j < CTRL_MAX; j++)
+	{
+		if(handle->exec->deps[i] & (1U << j))
+			handle->out0[j] = out0[j];
+	}
+}
+
+#if defined(VM_DISPATCH_THREADED)
+#	pragma GCC diagnostic pop
+#endif
+
+#if defined(VM_JIT)
+static void
+run_jit(plughandle_t *handle)
+{
+	num_t clk [TIME_MAX];
+
+	for(unsigned t = 0; t < TIME_MAX; t++)
+	{
+		if(handle->exec->jit.time & (1U << t))
+			clk[t] = _timely_value(&handle->timely, OP_BAR_BEAT + t);
+	}
+
+	_stack_clear(&handle->stack);
+	const int ptr = handle->exec->jit.fn(handle->stack.slots, handle->stack.regs,
+		handle->in0, clk);
+	if(ptr & VM_JIT_OVERRUN)
+		_overrun(handle);
+	handle->stack.ptr = ptr & SLOT_MASK;
+	_stack_pop_num(&handle->stack, handle->out0, CTRL_MAX);
+}
+#endif
+
+// room for whole events, so a full sequence is never cut mid-event
+static inline bool
+_forge_fits(const LV2_Atom_Forge *forge, uint32_t nevents, uint32_t size)
+{
+	const uint32_t need = nevents * (sizeof(LV2_Atom_Event) + lv2_atom_pad_size(size));
+
+	return forge->offset + need <= forge->size;
+}
+
+static int
+_midi_value(const vm_filter_t *filter, float val)
+{
+	if(filter->type == FILTER_BENDER)
+		return floor(val*0x2000 + 0x1fff);
+
+	return floor(val * 0x7f);
+}
+
+// messages for a new output value, note on also releases the note sent before
+static unsigned
+_midi_msgs(const vm_filter_t *filter, float sent, float out1,
+	uint8_t msgs [2][3], uint32_t sizes [2])
+{
+	const int value = _midi_value(filter, out1);
+
+	switch(filter->type)
+	{
+		case FILTER_CONTROLLER:
+		{
+			msgs[0][0] = LV2_MIDI_MSG_CONTROLLER | filter->channel;
+			msgs[0][1] = filter->value;
+			msgs[0][2] = value;
+			sizes[0] = 3;
+		} return 1;
+		case FILTER_BENDER:
+		{
+			msgs[0][0] = LV2_MIDI_MSG_BENDER | filter->channel;
+			msgs[0][1] = value & 0x7f;
+			msgs[0][2] = value >> 7;
+			sizes[0] = 3;
+		} return 1;
+		case FILTER_PROGRAM_CHANGE:
+		{
+			msgs[0][0] = LV2_MIDI_MSG_PGM_CHANGE | filter->channel;
+			msgs[0][1] = value;
+			sizes[0] = 2;
+		} return 1;
+		case FILTER_CHANNEL_PRESSURE:
+		{
+			msgs[0][0] = LV2_MIDI_MSG_CHANNEL_PRESSURE | filter->channel;
+			msgs[0][1] = value;
+			sizes[0] = 2;
+		} return 1;
+		case FILTER_NOTE_ON:
+		{
+			const int last = _midi_value(filter, sent);
+			unsigned n = 0;
+
+			if(last > 0x0)
+			{
+				msgs[n][0] = LV2_MIDI_MSG_NOTE_OFF | filter->channel;
+				msgs[n][1] = last;
+				msgs[n][2] = 0x0;
+				sizes[n++] = 3;
+			}
+			if(value > 0x0)
+			{
+				msgs[n][0] = LV2_MIDI_MSG_NOTE_ON | filter->channel;
+				msgs[n][1] = value;
+				msgs[n][2] = filter->value;
+				sizes[n++] = 3;
+			}
+
+			return n;
+		}
+		case FILTER_NOTE_PRESSURE:
+		{
+			msgs[0][0] = LV2_MIDI_MSG_NOTE_PRESSURE | filter->channel;
+			msgs[0][1] = filter->value;
+			msgs[0][2] = value;
+			sizes[0] = 3;
+		} return 1;
+		//FIXME handle more types
+
+		case FILTER_MAX:
+		{
+			// nothing
+		}	break;
+	}
+
+	return 0;
+}
+
+static bool
+_decim_differs(plughandle_t *handle, unsigned i, float out1)
+{
+	const vm_decim_t *decim = &handle->decimation[i];
+	const float sent = handle->sent[i];
+
+	if( (out1 == sent) || (fabsf(out1 - sent) < decim->deadband) )
+		return false;
+
+	if(decim->quantized && (handle->vm_plug == VM_PLUG_MIDI))
+	{
+		const vm_filter_t *filter = &handle->destinationFilter[i];
+
+		return _midi_value(filter, out1) != _midi_value(filter, sent);
+	}
+
+	return true;
+}
+
+// earliest frame the next event may go out on an output port
+static inline int64_t
+_decim_due(plughandle_t *handle, unsigned i)
+{
+	return handle->sent_t[i]
+		+ (int64_t)(handle->decimation[i].interval * 1e-3f * handle->rate);
+}
+
+static bool
+_output_send(plughandle_t *handle, unsigned i, uint32_t frames, float out1,
+	forge_t *forg)
+{
+	if(!forg->ref)
+		return false;
+
+	if(handle->vm_plug == VM_PLUG_ATOM)
+	{
+		if(!_forge_fits(&forg->forge, 1, sizeof(float)))
+			return false;
+
+		forg->ref = lv2_atom_forge_frame_time(&forg->forge, frames);
+		if(forg->ref)
+			forg->ref = lv2_atom_forge_float(&forg->forge, out1);
+	}
+	else if(handle->vm_plug == VM_PLUG_MIDI)
+	{
+		uint8_t msgs [2][3];
+		uint32_t sizes [2];
+		const unsigned n = _midi_msgs(&handle->destinationFilter[i],
+			handle->sent[i], out1, msgs, sizes);
+
+		if(!_forge_fits(&forg->forge, n, 3))
+			return false;
+
+		for(unsigned m = 0; (m < n) && forg->ref; m++)
+			forg->ref = send_chunk(&forg->forge, frames, handle->midi_MidiEvent, msgs[m], sizes[m]);
+	}
+
+	return forg->ref != 0;
+}
+
+// thin out events on atom and midi output ports
+static void
+run_output(plughandle_t *handle, unsigned i, uint32_t frames, float out1,
+	forge_t *forg)
+{
+	const uint32_t mask = 1U << i;
+	const int64_t now = handle->off + frames;
+
+	handle->held &= ~mask;
+
+	if(!_decim_differs(handle, i, out1))
+		return;
+
+	if(now < _decim_due(handle, i))
+	{
+		handle->held |= mask; // coalesce into a later event
+		return;
+	}
+
+	if(!_output_send(handle, i, frames, out1, forg))
+	{
+		handle->held |= mask; // keep latest value for next period
+		handle->starved |= mask;
+		return;
+	}
+
+	handle->sent[i] = out1;
+	handle->sent_t[i] = now;
+}
+
+static void
+run_internal(plughandle_t *handle, uint32_t frames,
+	const float *in [CTRL_MAX], float *out [CTRL_MAX], forge_t forgs [CTRL_MAX])
+{
+	uint32_t dirty = 0; // changed inputs
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		const float in1 = (handle->vm_plug == VM_PLUG_AUDIO)
+			? *in[i] // don't clip audio
+			: CLIP(VM_MIN, *in[i], VM_MAX);
+
+		if(handle->in0[i] != in1)
+		{
+			dirty |= 1U << i;
+			handle->in0[i] = in1;
+
+			if(in1 != handle->inm[i])
+			{
+				handle->inm[i] = in1;
+				handle->inf[i] = true; // notify in run_post
+			}
+		}
+	}
+
+	if(handle->exec->prog.status != VM_STATUS_STATIC)
+		handle->needs_recalc = true;
+
+	if(dirty)
+		handle->filled = false;
+
+	if(!handle->needs_recalc && dirty)
+	{
+		uint32_t affected = 0;
+
+		for(unsigned i = 0; i < CTRL_MAX; i++)
+		{
+			if(dirty & (1U << i))
+				affected |= handle->exec->deps[i];
+		}
+
+		if(!(dirty & (dirty - 1)) && (affected != (1U << CTRL_MAX) - 1)
+#if defined(VM_JIT)
+			&& !handle->exec->jit.fn // native code beats sliced interpretation
+#endif
+			)
+		{
+			if(affected) // single input with partial effect
+				run_slice(handle, __builtin_ctz(dirty));
+		}
+		else if(affected)
+		{
+			handle->needs_recalc = true;
+		}
+	}
+
+	if(handle->needs_recalc)
+	{
+		if(handle->exec->split)
+			run_fill(handle);
+
+#if defined(VM_JIT)
+		if(handle->exec->jit.fn)
+			run_jit(handle);
+		else
+#endif
+			run_prog(handle);
+		handle->needs_recalc = false;
+	}
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		const float out1 = (handle->vm_plug == VM_PLUG_AUDIO)
+			? handle->out0[i] // don't clip audio
+			: CLIP(VM_MIN, handle->out0[i], VM_MAX);
+
+		// send changes and held back values on atom and midi output ports
+		if(forgs && ( (*out[i] != out1) || (handle->held & (1U << i)) ) )
+			run_output(handle, i, frames, out1, &forgs[i]);
+
+		if(*out[i] != out1)
+		{
+			*out[i] = out1;
+
+			if(out1 != handle->outm[i])
+			{
+				handle->outm[i] = out1;
+				handle->outf[i] = true; // notify out run_post
+			}
+		}
+	}
+}
+
+static void
+run_control(LV2_Handle instance, uint32_t nsamples)
+{
+	plughandle_t *handle = instance;
+
+	const uint32_t capacity = handle->notify->atom.size;
+	LV2_Atom_Forge_Frame frame;
+	lv2_atom_forge_set_buffer(&handle->forge, (uint8_t *)handle->notify, capacity);
+	handle->ref = lv2_atom_forge_sequence_head(&handle->forge, &frame, 0);
+
+	run_pre(handle);
+	props_idle(&handle->props, &handle->forge, 0, &handle->ref);
+
+	int64_t last_t = 0;
+	LV2_ATOM_SEQUENCE_FOREACH(handle->control, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+		_control_advance(handle, ev->time.frames, obj);
+		timely_advance(&handle->timely, obj, last_t, ev->time.frames);
+
+		last_t = ev->time.frames;
+	}
+	timely_advance(&handle->timely, NULL, last_t, nsamples);
+
+	// run once at end of period for controls
+	{
+		const float *in [CTRL_MAX ] = {
+			handle->in[0].flt,
+			handle->in[1].flt,
+			handle->in[2].flt,
+			handle->in[3].flt,
+			handle->in[4].flt,
+			handle->in[5].flt,
+			handle->in[6].flt,
+			handle->in[7].flt
+		};
+
+		float *out [CTRL_MAX ] = {
+			handle->out[0].flt,
+			handle->out[1].flt,
+			handle->out[2].flt,
+			handle->out[3].flt,
+			handle->out[4].flt,
+			handle->out[5].flt,
+			handle->out[6].flt,
+			handle->out[7].flt
+		};
+
+		run_internal(handle, nsamples -1, in, out, NULL);
+	}
+
+	run_post(handle, nsamples - 1);
+
+	if(handle->ref)
+		lv2_atom_forge_pop(&handle->forge, &frame);
+	else
+		lv2_atom_sequence_clear(handle->notify);
+
+	handle->off += nsamples;
+}
+
+// x: second topmost value, y: topmost value
+#define BLOCK_UNARY(EXPR) \
+	for(unsigned f = 0; f < n; f++) \
+	{ \
+		const num_t y = a[f]; \
+		a[f] = (EXPR); \
+	}
+
+#define BLOCK_BINARY(EXPR) \
+	for(unsigned f = 0; f < n; f++) \
+	{ \
+		const num_t x = b[f]; \
+		const num_t y = a[f]; \
+		b[f] = (EXPR); \
+	}
+
+#define BLOCK_CONST(EXPR) \
+	for(unsigned f = 0; f < n; f++) \
+		d[f] = (EXPR);
+
+static inline void
+_block_spread(vm_block_t *block, uint32_t mask, unsigned n)
+{
+	for(unsigned j = 0; mask; j++, mask >>= 1)
+	{
+		if(!(mask & 1))
+			continue;
+
+		num_t *slot = block->slots[j];
+
+		for(unsigned f = 1; f < n; f++)
+			slot[f] = slot[0];
+	}
+}
+
+static void
+run_block_internal(plughandle_t *handle, const vm_prog_t *prog,
+	const vm_layout_t *layout, unsigned nframes)
+{
+	vm_block_t *block = &handle->exec->block;
+	num_t *regs = handle->stack.regs;
+
+	for(unsigned j = 0; j < SLOT_MAX; j++)
+	{
+		if(layout->zero & (1U << j))
+			memset(block->slots[j], 0x0, nframes*sizeof(num_t));
+	}
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		const vm_inst_t *inst = &prog->inst[i];
+		const int ptr = layout->ptr[i];
+		const unsigned n = layout->once[i] ? 1 : nframes;
+
+		if(layout->spread[i])
+			_block_spread(block, layout->spread[i], nframes);
+
+		num_t *a = block->slots[ptr]; // topmost
+		num_t *b = block->slots[(ptr + 1) & SLOT_MASK];
+		num_t *c = block->slots[(ptr + 2) & SLOT_MASK];
+		num_t *d = block->slots[(ptr - 1) & SLOT_MASK]; // to be pushed
+
+		switch(inst->op)
+		{
+			case INST_IMM:
+			{
+				const num_t v = inst->imm;
+				BLOCK_CONST(v);
+			} break;
+			case INST_HLOAD:
+			{
+				const num_t v = regs[REG_MAX + inst->target];
+				BLOCK_CONST(v);
+			} break;
+			case INST_HSAVE:
+			case INST_SKIP:
+			{
+				// only in fill program
+			} break;
+
+			case OP_CTRL:
+			{
+				for(unsigned f = 0; f < n; f++)
+				{
+					const int idx = floor(a[f]);
+					a[f] = block->in[idx & CTRL_MASK][f];
+				}
+			} break;
+			case OP_PUSH:
+			{
+				BLOCK_CONST(a[f]);
+			} break;
+			case OP_POP:
+			{
+				// nothing
+			} break;
+			case OP_SWAP:
+			{
+				for(unsigned f = 0; f < n; f++)
+				{
+					const num_t y = a[f];
+					a[f] = b[f];
+					b[f] = y;
+				}
+			} break;
+			case OP_STORE:
+			{
+				for(unsigned f = 0; f < n; f++)
+				{
+					const int idx = floorf(a[f]);
+					regs[idx & REG_MASK] = b[f];
+				}
+			} break;
+			case OP_LOAD:
+			{
+				for(unsigned f = 0; f < n; f++)
+				{
+					const int idx = floorf(a[f]);
+					a[f] = regs[idx & REG_MASK];
+				}
+			} break;
+			case OP_BREAK:
+			case OP_GOTO:
+			{
+				// not handled block-wise
+			} break;
+
+			case OP_RAND:
+			{
+				vm_rand_fill(&handle->rand, d, n);
+			} break;
+
+			case OP_ADD:
+			{
+				BLOCK_BINARY(x + y);
+			} break;
+			case OP_SUB:
+			{
+				BLOCK_BINARY(x - y);
+			} break;
+			case OP_MUL:
+			{
+				BLOCK_BINARY(x * y);
+			} break;
+			case OP_DIV:
+			{
+				BLOCK_BINARY(y == 0.0 ? 0.0 : x / y);
+			} break;
+			case OP_MOD:
+			{
+				BLOCK_BINARY(y == 0.0 ? 0.0 : fmod(x, y));
+			} break;
+			case OP_POW:
+			{
+				BLOCK_BINARY(pow(x, y));
+			} break;
+
+			case OP_NEG:
+			{
+				BLOCK_UNARY(-y);
+			} break;
+			case OP_ABS:
+			{
+				BLOCK_UNARY(fabs(y));
+			} break;
+			case OP_SQRT:
+			{
+				BLOCK_UNARY(sqrt(y));
+			} break;
+			case OP_CBRT:
+			{
+				BLOCK_UNARY(cbrt(y));
+			} break;
+
+			case OP_FLOOR:
+			{
+				BLOCK_UNARY(floor(y));
+			} break;
+			case OP_CEIL:
+			{
+				BLOCK_UNARY(ceil(y));
+			} break;
+			case OP_ROUND:
+			{
+				BLOCK_UNARY(round(y));
+			} break;
+			case OP_RINT:
+			{
+				BLOCK_UNARY(rint(y));
+			} break;
+			case OP_TRUNC:
+			{
+				BLOCK_UNARY(trunc(y));
+			} break;
+			case OP_MODF:
+			{
+				for(unsigned f = 0; f < n; f++)
+				{
+					num_t e;
+					a[f] = modf(a[f], &e);
+					d[f] = e;
+				}
+			} break;
+
+			case OP_EXP:
+			{
+				BLOCK_UNARY(exp(y));
+			} break;
+			case OP_EXP_2:
+			{
+				BLOCK_UNARY(exp2(y));
+			} break;
+			case OP_LD_EXP:
+			{
+				BLOCK_BINARY(ldexp(x, y));
+			} break;
+			case OP_FR_EXP:
+			{
+				for(unsigned f = 0; f < n; f++)
+				{
+					int e;
+					a[f] = frexp(a[f], &e);
+					d[f] = e;
+				}
+			} break;
+			case OP_LOG:
+			{
+				BLOCK_UNARY(log(y));
+			} break;
+			case OP_LOG_2:
+			{
+				BLOCK_UNARY(log2(y));
+			} break;
+			case OP_LOG_10:
+			{
+				BLOCK_UNARY(log10(y));
+			} break;
+
+			case OP_PI:
+			{
+				BLOCK_CONST(M_PI);
+			} break;
+			case OP_SIN:
+			{
+				BLOCK_UNARY(sin(y));
+			} break;
+			case OP_COS:
+			{
+				BLOCK_UNARY(cos(y));
+			} break;
+			case OP_TAN:
+			{
+				BLOCK_UNARY(tan(y));
+			} break;
+			case OP_ASIN:
+			{
+				BLOCK_UNARY(asin(y));
+			} break;
+			case OP_ACOS:
+			{
+				BLOCK_UNARY(acos(y));
+			} break;
+			case OP_ATAN:
+			{
+				BLOCK_UNARY(atan(y));
+			} break;
+			case OP_ATAN2:
+			{
+				BLOCK_BINARY(atan2(x, y));
+			} break;
+			case OP_SINH:
+			{
+				BLOCK_UNARY(sinh(y));
+			} break;
+			case OP_COSH:
+			{
+				BLOCK_UNARY(cosh(y));
+			} break;
+			case OP_TANH:
+			{
+				BLOCK_UNARY(tanh(y));
+			} break;
+			case OP_ASINH:
+			{
+				BLOCK_UNARY(asinh(y));
+			} break;
+			case OP_ACOSH:
+			{
+				BLOCK_UNARY(acosh(y));
+			} break;
+			case OP_ATANH:
+			{
+				BLOCK_UNARY(atanh(y));
+			} break;
+
+			case OP_EQ:
+			{
+				BLOCK_BINARY(x == y);
+			} break;
+			case OP_LT:
+			{
+				BLOCK_BINARY(x < y);
+			} break;
+			case OP_GT:
+			{
+				BLOCK_BINARY(x > y);
+			} break;
+			case OP_LE:
+			{
+				BLOCK_BINARY(x <= y);
+			} break;
+			case OP_GE:
+			{
+				BLOCK_BINARY(x >= y);
+			} break;
+			case OP_TER:
+			{
+				for(unsigned f = 0; f < n; f++)
+				{
+					const bool cond = a[f];
+					c[f] = cond ? c[f] : b[f];
+				}
+			} break;
+			case OP_MINI:
+			{
+				BLOCK_BINARY(vm_mini(x, y));
+			} break;
+			case OP_MAXI:
+			{
+				BLOCK_BINARY(vm_maxi(x, y));
+			} break;
+
+			case OP_AND:
+			{
+				BLOCK_BINARY(x && y);
+			} break;
+			case OP_OR:
+			{
+				BLOCK_BINARY(x || y);
+			} break;
+
+			case OP_NOT:
+			{
+				BLOCK_UNARY(!(int)y);
+			} break;
+			case OP_BAND:
+			{
+				BLOCK_BINARY((unsigned)x & (unsigned)y);
+			} break;
+			case OP_BOR:
+			{
+				BLOCK_BINARY((unsigned)x | (unsigned)y);
+			} break;
+			case OP_BNOT:
+			{
+				BLOCK_UNARY(~(unsigned)y);
+			} break;
+			case OP_LSHIFT:
+			{
+				BLOCK_BINARY((unsigned)x << (unsigned)y);
+			} break;
+			case OP_RSHIFT:
+			{
+				BLOCK_BINARY((unsigned)x >> (unsigned)y);
+			} break;
+
+			// time
+			case OP_BAR_BEAT:
+			case OP_BAR:
+			case OP_BEAT:
+			case OP_BEAT_UNIT:
+			case OP_BPB:
+			case OP_BPM:
+			case OP_FRAME:
+			case OP_FPS:
+			case OP_SPEED:
+			{
+				const num_t *clk = block->clk[inst->op - OP_BAR_BEAT];
+				BLOCK_CONST(clk[f]);
+			} break;
 
-	return ref;
+			case OP_NOP:
+			{
+				// no operation
+			} break;
+			case INST_MAX:
+				break;
+		}
+	}
+
+	_block_spread(block, layout->spread_end, nframes);
 }
 
 static void
-run_internal(plughandle_t *handle, uint32_t frames,
-	const float *in [CTRL_MAX], float *out [CTRL_MAX], forge_t forgs [CTRL_MAX])
+run_cv_audio_block(plughandle_t *handle, const LV2_Atom_Object *obj,
+	uint32_t from, uint32_t to)
 {
-	for(unsigned i = 0; i < CTRL_MAX; i++)
+	vm_block_t *block = &handle->exec->block;
+	const bool is_audio = (handle->vm_plug == VM_PLUG_AUDIO);
+
+	for(uint32_t off = from; off < to; off += BLOCK_MAX)
 	{
-		const float in1 = (handle->vm_plug == VM_PLUG_AUDIO)
-			? *in[i] // don't clip audio
-			: CLIP(VM_MIN, *in[i], VM_MAX);
+		const unsigned n = (to - off < BLOCK_MAX) ? to - off : BLOCK_MAX;
 
-		if(handle->in0[i] != in1)
+		if(block->time)
 		{
-			handle->needs_recalc = true;
-			handle->in0[i] = in1;
-
-			if(in1 != handle->inm[i])
+			// sample time frame by frame for time opcodes
+			for(unsigned f = 0; f < n; f++)
 			{
-				handle->inm[i] = in1;
-				handle->inf[i] = true; // notify in run_post
+				if(timely_advance(&handle->timely, obj, off + f, off + f + 1))
+					obj = NULL; // invalidate obj for further steps if handled
+
+				for(unsigned t = 0; t < TIME_MAX; t++)
+				{
+					if(block->time & (1U << t))
+						block->clk[t][f] = _timely_value(&handle->timely, OP_BAR_BEAT + t);
+				}
 			}
 		}
-	}
+		else
+		{
+			timely_advance(&handle->timely, obj, off, off + 1);
+			obj = NULL; // obj can only be handled on first frame
 
-	if(handle->status != VM_STATUS_STATIC)
-		handle->needs_recalc = true;
+			if(n > 1)
+				timely_advance(&handle->timely, NULL, off + 1, off + n);
+		}
 
-	if(handle->needs_recalc)
-	{
-		_stack_clear(&handle->stack);
+		bool varying = false; // inputs change within sub-block
 
-		for(unsigned i = 0; i < ITEMS_MAX; i++)
-loop: {
-			vm_command_t *cmd = &handle->cmds[i];
-			bool terminate = false;
+		// gather whole sub-block first to make it inplace-safe
+		for(unsigned i = 0; i < CTRL_MAX; i++)
+		{
+			const float *src = &handle->in[i].flt[off];
+			float *in1 = block->in[i];
 
-			switch(cmd->type)
+			if(is_audio) // don't clip audio
 			{
-				case COMMAND_BOOL:
-				{
-					const num_t c = cmd->i32;
-					_stack_push(&handle->stack, c);
-				} break;
-				case COMMAND_INT:
-				{
-					const num_t c = cmd->i32;
-					_stack_push(&handle->stack, c);
-				} break;
-				case COMMAND_FLOAT:
-				{
-					const num_t c = cmd->f32;
-					_stack_push(&handle->stack, c);
-				} break;
-				case COMMAND_OPCODE:
+				for(unsigned f = 0; f < n; f++)
+					in1[f] = src[f];
+			}
+			else
+			{
+				for(unsigned f = 0; f < n; f++)
+					in1[f] = CLIP(VM_MIN, src[f], VM_MAX);
+			}
+
+			for(unsigned f = 0; f < n; f++)
+			{
+				if(handle->in0[i] != in1[f])
 				{
-					switch(cmd->op)
+					if(f > 0)
+						varying = true;
+
+					handle->in0[i] = in1[f];
+					handle->filled = false;
+
+					if(in1[f] != handle->inm[i])
 					{
-						case OP_CTRL:
-						{
-							const int idx = floor(_stack_pop(&handle->stack));
-							const num_t c = handle->in0[idx & CTRL_MASK];
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_PUSH:
-						{
-							const num_t c = _stack_peek(&handle->stack);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_POP:
-						{
-							const num_t c = _stack_pop(&handle->stack);
-							(void)c;
-						} break;
-						case OP_SWAP:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							_stack_push_num(&handle->stack, ab, 2);
-						} break;
-						case OP_STORE:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const int idx = floorf(ab[0]);
-							handle->stack.regs[idx & REG_MASK] = ab[1];
-						} break;
-						case OP_LOAD:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const int idx = floorf(a);
-							const num_t c = handle->stack.regs[idx & REG_MASK];
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_BREAK:
-						{
-							const bool a = _stack_pop(&handle->stack);
-							if(a)
-								terminate = true;
-						} break;
-						case OP_GOTO:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							if(ab[0])
-							{
-								const int idx = ab[1];
-								i = idx & ITEMS_MASK;
-								goto loop;
-							}
-						} break;
-
-						case OP_RAND:
-						{
-							const num_t c = (num_t)rand() / RAND_MAX;
-							_stack_push(&handle->stack, c);
-						} break;
-
-						case OP_ADD:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const num_t c = ab[1] + ab[0];
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_SUB:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const num_t c = ab[1] - ab[0];
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_MUL:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const num_t c = ab[1] * ab[0];
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_DIV:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const num_t c = ab[0] == 0.0
-								? 0.0
-								: ab[1] / ab[0];
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_MOD:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const num_t c = ab[0] == 0.0
-								? 0.0
-								: fmod(ab[1], ab[0]);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_POW:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const num_t c = pow(ab[1], ab[0]);
-							_stack_push(&handle->stack, c);
-						} break;
-
-						case OP_NEG:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = -a;
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_ABS:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = fabs(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_SQRT:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = sqrt(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_CBRT:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = cbrt(a);
-							_stack_push(&handle->stack, c);
-						} break;
-
-						case OP_FLOOR:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = floor(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_CEIL:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = ceil(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_ROUND:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = round(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_RINT:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = rint(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_TRUNC:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = trunc(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_MODF:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							num_t d;
-							const num_t c = modf(a, &d);
-							_stack_push(&handle->stack, c);
-							_stack_push(&handle->stack, d);
-						} break;
-
-						case OP_EXP:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = exp(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_EXP_2:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = exp2(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_LD_EXP:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const num_t c = ldexp(ab[1], ab[0]);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_FR_EXP:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							int d;
-							const num_t c = frexp(a, &d);
-							_stack_push(&handle->stack, c);
-							_stack_push(&handle->stack, d);
-						} break;
-						case OP_LOG:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = log(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_LOG_2:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = log2(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_LOG_10:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = log10(a);
-							_stack_push(&handle->stack, c);
-						} break;
-
-						case OP_PI:
-						{
-							num_t c = M_PI;
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_SIN:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = sin(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_COS:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = cos(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_TAN:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = tan(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_ASIN:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = asin(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_ACOS:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = acos(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_ATAN:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = atan(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_ATAN2:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const num_t c = atan2(ab[1], ab[0]);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_SINH:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = sinh(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_COSH:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = cosh(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_TANH:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = tanh(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_ASINH:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = asinh(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_ACOSH:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = acosh(a);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_ATANH:
-						{
-							const num_t a = _stack_pop(&handle->stack);
-							const num_t c = atanh(a);
-							_stack_push(&handle->stack, c);
-						} break;
-
-						case OP_EQ:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const bool c = ab[1] == ab[0];
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_LT:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const bool c = ab[1] < ab[0];
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_GT:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const bool c = ab[1] > ab[0];
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_LE:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const bool c = ab[1] <= ab[0];
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_GE:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const bool c = ab[1] >= ab[0];
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_TER:
-						{
-							num_t ab [3];
-							_stack_pop_num(&handle->stack, ab, 3);
-							const bool c = ab[0];
-							_stack_push(&handle->stack, c ? ab[2] : ab[1]);
-						} break;
-						case OP_MINI:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const num_t c = fmin(ab[1], ab[0]);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_MAXI:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const num_t c = fmax(ab[1], ab[0]);
-							_stack_push(&handle->stack, c);
-						} break;
-
-						case OP_AND:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const bool c = ab[1] && ab[0];
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_OR:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const bool c = ab[1] || ab[0];
-							_stack_push(&handle->stack, c);
-						} break;
-
-						case OP_NOT:
-						{
-							const int a = _stack_pop(&handle->stack);
-							const bool c = !a;
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_BAND:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const unsigned a = ab[1];
-							const unsigned b = ab[0];
-							const unsigned c = a & b;
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_BOR:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const unsigned a = ab[1];
-							const unsigned b = ab[0];
-							const unsigned c = a | b;
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_BNOT:
-						{
-							const unsigned a = _stack_pop(&handle->stack);
-							const unsigned c = ~a;
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_LSHIFT:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const unsigned a = ab[1];
-							const unsigned b = ab[0];
-							const unsigned c = a <<  b;
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_RSHIFT:
-						{
-							num_t ab [2];
-							_stack_pop_num(&handle->stack, ab, 2);
-							const unsigned a = ab[1];
-							const unsigned b = ab[0];
-							const unsigned c = a >>  b;
-							_stack_push(&handle->stack, c);
-						} break;
-
-						// time
-						case OP_BAR_BEAT:
-						{
-							const num_t c = TIMELY_BAR_BEAT(&handle->timely);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_BAR:
-						{
-							const num_t c = TIMELY_BAR(&handle->timely);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_BEAT:
-						{
-							const num_t bar = TIMELY_BAR(&handle->timely);
-							const num_t beats_per_bar = TIMELY_BEATS_PER_BAR(&handle->timely);
-							const num_t bar_beat = TIMELY_BAR_BEAT(&handle->timely);
-							const num_t c = bar*beats_per_bar + bar_beat;
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_BEAT_UNIT:
-						{
-							const num_t c = TIMELY_BEAT_UNIT(&handle->timely);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_BPB:
-						{
-							const num_t c = TIMELY_BEATS_PER_BAR(&handle->timely);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_BPM:
-						{
-							const num_t c = TIMELY_BEATS_PER_MINUTE(&handle->timely);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_FRAME:
-						{
-							const num_t c = TIMELY_FRAME(&handle->timely);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_FPS:
-						{
-							const num_t c = TIMELY_FRAMES_PER_SECOND(&handle->timely);
-							_stack_push(&handle->stack, c);
-						} break;
-						case OP_SPEED:
-						{
-							const num_t c = TIMELY_SPEED(&handle->timely);
-							_stack_push(&handle->stack, c);
-						} break;
-
-						case OP_NOP:
-						{
-							// no operation
-						} break;
-						case OP_MAX:
-							break;
+						handle->inm[i] = in1[f];
+						handle->inf[i] = true; // notify in run_post
 					}
-				} break;
-				case COMMAND_NOP:
-				{
-					terminate = true;
-				} break;
-				case COMMAND_MAX:
-					break;
+				}
 			}
-
-			if(terminate)
-				break;
 		}
 
-		_stack_pop_num(&handle->stack, handle->out0, CTRL_MAX);
-		handle->needs_recalc = false;
-	}
-
-	for(unsigned i = 0; i < CTRL_MAX; i++)
-	{
-		const float out1 = (handle->vm_plug == VM_PLUG_AUDIO)
-			? handle->out0[i] // don't clip audio
-			: CLIP(VM_MIN, handle->out0[i], VM_MAX);
+		if(handle->exec->split && !varying)
+		{
+			run_fill(handle);
+			run_block_internal(handle, &handle->exec->timed, &block->timed, n);
+		}
+		else
+		{
+			run_block_internal(handle, &handle->exec->prog,
+				varying ? &block->varying : &block->steady, n);
+		}
 
-		if(*out[i] != out1)
+		for(unsigned i = 0; i < CTRL_MAX; i++)
 		{
-			if(forgs)
+			const num_t *out0 = block->slots[(block->end + i) & SLOT_MASK];
+			float *dst = &handle->out[i].flt[off];
+
+			for(unsigned f = 0; f < n; f++)
 			{
-				if(handle->vm_plug == VM_PLUG_ATOM)
-				{
-					// send changes on atom output ports
-					if(forgs[i].ref)
-						forgs[i].ref = lv2_atom_forge_frame_time(&forgs[i].forge, frames);
-					if(handle->ref)
-						forgs[i].ref = lv2_atom_forge_float(&forgs[i].forge, out1);
-				}
-				else if(handle->vm_plug == VM_PLUG_MIDI)
+				const float out1 = is_audio
+					? out0[f] // don't clip audio
+					: CLIP(VM_MIN, out0[f], VM_MAX);
+
+				if(dst[f] != out1)
 				{
-					const vm_filter_t *filter = &handle->destinationFilter[i];
+					dst[f] = out1;
 
-					switch(filter->type)
+					if(out1 != handle->outm[i])
 					{
-						case FILTER_CONTROLLER:
-						{
-							const uint8_t value = floor(out1 * 0x7f);
-							const uint8_t msg [3] = {
-								[0] = LV2_MIDI_MSG_CONTROLLER | filter->channel,
-								[1] = filter->value,
-								[2] = value
-							};
-
-							if(forgs[i].ref)
-								forgs[i].ref = send_chunk(&forgs[i].forge, frames, handle->midi_MidiEvent, msg, sizeof(msg));
-						} break;
-						case FILTER_BENDER:
-						{
-							const int16_t value = floor(out1*0x2000 + 0x1fff);
-							const uint8_t msg [3] = {
-								[0] = LV2_MIDI_MSG_BENDER | filter->channel,
-								[1] = value & 0x7f,
-								[2] = value >> 7
-							};
-
-							if(forgs[i].ref)
-								forgs[i].ref = send_chunk(&forgs[i].forge, frames, handle->midi_MidiEvent, msg, sizeof(msg));
-						} break;
-						case FILTER_PROGRAM_CHANGE:
-						{
-							const uint8_t value = floor(out1 * 0x7f);
-							const uint8_t msg [2] = {
-								[0] = LV2_MIDI_MSG_PGM_CHANGE | filter->channel,
-								[1] = value
-							};
-
-							if(forgs[i].ref)
-								forgs[i].ref = send_chunk(&forgs[i].forge, frames, handle->midi_MidiEvent, msg, sizeof(msg));
-						} break;
-						case FILTER_CHANNEL_PRESSURE:
-						{
-							const uint8_t value = floor(out1 * 0x7f);
-							const uint8_t msg [2] = {
-								[0] = LV2_MIDI_MSG_CHANNEL_PRESSURE | filter->channel,
-								[1] = value
-							};
-
-							if(forgs[i].ref)
-								forgs[i].ref = send_chunk(&forgs[i].forge, frames, handle->midi_MidiEvent, msg, sizeof(msg));
-						} break;
-						case FILTER_NOTE_ON:
-						{
-							if(floor(*out[i] * 0x7f) > 0x0)
-							{
-								const uint8_t value = floor(*out[i] * 0x7f);
-								const uint8_t msg [3] = {
-									[0] = LV2_MIDI_MSG_NOTE_OFF | filter->channel,
-									[1] = value,
-									[2] = 0x0
-								};
-
-								if(forgs[i].ref)
-									forgs[i].ref = send_chunk(&forgs[i].forge, frames, handle->midi_MidiEvent, msg, sizeof(msg));
-							}
-							if(floor(out1 * 0x7f) > 0x0)
-							{
-								const uint8_t value = floor(out1 * 0x7f);
-								const uint8_t msg [3] = {
-									[0] = LV2_MIDI_MSG_NOTE_ON | filter->channel,
-									[1] = value,
-									[2] = filter->value
-								};
-
-								if(forgs[i].ref)
-									forgs[i].ref = send_chunk(&forgs[i].forge, frames, handle->midi_MidiEvent, msg, sizeof(msg));
-							}
-						} break;
-						case FILTER_NOTE_PRESSURE:
-						{
-							const uint8_t value = floor(out1 * 0x7f);
-							const uint8_t msg [3] = {
-								[0] = LV2_MIDI_MSG_NOTE_PRESSURE | filter->channel,
-								[1] = filter->value,
-								[2] = value
-							};
-
-							if(forgs[i].ref)
-								forgs[i].ref = send_chunk(&forgs[i].forge, frames, handle->midi_MidiEvent, msg, sizeof(msg));
-						} break;
-						//FIXME handle more types
-
-						case FILTER_MAX:
-						{
-							// nothing
-						}	break;
+						handle->outm[i] = out1;
+						handle->outf[i] = true; // notify in run_post
 					}
 				}
 			}
 
-			*out[i] = out1;
-
-			if(out1 != handle->outm[i])
-			{
-				handle->outm[i] = out1;
-				handle->outf[i] = true; // notify out run_post
-			}
+			handle->out0[i] = out0[n - 1];
 		}
+
+		handle->needs_recalc = false;
 	}
 }
 
-static void
-run_control(LV2_Handle instance, uint32_t nsamples)
+// written without early exit to keep the loops vectorizable
+static inline bool
+_block_unchanged(const float *src, float in0, uint32_t n, bool clip)
 {
-	plughandle_t *handle = instance;
+	int changed = 0;
 
-	const uint32_t capacity = handle->notify->atom.size;
-	LV2_Atom_Forge_Frame frame;
-	lv2_atom_forge_set_buffer(&handle->forge, (uint8_t *)handle->notify, capacity);
-	handle->ref = lv2_atom_forge_sequence_head(&handle->forge, &frame, 0);
+	if(clip)
+	{
+		for(uint32_t f = 0; f < n; f++)
+			changed |= (CLIP(VM_MIN, src[f], VM_MAX) != in0);
+	}
+	else
+	{
+		for(uint32_t f = 0; f < n; f++)
+			changed |= (src[f] != in0);
+	}
 
-	run_pre(handle);
-	props_idle(&handle->props, &handle->forge, 0, &handle->ref);
+	return !changed;
+}
 
-	int64_t last_t = 0;
-	LV2_ATOM_SEQUENCE_FOREACH(handle->control, ev)
-	{
-		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+// fill outputs with cached values if a static program sees no input change
+static bool
+run_cv_audio_idle(plughandle_t *handle, const LV2_Atom_Object *obj,
+	uint32_t from, uint32_t to)
+{
+	const bool is_audio = (handle->vm_plug == VM_PLUG_AUDIO);
+	const uint32_t n = to - from;
 
-		props_advance(&handle->props, &handle->forge, ev->time.frames, obj, &handle->ref);
-		timely_advance(&handle->timely, obj, last_t, ev->time.frames);
+	if( (handle->exec->prog.status != VM_STATUS_STATIC) || handle->needs_recalc)
+		return false;
 
-		last_t = ev->time.frames;
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		if(!_block_unchanged(&handle->in[i].flt[from], handle->in0[i], n, !is_audio))
+			return false;
 	}
-	timely_advance(&handle->timely, NULL, last_t, nsamples);
 
-	// run once at end of period for controls
+	timely_advance(&handle->timely, obj, from, from + 1);
+	if(n > 1)
+		timely_advance(&handle->timely, NULL, from + 1, to);
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
 	{
-		const float *in [CTRL_MAX ] = {
-			handle->in[0].flt,
-			handle->in[1].flt,
-			handle->in[2].flt,
-			handle->in[3].flt,
-			handle->in[4].flt,
-			handle->in[5].flt,
-			handle->in[6].flt,
-			handle->in[7].flt
-		};
+		const float out1 = is_audio
+			? handle->out0[i] // don't clip audio
+			: CLIP(VM_MIN, handle->out0[i], VM_MAX);
+		float *dst = &handle->out[i].flt[from];
 
-		float *out [CTRL_MAX ] = {
-			handle->out[0].flt,
-			handle->out[1].flt,
-			handle->out[2].flt,
-			handle->out[3].flt,
-			handle->out[4].flt,
-			handle->out[5].flt,
-			handle->out[6].flt,
-			handle->out[7].flt
-		};
+		for(uint32_t f = 0; f < n; f++)
+			dst[f] = out1;
 
-		run_internal(handle, nsamples -1, in, out, NULL);
+		if(out1 != handle->outm[i])
+		{
+			handle->outm[i] = out1;
+			handle->outf[i] = true; // notify in run_post
+		}
 	}
 
-	run_post(handle, nsamples - 1);
-
-	if(handle->ref)
-		handle->ref = lv2_atom_forge_frame_time(&handle->forge, nsamples - 1);
-	if(handle->ref)
-		handle->ref = lv2_atom_forge_long(&handle->forge, handle->off);
-
-	if(handle->ref)
-		lv2_atom_forge_pop(&handle->forge, &frame);
-	else
-		lv2_atom_sequence_clear(handle->notify);
-
-	handle->off += nsamples;
+	return true;
 }
 
 static void
@@ -1178,6 +3602,14 @@ run_cv_audio_advance(plughandle_t *handle, const LV2_Atom_Object *obj,
 	{
 		timely_advance(&handle->timely, obj, from, to);
 	}
+	else if(run_cv_audio_idle(handle, obj, from, to))
+	{
+		// nothing
+	}
+	else if(handle->exec->block.enabled)
+	{
+		run_cv_audio_block(handle, obj, from, to);
+	}
 	else
 	{
 		for(unsigned i = from; i < to; i++)
@@ -1237,24 +3669,28 @@ run_cv_audio(LV2_Handle instance, uint32_t nsamples)
 	run_pre(handle);
 	props_idle(&handle->props, &handle->forge, 0, &handle->ref);
 
+	const bool is_audio = (handle->vm_plug == VM_PLUG_AUDIO);
+
+	// before evaluation, as outputs may be connected inplace
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+		_env_reduce(&handle->inenv[i], handle->in[i].flt, nsamples, !is_audio);
+
 	int64_t last_t = 0;
 	LV2_ATOM_SEQUENCE_FOREACH(handle->control, ev)
 	{
 		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
 
-		props_advance(&handle->props, &handle->forge, ev->time.frames, obj, &handle->ref);
+		_control_advance(handle, ev->time.frames, obj);
 		run_cv_audio_advance(handle, obj, last_t, ev->time.frames);
 
 		last_t = ev->time.frames;
 	}
 	run_cv_audio_advance(handle, NULL, last_t, nsamples);
 
-	run_post(handle, nsamples - 1);
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+		_env_reduce(&handle->outenv[i], handle->out[i].flt, nsamples, false);
 
-	if(handle->ref)
-		handle->ref = lv2_atom_forge_frame_time(&handle->forge, nsamples - 1);
-	if(handle->ref)
-		handle->ref = lv2_atom_forge_long(&handle->forge, handle->off);
+	run_post(handle, nsamples - 1);
 
 	if(handle->ref)
 		lv2_atom_forge_pop(&handle->forge, &frame);
@@ -1264,24 +3700,76 @@ run_cv_audio(LV2_Handle instance, uint32_t nsamples)
 	handle->off += nsamples;
 }
 
+#define CLOCK_MASK(op) (1U << ((op) - OP_BAR_BEAT))
+
+// frames for which outputs of evaluation at frame i stay valid, at most n
+static uint32_t
+_event_hold(plughandle_t *handle, uint32_t i, uint32_t n)
+{
+	const vm_exec_t *exec = handle->exec;
+	const timely_t *timely = &handle->timely;
+	const uint32_t held = handle->held & ~handle->starved;
+
+	if(exec->every)
+		return 1;
+
+	for(unsigned j = 0; held && (j < CTRL_MAX); j++)
+	{
+		if(!(held & (1U << j)))
+			continue;
+
+		// wake up when held back value is due
+		const int64_t due = _decim_due(handle, j) - (handle->off + i);
+
+		if(due < n)
+			n = (due < 1) ? 1 : due;
+	}
+
+	if(TIMELY_SPEED(timely) == 0.f) // transport stopped, time stands still
+		return n;
+
+	if(exec->block.time & (CLOCK_MASK(OP_BAR_BEAT) | CLOCK_MASK(OP_BEAT) | CLOCK_MASK(OP_FRAME)))
+		return 1;
+
+	if(exec->block.time & CLOCK_MASK(OP_BAR))
+	{
+		// wake up at bar boundary, rather early than late
+		const double left = TIMELY_FRAMES_PER_BAR(timely) - timely->offset.bar;
+
+		if(left < n)
+			return (left < 1.0) ? 1 : (uint32_t)left;
+	}
+
+	return n; // other time opcodes change with transport events only
+}
+
+// evaluate at start of range and wherever time-dependent opcodes need it
 static void
-run_atom_advance(plughandle_t *handle, const LV2_Atom_Object *obj,
+run_event_advance(plughandle_t *handle, const LV2_Atom_Object *obj,
 	uint32_t from, uint32_t to, const float *in [CTRL_MAX], float *out [CTRL_MAX],
 	forge_t forgs [CTRL_MAX])
 {
 	if(from == to) // just run timely_advance for void range
 	{
 		timely_advance(&handle->timely, obj, from, to);
+		return;
 	}
-	else
+
+	timely_advance(&handle->timely, obj, from, from + 1);
+
+	for(uint32_t i = from; i < to; )
 	{
-		for(unsigned i = from; i < to; i++)
-		{
-			if(timely_advance(&handle->timely, obj, i, i + 1))
-				obj = NULL; // invalidate obj for further steps if handled
+		run_internal(handle, i, in, out, forgs);
 
-			run_internal(handle, i, in, out, forgs);
-		}
+		const uint32_t n = _event_hold(handle, i, to - i);
+		const uint32_t end = (i + n < to)
+			? i + n + 1
+			: to;
+
+		if(end > i + 1)
+			timely_advance(&handle->timely, NULL, i + 1, end);
+
+		i += n;
 	}
 }
 
@@ -1302,6 +3790,8 @@ run_atom(LV2_Handle instance, uint32_t nsamples)
 	float pin [CTRL_MAX];
 	float pout [CTRL_MAX];
 
+	handle->starved = 0; // fresh output sequences
+
 	for(unsigned i = 0; i < CTRL_MAX; i++)
 	{
 		lv2_atom_forge_set_buffer(&forgs[i].forge, (uint8_t *)handle->out[i].seq, handle->out[i].seq->atom.size);
@@ -1333,77 +3823,54 @@ run_atom(LV2_Handle instance, uint32_t nsamples)
 		&pout[7]
 	};
 
-	const unsigned nseqs = CTRL_MAX + 1;
-	const LV2_Atom_Sequence *seqs [nseqs];
-	const LV2_Atom_Event *evs [nseqs];
+	const LV2_Atom_Sequence *seqs [MERGE_MAX];
+	vm_merge_t merge;
 
-	for(unsigned i = 0; i < nseqs; i++)
+	for(unsigned i = 0; i < MERGE_MAX; i++)
 	{
 		seqs[i] = (i == 0)
 			? handle->control
 			: handle->in[i-1].seq;
-
-		evs[i] = lv2_atom_sequence_begin(&seqs[i]->body);
 	}
 
+	vm_merge_init(&merge, seqs, MERGE_MAX);
+
 	int64_t last_t = 0;
 	while(true)
 	{
-		int nxt = -1;
-		int64_t frames = nsamples;
-
-		// search next event
-		for(unsigned i = 0; i < nseqs; i++)
-		{
-			if(!evs[i] || lv2_atom_sequence_is_end(&seqs[i]->body, seqs[i]->atom.size, evs[i]))
-			{
-				evs[i] = NULL; // invalidate, sequence has been drained
-				continue;
-			}
-
-			if(evs[i]->time.frames < frames)
-			{
-				frames = evs[i]->time.frames;
-				nxt = i;
-			}
-		}
+		unsigned nxt;
+		const LV2_Atom_Event *ev = vm_merge_peek(&merge, &nxt);
 
-		if(nxt == -1)
+		if(!ev || (ev->time.frames >= nsamples))
 			break; // no events anymore, exit loop
 
 		// handle event
 		{
 			const bool is_control = (nxt == 0); // is event from control port?
-			const LV2_Atom_Event *ev = evs[nxt];
 			const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
 			const LV2_Atom_Float *f32 = (const LV2_Atom_Float *)&ev->body;
 
 			if(is_control)
 			{
-				props_advance(&handle->props, &handle->forge, ev->time.frames, obj, &handle->ref);
+				_control_advance(handle, ev->time.frames, obj);
 			}
 			else if(f32->atom.type == handle->forge.Float)
 			{
 				pin[nxt-1] = f32->body;
 			}
 
-			run_atom_advance(handle, is_control ? obj : NULL, last_t, ev->time.frames, in, out, forgs);
+			run_event_advance(handle, is_control ? obj : NULL, last_t, ev->time.frames, in, out, forgs);
 
 			last_t = ev->time.frames;
 		}
 
 		// advance event iterator on active sequence
-		evs[nxt] = lv2_atom_sequence_next(evs[nxt]);
+		vm_merge_next(&merge);
 	}
-	run_atom_advance(handle, NULL, last_t, nsamples, in, out, forgs);
+	run_event_advance(handle, NULL, last_t, nsamples, in, out, forgs);
 
 	run_post(handle, nsamples - 1);
 
-	if(handle->ref)
-		handle->ref = lv2_atom_forge_frame_time(&handle->forge, nsamples - 1);
-	if(handle->ref)
-		handle->ref = lv2_atom_forge_long(&handle->forge, handle->off);
-
 	if(handle->ref)
 		lv2_atom_forge_pop(&handle->forge, &frame);
 	else
@@ -1420,27 +3887,6 @@ run_atom(LV2_Handle instance, uint32_t nsamples)
 	handle->off += nsamples;
 }
 
-static void
-run_midi_advance(plughandle_t *handle, const LV2_Atom_Object *obj,
-	uint32_t from, uint32_t to, const float *in [CTRL_MAX], float *out [CTRL_MAX],
-	forge_t forgs [CTRL_MAX])
-{
-	if(from == to) // just run timely_advance for void range
-	{
-		timely_advance(&handle->timely, obj, from, to);
-	}
-	else
-	{
-		for(unsigned i = from; i < to; i++)
-		{
-			if(timely_advance(&handle->timely, obj, i, i + 1))
-				obj = NULL; // invalidate obj for further steps if handled
-
-			run_internal(handle, i, in, out, forgs);
-		}
-	}
-}
-
 static bool
 filter_midi(vm_filter_t *filter, const uint8_t *msg, float *f32)
 {
@@ -1542,6 +3988,8 @@ run_midi(LV2_Handle instance, uint32_t nsamples)
 	float pin [CTRL_MAX];
 	float pout [CTRL_MAX];
 
+	handle->starved = 0; // fresh output sequences
+
 	for(unsigned i = 0; i < CTRL_MAX; i++)
 	{
 		lv2_atom_forge_set_buffer(&forgs[i].forge, (uint8_t *)handle->out[i].seq, handle->out[i].seq->atom.size);
@@ -1573,48 +4021,30 @@ run_midi(LV2_Handle instance, uint32_t nsamples)
 		&pout[7]
 	};
 
-	const unsigned nseqs = CTRL_MAX + 1;
-	const LV2_Atom_Sequence *seqs [nseqs];
-	const LV2_Atom_Event *evs [nseqs];
+	const LV2_Atom_Sequence *seqs [MERGE_MAX];
+	vm_merge_t merge;
 
-	for(unsigned i = 0; i < nseqs; i++)
+	for(unsigned i = 0; i < MERGE_MAX; i++)
 	{
 		seqs[i] = (i == 0)
 			? handle->control
 			: handle->in[i-1].seq;
-
-		evs[i] = lv2_atom_sequence_begin(&seqs[i]->body);
 	}
 
+	vm_merge_init(&merge, seqs, MERGE_MAX);
+
 	int64_t last_t = 0;
 	while(true)
 	{
-		int nxt = -1;
-		int64_t frames = nsamples;
-
-		// search next event
-		for(unsigned i = 0; i < nseqs; i++)
-		{
-			if(!evs[i] || lv2_atom_sequence_is_end(&seqs[i]->body, seqs[i]->atom.size, evs[i]))
-			{
-				evs[i] = NULL; // invalidate, sequence has been drained
-				continue;
-			}
-
-			if(evs[i]->time.frames < frames)
-			{
-				frames = evs[i]->time.frames;
-				nxt = i;
-			}
-		}
+		unsigned nxt;
+		const LV2_Atom_Event *ev = vm_merge_peek(&merge, &nxt);
 
-		if(nxt == -1)
+		if(!ev || (ev->time.frames >= nsamples))
 			break; // no events anymore, exit loop
 
 		// handle event
 		{
 			const bool is_control = (nxt == 0); // is event from control port?
-			const LV2_Atom_Event *ev = evs[nxt];
 			const LV2_Atom *atom= &ev->body;
 			const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
 			const uint8_t *msg = LV2_ATOM_BODY_CONST(atom);
@@ -1622,7 +4052,7 @@ run_midi(LV2_Handle instance, uint32_t nsamples)
 
 			if(is_control)
 			{
-				props_advance(&handle->props, &handle->forge, ev->time.frames, obj, &handle->ref);
+				_control_advance(handle, ev->time.frames, obj);
 			}
 			else if( (atom->type == handle->midi_MidiEvent)
 				&& filter_midi(&handle->sourceFilter[nxt-1], msg, &f32) )
@@ -1631,23 +4061,18 @@ run_midi(LV2_Handle instance, uint32_t nsamples)
 			}
 
 
-			run_midi_advance(handle, is_control ? obj : NULL, last_t, ev->time.frames, in, out, forgs);
+			run_event_advance(handle, is_control ? obj : NULL, last_t, ev->time.frames, in, out, forgs);
 
 			last_t = ev->time.frames;
 		}
 
 		// advance event iterator on active sequence
-		evs[nxt] = lv2_atom_sequence_next(evs[nxt]);
+		vm_merge_next(&merge);
 	}
-	run_midi_advance(handle, NULL, last_t, nsamples, in, out, forgs);
+	run_event_advance(handle, NULL, last_t, nsamples, in, out, forgs);
 
 	run_post(handle, nsamples - 1);
 
-	if(handle->ref)
-		handle->ref = lv2_atom_forge_frame_time(&handle->forge, nsamples - 1);
-	if(handle->ref)
-		handle->ref = lv2_atom_forge_long(&handle->forge, handle->off);
-
 	if(handle->ref)
 		lv2_atom_forge_pop(&handle->forge, &frame);
 	else
@@ -1669,6 +4094,16 @@ cleanup(LV2_Handle instance)
 {
 	plughandle_t *handle = instance;
 
+	for(unsigned i = 0; i < 2; i++)
+	{
+#if defined(VM_JIT)
+		vm_jit_deinit(&handle->execs[i].jit);
+#endif
+		vm_arena_deinit(&handle->execs[i].arena);
+	}
+	_store_reap(handle);
+	free(handle->grown);
+	free(handle->store);
 	free(handle);
 }
 
@@ -1686,6 +4121,33 @@ _state_restore(LV2_Handle instance, LV2_State_Retrieve_Function retrieve,
 	LV2_State_Handle state, uint32_t flags, const LV2_Feature *const *features)
 {
 	plughandle_t *handle = instance;
+	size_t size;
+	uint32_t type;
+	uint32_t _flags;
+
+	_store_reap(handle);
+
+	// graphs not fitting current storage get their own, props_restore skips them
+	const void *body = retrieve(state, handle->vm_graph, &size, &type, &_flags);
+	vm_store_t *store = NULL;
+
+	if(  body && (type == handle->forge.Tuple) && (size <= GRAPH_SIZE)
+		&& (size > __atomic_load_n(&handle->defs[0].max_size, __ATOMIC_ACQUIRE)) )
+	{
+		uint32_t pot = GRAPH_PRE;
+		while(pot < size)
+			pot <<= 1;
+
+		store = _store_new(pot);
+		if(store)
+		{
+			memcpy(store->value, body, size);
+			memcpy(store->stash, body, size);
+			store->size = size;
+		}
+	}
+
+	_store_offer(handle, store, true); // NULL drops one restored before
 
 	return props_restore(&handle->props, retrieve, state, flags, features);
 }
@@ -1695,11 +4157,48 @@ static const LV2_State_Interface state_iface = {
 	.restore = _state_restore
 };
 
+static LV2_Worker_Status
+_work(LV2_Handle instance, LV2_Worker_Respond_Function respond,
+	LV2_Worker_Respond_Handle target, uint32_t size, const void *body)
+{
+	plughandle_t *handle = instance;
+	vm_exec_t *exec = _exec_idle(handle);
+
+	_store_reap(handle);
+	_store_grow(handle, size);
+	if(!_exec_compile(handle, exec, size, body, true))
+		exec = NULL; // previous program keeps running
+
+	return respond(target, sizeof(exec), &exec);
+}
+
+static LV2_Worker_Status
+_work_response(LV2_Handle instance, uint32_t size __attribute__((unused)),
+	const void *body)
+{
+	plughandle_t *handle = instance;
+	vm_exec_t *const *exec = body;
+
+	if(*exec)
+		_exec_swap(handle, *exec);
+	handle->busy = false;
+
+	return LV2_WORKER_SUCCESS;
+}
+
+static const LV2_Worker_Interface work_iface = {
+	.work = _work,
+	.work_response = _work_response,
+	.end_run = NULL
+};
+
 static const void*
 extension_data(const char* uri)
 {
 	if(!strcmp(uri, LV2_STATE__interface))
 		return &state_iface;
+	else if(!strcmp(uri, LV2_WORKER__interface))
+		return &work_iface;
 
 	return NULL;
 }
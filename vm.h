@@ -18,6 +18,10 @@
 #ifndef _VM_LV2_H
 #define _VM_LV2_H
 
+#include <stdlib.h>
+#include <math.h>
+#include <limits.h>
+
 #include "lv2/lv2plug.in/ns/ext/atom/atom.h"
 #include "lv2/lv2plug.in/ns/ext/atom/forge.h"
 #include "lv2/lv2plug.in/ns/ext/log/log.h"
@@ -26,8 +30,10 @@
 #include "lv2/lv2plug.in/ns/ext/time/time.h"
 #include "lv2/lv2plug.in/ns/ext/midi/midi.h"
 #include "lv2/lv2plug.in/ns/ext/state/state.h"
+#include "lv2/lv2plug.in/ns/ext/worker/worker.h"
 #include "lv2/lv2plug.in/ns/ext/time/time.h"
 #include "lv2/lv2plug.in/ns/ext/options/options.h"
+#include "lv2/lv2plug.in/ns/ext/buf-size/buf-size.h"
 #include "lv2/lv2plug.in/ns/ext/parameters/parameters.h"
 #include "lv2/lv2plug.in/ns/extensions/ui/ui.h"
 #include "lv2/lv2plug.in/ns/lv2core/lv2.h"
@@ -40,16 +46,61 @@
 #define VM__graph             VM_PREFIX"graph"
 #define VM__sourceFilter      VM_PREFIX"sourceFilter"
 #define VM__destinationFilter VM_PREFIX"destinationFilter"
-
-#define MAX_NPROPS 3
+#define VM__seed              VM_PREFIX"seed"
+#define VM__budget            VM_PREFIX"budget"
+#define VM__overruns          VM_PREFIX"overruns"
+#define VM__updateRate        VM_PREFIX"updateRate"
+#define VM__param0            VM_PREFIX"param0"
+#define VM__param1            VM_PREFIX"param1"
+#define VM__param2            VM_PREFIX"param2"
+#define VM__param3            VM_PREFIX"param3"
+#define VM__param4            VM_PREFIX"param4"
+#define VM__param5            VM_PREFIX"param5"
+#define VM__param6            VM_PREFIX"param6"
+#define VM__param7            VM_PREFIX"param7"
+#define VM__decimation        VM_PREFIX"decimation"
+#define VM__Decimation        VM_PREFIX"Decimation"
+#define VM__interval          VM_PREFIX"interval"
+#define VM__deadband          VM_PREFIX"deadband"
+#define VM__quantized         VM_PREFIX"quantized"
+
+#define PARAM_MAX  0x8 // registers exposed as parameters
+
+#define MAX_NPROPS (8 + PARAM_MAX)
 
 #define CTRL_MAX   0x8
 #define CTRL_MASK  (CTRL_MAX - 1)
 
-#define ITEMS_MAX  128
+#define SLOT_MAX   0x20
+#define SLOT_MASK  (SLOT_MAX - 1)
+
+#define REG_MAX    0x20
+#define REG_MASK   (REG_MAX - 1)
+
+#define HIDDEN_MAX 0x40 // registers above REG_MAX, not reachable by OP_LOAD/OP_STORE
+
+#define RAND_LANES 4
+#define RAND_MASK  (RAND_LANES - 1)
+
+#define ITEMS_MAX  0x1000 // commands per graph
 #define ITEMS_MASK (ITEMS_MAX - 1)
+#define ITEMS_PRE  0x80 // program capacity preallocated per instance
+#define ITEMS_LEGACY 0x80 // graph length up to 0.14, goto targets of such graphs wrap at it
+
+#define IR_INST_MAX 0x100
+#define IR_VALS_MAX 0x100 // virtual registers of register IR
+#define IR_ZERO     0 // value of cells never written
 #define GRAPH_SIZE (ITEMS_MAX * sizeof(LV2_Atom_Long))
+#define GRAPH_PRE  (ITEMS_PRE * sizeof(LV2_Atom_Long)) // serialized graph held inline in state
+// temporaries of analysis passes held at once for programs of N instructions,
+// vm_prog_deps with nested vm_prog_depth needs most
+#define SCRATCH_SIZE(N) (((N) + 1)*(sizeof(vm_dep_t) + 0x10) + 0x100)
 #define FILTER_SIZE 0x1000 // 4K
+#define DECIM_SIZE 0x1000 // 4K
+#define VM_BUDGET 0x1000 // instructions re-executed by backward jumps per evaluation
+#define VM_SHARE 0.5f // default share of period a graph may take
+#define VM_UPDATE_RATE 30.f // default notifications per second to UI
+#define MERGE_MAX (CTRL_MAX + 1) // event sequences merged per period
 
 #define VM_MIN -1.f
 #define VM_MAX 1.f
@@ -73,6 +124,23 @@ typedef enum _vm_status_t {
 	VM_STATUS_HAS_RAND = (1 << 2),
 } vm_status_t;
 
+typedef enum _vm_verify_t {
+	VM_VERIFY_OK = 0,
+	VM_VERIFY_DYNAMIC, // stack depth depends on path taken
+	VM_VERIFY_UNDERFLOW, // pops more cells than have been pushed
+	VM_VERIFY_OVERFLOW, // pushes more than SLOT_MAX cells
+
+	VM_VERIFY_MAX,
+} vm_verify_t;
+
+typedef enum _vm_rate_t {
+	VM_RATE_CONST = 0, // constant
+	VM_RATE_BLOCK, // changes at most once per block
+	VM_RATE_SAMPLE, // changes from sample to sample
+
+	VM_RATE_MAX,
+} vm_rate_t;
+
 typedef enum _vm_opcode_enum_t {
 	OP_NOP = 0,
 
@@ -172,6 +240,36 @@ typedef enum _vm_command_enum_t {
 	COMMAND_MAX,
 } vm_command_enum_t;
 
+typedef enum _vm_inst_enum_t {
+	INST_IMM = OP_MAX, // push immediate
+	INST_JMP, // goto with target resolved at compile time
+	INST_HLOAD, // push hidden register
+	INST_HSAVE, // copy stack cell at offset imm to hidden register
+	INST_SKIP, // stack effect of an instruction evaluated elsewhere
+
+	INST_MAX,
+} vm_inst_enum_t;
+
+typedef enum _vm_ir_enum_t {
+	IR_MOVE = INST_MAX, // copy value into parameter of jump target
+	IR_JMP, // unconditional jump
+	IR_JMP_IF, // jump if value is true
+	IR_JMP_NOT, // jump if value is false
+
+	// superinstructions
+	IR_CTRL_K, // input at constant index
+	IR_MADD, // multiply-add with single rounding
+	IR_MINI_MAXI, // clamp, minimum of maximum
+	IR_MAXI_MINI, // clamp, maximum of minimum
+	IR_SEL_EQ, // ternary on inlined comparison, same order as OP_EQ..OP_GE
+	IR_SEL_LT,
+	IR_SEL_GT,
+	IR_SEL_LE,
+	IR_SEL_GE,
+
+	IR_MAX,
+} vm_ir_enum_t;
+
 typedef enum _vm_filter_enum_t {
 	FILTER_CONTROLLER = 0,
 	FILTER_BENDER,
@@ -183,11 +281,34 @@ typedef enum _vm_filter_enum_t {
 	FILTER_MAX,
 } vm_filter_enum_t;
 
+// sections of port value vector notified to UI, each CTRL_MAX*2 wide
+typedef enum _vm_notify_enum_t {
+	NOTIFY_LAST = 0,
+	NOTIFY_MIN, // envelopes of cv and audio plugins only
+	NOTIFY_MAX,
+	NOTIFY_RMS,
+
+	NOTIFY_ENV_MAX,
+} vm_notify_enum_t;
+
+typedef double num_t;
+
 typedef struct _vm_command_t vm_command_t;
+typedef struct _vm_inst_t vm_inst_t;
+typedef struct _vm_prog_t vm_prog_t;
+typedef struct _vm_arena_t vm_arena_t;
+typedef struct _vm_scratch_t vm_scratch_t;
+typedef struct _vm_merge_t vm_merge_t;
+typedef struct _vm_ir_inst_t vm_ir_inst_t;
+typedef struct _vm_ir_t vm_ir_t;
+typedef struct _vm_dep_t vm_dep_t;
+typedef struct _vm_rand_t vm_rand_t;
 typedef struct _vm_api_def_t vm_api_def_t;
 typedef struct _vm_api_impl_t vm_api_impl_t;
 typedef struct _vm_filter_impl_t vm_filter_impl_t;
 typedef struct _vm_filter_t vm_filter_t;
+typedef struct _vm_decim_impl_t vm_decim_impl_t;
+typedef struct _vm_decim_t vm_decim_t;
 typedef struct _plugstate_t plugstate_t;
 
 struct _vm_command_t {
@@ -200,6 +321,61 @@ struct _vm_command_t {
 	};
 };
 
+struct _vm_inst_t {
+	uint16_t op; // vm_opcode_enum_t or vm_inst_enum_t
+	uint8_t npops;
+	uint8_t npushs;
+	uint16_t target;
+	uint8_t ptr; // fixed stack slot of top before instruction, if program verified
+	num_t imm;
+};
+
+struct _vm_prog_t {
+	vm_inst_t *inst; // storage for size instructions, owned by caller
+	uint32_t size;
+	uint32_t ninst;
+	vm_status_t status;
+	bool verified; // stack accessed at fixed offsets without wrapping
+	uint8_t base; // slot of stack bottom in fixed layout
+	uint32_t wrap; // mask applied to goto targets
+	uint8_t params; // parameter registers the graph may store into
+	vm_arena_t *scratch; // temporaries of analysis passes, owned by caller
+};
+
+struct _vm_arena_t {
+	uint8_t *buf;
+	size_t size;
+	size_t used;
+};
+
+struct _vm_merge_t {
+	unsigned nheap;
+	uint8_t heap [MERGE_MAX]; // min-heap of sequences with events left
+	const LV2_Atom_Sequence *seqs [MERGE_MAX];
+	const LV2_Atom_Event *evs [MERGE_MAX]; // next event of each sequence
+};
+
+struct _vm_ir_inst_t {
+	uint16_t op; // vm_opcode_enum_t, vm_inst_enum_t or vm_ir_enum_t
+	uint8_t dst [2]; // values defined, topmost first
+	uint8_t src [4]; // values used, topmost first
+	uint16_t target; // jump target or hidden register
+	num_t imm;
+};
+
+struct _vm_ir_t {
+	vm_ir_inst_t inst [IR_INST_MAX];
+	uint32_t ninst;
+	uint32_t nvals;
+	uint8_t out [CTRL_MAX]; // value of each output, topmost first
+	bool enabled; // program could be translated
+};
+
+struct _vm_rand_t {
+	uint64_t s [4][RAND_LANES]; // xoshiro256+ state, one generator per lane
+	unsigned lane; // next lane to draw from
+};
+
 struct _vm_api_def_t {
 	const char *uri;
 	const char *label;
@@ -232,8 +408,27 @@ struct _vm_filter_impl_t {
 	LV2_URID midi_velocity;
 };
 
+struct _vm_decim_t {
+	float interval; // minimum milliseconds between output events
+	float deadband; // minimum change of value to send an event
+	bool quantized; // send midi only if the message would differ
+};
+
+struct _vm_decim_impl_t {
+	LV2_URID vm_Decimation;
+	LV2_URID vm_interval;
+	LV2_URID vm_deadband;
+	LV2_URID vm_quantized;
+};
+
 struct _plugstate_t {
-	uint8_t graph [GRAPH_SIZE];
+	uint8_t graph [GRAPH_PRE]; // larger graphs are held elsewhere
+	int64_t seed;
+	float budget;
+	int32_t overruns;
+	float update_rate;
+	float params [PARAM_MAX];
+	uint8_t decimation [DECIM_SIZE];
 	uint8_t sourceFilter [FILTER_SIZE];
 	uint8_t destinationFilter [FILTER_SIZE];
 };
@@ -872,64 +1067,219 @@ vm_api_map(vm_api_impl_t *impl, vm_opcode_enum_t op)
 	return impl[op].urid;
 }
 
+// whether command takes up an item in serialized graph, unmapped opcodes do not
+static inline bool
+_vm_command_is_item(vm_api_impl_t *impl, const vm_command_t *cmd)
+{
+	switch(cmd->type)
+	{
+		case COMMAND_BOOL:
+		case COMMAND_INT:
+		case COMMAND_FLOAT:
+			return true;
+		case COMMAND_OPCODE:
+			return vm_api_map(impl, cmd->op) != 0;
+		case COMMAND_NOP:
+		case COMMAND_MAX:
+			break;
+	}
+
+	return false;
+}
+
+static inline LV2_Atom_Forge_Ref
+vm_command_serialize(vm_api_impl_t *impl, LV2_Atom_Forge *forge, const vm_command_t *cmd)
+{
+	if(!_vm_command_is_item(impl, cmd))
+		return 1; // skip
+
+	switch(cmd->type)
+	{
+		case COMMAND_BOOL:
+		{
+			return lv2_atom_forge_bool(forge, cmd->i32);
+		}
+		case COMMAND_INT:
+		{
+			return lv2_atom_forge_int(forge, cmd->i32);
+		}
+		case COMMAND_FLOAT:
+		{
+			return lv2_atom_forge_float(forge, cmd->f32);
+		}
+		case COMMAND_OPCODE:
+		{
+			return lv2_atom_forge_urid(forge, vm_api_map(impl, cmd->op));
+		}
+		case COMMAND_NOP:
+		case COMMAND_MAX:
+			break;
+	}
+
+	return 1; // skip
+}
+
 static inline LV2_Atom_Forge_Ref
 vm_graph_serialize(vm_api_impl_t *impl, LV2_Atom_Forge *forge, const vm_command_t *cmds)
 {
 	LV2_Atom_Forge_Frame frame;
 	LV2_Atom_Forge_Ref ref = lv2_atom_forge_tuple(forge, &frame);
 
-	for(unsigned i = 0; i < ITEMS_MAX; i++)
+	for(unsigned i = 0; (i < ITEMS_MAX) && (cmds[i].type != COMMAND_NOP); i++)
 	{
-		const vm_command_t *cmd = &cmds[i];
-		bool terminate = false;
+		if(ref)
+			ref = vm_command_serialize(impl, forge, &cmds[i]);
+	}
 
-		switch(cmd->type)
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame);
+
+	return ref;
+}
+
+// index in serialized graph of command idx, skipped commands take up no item
+static inline uint32_t
+vm_graph_item(vm_api_impl_t *impl, const vm_command_t *cmds, uint32_t idx)
+{
+	uint32_t item = 0;
+
+	for(uint32_t i = 0; (i < idx) && (i < ITEMS_MAX) && (cmds[i].type != COMMAND_NOP); i++)
+	{
+		if(_vm_command_is_item(impl, &cmds[i]))
+			item++;
+	}
+
+	return item;
+}
+
+// changed range of commands, as index and number of old and new commands there
+static inline bool
+vm_graph_diff(const vm_command_t *old, const vm_command_t *cmds,
+	uint32_t *idx, uint32_t *nrem, uint32_t *nadd)
+{
+	uint32_t nold = 0;
+	uint32_t nnew = 0;
+
+	while( (nold < ITEMS_MAX) && (old[nold].type != COMMAND_NOP) )
+		nold++;
+	while( (nnew < ITEMS_MAX) && (cmds[nnew].type != COMMAND_NOP) )
+		nnew++;
+
+	uint32_t pre = 0;
+	while( (pre < nold) && (pre < nnew)
+		&& (old[pre].type == cmds[pre].type) && (old[pre].i32 == cmds[pre].i32) )
+		pre++;
+
+	uint32_t post = 0;
+	while( (post < nold - pre) && (post < nnew - pre)
+		&& (old[nold - post - 1].type == cmds[nnew - post - 1].type)
+		&& (old[nold - post - 1].i32 == cmds[nnew - post - 1].i32) )
+		post++;
+
+	*idx = pre;
+	*nrem = nold - pre - post;
+	*nadd = nnew - pre - post;
+
+	return *nrem || *nadd;
+}
+
+// commands in serialized graph, each item takes up an LV2_Atom_Long at most
+static inline uint32_t
+vm_graph_items(uint32_t size)
+{
+	const uint32_t n = size / sizeof(LV2_Atom_Long);
+
+	return (n < ITEMS_MAX) ? n : ITEMS_MAX;
+}
+
+// byte offset of item idx in serialized graph, or its size if beyond
+static inline uint32_t
+_vm_graph_offset(const uint8_t *body, uint32_t size, uint32_t idx)
+{
+	uint32_t off = 0;
+
+	for(uint32_t i = 0; (i < idx) && (off < size); i++)
+	{
+		const LV2_Atom *item = (const LV2_Atom *)&body[off];
+
+		off += lv2_atom_pad_size(lv2_atom_total_size(item));
+	}
+
+	return (off < size) ? off : size;
+}
+
+// replace nrem items at idx of serialized graph in place with serialized items
+static inline bool
+vm_graph_splice(uint8_t *body, uint32_t *size, uint32_t max_size,
+	uint32_t idx, uint32_t nrem, const void *items, uint32_t items_size)
+{
+	const uint32_t from = _vm_graph_offset(body, *size, idx);
+	const uint32_t to = from + _vm_graph_offset(&body[from], *size - from, nrem);
+	const uint32_t tail = *size - to;
+
+	if(from + items_size + tail > max_size)
+		return false;
+
+	memmove(&body[from + items_size], &body[to], tail);
+	memcpy(&body[from], items, items_size);
+	*size = from + items_size + tail;
+
+	return true;
+}
+
+// apply indexed graph edit, remove: (index count), add: (index item ...),
+// size needed is reported if an insertion does not fit
+static inline bool
+vm_graph_patch(LV2_Atom_Forge *forge, props_dyn_ev_t ev, const LV2_Atom *value,
+	uint8_t *body, uint32_t *size, uint32_t max_size, uint32_t *need)
+{
+	if(value->type != forge->Tuple)
+		return false;
+
+	const LV2_Atom_Tuple *tup = (const LV2_Atom_Tuple *)value;
+	const LV2_Atom_Int *idx = (const LV2_Atom_Int *)lv2_atom_tuple_begin(tup);
+
+	if(  lv2_atom_tuple_is_end(LV2_ATOM_BODY_CONST(tup), tup->atom.size, &idx->atom)
+		|| (idx->atom.type != forge->Int) || (idx->body < 0) )
+		return false;
+
+	const LV2_Atom *items = lv2_atom_tuple_next(&idx->atom);
+	const uint32_t head = (const uint8_t *)items - (const uint8_t *)LV2_ATOM_BODY_CONST(tup);
+	const uint32_t items_size = (tup->atom.size > head) ? tup->atom.size - head : 0;
+
+	switch(ev)
+	{
+		case PROPS_DYN_EV_REM:
 		{
-			case COMMAND_BOOL:
-			{
-				if(ref)
-					ref = lv2_atom_forge_bool(forge, cmd->i32);
-			} break;
-			case COMMAND_INT:
-			{
-				if(ref)
-					ref = lv2_atom_forge_int(forge, cmd->i32);
-			} break;
-			case COMMAND_FLOAT:
-			{
-				if(ref)
-					ref = lv2_atom_forge_float(forge, cmd->f32);
-			} break;
-			case COMMAND_OPCODE:
-			{
-				const LV2_URID otype = vm_api_map(impl, cmd->op);
-				if(ref && otype)
-					ref = lv2_atom_forge_urid(forge, otype);
-			} break;
-			case COMMAND_NOP:
-			{
-				terminate = true;
-			} break;
-			case COMMAND_MAX:
-				break;
+			const LV2_Atom_Int *nrem = (const LV2_Atom_Int *)items;
+
+			if( (items_size < sizeof(LV2_Atom_Int)) || (nrem->atom.type != forge->Int)
+				|| (nrem->body <= 0) )
+				return false;
+
+			return vm_graph_splice(body, size, max_size, idx->body, nrem->body, NULL, 0);
 		}
+		case PROPS_DYN_EV_ADD:
+		{
+			if(vm_graph_splice(body, size, max_size, idx->body, 0, items, items_size))
+				return true;
 
-		if(terminate)
+			if(need)
+				*need = *size + items_size;
+		} break;
+		case PROPS_DYN_EV_SET:
 			break;
 	}
 
-	if(ref)
-		lv2_atom_forge_pop(forge, &frame);
-
-	return ref;
+	return false;
 }
 
 static inline vm_status_t
 vm_graph_deserialize(vm_api_impl_t *impl, LV2_Atom_Forge *forge,
-	vm_command_t *cmds, uint32_t size, const LV2_Atom *body)
+	vm_command_t *cmds, uint32_t nitems, uint32_t size, const LV2_Atom *body)
 {
 	vm_command_t *cmd = cmds;
-	memset(cmds, 0x0, sizeof(vm_command_t)*ITEMS_MAX);
+	memset(cmds, 0x0, sizeof(vm_command_t)*nitems);
 
 	vm_status_t state = VM_STATUS_STATIC;
 
@@ -987,147 +1337,2544 @@ vm_graph_deserialize(vm_api_impl_t *impl, LV2_Atom_Forge *forge,
 			break;
 		}
 
-		if(++cmd >= cmds + ITEMS_MAX)
+		if(++cmd >= cmds + nitems)
 			break;
 	}
 
 	return state;
 }
 
-static inline LV2_Atom_Forge_Ref
-vm_filter_serialize(LV2_Atom_Forge *forge, const vm_filter_impl_t *impl,
-	const vm_filter_t *filters)
+// drops earlier allocations, grows backing memory, not real-time safe
+static inline bool
+vm_arena_reserve(vm_arena_t *arena, size_t size)
 {
-	LV2_Atom_Forge_Frame frame [2];
-	LV2_Atom_Forge_Ref ref = lv2_atom_forge_tuple(forge, &frame[0]);
+	arena->used = 0;
 
-	for(unsigned i = 0; i < CTRL_MAX; i++)
-	{
-		const vm_filter_t *filter = &filters[i];
+	if(size <= arena->size)
+		return true;
 
-		switch(filter->type)
-		{
-			case FILTER_CONTROLLER:
-			{
-				if(ref)
-					ref = lv2_atom_forge_object(forge, &frame[1], 0, impl->midi_Controller);
+	uint8_t *buf = calloc(1, size);
+	if(!buf)
+		return false;
 
-				if(ref)
-					ref = lv2_atom_forge_key(forge, impl->midi_channel);
-				if(ref)
-					ref = lv2_atom_forge_int(forge, filter->channel);
+	free(arena->buf);
+	arena->buf = buf;
+	arena->size = size;
 
-				if(ref)
-					ref = lv2_atom_forge_key(forge, impl->midi_controllerNumber);
-				if(ref)
-					ref = lv2_atom_forge_int(forge, filter->value);
+	return true;
+}
 
-				if(ref)
-					lv2_atom_forge_pop(forge, &frame[1]);
-			} break;
-			case FILTER_BENDER:
-			{
-				if(ref)
-					ref = lv2_atom_forge_object(forge, &frame[1], 0, impl->midi_Bender);
+static inline void *
+vm_arena_alloc(vm_arena_t *arena, size_t size)
+{
+	const size_t used = (arena->used + 0xf) & ~(size_t)0xf;
 
-				if(ref)
-					ref = lv2_atom_forge_key(forge, impl->midi_channel);
-				if(ref)
-					ref =lv2_atom_forge_int(forge, filter->channel);
+	if(used + size > arena->size)
+		return NULL;
 
-				if(ref)
-					lv2_atom_forge_pop(forge, &frame[1]);
-			} break;
-			case FILTER_PROGRAM_CHANGE:
-			{
-				if(ref)
-					ref = lv2_atom_forge_object(forge, &frame[1], 0, impl->midi_ProgramChange);
+	arena->used = used + size;
 
-				if(ref)
-					ref = lv2_atom_forge_key(forge, impl->midi_channel);
-				if(ref)
-					ref =lv2_atom_forge_int(forge, filter->channel);
+	return arena->buf + used;
+}
 
-				if(ref)
-					lv2_atom_forge_pop(forge, &frame[1]);
-			} break;
-			case FILTER_CHANNEL_PRESSURE:
-			{
-				if(ref)
-					ref = lv2_atom_forge_object(forge, &frame[1], 0, impl->midi_ChannelPressure);
+static inline void
+vm_arena_deinit(vm_arena_t *arena)
+{
+	free(arena->buf);
+	memset(arena, 0x0, sizeof(vm_arena_t));
+}
 
-				if(ref)
-					ref = lv2_atom_forge_key(forge, impl->midi_channel);
-				if(ref)
-					ref =lv2_atom_forge_int(forge, filter->channel);
+struct _vm_scratch_t {
+	vm_arena_t *arena;
+	size_t used;
+};
 
-				if(ref)
-					lv2_atom_forge_pop(forge, &frame[1]);
-			} break;
-			case FILTER_NOTE_ON:
-			{
-				if(ref)
-					ref = lv2_atom_forge_object(forge, &frame[1], 0, impl->midi_NoteOn);
+static inline void
+_vm_scratch_release(vm_scratch_t *scratch)
+{
+	scratch->arena->used = scratch->used;
+}
 
-				if(ref)
-					ref = lv2_atom_forge_key(forge, impl->midi_channel);
-				if(ref)
-					ref =lv2_atom_forge_int(forge, filter->channel);
+// temporaries taken from scratch arena of PROG are handed back on scope exit
+#define VM_SCRATCH_SCOPE(PROG) \
+	vm_scratch_t _scratch __attribute__((cleanup(_vm_scratch_release))) = { \
+		.arena = (PROG)->scratch, \
+		.used = (PROG)->scratch->used \
+	}
 
-				if(ref)
-					ref = lv2_atom_forge_key(forge, impl->midi_velocity);
-				if(ref)
-					ref =lv2_atom_forge_int(forge, filter->value);
+// one temporary per instruction, end of program included, NULL if exhausted
+#define VM_SCRATCH(PROG, TYPE) \
+	((TYPE *)vm_arena_alloc((PROG)->scratch, sizeof(TYPE)*((PROG)->ninst + 1)))
 
-				if(ref)
-					lv2_atom_forge_pop(forge, &frame[1]);
-			} break;
-			case FILTER_NOTE_PRESSURE:
-			{
-				if(ref)
-					ref = lv2_atom_forge_object(forge, &frame[1], 0, impl->midi_NotePressure);
+// earlier event first, lower sequence index first on ties
+static inline bool
+_vm_merge_before(const vm_merge_t *merge, unsigned a, unsigned b)
+{
+	const int64_t ta = merge->evs[a]->time.frames;
+	const int64_t tb = merge->evs[b]->time.frames;
 
-				if(ref)
-					ref = lv2_atom_forge_key(forge, impl->midi_channel);
-				if(ref)
-					ref =lv2_atom_forge_int(forge, filter->channel);
+	return (ta < tb) || ( (ta == tb) && (a < b) );
+}
 
-				if(ref)
-					ref = lv2_atom_forge_key(forge, impl->midi_noteNumber);
-				if(ref)
-					ref =lv2_atom_forge_int(forge, filter->value);
+static inline void
+_vm_merge_sift(vm_merge_t *merge, unsigned pos)
+{
+	const uint8_t idx = merge->heap[pos];
 
-				if(ref)
-					lv2_atom_forge_pop(forge, &frame[1]);
-			} break;
-			//FIXME handle more types
+	while(true)
+	{
+		unsigned child = 2*pos + 1;
 
-			case FILTER_MAX:
-			{
-				// nothing
-			}	break;
-		}
-	}
+		if(child >= merge->nheap)
+			break;
 
-	if(ref)
-		lv2_atom_forge_pop(forge, &frame[0]);
+		if( (child + 1 < merge->nheap)
+				&& _vm_merge_before(merge, merge->heap[child + 1], merge->heap[child]) )
+			child += 1;
 
-	return ref;
+		if(!_vm_merge_before(merge, merge->heap[child], idx))
+			break;
+
+		merge->heap[pos] = merge->heap[child];
+		pos = child;
+	}
+
+	merge->heap[pos] = idx;
 }
 
-static inline int
-vm_filter_deserialize(LV2_Atom_Forge *forge, const vm_filter_impl_t *impl,
-	vm_filter_t *filters, uint32_t size, const LV2_Atom *body)
+// k-way merge of event sequences in time order
+static inline void
+vm_merge_init(vm_merge_t *merge, const LV2_Atom_Sequence *const *seqs,
+	unsigned nseqs)
 {
-	memset(filters, 0x0, sizeof(vm_filter_t)*CTRL_MAX);
+	merge->nheap = 0;
 
-	unsigned i = 0;
-	LV2_ATOM_TUPLE_BODY_FOREACH(body, size, atom)
+	for(unsigned i = 0; (i < nseqs) && (i < MERGE_MAX); i++)
 	{
-		vm_filter_t *filter = &filters[i];
+		const LV2_Atom_Sequence *seq = seqs[i];
 
-		if(lv2_atom_forge_is_object_type(forge, atom->type))
-		{
+		merge->seqs[i] = seq;
+		merge->evs[i] = lv2_atom_sequence_begin(&seq->body);
+
+		if(!lv2_atom_sequence_is_end(&seq->body, seq->atom.size, merge->evs[i]))
+			merge->heap[merge->nheap++] = i;
+	}
+
+	for(unsigned pos = merge->nheap / 2; pos-- > 0; )
+		_vm_merge_sift(merge, pos);
+}
+
+// next event in time order or NULL if drained, idx is its sequence
+static inline const LV2_Atom_Event *
+vm_merge_peek(const vm_merge_t *merge, unsigned *idx)
+{
+	if(!merge->nheap)
+		return NULL;
+
+	*idx = merge->heap[0];
+
+	return merge->evs[*idx];
+}
+
+static inline void
+vm_merge_next(vm_merge_t *merge)
+{
+	if(!merge->nheap)
+		return;
+
+	const unsigned idx = merge->heap[0];
+	const LV2_Atom_Sequence *seq = merge->seqs[idx];
+
+	merge->evs[idx] = lv2_atom_sequence_next(merge->evs[idx]);
+
+	if(lv2_atom_sequence_is_end(&seq->body, seq->atom.size, merge->evs[idx]))
+		merge->heap[0] = merge->heap[--merge->nheap]; // sequence drained
+
+	if(merge->nheap)
+		_vm_merge_sift(merge, 0);
+}
+
+static inline void
+vm_prog_init(vm_prog_t *prog, vm_inst_t *inst, uint32_t size,
+	vm_arena_t *scratch)
+{
+	memset(prog, 0x0, sizeof(vm_prog_t));
+	prog->inst = inst;
+	prog->size = size;
+	prog->wrap = ITEMS_MASK;
+	prog->scratch = scratch;
+}
+
+static inline void
+vm_prog_clear(vm_prog_t *prog)
+{
+	memset(prog->inst, 0x0, sizeof(vm_inst_t)*prog->size);
+	prog->ninst = 0;
+	prog->status = VM_STATUS_STATIC;
+	prog->verified = false;
+	prog->base = 0;
+	prog->wrap = ITEMS_MASK;
+	prog->params = 0;
+}
+
+// copy into storage of dst, false if it does not fit
+static inline bool
+vm_prog_copy(vm_prog_t *dst, const vm_prog_t *src)
+{
+	if(src->ninst > dst->size)
+		return false;
+
+	vm_prog_clear(dst);
+	memcpy(dst->inst, src->inst, sizeof(vm_inst_t)*src->ninst);
+	dst->ninst = src->ninst;
+	dst->status = src->status;
+	dst->verified = src->verified;
+	dst->base = src->base;
+	dst->wrap = src->wrap;
+	dst->params = src->params;
+
+	return true;
+}
+
+// compiles as many commands as fit into storage of prog
+static inline void
+vm_graph_compile(vm_prog_t *prog, const vm_command_t *cmds, vm_status_t status)
+{
+	VM_SCRATCH_SCOPE(prog);
+	int prod [SLOT_MAX]; // producing immediate of each stack slot or -1
+	int *src = vm_arena_alloc(prog->scratch, sizeof(int)*(prog->size + 1)); // producing immediate of each goto target or -1
+	int ptr = 0;
+	bool resolve = (src != NULL); // gotos stay dynamic without scratch space
+
+	vm_prog_clear(prog);
+	prog->status = status;
+
+	for(unsigned i = 0; i < SLOT_MAX; i++)
+		prod[i] = -1;
+
+	for(unsigned i = 0; i < prog->size; i++)
+	{
+		const vm_command_t *cmd = &cmds[i];
+		vm_inst_t *inst = &prog->inst[i];
+
+		if(resolve)
+			src[i] = -1;
+
+		switch(cmd->type)
+		{
+			case COMMAND_BOOL:
+			case COMMAND_INT:
+			{
+				inst->op = INST_IMM;
+				inst->imm = cmd->i32;
+				inst->npushs = 1;
+			} break;
+			case COMMAND_FLOAT:
+			{
+				inst->op = INST_IMM;
+				inst->imm = cmd->f32;
+				inst->npushs = 1;
+			} break;
+			case COMMAND_OPCODE:
+			{
+				inst->op = cmd->op;
+				inst->npops = vm_api_def[cmd->op].npops;
+				inst->npushs = vm_api_def[cmd->op].npushs;
+			} break;
+			case COMMAND_NOP:
+			case COMMAND_MAX:
+				break;
+		}
+
+		if(cmd->type == COMMAND_NOP)
+			break;
+
+		prog->ninst = i + 1;
+
+		// track immediates through the stack to find static goto targets
+		const int top = prod[ptr];
+		const int nxt = prod[(ptr + 1) & SLOT_MASK];
+
+		if( resolve && (inst->op == OP_GOTO) )
+		{
+			src[i] = nxt;
+
+			if(nxt == -1)
+				resolve = false;
+		}
+
+		for(unsigned j = 0; j < inst->npops; j++)
+			prod[(ptr + j) & SLOT_MASK] = -1;
+
+		ptr = (ptr + inst->npops - inst->npushs) & SLOT_MASK;
+
+		for(unsigned j = 0; j < inst->npushs; j++)
+			prod[(ptr + j) & SLOT_MASK] = -1;
+
+		if(inst->op == INST_IMM)
+		{
+			prod[ptr] = i;
+		}
+		else if(inst->op == OP_PUSH)
+		{
+			prod[ptr] = top;
+			prod[(ptr + 1) & SLOT_MASK] = top;
+		}
+		else if(inst->op == OP_SWAP)
+		{
+			prod[ptr] = nxt;
+			prod[(ptr + 1) & SLOT_MASK] = top;
+		}
+	}
+
+	// targets of graphs not longer than before wrap as they always did
+	prog->wrap = (prog->ninst <= ITEMS_LEGACY)
+		? ITEMS_LEGACY - 1
+		: ITEMS_MASK;
+
+	// a target is only static if no jump lands between its immediate and goto
+	for(unsigned i = 0; resolve && (i < prog->ninst); i++)
+	{
+		if(src[i] == -1)
+			continue;
+
+		const int idx = prog->inst[src[i]].imm;
+		const uint32_t target = idx & prog->wrap;
+
+		for(unsigned j = 0; j < prog->ninst; j++)
+		{
+			if( (src[j] != -1) && ((int)target > src[j]) && (target <= j) )
+				resolve = false;
+		}
+	}
+
+	for(unsigned i = 0; resolve && (i < prog->ninst); i++)
+	{
+		if(src[i] == -1)
+			continue;
+
+		vm_inst_t *inst = &prog->inst[i];
+		const int idx = prog->inst[src[i]].imm;
+		const uint32_t target = idx & prog->wrap;
+
+		inst->op = INST_JMP;
+		inst->target = (target < prog->ninst)
+			? target
+			: prog->ninst; // jumps past the end halt
+	}
+
+	// flag parameter registers stored into, all of them if index not static
+	for(unsigned i = 0; resolve && (i <= prog->ninst); i++)
+		src[i] = -1;
+
+	for(unsigned i = 0; resolve && (i < prog->ninst); i++)
+	{
+		if(prog->inst[i].op == INST_JMP)
+			src[prog->inst[i].target] = i;
+	}
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		if(prog->inst[i].op != OP_STORE)
+			continue;
+
+		const vm_inst_t *imm = (i > 0) ? &prog->inst[i - 1] : NULL;
+
+		if(resolve && imm && (imm->op == INST_IMM) && (src[i] == -1)
+			&& (fabs(imm->imm) < 0x40000000) )
+		{
+			const unsigned idx = (int)floorf(imm->imm) & REG_MASK; // as in OP_STORE
+
+			if(idx < PARAM_MAX)
+				prog->params |= 1U << idx;
+		}
+		else
+		{
+			prog->params = (1U << PARAM_MAX) - 1;
+		}
+	}
+}
+
+static inline bool
+_vm_inst_is_time(unsigned op)
+{
+	return (op >= OP_BAR_BEAT) && (op <= OP_SPEED);
+}
+
+// ring cells read and written by an instruction at stack pointer ptr
+static inline void
+_vm_inst_cells(const vm_inst_t *inst, int ptr, uint32_t *reads, uint32_t *writes)
+{
+	const int end = ptr + inst->npops - inst->npushs;
+
+	*reads = 0;
+	*writes = 0;
+
+	switch(inst->op)
+	{
+		case OP_POP:
+		{
+			// nothing read or written
+		} break;
+		case OP_PUSH:
+		{
+			*reads = 1U << (ptr & SLOT_MASK);
+			*writes = 1U << (end & SLOT_MASK);
+		} break;
+		case INST_JMP:
+		{
+			*reads = 1U << (ptr & SLOT_MASK); // target is static
+		} break;
+		default:
+		{
+			for(unsigned j = 0; j < inst->npops; j++)
+				*reads |= 1U << ((ptr + j) & SLOT_MASK);
+			for(unsigned j = 0; j < inst->npushs; j++)
+				*writes |= 1U << ((end + j) & SLOT_MASK);
+		} break;
+	}
+}
+
+// cells popped as given outputs when the program ends at stack pointer ptr
+static inline uint32_t
+_vm_prog_outputs(int ptr, uint32_t outputs)
+{
+	uint32_t mask = 0;
+
+	if(ptr == -1)
+		return 0;
+
+	for(unsigned j = 0; j < CTRL_MAX; j++)
+	{
+		if(outputs & (1U << j))
+			mask |= 1U << ((ptr + j) & SLOT_MASK);
+	}
+
+	return mask;
+}
+
+// condition of break/jump, if pushed as immediate right before
+static inline bool
+_vm_prog_cond(const vm_prog_t *prog, const bool *target, unsigned i, bool *cond)
+{
+	if( (i == 0) || target[i] || (prog->inst[i - 1].op != INST_IMM) )
+		return false;
+
+	*cond = prog->inst[i - 1].imm;
+
+	return true;
+}
+
+// jump targets of all resolved gotos
+static inline void
+_vm_prog_targets(const vm_prog_t *prog, bool *target)
+{
+	for(unsigned i = 0; i <= prog->ninst; i++)
+		target[i] = false;
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		if(prog->inst[i].op == INST_JMP)
+			target[prog->inst[i].target] = true;
+	}
+}
+
+// successors of instruction, ninst denotes the end of program
+static inline unsigned
+_vm_prog_succ(const vm_prog_t *prog, const bool *target, unsigned i,
+	uint32_t succ [2], bool *exits)
+{
+	const vm_inst_t *inst = &prog->inst[i];
+	bool cond;
+
+	*exits = false;
+
+	switch(inst->op)
+	{
+		case OP_BREAK:
+		{
+			if(_vm_prog_cond(prog, target, i, &cond))
+			{
+				*exits = cond;
+				succ[0] = i + 1;
+				return cond ? 0 : 1;
+			}
+
+			*exits = true;
+			succ[0] = i + 1;
+			return 1;
+		}
+		case INST_JMP:
+		{
+			succ[0] = inst->target;
+
+			if(_vm_prog_cond(prog, target, i, &cond))
+			{
+				if(!cond)
+					succ[0] = i + 1;
+				return 1;
+			}
+
+			succ[1] = i + 1;
+			return 2;
+		}
+		default:
+		{
+			succ[0] = i + 1;
+			return 1;
+		}
+	}
+}
+
+// static stack pointer before each instruction, -1 if unreachable
+static inline bool
+vm_prog_depth(const vm_prog_t *prog, int *ptr)
+{
+	VM_SCRATCH_SCOPE(prog);
+	bool *target = VM_SCRATCH(prog, bool);
+
+	if(!target)
+		return false;
+
+	_vm_prog_targets(prog, target);
+
+	for(unsigned i = 0; i <= prog->ninst; i++)
+		ptr[i] = -1;
+
+	ptr[0] = 0;
+
+	for(bool changed = true; changed; )
+	{
+		changed = false;
+
+		for(unsigned i = 0; i < prog->ninst; i++)
+		{
+			const vm_inst_t *inst = &prog->inst[i];
+			uint32_t succ [2];
+			bool exits;
+
+			if(ptr[i] == -1)
+				continue;
+
+			if(inst->op == OP_GOTO)
+				return false; // dynamic target
+
+			const int nxt = (ptr[i] + inst->npops - inst->npushs) & SLOT_MASK;
+			const unsigned nsucc = _vm_prog_succ(prog, target, i, succ, &exits);
+
+			for(unsigned j = 0; j < nsucc; j++)
+			{
+				if(ptr[succ[j]] == -1)
+				{
+					ptr[succ[j]] = nxt;
+					changed = true;
+				}
+				else if(ptr[succ[j]] != nxt)
+				{
+					return false; // stack depth depends on path
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+// exact stack depth after each instruction, INT_MIN if unknown
+static inline vm_verify_t
+vm_prog_verify(vm_prog_t *prog, int *depth, uint8_t *errs)
+{
+	VM_SCRATCH_SCOPE(prog);
+	bool *target = VM_SCRATCH(prog, bool);
+	int *d = VM_SCRATCH(prog, int); // depth before each instruction
+	vm_verify_t res = VM_VERIFY_OK;
+
+	prog->verified = false;
+
+	if(!target || !d)
+		return VM_VERIFY_DYNAMIC; // left to ring interpreter
+
+	_vm_prog_targets(prog, target);
+
+	for(unsigned i = 0; i <= prog->ninst; i++)
+		d[i] = INT_MIN;
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		if(depth)
+			depth[i] = INT_MIN;
+		if(errs)
+			errs[i] = VM_VERIFY_OK;
+	}
+
+	d[0] = 0;
+
+	for(bool changed = true; changed; )
+	{
+		changed = false;
+
+		for(unsigned i = 0; i < prog->ninst; i++)
+		{
+			const vm_inst_t *inst = &prog->inst[i];
+			uint32_t succ [2];
+			bool exits;
+
+			if(d[i] == INT_MIN)
+				continue;
+
+			if(inst->op == OP_GOTO)
+			{
+				if(errs)
+					errs[i] = VM_VERIFY_DYNAMIC;
+				return VM_VERIFY_DYNAMIC; // computed target
+			}
+
+			const int nxt = d[i] - inst->npops + inst->npushs;
+			unsigned nsucc = _vm_prog_succ(prog, target, i, succ, &exits);
+
+			if(exits) // break joins the end of program
+				succ[nsucc++] = prog->ninst;
+
+			for(unsigned j = 0; j < nsucc; j++)
+			{
+				if(d[succ[j]] == INT_MIN)
+				{
+					d[succ[j]] = nxt;
+					changed = true;
+				}
+				else if(d[succ[j]] != nxt)
+				{
+					if(errs)
+						errs[i] = VM_VERIFY_DYNAMIC;
+					return VM_VERIFY_DYNAMIC;
+				}
+			}
+		}
+	}
+
+	int hi = 0; // deepest stack
+	int lo = (d[prog->ninst] == INT_MIN) // lowest cell read, outputs included
+		? 0
+		: d[prog->ninst] - CTRL_MAX;
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		const vm_inst_t *inst = &prog->inst[i];
+
+		if(d[i] == INT_MIN)
+			continue; // unreachable
+
+		const int nxt = d[i] - inst->npops + inst->npushs;
+		const int reach = (inst->op == INST_HSAVE)
+			? d[i] - 1 - (int)inst->imm
+			: d[i] - inst->npops;
+		vm_verify_t err = VM_VERIFY_OK;
+
+		if(nxt > SLOT_MAX)
+			err = VM_VERIFY_OVERFLOW;
+		else if(inst->npops && (reach < 0))
+			err = VM_VERIFY_UNDERFLOW;
+
+		if(err > res)
+			res = err;
+		if(depth)
+			depth[i] = nxt;
+		if(errs)
+			errs[i] = err;
+
+		if(nxt > hi)
+			hi = nxt;
+		if(reach < lo)
+			lo = reach;
+	}
+
+	if(hi - lo > SLOT_MAX)
+		return res; // cells alias on ring
+
+	// lay out stack with deepest cell at slot 0, no access wraps around
+	for(unsigned i = 0; i < prog->ninst; i++)
+		prog->inst[i].ptr = (d[i] == INT_MIN) ? 0 : hi - d[i];
+
+	prog->base = hi;
+	prog->verified = true;
+
+	return res;
+}
+
+// rough cost of instruction in nanoseconds, dispatch included
+static inline float
+_vm_inst_cost(unsigned op)
+{
+	switch(op)
+	{
+		case OP_NOP:
+		case INST_SKIP:
+			return 0.f;
+		case OP_DIV:
+		case OP_MOD:
+		case OP_SQRT:
+		case OP_FLOOR:
+		case OP_CEIL:
+		case OP_ROUND:
+		case OP_RINT:
+		case OP_TRUNC:
+		case OP_MODF:
+		case OP_LD_EXP:
+		case OP_FR_EXP:
+		case OP_RAND:
+			return 5.f;
+		case OP_POW:
+		case OP_CBRT:
+		case OP_EXP:
+		case OP_EXP_2:
+		case OP_LOG:
+		case OP_LOG_2:
+		case OP_LOG_10:
+		case OP_SIN:
+		case OP_COS:
+		case OP_TAN:
+		case OP_ASIN:
+		case OP_ACOS:
+		case OP_ATAN:
+		case OP_ATAN2:
+		case OP_SINH:
+		case OP_COSH:
+		case OP_TANH:
+		case OP_ASINH:
+		case OP_ACOSH:
+		case OP_ATANH:
+			return 25.f;
+		default:
+		{
+			if( (op >= OP_BAR_BEAT) && (op <= OP_SPEED) )
+				return 5.f; // read from timely
+		} break;
+	}
+
+	return 2.f;
+}
+
+// worst-case execution time of one evaluation in nanoseconds
+static inline float
+vm_prog_wcet(const vm_prog_t *prog)
+{
+	float sum = 0.f;
+	float loop = 0.f; // most expensive instruction a backward jump may repeat
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		const vm_inst_t *inst = &prog->inst[i];
+
+		sum += _vm_inst_cost(inst->op);
+
+		// computed targets may repeat anything, static ones their loop body
+		const unsigned from = (inst->op == OP_GOTO)
+			? 0
+			: ( (inst->op == INST_JMP) && (inst->target <= i) )
+				? inst->target
+				: i + 1;
+
+		for(unsigned j = from; j <= i; j++)
+		{
+			const float cost = _vm_inst_cost(prog->inst[j].op);
+
+			if(cost > loop)
+				loop = cost;
+		}
+	}
+
+	return sum + VM_BUDGET*loop;
+}
+
+// jump and fall-through edges of instruction, jumps land on dest
+static inline void
+_vm_ir_edges(const vm_prog_t *prog, const bool *target, unsigned i,
+	bool *jumps, bool *falls, uint32_t *dest)
+{
+	const vm_inst_t *inst = &prog->inst[i];
+	bool cond;
+
+	*jumps = false;
+	*falls = true;
+
+	if( (inst->op != OP_BREAK) && (inst->op != INST_JMP) )
+		return;
+
+	*dest = (inst->op == OP_BREAK) ? prog->ninst : inst->target;
+
+	if(_vm_prog_cond(prog, target, i, &cond))
+	{
+		*jumps = cond;
+		*falls = !cond;
+		return;
+	}
+
+	*jumps = true;
+}
+
+static inline vm_ir_inst_t *
+_vm_ir_emit(vm_ir_t *ir, unsigned op)
+{
+	if(ir->ninst >= IR_INST_MAX)
+		return NULL;
+
+	vm_ir_inst_t *inst = &ir->inst[ir->ninst++];
+	inst->op = op;
+
+	return inst;
+}
+
+// cells from top of jump target down to deepest slot read, outputs at end
+static inline unsigned
+_vm_ir_nparams(unsigned ptr, unsigned bot, bool end)
+{
+	if(end)
+		return CTRL_MAX;
+
+	return (ptr > bot) ? 0 : bot + 1 - ptr;
+}
+
+// moves needed to enter jump target with parameters starting at param
+static inline unsigned
+_vm_ir_moves(const uint8_t *cell, unsigned nparams, unsigned param)
+{
+	unsigned nmoves = 0;
+
+	for(unsigned j = 0; j < nparams; j++)
+	{
+		if(cell[j] != param + j)
+			nmoves++;
+	}
+
+	return nmoves;
+}
+
+static inline bool
+_vm_ir_move(vm_ir_t *ir, const uint8_t *cell, unsigned nparams, unsigned param)
+{
+	for(unsigned j = 0; j < nparams; j++)
+	{
+		if(cell[j] == param + j)
+			continue;
+
+		if( (cell[j] >= param) && (cell[j] < param + j) )
+			return false; // source already overwritten, needs a cycle breaker
+
+		vm_ir_inst_t *inst = _vm_ir_emit(ir, IR_MOVE);
+		if(!inst)
+			return false;
+
+		inst->dst[0] = param + j;
+		inst->src[0] = cell[j];
+	}
+
+	return true;
+}
+
+// translate verified program into register form, stack cells become single
+// assignment values, cells live at a jump target become its parameters
+static inline bool
+vm_ir_build(vm_ir_t *ir, const vm_prog_t *prog)
+{
+	VM_SCRATCH_SCOPE(prog);
+	bool *target = VM_SCRATCH(prog, bool);
+	bool *reach = VM_SCRATCH(prog, bool);
+	bool *fall = VM_SCRATCH(prog, bool); // entered from preceding instruction
+	bool *join = VM_SCRATCH(prog, bool); // entered by jump
+	uint8_t *ptr = VM_SCRATCH(prog, uint8_t); // fixed slot of top, end of program included
+	unsigned *param = VM_SCRATCH(prog, unsigned); // first parameter of each join
+	uint32_t *label = VM_SCRATCH(prog, uint32_t); // IR index of each instruction
+	bool local [IR_INST_MAX]; // jump target already is an IR index
+	uint8_t cell [SLOT_MAX]; // value held by each slot
+	unsigned bot = 0; // deepest slot read
+	const uint32_t end = prog->ninst;
+
+	memset(ir, 0x0, sizeof(vm_ir_t));
+	ir->nvals = IR_ZERO + 1;
+
+	if(!prog->verified || !target || !reach || !fall || !join || !ptr || !param || !label)
+		return false;
+
+	for(unsigned i = 0; i < end; i++)
+	{
+		if( (prog->inst[i].op == INST_JMP) && (prog->inst[i].target <= i) )
+			return false; // loops stay with budgeted stack interpreter
+	}
+
+	_vm_prog_targets(prog, target);
+
+	for(unsigned i = 0; i <= end; i++)
+	{
+		reach[i] = false;
+		fall[i] = false;
+		join[i] = false;
+		param[i] = 0;
+		ptr[i] = (i < end) ? prog->inst[i].ptr : 0;
+	}
+
+	reach[0] = true;
+	fall[0] = true;
+
+	for(bool changed = true; changed; )
+	{
+		changed = false;
+
+		for(unsigned i = 0; i < end; i++)
+		{
+			const vm_inst_t *inst = &prog->inst[i];
+			const uint8_t nxt = inst->ptr + inst->npops - inst->npushs;
+			bool jumps;
+			bool falls;
+			uint32_t dest;
+
+			if(!reach[i])
+				continue;
+
+			_vm_ir_edges(prog, target, i, &jumps, &falls, &dest);
+
+			if(jumps && !join[dest])
+			{
+				join[dest] = true;
+				changed |= !reach[dest];
+				reach[dest] = true;
+				if(dest == end)
+					ptr[end] = nxt;
+			}
+
+			if(falls && !fall[i + 1])
+			{
+				fall[i + 1] = true;
+				changed |= !reach[i + 1];
+				reach[i + 1] = true;
+				if(i + 1 == end)
+					ptr[end] = nxt;
+			}
+		}
+	}
+
+	if(!reach[end])
+		return false; // never terminates
+
+	for(unsigned i = 0; i < end; i++)
+	{
+		const vm_inst_t *inst = &prog->inst[i];
+		const unsigned deepest = (inst->op == INST_HSAVE)
+			? inst->ptr + (unsigned)inst->imm
+			: inst->ptr + inst->npops - 1U;
+
+		if(reach[i] && (inst->npops || (inst->op == INST_HSAVE)) && (deepest > bot))
+			bot = deepest;
+	}
+
+	const unsigned outputs = ptr[end] + CTRL_MAX - 1U;
+
+	if(outputs > bot)
+		bot = outputs;
+
+	if(bot >= SLOT_MAX)
+		return false;
+
+	for(unsigned j = 0; j < SLOT_MAX; j++)
+		cell[j] = IR_ZERO;
+
+	for(unsigned k = 0; k < IR_INST_MAX; k++)
+		local[k] = false;
+
+	for(unsigned i = 0; i <= end; i++)
+	{
+		const unsigned nparams = _vm_ir_nparams(ptr[i], bot, i == end);
+
+		if(join[i])
+		{
+			if(!param[i])
+			{
+				if(ir->nvals + nparams > IR_VALS_MAX)
+					return false;
+
+				param[i] = ir->nvals;
+				ir->nvals += nparams;
+			}
+
+			if(fall[i] && !_vm_ir_move(ir, &cell[ptr[i]], nparams, param[i]))
+				return false;
+
+			for(unsigned j = 0; j < nparams; j++)
+				cell[ptr[i] + j] = param[i] + j;
+		}
+
+		label[i] = ir->ninst;
+
+		if( (i == end) || !reach[i] )
+			continue;
+
+		const vm_inst_t *inst = &prog->inst[i];
+		const unsigned p = inst->ptr;
+
+		switch(inst->op)
+		{
+			case OP_NOP:
+			case OP_POP:
+			case INST_SKIP: // leaves stale cells, like the stack does
+			{
+				// nothing
+			} break;
+			case OP_PUSH:
+			{
+				cell[p - 1] = cell[p];
+			} break;
+			case OP_SWAP:
+			{
+				const uint8_t tmp = cell[p];
+				cell[p] = cell[p + 1];
+				cell[p + 1] = tmp;
+			} break;
+			case OP_BREAK:
+			case INST_JMP:
+			{
+				bool jumps;
+				bool falls;
+				uint32_t dest;
+
+				_vm_ir_edges(prog, target, i, &jumps, &falls, &dest);
+
+				if(!jumps)
+					break;
+
+				const unsigned n = _vm_ir_nparams(ptr[dest], bot, dest == end);
+
+				if(!param[dest])
+				{
+					if(ir->nvals + n > IR_VALS_MAX)
+						return false;
+
+					param[dest] = ir->nvals;
+					ir->nvals += n;
+				}
+
+				vm_ir_inst_t *skip = NULL;
+				vm_ir_inst_t *jump;
+
+				if(falls && !_vm_ir_moves(&cell[ptr[dest]], n, param[dest]))
+				{
+					if(!(jump = _vm_ir_emit(ir, IR_JMP_IF)))
+						return false;
+
+					jump->src[0] = cell[p];
+				}
+				else
+				{
+					if(falls)
+					{
+						if(!(skip = _vm_ir_emit(ir, IR_JMP_NOT)))
+							return false;
+
+						skip->src[0] = cell[p];
+						local[ir->ninst - 1] = true;
+					}
+
+					if(!_vm_ir_move(ir, &cell[ptr[dest]], n, param[dest])
+						|| !(jump = _vm_ir_emit(ir, IR_JMP)) )
+						return false;
+				}
+
+				jump->target = dest;
+
+				if(skip)
+					skip->target = ir->ninst;
+			} break;
+			case INST_HSAVE:
+			{
+				vm_ir_inst_t *save = _vm_ir_emit(ir, inst->op);
+				if(!save)
+					return false;
+
+				save->src[0] = cell[p + (unsigned)inst->imm];
+				save->target = inst->target;
+			} break;
+			default:
+			{
+				vm_ir_inst_t *op = _vm_ir_emit(ir, inst->op);
+				if(!op || (ir->nvals + inst->npushs > IR_VALS_MAX))
+					return false;
+
+				op->imm = inst->imm;
+				op->target = inst->target;
+
+				for(unsigned j = 0; j < inst->npops; j++)
+					op->src[j] = cell[p + j];
+
+				const unsigned q = p + inst->npops - inst->npushs;
+
+				for(unsigned j = 0; j < inst->npushs; j++)
+				{
+					op->dst[j] = ir->nvals++;
+					cell[q + j] = op->dst[j];
+				}
+			} break;
+		}
+	}
+
+	for(unsigned k = 0; k < ir->ninst; k++)
+	{
+		vm_ir_inst_t *inst = &ir->inst[k];
+
+		if( (inst->op >= IR_JMP) && (inst->op <= IR_JMP_NOT) && !local[k] )
+			inst->target = label[inst->target];
+	}
+
+	for(unsigned j = 0; j < CTRL_MAX; j++)
+		ir->out[j] = cell[ptr[end] + j];
+
+	ir->enabled = true;
+
+	return true;
+}
+
+// like fminnm/fmaxnm, libm leaves the sign of equal zeros unspecified
+static inline num_t
+vm_mini(num_t a, num_t b)
+{
+	if(isnan(a))
+		return b;
+	if(isnan(b) || (a < b))
+		return a;
+	if(a == b)
+		return signbit(a) ? a : b;
+	return b;
+}
+
+static inline num_t
+vm_maxi(num_t a, num_t b)
+{
+	if(isnan(a))
+		return b;
+	if(isnan(b) || (a > b))
+		return a;
+	if(a == b)
+		return signbit(a) ? b : a;
+	return b;
+}
+
+static inline bool
+_vm_fold_int(num_t v)
+{
+	return (v > -2147483648.0) && (v < 2147483648.0);
+}
+
+static inline bool
+_vm_fold_uint(num_t v)
+{
+	return (v >= 0.0) && (v < 4294967296.0);
+}
+
+// evaluate pure opcode like the interpreter does, ab[0] being topmost
+static inline unsigned
+_vm_fold(unsigned op, const num_t *ab, num_t *c)
+{
+	switch(op)
+	{
+		case OP_PUSH:
+			c[0] = ab[0];
+			c[1] = ab[0];
+			return 2;
+		case OP_SWAP:
+			c[0] = ab[0];
+			c[1] = ab[1];
+			return 2;
+
+		case OP_ADD:
+			c[0] = ab[1] + ab[0];
+			return 1;
+		case OP_SUB:
+			c[0] = ab[1] - ab[0];
+			return 1;
+		case OP_MUL:
+			c[0] = ab[1] * ab[0];
+			return 1;
+		case OP_DIV:
+			c[0] = ab[0] == 0.0
+				? 0.0
+				: ab[1] / ab[0];
+			return 1;
+		case OP_MOD:
+			c[0] = ab[0] == 0.0
+				? 0.0
+				: fmod(ab[1], ab[0]);
+			return 1;
+		case OP_POW:
+			c[0] = pow(ab[1], ab[0]);
+			return 1;
+
+		case OP_NEG:
+			c[0] = -ab[0];
+			return 1;
+		case OP_ABS:
+			c[0] = fabs(ab[0]);
+			return 1;
+		case OP_SQRT:
+			c[0] = sqrt(ab[0]);
+			return 1;
+		case OP_CBRT:
+			c[0] = cbrt(ab[0]);
+			return 1;
+
+		case OP_FLOOR:
+			c[0] = floor(ab[0]);
+			return 1;
+		case OP_CEIL:
+			c[0] = ceil(ab[0]);
+			return 1;
+		case OP_ROUND:
+			c[0] = round(ab[0]);
+			return 1;
+		case OP_RINT:
+			c[0] = rint(ab[0]);
+			return 1;
+		case OP_TRUNC:
+			c[0] = trunc(ab[0]);
+			return 1;
+		case OP_MODF:
+			c[0] = modf(ab[0], &c[1]);
+			return 2;
+
+		case OP_EXP:
+			c[0] = exp(ab[0]);
+			return 1;
+		case OP_EXP_2:
+			c[0] = exp2(ab[0]);
+			return 1;
+		case OP_LD_EXP:
+		{
+			if(!_vm_fold_int(ab[0]))
+				return 0;
+			c[0] = ldexp(ab[1], ab[0]);
+		}	return 1;
+		case OP_FR_EXP:
+		{
+			int d;
+			c[0] = frexp(ab[0], &d);
+			c[1] = d;
+		}	return 2;
+		case OP_LOG:
+			c[0] = log(ab[0]);
+			return 1;
+		case OP_LOG_2:
+			c[0] = log2(ab[0]);
+			return 1;
+		case OP_LOG_10:
+			c[0] = log10(ab[0]);
+			return 1;
+
+		case OP_PI:
+			c[0] = M_PI;
+			return 1;
+		case OP_SIN:
+			c[0] = sin(ab[0]);
+			return 1;
+		case OP_COS:
+			c[0] = cos(ab[0]);
+			return 1;
+		case OP_TAN:
+			c[0] = tan(ab[0]);
+			return 1;
+		case OP_ASIN:
+			c[0] = asin(ab[0]);
+			return 1;
+		case OP_ACOS:
+			c[0] = acos(ab[0]);
+			return 1;
+		case OP_ATAN:
+			c[0] = atan(ab[0]);
+			return 1;
+		case OP_ATAN2:
+			c[0] = atan2(ab[1], ab[0]);
+			return 1;
+		case OP_SINH:
+			c[0] = sinh(ab[0]);
+			return 1;
+		case OP_COSH:
+			c[0] = cosh(ab[0]);
+			return 1;
+		case OP_TANH:
+			c[0] = tanh(ab[0]);
+			return 1;
+		case OP_ASINH:
+			c[0] = asinh(ab[0]);
+			return 1;
+		case OP_ACOSH:
+			c[0] = acosh(ab[0]);
+			return 1;
+		case OP_ATANH:
+			c[0] = atanh(ab[0]);
+			return 1;
+
+		case OP_EQ:
+			c[0] = ab[1] == ab[0];
+			return 1;
+		case OP_LT:
+			c[0] = ab[1] < ab[0];
+			return 1;
+		case OP_GT:
+			c[0] = ab[1] > ab[0];
+			return 1;
+		case OP_LE:
+			c[0] = ab[1] <= ab[0];
+			return 1;
+		case OP_GE:
+			c[0] = ab[1] >= ab[0];
+			return 1;
+		case OP_TER:
+			c[0] = ab[0] ? ab[2] : ab[1];
+			return 1;
+		case OP_MINI:
+			c[0] = vm_mini(ab[1], ab[0]);
+			return 1;
+		case OP_MAXI:
+			c[0] = vm_maxi(ab[1], ab[0]);
+			return 1;
+
+		case OP_AND:
+			c[0] = ab[1] && ab[0];
+			return 1;
+		case OP_OR:
+			c[0] = ab[1] || ab[0];
+			return 1;
+		case OP_NOT:
+		{
+			if(!_vm_fold_int(ab[0]))
+				return 0;
+			const int a = ab[0];
+			c[0] = !a;
+		}	return 1;
+
+		case OP_BAND:
+		case OP_BOR:
+		case OP_LSHIFT:
+		case OP_RSHIFT:
+		{
+			if(!_vm_fold_uint(ab[1]) || !_vm_fold_uint(ab[0]))
+				return 0;
+			const unsigned a = ab[1];
+			const unsigned b = ab[0];
+			if( (op == OP_LSHIFT) || (op == OP_RSHIFT) )
+			{
+				if(b >= 32)
+					return 0;
+				c[0] = (op == OP_LSHIFT) ? a << b : a >> b;
+			}
+			else
+			{
+				c[0] = (op == OP_BAND) ? a & b : a | b;
+			}
+		}	return 1;
+		case OP_BNOT:
+		{
+			if(!_vm_fold_uint(ab[0]))
+				return 0;
+			const unsigned a = ab[0];
+			c[0] = ~a;
+		}	return 1;
+	}
+
+	return 0; // not foldable
+}
+
+// values read and defined by register instruction
+static inline void
+_vm_ir_arity(const vm_ir_inst_t *inst, unsigned *nsrc, unsigned *ndst)
+{
+	switch(inst->op)
+	{
+		case INST_IMM:
+		case INST_HLOAD:
+		case IR_CTRL_K:
+			*nsrc = 0;
+			*ndst = 1;
+			break;
+		case INST_HSAVE:
+		case IR_JMP_IF:
+		case IR_JMP_NOT:
+			*nsrc = 1;
+			*ndst = 0;
+			break;
+		case IR_MOVE:
+			*nsrc = 1;
+			*ndst = 1;
+			break;
+		case IR_JMP:
+			*nsrc = 0;
+			*ndst = 0;
+			break;
+		case IR_MADD:
+		case IR_MINI_MAXI:
+		case IR_MAXI_MINI:
+			*nsrc = 3;
+			*ndst = 1;
+			break;
+		case IR_SEL_EQ:
+		case IR_SEL_LT:
+		case IR_SEL_GT:
+		case IR_SEL_LE:
+		case IR_SEL_GE:
+			*nsrc = 4;
+			*ndst = 1;
+			break;
+		default:
+			*nsrc = (inst->op < OP_MAX) ? vm_api_def[inst->op].npops : 0;
+			*ndst = (inst->op < OP_MAX) ? vm_api_def[inst->op].npushs : 0;
+			break;
+	}
+}
+
+// instruction defining src of given opcode within the same basic block,
+// whose result nothing else reads
+static inline vm_ir_inst_t *
+_vm_ir_single(vm_ir_t *ir, const int *def, const uint8_t *uses,
+	const unsigned *blk, unsigned k, unsigned src, unsigned op)
+{
+	const int d = def[src];
+
+	if( (d < 0) || (uses[src] != 1) || (blk[d] != blk[k])
+		|| (ir->inst[d].op != op) )
+		return NULL;
+
+	return &ir->inst[d];
+}
+
+// fuse frequent sequences into superinstructions, contract allows
+// multiply-add to round once, which deviates from the stack program
+static inline void
+vm_ir_fuse(vm_ir_t *ir, bool contract)
+{
+	int def [IR_VALS_MAX]; // defining instruction, -1 for none or several
+	uint8_t uses [IR_VALS_MAX]; // readers, saturating
+	bool leader [IR_INST_MAX + 1];
+	unsigned blk [IR_INST_MAX]; // basic block of each instruction
+	uint32_t map [IR_INST_MAX + 1];
+
+	if(!ir->enabled)
+		return;
+
+	for(unsigned v = 0; v < IR_VALS_MAX; v++)
+	{
+		def[v] = -1;
+		uses[v] = 0;
+	}
+
+	for(unsigned k = 0; k <= ir->ninst; k++)
+		leader[k] = false;
+
+	for(unsigned k = 0; k < ir->ninst; k++)
+	{
+		const vm_ir_inst_t *inst = &ir->inst[k];
+		unsigned nsrc;
+		unsigned ndst;
+
+		_vm_ir_arity(inst, &nsrc, &ndst);
+
+		for(unsigned j = 0; j < nsrc; j++)
+		{
+			if(uses[inst->src[j]] < UINT8_MAX)
+				uses[inst->src[j]]++;
+		}
+
+		for(unsigned j = 0; j < ndst; j++)
+		{
+			const bool once = (inst->op != IR_MOVE) && (def[inst->dst[j]] == -1);
+
+			def[inst->dst[j]] = once ? (int)k : -2;
+		}
+
+		if( (inst->op >= IR_JMP) && (inst->op <= IR_JMP_NOT) )
+		{
+			leader[inst->target] = true;
+			leader[k + 1] = true;
+		}
+	}
+
+	for(unsigned j = 0; j < CTRL_MAX; j++)
+	{
+		if(uses[ir->out[j]] < UINT8_MAX)
+			uses[ir->out[j]]++;
+	}
+
+	for(unsigned k = 0, b = 0; k < ir->ninst; k++)
+	{
+		if(leader[k])
+			b++;
+
+		blk[k] = b;
+	}
+
+	for(unsigned k = 0; k < ir->ninst; k++)
+	{
+		vm_ir_inst_t *inst = &ir->inst[k];
+		vm_ir_inst_t *in;
+
+		switch(inst->op)
+		{
+			case OP_CTRL:
+			{
+				const int d = def[inst->src[0]];
+
+				if( (d < 0) || (ir->inst[d].op != INST_IMM)
+					|| !_vm_fold_int(ir->inst[d].imm) )
+					break;
+
+				const int idx = floor(ir->inst[d].imm);
+
+				if(--uses[inst->src[0]] == 0)
+					ir->inst[d].op = OP_NOP; // immediate has no other reader
+
+				inst->op = IR_CTRL_K;
+				inst->target = idx & CTRL_MASK;
+				inst->src[0] = IR_ZERO;
+			} break;
+			case OP_ADD:
+			{
+				if(!contract)
+					break;
+
+				for(unsigned j = 0; j < 2; j++)
+				{
+					if(!(in = _vm_ir_single(ir, def, uses, blk, k, inst->src[j], OP_MUL)))
+						continue;
+
+					// addition commutes exactly, either operand may be the product
+					inst->op = IR_MADD;
+					inst->src[2] = inst->src[1 - j];
+					inst->src[0] = in->src[0];
+					inst->src[1] = in->src[1];
+					in->op = OP_NOP;
+					break;
+				}
+			} break;
+			case OP_MINI:
+			case OP_MAXI:
+			{
+				// clamped value must be the deeper operand, NaN order matters
+				const unsigned op = (inst->op == OP_MINI) ? OP_MAXI : OP_MINI;
+
+				if(!(in = _vm_ir_single(ir, def, uses, blk, k, inst->src[1], op)))
+					break;
+
+				inst->op = (inst->op == OP_MINI) ? IR_MINI_MAXI : IR_MAXI_MINI;
+				inst->src[2] = inst->src[0];
+				inst->src[0] = in->src[0];
+				inst->src[1] = in->src[1];
+				in->op = OP_NOP;
+			} break;
+			case OP_TER:
+			{
+				const int d = def[inst->src[0]];
+
+				if( (d < 0) || (ir->inst[d].op < OP_EQ) || (ir->inst[d].op > OP_GE) )
+					break;
+
+				if(!(in = _vm_ir_single(ir, def, uses, blk, k, inst->src[0], ir->inst[d].op)))
+					break;
+
+				inst->op = IR_SEL_EQ + (in->op - OP_EQ);
+				inst->src[3] = inst->src[2];
+				inst->src[2] = inst->src[1];
+				inst->src[0] = in->src[0];
+				inst->src[1] = in->src[1];
+				in->op = OP_NOP;
+			} break;
+		}
+	}
+
+	// drop fused instructions, jumps to them land on their successor
+	unsigned n = 0;
+
+	for(unsigned k = 0; k < ir->ninst; k++)
+	{
+		map[k] = n;
+
+		if(ir->inst[k].op != OP_NOP)
+			ir->inst[n++] = ir->inst[k];
+	}
+
+	map[ir->ninst] = n;
+	ir->ninst = n;
+
+	for(unsigned k = 0; k < ir->ninst; k++)
+	{
+		vm_ir_inst_t *inst = &ir->inst[k];
+
+		if( (inst->op >= IR_JMP) && (inst->op <= IR_JMP_NOT) )
+			inst->target = map[inst->target];
+	}
+}
+
+// instruction has no effect besides its stack cells
+static inline bool
+_vm_inst_is_pure(unsigned op)
+{
+	switch(op)
+	{
+		case OP_STORE:
+		case OP_BREAK:
+		case OP_GOTO:
+		case OP_RAND: // advances generator
+		case INST_JMP:
+			return false;
+	}
+
+	return true;
+}
+
+// ring cells read before being written, end of program reads the outputs
+static inline bool
+_vm_prog_live(const vm_prog_t *prog, const int *ptr, const bool *target,
+	uint32_t outputs, uint32_t *live_out)
+{
+	VM_SCRATCH_SCOPE(prog);
+	uint32_t *live_in = VM_SCRATCH(prog, uint32_t);
+
+	if(!live_in)
+		return false;
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		live_in[i] = 0;
+		live_out[i] = 0;
+	}
+	live_in[prog->ninst] = _vm_prog_outputs(ptr[prog->ninst], outputs);
+
+	for(bool again = true; again; )
+	{
+		again = false;
+
+		for(int i = prog->ninst - 1; i >= 0; i--)
+		{
+			const vm_inst_t *inst = &prog->inst[i];
+			uint32_t succ [2];
+			uint32_t reads;
+			uint32_t writes;
+			bool exits;
+
+			if(ptr[i] == -1)
+				continue;
+
+			const unsigned nsucc = _vm_prog_succ(prog, target, i, succ, &exits);
+			uint32_t out = 0;
+
+			for(unsigned j = 0; j < nsucc; j++)
+				out |= live_in[succ[j]];
+			if(exits)
+				out |= _vm_prog_outputs((ptr[i] + 1) & SLOT_MASK, outputs);
+
+			_vm_inst_cells(inst, ptr[i], &reads, &writes);
+			const uint32_t in = (out & ~writes) | reads;
+
+			live_out[i] = out;
+			if(in != live_in[i])
+			{
+				live_in[i] = in;
+				again = true;
+			}
+		}
+	}
+
+	return true;
+}
+
+static inline bool
+_vm_prog_optimize_pass(vm_prog_t *prog, uint32_t outputs)
+{
+	VM_SCRATCH_SCOPE(prog);
+	int *ptr = VM_SCRATCH(prog, int);
+	bool *target = VM_SCRATCH(prog, bool);
+	uint32_t *live_out = VM_SCRATCH(prog, uint32_t);
+	bool *keep = VM_SCRATCH(prog, bool);
+	bool *touched = VM_SCRATCH(prog, bool);
+	uint32_t *map = VM_SCRATCH(prog, uint32_t);
+	bool changed = false;
+
+	if(!ptr || !target || !live_out || !keep || !touched || !map)
+		return false;
+
+	if(!vm_prog_depth(prog, ptr))
+		return false;
+
+	_vm_prog_targets(prog, target);
+	if(!_vm_prog_live(prog, ptr, target, outputs, live_out))
+		return false;
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		keep[i] = true;
+		touched[i] = false;
+	}
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		vm_inst_t *inst = &prog->inst[i];
+		uint32_t reads;
+		uint32_t writes;
+		bool cond;
+
+		if(touched[i])
+			continue;
+
+		// unreachable code and no operations
+		if( (ptr[i] == -1) || (inst->op == OP_NOP) )
+		{
+			keep[i] = false;
+			touched[i] = true;
+			changed = true;
+			continue;
+		}
+
+		_vm_inst_cells(inst, ptr[i], &reads, &writes);
+
+		// swap swap
+		if( (inst->op == OP_SWAP) && (i + 1 < prog->ninst) && !target[i + 1]
+			&& (prog->inst[i + 1].op == OP_SWAP) )
+		{
+			keep[i] = keep[i + 1] = false;
+			touched[i] = touched[i + 1] = true;
+			changed = true;
+			continue;
+		}
+
+		// constant folding of immediates right before
+		const unsigned npops = (inst->op == INST_IMM) ? 0 : inst->npops;
+		bool foldable = (inst->op < OP_MAX) && (inst->op != OP_CTRL)
+			&& (inst->op != OP_LOAD) && !_vm_inst_is_time(inst->op)
+			&& _vm_inst_is_pure(inst->op) && (i >= npops);
+
+		for(unsigned j = 1; foldable && (j <= npops); j++)
+		{
+			const vm_inst_t *imm = &prog->inst[i - j];
+
+			if( (imm->op != INST_IMM) || touched[i - j] || target[i - j + 1]
+				|| isnan(imm->imm) )
+				foldable = false;
+		}
+
+		if(foldable)
+		{
+			num_t ab [3];
+			num_t c [2];
+			uint32_t stale = writes;
+
+			for(unsigned j = 0; j < npops; j++)
+			{
+				ab[j] = prog->inst[i - 1 - j].imm;
+				stale |= 1U << ((ptr[i - npops] - 1 - j) & SLOT_MASK);
+			}
+
+			const unsigned nc = _vm_fold(inst->op, ab, c);
+			const int end = ptr[i] + inst->npops - inst->npushs;
+
+			for(unsigned j = 0; j < nc; j++)
+				stale &= ~(1U << ((end + nc - 1 - j) & SLOT_MASK));
+
+			if( (nc == inst->npushs) && (nc <= npops + 1) && !(stale & live_out[i]) )
+			{
+				// replace group with pushed results
+				const unsigned first = i - npops;
+
+				for(unsigned j = 0; j <= npops; j++)
+				{
+					vm_inst_t *dst = &prog->inst[first + j];
+
+					touched[first + j] = true;
+					keep[first + j] = j < nc;
+
+					if(j < nc)
+					{
+						dst->op = INST_IMM;
+						dst->npops = 0;
+						dst->npushs = 1;
+						dst->target = 0;
+						dst->imm = c[j];
+					}
+				}
+
+				changed = true;
+				continue;
+			}
+		}
+
+		// constant conditions, break at the end pops either way
+		if( (inst->op == OP_BREAK) && ( (i + 1 == prog->ninst)
+			|| (_vm_prog_cond(prog, target, i, &cond) && !cond) ) )
+		{
+			inst->op = OP_POP;
+			touched[i] = true;
+			changed = true;
+			continue;
+		}
+
+		if( (inst->op == INST_JMP) && !touched[i - 1]
+			&& _vm_prog_cond(prog, target, i, &cond)
+			&& (!cond || (inst->target == i + 1))
+			&& !(live_out[i] & (1U << (ptr[i] & SLOT_MASK))) )
+		{
+			// never jumps or lands on next: pop condition and target
+			keep[i - 1] = false;
+			touched[i - 1] = true;
+			inst->op = OP_POP;
+			inst->npops = 1;
+			inst->target = 0;
+			touched[i] = true;
+			changed = true;
+			continue;
+		}
+
+		// pure operations with dead results
+		if(!_vm_inst_is_pure(inst->op) || (inst->op == OP_POP) || (writes & live_out[i]))
+			continue;
+
+		const int net = inst->npops - inst->npushs;
+
+		if(net == 0)
+		{
+			keep[i] = false;
+			touched[i] = true;
+			changed = true;
+		}
+		else if(net == 1)
+		{
+			inst->op = OP_POP;
+			inst->npops = 1;
+			inst->npushs = 0;
+			touched[i] = true;
+			changed = true;
+		}
+		else if( (net == -1) && (i + 1 < prog->ninst) && !target[i + 1]
+			&& !touched[i + 1] && (prog->inst[i + 1].op == OP_POP) )
+		{
+			keep[i] = keep[i + 1] = false;
+			touched[i] = touched[i + 1] = true;
+			changed = true;
+		}
+	}
+
+	if(!changed)
+		return false;
+
+	// compact and remap jump targets onto next kept instruction
+	uint32_t ninst = 0;
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		map[i] = ninst;
+
+		if(keep[i])
+			prog->inst[ninst++] = prog->inst[i];
+	}
+	map[prog->ninst] = ninst;
+
+	for(unsigned i = 0; i < ninst; i++)
+	{
+		vm_inst_t *inst = &prog->inst[i];
+
+		if(inst->op == INST_JMP)
+			inst->target = map[inst->target];
+	}
+
+	memset(&prog->inst[ninst], 0x0, sizeof(vm_inst_t)*(prog->ninst - ninst));
+	prog->ninst = ninst;
+
+	return true;
+}
+
+// optimize for the given outputs only, others are left undefined
+static inline void
+vm_prog_slice(vm_prog_t *prog, uint32_t outputs)
+{
+	prog->verified = false; // stack offsets change
+
+	for(unsigned pass = 0; pass < ITEMS_MAX*2; pass++)
+	{
+		if(!_vm_prog_optimize_pass(prog, outputs))
+			break;
+	}
+
+	prog->status = VM_STATUS_STATIC;
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		const unsigned op = prog->inst[i].op;
+
+		if(_vm_inst_is_time(op))
+			prog->status |= VM_STATUS_HAS_TIME;
+		else if(op == OP_RAND)
+			prog->status |= VM_STATUS_HAS_RAND;
+	}
+}
+
+// fold constants, drop dead and unreachable code, outputs stay the same
+static inline void
+vm_prog_optimize(vm_prog_t *prog)
+{
+	vm_prog_slice(prog, (1U << CTRL_MAX) - 1);
+}
+
+#define VM_DEP_STATE (1U << CTRL_MAX) // register state of previous run
+
+// input and register state masks each value depends on
+struct _vm_dep_t {
+	uint16_t cells [SLOT_MAX];
+	uint16_t regs [REG_MAX];
+};
+
+// constant index pushed as immediate right before
+static inline bool
+_vm_prog_index(const vm_prog_t *prog, const bool *target, unsigned i,
+	bool ctrl, int *idx)
+{
+	if( (i == 0) || target[i] || (prog->inst[i - 1].op != INST_IMM) )
+		return false;
+
+	const num_t imm = prog->inst[i - 1].imm;
+
+	if(!(fabs(imm) < 0x40000000))
+		return false;
+
+	*idx = ctrl
+		? (int)floor(imm) // as in OP_CTRL
+		: (int)floorf(imm); // as in OP_LOAD and OP_STORE
+
+	return true;
+}
+
+static inline void
+_vm_dep_step(const vm_prog_t *prog, const bool *target, unsigned i, int ptr,
+	vm_dep_t *dep)
+{
+	const vm_inst_t *inst = &prog->inst[i];
+	const int end = ptr + inst->npops - inst->npushs;
+	uint16_t *cells = dep->cells;
+	uint16_t pops = 0;
+	int idx;
+
+	for(unsigned j = 0; j < inst->npops; j++)
+		pops |= cells[(ptr + j) & SLOT_MASK];
+
+	switch(inst->op)
+	{
+		case INST_IMM:
+		case OP_RAND: // handled by status
+		{
+			cells[end & SLOT_MASK] = 0;
+		} break;
+		case OP_CTRL:
+		{
+			cells[end & SLOT_MASK] = _vm_prog_index(prog, target, i, true, &idx)
+				? 1U << (idx & CTRL_MASK)
+				: (1U << CTRL_MAX) - 1;
+		} break;
+		case OP_SWAP:
+		{
+			const uint16_t tmp = cells[ptr & SLOT_MASK];
+
+			cells[ptr & SLOT_MASK] = cells[(ptr + 1) & SLOT_MASK];
+			cells[(ptr + 1) & SLOT_MASK] = tmp;
+		} break;
+		case OP_STORE:
+		{
+			const uint16_t val = cells[(ptr + 1) & SLOT_MASK];
+
+			if(_vm_prog_index(prog, target, i, false, &idx))
+			{
+				dep->regs[idx & REG_MASK] = val;
+			}
+			else
+			{
+				for(unsigned r = 0; r < REG_MAX; r++)
+					dep->regs[r] |= pops;
+			}
+		} break;
+		case OP_LOAD:
+		{
+			uint16_t val = pops;
+
+			if(_vm_prog_index(prog, target, i, false, &idx))
+			{
+				val = dep->regs[idx & REG_MASK];
+			}
+			else
+			{
+				for(unsigned r = 0; r < REG_MAX; r++)
+					val |= dep->regs[r];
+			}
+
+			cells[end & SLOT_MASK] = val;
+		} break;
+		default:
+		{
+			if(_vm_inst_is_time(inst->op))
+				pops = 0; // handled by status
+
+			for(unsigned j = 0; j < inst->npushs; j++)
+				cells[(end + j) & SLOT_MASK] = pops;
+		} break;
+	}
+}
+
+// outputs affected by each input, all of them where not known statically
+static inline bool
+vm_prog_deps(const vm_prog_t *prog, uint8_t *deps)
+{
+	VM_SCRATCH_SCOPE(prog);
+	int *ptr = VM_SCRATCH(prog, int);
+	bool *target = VM_SCRATCH(prog, bool);
+	vm_dep_t *dep = VM_SCRATCH(prog, vm_dep_t);
+	uint16_t outs [CTRL_MAX];
+	uint16_t ctrl = 0; // conditions of branches
+
+	for(unsigned j = 0; j < CTRL_MAX; j++)
+	{
+		deps[j] = (1U << CTRL_MAX) - 1;
+		outs[j] = 0;
+	}
+
+	if(!ptr || !target || !dep || !vm_prog_depth(prog, ptr))
+		return false;
+
+	_vm_prog_targets(prog, target);
+	memset(dep, 0x0, sizeof(vm_dep_t)*(prog->ninst + 1));
+
+	for(unsigned r = 0; r < REG_MAX; r++)
+		dep[0].regs[r] = VM_DEP_STATE;
+
+	for(bool changed = true; changed; )
+	{
+		changed = false;
+
+		for(unsigned i = 0; i < prog->ninst; i++)
+		{
+			uint32_t succ [2];
+			bool exits;
+			bool cond;
+
+			if(ptr[i] == -1)
+				continue;
+
+			vm_dep_t nxt = dep[i];
+			const unsigned nsucc = _vm_prog_succ(prog, target, i, succ, &exits);
+
+			if( ( (prog->inst[i].op == OP_BREAK) || (prog->inst[i].op == INST_JMP) )
+				&& !_vm_prog_cond(prog, target, i, &cond) )
+			{
+				ctrl |= dep[i].cells[ptr[i] & SLOT_MASK];
+			}
+
+			_vm_dep_step(prog, target, i, ptr[i], &nxt);
+
+			if(exits)
+			{
+				for(unsigned j = 0; j < CTRL_MAX; j++)
+					outs[j] |= nxt.cells[(ptr[i] + 1 + j) & SLOT_MASK];
+			}
+
+			for(unsigned k = 0; k < nsucc; k++)
+			{
+				vm_dep_t *dst = &dep[succ[k]];
+
+				for(unsigned j = 0; j < SLOT_MAX; j++)
+				{
+					if( (dst->cells[j] | nxt.cells[j]) != dst->cells[j])
+					{
+						dst->cells[j] |= nxt.cells[j];
+						changed = true;
+					}
+				}
+
+				for(unsigned r = 0; r < REG_MAX; r++)
+				{
+					if( (dst->regs[r] | nxt.regs[r]) != dst->regs[r])
+					{
+						dst->regs[r] |= nxt.regs[r];
+						changed = true;
+					}
+				}
+			}
+		}
+	}
+
+	if(ptr[prog->ninst] != -1)
+	{
+		for(unsigned j = 0; j < CTRL_MAX; j++)
+			outs[j] |= dep[prog->ninst].cells[(ptr[prog->ninst] + j) & SLOT_MASK];
+	}
+
+	for(unsigned j = 0; j < CTRL_MAX; j++)
+	{
+		outs[j] |= ctrl;
+
+		if(outs[j] & VM_DEP_STATE)
+			return false; // outputs depend on previous runs
+	}
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		deps[i] = 0;
+
+		for(unsigned j = 0; j < CTRL_MAX; j++)
+		{
+			if(outs[j] & (1U << i))
+				deps[i] |= 1U << j;
+		}
+	}
+
+	return true;
+}
+
+// instruction only depends on constants and inputs
+static inline bool
+_vm_inst_is_static(unsigned op)
+{
+	return _vm_inst_is_pure(op) && !_vm_inst_is_time(op) && (op != OP_LOAD);
+}
+
+static inline void
+_vm_prog_append(vm_prog_t *prog, unsigned op, unsigned npops, unsigned npushs,
+	uint32_t target, num_t imm)
+{
+	vm_inst_t *inst = &prog->inst[prog->ninst++];
+
+	inst->op = op;
+	inst->npops = npops;
+	inst->npushs = npushs;
+	inst->target = target;
+	inst->imm = imm;
+}
+
+// split time-varying straight-line program into a part filling hidden
+// registers whenever inputs change, and a part to run per frame reading them
+static inline bool
+vm_prog_split(const vm_prog_t *prog, vm_prog_t *fill, vm_prog_t *timed)
+{
+	VM_SCRATCH_SCOPE(prog);
+	int *ptr = VM_SCRATCH(prog, int);
+	bool *target = VM_SCRATCH(prog, bool);
+	uint32_t *live_out = VM_SCRATCH(prog, uint32_t);
+	bool *stat = VM_SCRATCH(prog, bool);
+	uint32_t varying = 0; // cells holding time-varying values
+	uint32_t nhidden = 0;
+
+	if(!ptr || !target || !live_out || !stat)
+		return false;
+
+	if( (prog->status == VM_STATUS_STATIC) || !vm_prog_depth(prog, ptr) )
+		return false;
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		const vm_inst_t *inst = &prog->inst[i];
+		uint32_t reads;
+		uint32_t writes;
+
+		if( (inst->op == OP_BREAK) || (inst->op == OP_GOTO) || (inst->op == INST_JMP) )
+			return false; // values may differ per path
+
+		_vm_inst_cells(inst, ptr[i], &reads, &writes);
+		stat[i] = _vm_inst_is_static(inst->op) && !(reads & varying);
+
+		if(stat[i])
+			varying &= ~writes;
+		else
+			varying |= writes;
+	}
+
+	_vm_prog_targets(prog, target);
+	if(!_vm_prog_live(prog, ptr, target, (1U << CTRL_MAX) - 1, live_out))
+		return false;
+
+	if(timed->size < prog->ninst)
+		return false;
+
+	vm_prog_clear(fill);
+	vm_prog_clear(timed);
+
+	for(unsigned a = 0; a < prog->ninst; )
+	{
+		const vm_inst_t *inst = &prog->inst[a];
+
+		if(!stat[a])
+		{
+			_vm_prog_append(fill, INST_SKIP, inst->npops, inst->npushs, 0, 0.0);
+			timed->inst[timed->ninst++] = *inst;
+			a++;
+			continue;
+		}
+
+		// maximal run of static instructions
+		unsigned b = a;
+		uint32_t written = 0;
+		int net = 0;
+
+		for( ; ; b++)
+		{
+			uint32_t reads;
+			uint32_t writes;
+
+			_vm_inst_cells(&prog->inst[b], ptr[b], &reads, &writes);
+			written |= writes;
+			net += prog->inst[b].npops - prog->inst[b].npushs;
+
+			if( (b + 1 == prog->ninst) || !stat[b + 1])
+				break;
+		}
+
+		// replace with pops and pushes of hidden registers onto cells x..x+q-1
+		const int x = ptr[a] + net;
+		const uint32_t live = live_out[b];
+		unsigned q = (net < 0) ? -net : 0;
+
+		for(unsigned j = 0; j < SLOT_MAX; j++)
+		{
+			const uint32_t bit = 1U << ((x + j) & SLOT_MASK);
+
+			if( (written & live & bit) && (j + 1 > q) )
+				q = j + 1;
+		}
+
+		const unsigned p = q + net;
+		bool collapse = (p + q < b - a + 1) && (q < SLOT_MAX) && (nhidden + q <= HIDDEN_MAX)
+			&& (fill->ninst + b - a + 1 + q <= fill->size);
+
+		for(unsigned j = 0; collapse && (j < q); j++)
+		{
+			const uint32_t bit = 1U << ((x + j) & SLOT_MASK);
+
+			if( (live & bit) && !(written & bit) )
+				collapse = false; // would clobber a live cell
+		}
+
+		for(unsigned i = a; i <= b; i++)
+			fill->inst[fill->ninst++] = prog->inst[i];
+
+		if(collapse)
+		{
+			for(unsigned j = 0; j < q; j++)
+				_vm_prog_append(fill, INST_HSAVE, 0, 0, nhidden + j, q - 1 - j);
+
+			for(unsigned j = 0; j < p; j++)
+				_vm_prog_append(timed, OP_POP, 1, 0, 0, 0.0);
+			for(unsigned j = 0; j < q; j++)
+				_vm_prog_append(timed, INST_HLOAD, 0, 1, nhidden + j, 0.0);
+
+			nhidden += q;
+		}
+		else
+		{
+			for(unsigned i = a; i <= b; i++)
+				timed->inst[timed->ninst++] = prog->inst[i];
+		}
+
+		a = b + 1;
+	}
+
+	fill->status = VM_STATUS_STATIC;
+	timed->status = prog->status;
+
+	return timed->ninst < prog->ninst;
+}
+
+static inline vm_rate_t
+_vm_rate_max(vm_rate_t a, vm_rate_t b)
+{
+	return (a > b) ? a : b;
+}
+
+// rate each instruction result changes at, inputs either per sample or block
+static inline void
+vm_prog_rates(const vm_prog_t *prog, bool varying, uint8_t *rates)
+{
+	VM_SCRATCH_SCOPE(prog);
+	int *ptr = VM_SCRATCH(prog, int);
+	uint8_t cells [SLOT_MAX];
+	bool has_store = false;
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		rates[i] = VM_RATE_SAMPLE;
+
+		if(prog->inst[i].op == OP_STORE)
+			has_store = true;
+	}
+
+	if(!ptr || !vm_prog_depth(prog, ptr))
+		return;
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		switch(prog->inst[i].op)
+		{
+			case OP_BREAK:
+			case OP_GOTO:
+			case INST_JMP:
+				return; // evaluated per sample
+		}
+	}
+
+	memset(cells, VM_RATE_CONST, sizeof(cells)); // cleared stack
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		const vm_inst_t *inst = &prog->inst[i];
+		const int end = ptr[i] + inst->npops - inst->npushs;
+		vm_rate_t rate = VM_RATE_CONST;
+
+		for(unsigned j = 0; (inst->op != OP_POP) && (j < inst->npops); j++)
+			rate = _vm_rate_max(rate, cells[(ptr[i] + j) & SLOT_MASK]);
+
+		switch(inst->op)
+		{
+			case OP_CTRL:
+			{
+				rate = _vm_rate_max(rate, varying ? VM_RATE_SAMPLE : VM_RATE_BLOCK);
+			} break;
+			case OP_LOAD:
+			{
+				rate = _vm_rate_max(rate, has_store ? VM_RATE_SAMPLE : VM_RATE_BLOCK);
+			} break;
+			case INST_HLOAD:
+			case OP_BPB:
+			case OP_BEAT_UNIT:
+			case OP_BPM:
+			case OP_FPS:
+			case OP_SPEED:
+			{
+				rate = _vm_rate_max(rate, VM_RATE_BLOCK); // changed by transport events only
+			} break;
+			case OP_RAND:
+			case OP_BAR_BEAT:
+			case OP_BAR:
+			case OP_BEAT:
+			case OP_FRAME:
+			{
+				rate = VM_RATE_SAMPLE;
+			} break;
+		}
+
+		rates[i] = rate;
+
+		if(inst->op == OP_SWAP)
+		{
+			const uint8_t tmp = cells[ptr[i] & SLOT_MASK];
+
+			cells[ptr[i] & SLOT_MASK] = cells[(ptr[i] + 1) & SLOT_MASK];
+			cells[(ptr[i] + 1) & SLOT_MASK] = tmp;
+		}
+		else
+		{
+			for(unsigned j = 0; j < inst->npushs; j++)
+				cells[(end + j) & SLOT_MASK] = rate;
+		}
+	}
+}
+
+static inline uint64_t
+_vm_rand_splitmix(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return z ^ (z >> 31);
+}
+
+static inline void
+vm_rand_seed(vm_rand_t *rng, uint64_t seed)
+{
+	for(unsigned l = 0; l < RAND_LANES; l++)
+	{
+		for(unsigned k = 0; k < 4; k++)
+			rng->s[k][l] = _vm_rand_splitmix(&seed);
+	}
+
+	rng->lane = 0;
+}
+
+// advance a single lane, returns uniform number in [0, 1)
+static inline num_t
+_vm_rand_step(uint64_t s [4][RAND_LANES], unsigned l)
+{
+	const uint64_t res = s[0][l] + s[3][l];
+	const uint64_t t = s[1][l] << 17;
+
+	s[2][l] ^= s[0][l];
+	s[3][l] ^= s[1][l];
+	s[1][l] ^= s[2][l];
+	s[0][l] ^= s[3][l];
+	s[2][l] ^= t;
+	s[3][l] = (s[3][l] << 45) | (s[3][l] >> 19);
+
+	return (res >> 11) * 0x1.0p-53;
+}
+
+static inline num_t
+vm_rand_next(vm_rand_t *rng)
+{
+	const num_t v = _vm_rand_step(rng->s, rng->lane);
+
+	rng->lane = (rng->lane + 1) & RAND_MASK;
+
+	return v;
+}
+
+// same sequence as repeated vm_rand_next, but all lanes advanced in lockstep
+static inline void
+vm_rand_fill(vm_rand_t *rng, num_t *dst, unsigned n)
+{
+	unsigned f = 0;
+
+	for( ; (f < n) && rng->lane; f++)
+		dst[f] = vm_rand_next(rng);
+
+	for( ; f + RAND_LANES <= n; f += RAND_LANES)
+	{
+		for(unsigned l = 0; l < RAND_LANES; l++)
+			dst[f + l] = _vm_rand_step(rng->s, l);
+	}
+
+	for( ; f < n; f++)
+		dst[f] = vm_rand_next(rng);
+}
+
+static inline LV2_Atom_Forge_Ref
+vm_filter_serialize(LV2_Atom_Forge *forge, const vm_filter_impl_t *impl,
+	const vm_filter_t *filters)
+{
+	LV2_Atom_Forge_Frame frame [2];
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_tuple(forge, &frame[0]);
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		const vm_filter_t *filter = &filters[i];
+
+		switch(filter->type)
+		{
+			case FILTER_CONTROLLER:
+			{
+				if(ref)
+					ref = lv2_atom_forge_object(forge, &frame[1], 0, impl->midi_Controller);
+
+				if(ref)
+					ref = lv2_atom_forge_key(forge, impl->midi_channel);
+				if(ref)
+					ref = lv2_atom_forge_int(forge, filter->channel);
+
+				if(ref)
+					ref = lv2_atom_forge_key(forge, impl->midi_controllerNumber);
+				if(ref)
+					ref = lv2_atom_forge_int(forge, filter->value);
+
+				if(ref)
+					lv2_atom_forge_pop(forge, &frame[1]);
+			} break;
+			case FILTER_BENDER:
+			{
+				if(ref)
+					ref = lv2_atom_forge_object(forge, &frame[1], 0, impl->midi_Bender);
+
+				if(ref)
+					ref = lv2_atom_forge_key(forge, impl->midi_channel);
+				if(ref)
+					ref =lv2_atom_forge_int(forge, filter->channel);
+
+				if(ref)
+					lv2_atom_forge_pop(forge, &frame[1]);
+			} break;
+			case FILTER_PROGRAM_CHANGE:
+			{
+				if(ref)
+					ref = lv2_atom_forge_object(forge, &frame[1], 0, impl->midi_ProgramChange);
+
+				if(ref)
+					ref = lv2_atom_forge_key(forge, impl->midi_channel);
+				if(ref)
+					ref =lv2_atom_forge_int(forge, filter->channel);
+
+				if(ref)
+					lv2_atom_forge_pop(forge, &frame[1]);
+			} break;
+			case FILTER_CHANNEL_PRESSURE:
+			{
+				if(ref)
+					ref = lv2_atom_forge_object(forge, &frame[1], 0, impl->midi_ChannelPressure);
+
+				if(ref)
+					ref = lv2_atom_forge_key(forge, impl->midi_channel);
+				if(ref)
+					ref =lv2_atom_forge_int(forge, filter->channel);
+
+				if(ref)
+					lv2_atom_forge_pop(forge, &frame[1]);
+			} break;
+			case FILTER_NOTE_ON:
+			{
+				if(ref)
+					ref = lv2_atom_forge_object(forge, &frame[1], 0, impl->midi_NoteOn);
+
+				if(ref)
+					ref = lv2_atom_forge_key(forge, impl->midi_channel);
+				if(ref)
+					ref =lv2_atom_forge_int(forge, filter->channel);
+
+				if(ref)
+					ref = lv2_atom_forge_key(forge, impl->midi_velocity);
+				if(ref)
+					ref =lv2_atom_forge_int(forge, filter->value);
+
+				if(ref)
+					lv2_atom_forge_pop(forge, &frame[1]);
+			} break;
+			case FILTER_NOTE_PRESSURE:
+			{
+				if(ref)
+					ref = lv2_atom_forge_object(forge, &frame[1], 0, impl->midi_NotePressure);
+
+				if(ref)
+					ref = lv2_atom_forge_key(forge, impl->midi_channel);
+				if(ref)
+					ref =lv2_atom_forge_int(forge, filter->channel);
+
+				if(ref)
+					ref = lv2_atom_forge_key(forge, impl->midi_noteNumber);
+				if(ref)
+					ref =lv2_atom_forge_int(forge, filter->value);
+
+				if(ref)
+					lv2_atom_forge_pop(forge, &frame[1]);
+			} break;
+			//FIXME handle more types
+
+			case FILTER_MAX:
+			{
+				// nothing
+			}	break;
+		}
+	}
+
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame[0]);
+
+	return ref;
+}
+
+static inline int
+vm_filter_deserialize(LV2_Atom_Forge *forge, const vm_filter_impl_t *impl,
+	vm_filter_t *filters, uint32_t size, const LV2_Atom *body)
+{
+	memset(filters, 0x0, sizeof(vm_filter_t)*CTRL_MAX);
+
+	unsigned i = 0;
+	LV2_ATOM_TUPLE_BODY_FOREACH(body, size, atom)
+	{
+		vm_filter_t *filter = &filters[i];
+
+		if(lv2_atom_forge_is_object_type(forge, atom->type))
+		{
 			const LV2_Atom_Object *obj = (const LV2_Atom_Object *)atom;
 
 			if(obj->body.otype == impl->midi_Controller)
@@ -1232,4 +3979,90 @@ vm_filter_deserialize(LV2_Atom_Forge *forge, const vm_filter_impl_t *impl,
 	return 0;
 }
 
+static inline LV2_Atom_Forge_Ref
+vm_decim_serialize(LV2_Atom_Forge *forge, const vm_decim_impl_t *impl,
+	const vm_decim_t *decims)
+{
+	LV2_Atom_Forge_Frame frame [2];
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_tuple(forge, &frame[0]);
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		const vm_decim_t *decim = &decims[i];
+
+		if(ref)
+			ref = lv2_atom_forge_object(forge, &frame[1], 0, impl->vm_Decimation);
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, impl->vm_interval);
+		if(ref)
+			ref = lv2_atom_forge_float(forge, decim->interval);
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, impl->vm_deadband);
+		if(ref)
+			ref = lv2_atom_forge_float(forge, decim->deadband);
+
+		if(ref)
+			ref = lv2_atom_forge_key(forge, impl->vm_quantized);
+		if(ref)
+			ref = lv2_atom_forge_bool(forge, decim->quantized);
+
+		if(ref)
+			lv2_atom_forge_pop(forge, &frame[1]);
+	}
+
+	if(ref)
+		lv2_atom_forge_pop(forge, &frame[0]);
+
+	return ref;
+}
+
+static inline int
+vm_decim_deserialize(LV2_Atom_Forge *forge, const vm_decim_impl_t *impl,
+	vm_decim_t *decims, uint32_t size, const LV2_Atom *body)
+{
+	memset(decims, 0x0, sizeof(vm_decim_t)*CTRL_MAX);
+
+	unsigned i = 0;
+	LV2_ATOM_TUPLE_BODY_FOREACH(body, size, atom)
+	{
+		if(i >= CTRL_MAX)
+			break;
+
+		vm_decim_t *decim = &decims[i];
+
+		if(lv2_atom_forge_is_object_type(forge, atom->type))
+		{
+			const LV2_Atom_Object *obj = (const LV2_Atom_Object *)atom;
+
+			if(obj->body.otype == impl->vm_Decimation)
+			{
+				const LV2_Atom_Float *interval = NULL;
+				const LV2_Atom_Float *deadband = NULL;
+				const LV2_Atom_Bool *quantized = NULL;
+
+				lv2_atom_object_get(obj,
+					impl->vm_interval, &interval,
+					impl->vm_deadband, &deadband,
+					impl->vm_quantized, &quantized,
+					0);
+
+				if(interval && (interval->atom.type == forge->Float) )
+					decim->interval = fmaxf(interval->body, 0.f);
+
+				if(deadband && (deadband->atom.type == forge->Float) )
+					decim->deadband = fmaxf(deadband->body, 0.f);
+
+				if(quantized && (quantized->atom.type == forge->Bool) )
+					decim->quantized = quantized->body;
+			}
+		}
+
+		i += 1;
+	}
+
+	return 0;
+}
+
 #endif // _VM_LV2_H
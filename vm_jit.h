@@ -0,0 +1,1796 @@
+/*
+ * Copyright (c) 2017-2021 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _VM_JIT_H
+#define _VM_JIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <sys/mman.h>
+
+#include <vm.h>
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#	define VM_JIT_NATIVE
+#endif
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#	define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#if defined(__APPLE__) && defined(MAP_JIT)
+#	define VM_JIT_MAP_JIT MAP_JIT // hardened runtime
+#else
+#	define VM_JIT_MAP_JIT 0
+#endif
+
+#if defined(__APPLE__) && defined(__aarch64__)
+#	include <pthread.h>
+#	define VM_JIT_WRITE_PROTECT_NP // per-thread toggle instead of mprotect
+#endif
+
+#define VM_JIT_SIZE 0x8000 // 32K per code buffer
+#define VM_JIT_ITEMS 0x200 // longer programs are left to the interpreter
+#define VM_JIT_LABEL_END (VM_JIT_ITEMS + 1) // label of common epilogue
+#define VM_JIT_OVERRUN 0x100 // or'ed into stack pointer of cut off loops
+#define VM_JIT_FIXUP_MAX (VM_JIT_ITEMS * 4)
+
+typedef enum _vm_jit_arch_t {
+	VM_JIT_ARCH_X86_64 = 0,
+	VM_JIT_ARCH_AARCH64
+} vm_jit_arch_t;
+
+typedef enum _vm_jit_fixup_enum_t {
+	VM_JIT_FIXUP_REL32 = 0, // x86-64 jmp/jcc
+	VM_JIT_FIXUP_B, // aarch64 b
+	VM_JIT_FIXUP_B_COND // aarch64 b.cond
+} vm_jit_fixup_enum_t;
+
+typedef struct _vm_jit_t vm_jit_t;
+typedef struct _vm_jit_fixup_t vm_jit_fixup_t;
+typedef struct _vm_jit_emit_t vm_jit_emit_t;
+
+// returns stack pointer after execution
+typedef int (*vm_jit_fn_t)(num_t *slots, num_t *regs, const float *in,
+	const num_t *clk);
+typedef num_t (*vm_jit_rand_t)(void *data);
+typedef void (*vm_jit_call_t)(void); // generic callee address
+
+struct _vm_jit_t {
+	uint8_t *code [2]; // double-buffered executable pages
+	unsigned cur;
+	uint32_t time; // mask of time opcodes read from clk
+	vm_jit_fn_t fn; // NULL if program needs the interpreter
+};
+
+struct _vm_jit_fixup_t {
+	uint32_t at;
+	uint32_t label;
+	vm_jit_fixup_enum_t type;
+};
+
+struct _vm_jit_emit_t {
+	uint8_t *buf;
+	uint32_t size;
+	uint32_t off;
+	bool overflow;
+
+	vm_jit_rand_t rand_cb;
+	void *rand_data;
+
+	int ptr [VM_JIT_ITEMS + 1];
+	uint32_t label [VM_JIT_ITEMS + 2];
+	vm_jit_fixup_t fixups [VM_JIT_FIXUP_MAX];
+	uint32_t nfixups;
+};
+
+static inline void
+_vm_jit_u8(vm_jit_emit_t *e, uint8_t v)
+{
+	if(e->off + 1 > e->size)
+	{
+		e->overflow = true;
+		return;
+	}
+
+	e->buf[e->off++] = v;
+}
+
+static inline void
+_vm_jit_u32(vm_jit_emit_t *e, uint32_t v)
+{
+	for(unsigned i = 0; i < 4; i++)
+		_vm_jit_u8(e, v >> (i*8));
+}
+
+static inline void
+_vm_jit_u64(vm_jit_emit_t *e, uint64_t v)
+{
+	for(unsigned i = 0; i < 8; i++)
+		_vm_jit_u8(e, v >> (i*8));
+}
+
+static inline void
+_vm_jit_fixup(vm_jit_emit_t *e, uint32_t at, uint32_t label,
+	vm_jit_fixup_enum_t type)
+{
+	if(e->nfixups >= VM_JIT_FIXUP_MAX)
+	{
+		e->overflow = true;
+		return;
+	}
+
+	vm_jit_fixup_t *fixup = &e->fixups[e->nfixups++];
+
+	fixup->at = at;
+	fixup->label = label;
+	fixup->type = type;
+}
+
+static inline void
+_vm_jit_patch(vm_jit_emit_t *e, uint32_t at, uint32_t to,
+	vm_jit_fixup_enum_t type)
+{
+	if(e->overflow)
+		return;
+
+	uint8_t *p = &e->buf[at];
+
+	switch(type)
+	{
+		case VM_JIT_FIXUP_REL32:
+		{
+			const int32_t rel = (int32_t)to - (int32_t)(at + 4);
+
+			for(unsigned i = 0; i < 4; i++)
+				p[i] = (uint32_t)rel >> (i*8);
+		} break;
+		case VM_JIT_FIXUP_B:
+		case VM_JIT_FIXUP_B_COND:
+		{
+			const int32_t rel = ((int32_t)to - (int32_t)at) / 4;
+			uint32_t ins = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+
+			if(type == VM_JIT_FIXUP_B)
+				ins |= rel & 0x3ffffff;
+			else
+				ins |= (rel & 0x7ffff) << 5;
+
+			for(unsigned i = 0; i < 4; i++)
+				p[i] = ins >> (i*8);
+		} break;
+	}
+}
+
+static inline uint64_t
+_vm_jit_bits(num_t v)
+{
+	uint64_t u;
+
+	memcpy(&u, &v, sizeof(u));
+
+	return u;
+}
+
+static inline uint32_t
+_vm_jit_disp(int ptr, int rel)
+{
+	return ((ptr + rel) & SLOT_MASK) * sizeof(num_t);
+}
+
+/*
+ * x86-64, System V ABI
+ *
+ * rbx: slots, r12: regs, r13: in, r14: clk, r15: budget, [rsp]: scratch
+ */
+
+enum {
+	X86_RAX = 0,
+	X86_RCX = 1,
+	X86_RDX = 2,
+	X86_RBX = 3,
+	X86_RSP = 4,
+	X86_RBP = 5,
+	X86_RSI = 6,
+	X86_RDI = 7,
+	X86_R12 = 12,
+	X86_R13 = 13,
+	X86_R14 = 14,
+	X86_R15 = 15
+};
+
+enum {
+	X86_CC_B  = 0x2,
+	X86_CC_AE = 0x3,
+	X86_CC_E  = 0x4,
+	X86_CC_NE = 0x5,
+	X86_CC_A  = 0x7,
+	X86_CC_P  = 0xa,
+	X86_CC_NP = 0xb
+};
+
+#define X86_SLOTS X86_RBX
+#define X86_REGS  X86_R12
+#define X86_IN    X86_R13
+#define X86_CLK   X86_R14
+
+static inline void
+_vm_jit_x86_rex(vm_jit_emit_t *e, bool w, unsigned r, unsigned x, unsigned b)
+{
+	const uint8_t rex = 0x40 | (w << 3) | ((r >> 3) << 2) | ((x >> 3) << 1) | (b >> 3);
+
+	if(rex != 0x40)
+		_vm_jit_u8(e, rex);
+}
+
+// [base + disp32]
+static inline void
+_vm_jit_x86_mem(vm_jit_emit_t *e, unsigned reg, unsigned base, uint32_t disp)
+{
+	_vm_jit_u8(e, 0x80 | ((reg & 7) << 3) | (base & 7));
+	if((base & 7) == X86_RSP)
+		_vm_jit_u8(e, 0x24);
+	_vm_jit_u32(e, disp);
+}
+
+// [base + index*(1 << scale)]
+static inline void
+_vm_jit_x86_sib(vm_jit_emit_t *e, unsigned reg, unsigned base, unsigned index,
+	unsigned scale)
+{
+	const bool disp8 = (base & 7) == X86_RBP;
+
+	_vm_jit_u8(e, (disp8 ? 0x40 : 0x00) | ((reg & 7) << 3) | 0x4);
+	_vm_jit_u8(e, (scale << 6) | ((index & 7) << 3) | (base & 7));
+	if(disp8)
+		_vm_jit_u8(e, 0x00);
+}
+
+static inline void
+_vm_jit_x86_sse_mem(vm_jit_emit_t *e, uint8_t prefix, uint8_t op, unsigned xmm,
+	unsigned base, uint32_t disp)
+{
+	_vm_jit_u8(e, prefix);
+	_vm_jit_x86_rex(e, false, xmm, 0, base);
+	_vm_jit_u8(e, 0x0f);
+	_vm_jit_u8(e, op);
+	_vm_jit_x86_mem(e, xmm, base, disp);
+}
+
+static inline void
+_vm_jit_x86_sse_rr(vm_jit_emit_t *e, uint8_t prefix, bool w, uint8_t op,
+	unsigned dst, unsigned src)
+{
+	_vm_jit_u8(e, prefix);
+	_vm_jit_x86_rex(e, w, dst, 0, src);
+	_vm_jit_u8(e, 0x0f);
+	_vm_jit_u8(e, op);
+	_vm_jit_u8(e, 0xc0 | ((dst & 7) << 3) | (src & 7));
+}
+
+static inline void
+_vm_jit_x86_load(vm_jit_emit_t *e, unsigned xmm, unsigned base, uint32_t disp)
+{
+	_vm_jit_x86_sse_mem(e, 0xf2, 0x10, xmm, base, disp); // movsd xmm, [base + disp]
+}
+
+static inline void
+_vm_jit_x86_store(vm_jit_emit_t *e, unsigned xmm, unsigned base, uint32_t disp)
+{
+	_vm_jit_x86_sse_mem(e, 0xf2, 0x11, xmm, base, disp); // movsd [base + disp], xmm
+}
+
+static inline void
+_vm_jit_x86_mov_load(vm_jit_emit_t *e, unsigned reg, unsigned base, uint32_t disp)
+{
+	_vm_jit_x86_rex(e, true, reg, 0, base);
+	_vm_jit_u8(e, 0x8b); // mov reg, [base + disp]
+	_vm_jit_x86_mem(e, reg, base, disp);
+}
+
+static inline void
+_vm_jit_x86_mov_store(vm_jit_emit_t *e, unsigned reg, unsigned base, uint32_t disp)
+{
+	_vm_jit_x86_rex(e, true, reg, 0, base);
+	_vm_jit_u8(e, 0x89); // mov [base + disp], reg
+	_vm_jit_x86_mem(e, reg, base, disp);
+}
+
+static inline void
+_vm_jit_x86_mov_imm(vm_jit_emit_t *e, unsigned reg, uint64_t imm)
+{
+	_vm_jit_x86_rex(e, true, 0, 0, reg);
+	_vm_jit_u8(e, 0xb8 | (reg & 7)); // movabs reg, imm64
+	_vm_jit_u64(e, imm);
+}
+
+static inline void
+_vm_jit_x86_call(vm_jit_emit_t *e, vm_jit_call_t fn)
+{
+	_vm_jit_x86_mov_imm(e, X86_RAX, (uintptr_t)fn);
+	_vm_jit_u8(e, 0xff); // call rax
+	_vm_jit_u8(e, 0xd0);
+}
+
+static inline void
+_vm_jit_x86_jcc(vm_jit_emit_t *e, uint8_t cc, uint32_t label)
+{
+	_vm_jit_u8(e, 0x0f);
+	_vm_jit_u8(e, 0x80 | cc);
+	_vm_jit_fixup(e, e->off, label, VM_JIT_FIXUP_REL32);
+	_vm_jit_u32(e, 0);
+}
+
+static inline void
+_vm_jit_x86_jmp(vm_jit_emit_t *e, uint32_t label)
+{
+	_vm_jit_u8(e, 0xe9);
+	_vm_jit_fixup(e, e->off, label, VM_JIT_FIXUP_REL32);
+	_vm_jit_u32(e, 0);
+}
+
+// forward jump within an instruction, to be patched with _vm_jit_x86_here
+static inline uint32_t
+_vm_jit_x86_jcc_fwd(vm_jit_emit_t *e, uint8_t cc)
+{
+	_vm_jit_u8(e, 0x0f);
+	_vm_jit_u8(e, 0x80 | cc);
+	const uint32_t at = e->off;
+	_vm_jit_u32(e, 0);
+
+	return at;
+}
+
+static inline uint32_t
+_vm_jit_x86_jmp_fwd(vm_jit_emit_t *e)
+{
+	_vm_jit_u8(e, 0xe9);
+	const uint32_t at = e->off;
+	_vm_jit_u32(e, 0);
+
+	return at;
+}
+
+static inline void
+_vm_jit_x86_here(vm_jit_emit_t *e, uint32_t at)
+{
+	_vm_jit_patch(e, at, e->off, VM_JIT_FIXUP_REL32);
+}
+
+// compare xmm0 against zero, true if PF or !ZF
+static inline void
+_vm_jit_x86_test(vm_jit_emit_t *e)
+{
+	_vm_jit_x86_sse_rr(e, 0x66, false, 0x57, 1, 1); // xorpd xmm1, xmm1
+	_vm_jit_x86_sse_rr(e, 0x66, false, 0x2e, 0, 1); // ucomisd xmm0, xmm1
+}
+
+// al = xmm0 != 0.0
+static inline void
+_vm_jit_x86_truth(vm_jit_emit_t *e, unsigned reg)
+{
+	_vm_jit_x86_test(e);
+	_vm_jit_u8(e, 0x0f); // setne reg8
+	_vm_jit_u8(e, 0x95);
+	_vm_jit_u8(e, 0xc0 | reg);
+	_vm_jit_u8(e, 0x0f); // setp dl
+	_vm_jit_u8(e, 0x9a);
+	_vm_jit_u8(e, 0xc2);
+	_vm_jit_u8(e, 0x08); // or reg8, dl
+	_vm_jit_u8(e, 0xd0 | reg);
+}
+
+// xmm0 = (num_t)eax, zero-extended
+static inline void
+_vm_jit_x86_from_u32(vm_jit_emit_t *e, uint32_t disp)
+{
+	_vm_jit_x86_sse_rr(e, 0xf2, true, 0x2a, 0, X86_RAX); // cvtsi2sd xmm0, rax
+	_vm_jit_x86_store(e, 0, X86_SLOTS, disp);
+}
+
+// xmm0 = (num_t)(bool)al
+static inline void
+_vm_jit_x86_from_bool(vm_jit_emit_t *e, uint32_t disp)
+{
+	_vm_jit_u8(e, 0x0f); // movzx eax, al
+	_vm_jit_u8(e, 0xb6);
+	_vm_jit_u8(e, 0xc0);
+	_vm_jit_x86_from_u32(e, disp);
+}
+
+static inline void
+_vm_jit_x86_unary(vm_jit_emit_t *e, vm_jit_call_t fn, uint32_t a)
+{
+	_vm_jit_x86_load(e, 0, X86_SLOTS, a);
+	_vm_jit_x86_call(e, fn);
+	_vm_jit_x86_store(e, 0, X86_SLOTS, a);
+}
+
+static inline void
+_vm_jit_x86_binary(vm_jit_emit_t *e, vm_jit_call_t fn, uint32_t a, uint32_t b)
+{
+	_vm_jit_x86_load(e, 0, X86_SLOTS, b);
+	_vm_jit_x86_load(e, 1, X86_SLOTS, a);
+	_vm_jit_x86_call(e, fn);
+	_vm_jit_x86_store(e, 0, X86_SLOTS, b);
+}
+
+static inline void
+_vm_jit_x86_arith(vm_jit_emit_t *e, uint8_t op, uint32_t a, uint32_t b)
+{
+	_vm_jit_x86_load(e, 0, X86_SLOTS, b);
+	_vm_jit_x86_load(e, 1, X86_SLOTS, a);
+	_vm_jit_x86_sse_rr(e, 0xf2, false, op, 0, 1);
+	_vm_jit_x86_store(e, 0, X86_SLOTS, b);
+}
+
+// eax = floorf(slot) & mask
+static inline void
+_vm_jit_x86_index_floorf(vm_jit_emit_t *e, uint32_t a, uint8_t mask)
+{
+	_vm_jit_x86_load(e, 0, X86_SLOTS, a);
+	_vm_jit_x86_sse_rr(e, 0xf2, false, 0x5a, 0, 0); // cvtsd2ss xmm0, xmm0
+	_vm_jit_x86_call(e, (vm_jit_call_t)floorf);
+	_vm_jit_x86_sse_rr(e, 0xf3, false, 0x2c, X86_RAX, 0); // cvttss2si eax, xmm0
+	_vm_jit_u8(e, 0x83); // and eax, imm8
+	_vm_jit_u8(e, 0xe0);
+	_vm_jit_u8(e, mask);
+}
+
+// eax = (unsigned)x, ecx = (unsigned)y
+static inline void
+_vm_jit_x86_u32s(vm_jit_emit_t *e, uint32_t a, uint32_t b)
+{
+	_vm_jit_x86_load(e, 0, X86_SLOTS, b);
+	_vm_jit_x86_load(e, 1, X86_SLOTS, a);
+	_vm_jit_x86_sse_rr(e, 0xf2, true, 0x2c, X86_RAX, 0); // cvttsd2si rax, xmm0
+	_vm_jit_x86_sse_rr(e, 0xf2, true, 0x2c, X86_RCX, 1); // cvttsd2si rcx, xmm1
+}
+
+static inline void
+_vm_jit_x86_cmp(vm_jit_emit_t *e, uint8_t cc, bool swap, uint32_t a, uint32_t b)
+{
+	_vm_jit_x86_load(e, 0, X86_SLOTS, b);
+	_vm_jit_x86_load(e, 1, X86_SLOTS, a);
+	if(swap)
+		_vm_jit_x86_sse_rr(e, 0x66, false, 0x2e, 1, 0); // ucomisd xmm1, xmm0
+	else
+		_vm_jit_x86_sse_rr(e, 0x66, false, 0x2e, 0, 1); // ucomisd xmm0, xmm1
+	_vm_jit_u8(e, 0x0f); // setcc al
+	_vm_jit_u8(e, 0x90 | cc);
+	_vm_jit_u8(e, 0xc0);
+	if(cc == X86_CC_E)
+	{
+		_vm_jit_u8(e, 0x0f); // setnp cl
+		_vm_jit_u8(e, 0x9b);
+		_vm_jit_u8(e, 0xc1);
+		_vm_jit_u8(e, 0x20); // and al, cl
+		_vm_jit_u8(e, 0xc8);
+	}
+	_vm_jit_x86_from_bool(e, b);
+}
+
+static inline void
+_vm_jit_x86_exit(vm_jit_emit_t *e, int ptr)
+{
+	_vm_jit_u8(e, 0xb8); // mov eax, imm32
+	_vm_jit_u32(e, ptr);
+	_vm_jit_x86_jmp(e, VM_JIT_LABEL_END);
+}
+
+static inline void
+_vm_jit_x86_prologue(vm_jit_emit_t *e)
+{
+	static const uint8_t code [] = {
+		0x53, // push rbx
+		0x41, 0x54, // push r12
+		0x41, 0x55, // push r13
+		0x41, 0x56, // push r14
+		0x41, 0x57, // push r15
+		0x48, 0x83, 0xec, 0x10, // sub rsp, 16
+		0x48, 0x89, 0xfb, // mov rbx, rdi
+		0x49, 0x89, 0xf4, // mov r12, rsi
+		0x49, 0x89, 0xd5, // mov r13, rdx
+		0x49, 0x89, 0xce // mov r14, rcx
+	};
+
+	for(unsigned i = 0; i < sizeof(code); i++)
+		_vm_jit_u8(e, code[i]);
+
+	_vm_jit_u8(e, 0x41); // mov r15d, VM_BUDGET
+	_vm_jit_u8(e, 0xbf);
+	_vm_jit_u32(e, VM_BUDGET);
+}
+
+static inline void
+_vm_jit_x86_epilogue(vm_jit_emit_t *e)
+{
+	static const uint8_t code [] = {
+		0x48, 0x83, 0xc4, 0x10, // add rsp, 16
+		0x41, 0x5f, // pop r15
+		0x41, 0x5e, // pop r14
+		0x41, 0x5d, // pop r13
+		0x41, 0x5c, // pop r12
+		0x5b, // pop rbx
+		0xc3 // ret
+	};
+
+	for(unsigned i = 0; i < sizeof(code); i++)
+		_vm_jit_u8(e, code[i]);
+}
+
+static inline bool
+_vm_jit_x86_inst(vm_jit_emit_t *e, const vm_prog_t *prog, unsigned i)
+{
+	const vm_inst_t *inst = &prog->inst[i];
+	const int ptr = e->ptr[i];
+	const int end = (ptr + inst->npops - inst->npushs) & SLOT_MASK;
+	const uint32_t a = _vm_jit_disp(ptr, 0); // topmost
+	const uint32_t b = _vm_jit_disp(ptr, 1);
+	const uint32_t c = _vm_jit_disp(ptr, 2);
+	const uint32_t d = _vm_jit_disp(ptr, -1); // to be pushed
+
+	switch(inst->op)
+	{
+		case INST_IMM:
+		{
+			_vm_jit_x86_mov_imm(e, X86_RAX, _vm_jit_bits(inst->imm));
+			_vm_jit_x86_mov_store(e, X86_RAX, X86_SLOTS, d);
+		} break;
+		case INST_HLOAD:
+		{
+			_vm_jit_x86_mov_load(e, X86_RAX, X86_REGS, (REG_MAX + inst->target) * sizeof(num_t));
+			_vm_jit_x86_mov_store(e, X86_RAX, X86_SLOTS, d);
+		} break;
+		case INST_JMP:
+		{
+			_vm_jit_x86_load(e, 0, X86_SLOTS, a);
+			_vm_jit_x86_test(e);
+			if(inst->target > i)
+			{
+				_vm_jit_x86_jcc(e, X86_CC_P, inst->target);
+				_vm_jit_x86_jcc(e, X86_CC_NE, inst->target);
+				break;
+			}
+
+			// loop draws on budget, cut off once exhausted
+			const uint32_t nan = _vm_jit_x86_jcc_fwd(e, X86_CC_P);
+			const uint32_t skip = _vm_jit_x86_jcc_fwd(e, X86_CC_E);
+			_vm_jit_x86_here(e, nan);
+			_vm_jit_u8(e, 0x41); // sub r15d, imm32
+			_vm_jit_u8(e, 0x81);
+			_vm_jit_u8(e, 0xef);
+			_vm_jit_u32(e, i + 1 - inst->target);
+			const uint32_t left = _vm_jit_x86_jcc_fwd(e, X86_CC_AE);
+			_vm_jit_x86_exit(e, end | VM_JIT_OVERRUN);
+			_vm_jit_x86_here(e, left);
+			_vm_jit_x86_jmp(e, inst->target);
+			_vm_jit_x86_here(e, skip);
+		} break;
+
+		case OP_CTRL:
+		{
+			_vm_jit_x86_load(e, 0, X86_SLOTS, a);
+			_vm_jit_x86_call(e, (vm_jit_call_t)floor);
+			_vm_jit_x86_sse_rr(e, 0xf2, false, 0x2c, X86_RAX, 0); // cvttsd2si eax, xmm0
+			_vm_jit_u8(e, 0x83); // and eax, CTRL_MASK
+			_vm_jit_u8(e, 0xe0);
+			_vm_jit_u8(e, CTRL_MASK);
+			_vm_jit_u8(e, 0xf3); // cvtss2sd xmm0, [r13 + rax*4]
+			_vm_jit_x86_rex(e, false, 0, X86_RAX, X86_IN);
+			_vm_jit_u8(e, 0x0f);
+			_vm_jit_u8(e, 0x5a);
+			_vm_jit_x86_sib(e, 0, X86_IN, X86_RAX, 2);
+			_vm_jit_x86_store(e, 0, X86_SLOTS, a);
+		} break;
+		case OP_PUSH:
+		{
+			_vm_jit_x86_mov_load(e, X86_RAX, X86_SLOTS, a);
+			_vm_jit_x86_mov_store(e, X86_RAX, X86_SLOTS, d);
+		} break;
+		case OP_POP:
+		{
+			// nothing
+		} break;
+		case OP_SWAP:
+		{
+			_vm_jit_x86_mov_load(e, X86_RAX, X86_SLOTS, a);
+			_vm_jit_x86_mov_load(e, X86_RCX, X86_SLOTS, b);
+			_vm_jit_x86_mov_store(e, X86_RCX, X86_SLOTS, a);
+			_vm_jit_x86_mov_store(e, X86_RAX, X86_SLOTS, b);
+		} break;
+		case OP_STORE:
+		{
+			_vm_jit_x86_index_floorf(e, a, REG_MASK);
+			_vm_jit_x86_mov_load(e, X86_RCX, X86_SLOTS, b);
+			_vm_jit_x86_rex(e, true, X86_RCX, X86_RAX, X86_REGS); // mov [r12 + rax*8], rcx
+			_vm_jit_u8(e, 0x89);
+			_vm_jit_x86_sib(e, X86_RCX, X86_REGS, X86_RAX, 3);
+		} break;
+		case OP_LOAD:
+		{
+			_vm_jit_x86_index_floorf(e, a, REG_MASK);
+			_vm_jit_x86_rex(e, true, X86_RCX, X86_RAX, X86_REGS); // mov rcx, [r12 + rax*8]
+			_vm_jit_u8(e, 0x8b);
+			_vm_jit_x86_sib(e, X86_RCX, X86_REGS, X86_RAX, 3);
+			_vm_jit_x86_mov_store(e, X86_RCX, X86_SLOTS, a);
+		} break;
+		case OP_BREAK:
+		{
+			_vm_jit_x86_load(e, 0, X86_SLOTS, a);
+			_vm_jit_x86_test(e);
+			const uint32_t nan = _vm_jit_x86_jcc_fwd(e, X86_CC_P);
+			const uint32_t skip = _vm_jit_x86_jcc_fwd(e, X86_CC_E);
+			_vm_jit_x86_here(e, nan);
+			_vm_jit_x86_exit(e, end);
+			_vm_jit_x86_here(e, skip);
+		} break;
+		case OP_GOTO:
+		{
+			return false; // dynamic target
+		} break;
+
+		case OP_RAND:
+		{
+			if(!e->rand_cb)
+				return false;
+
+			_vm_jit_x86_mov_imm(e, X86_RDI, (uintptr_t)e->rand_data);
+			_vm_jit_x86_call(e, (vm_jit_call_t)e->rand_cb);
+			_vm_jit_x86_store(e, 0, X86_SLOTS, d);
+		} break;
+
+		case OP_ADD:
+		{
+			_vm_jit_x86_arith(e, 0x58, a, b); // addsd
+		} break;
+		case OP_SUB:
+		{
+			_vm_jit_x86_arith(e, 0x5c, a, b); // subsd
+		} break;
+		case OP_MUL:
+		{
+			_vm_jit_x86_arith(e, 0x59, a, b); // mulsd
+		} break;
+		case OP_DIV:
+		case OP_MOD:
+		{
+			_vm_jit_x86_load(e, 1, X86_SLOTS, a);
+			_vm_jit_x86_sse_rr(e, 0x66, false, 0x57, 2, 2); // xorpd xmm2, xmm2
+			_vm_jit_x86_sse_rr(e, 0x66, false, 0x2e, 1, 2); // ucomisd xmm1, xmm2
+			const uint32_t nan = _vm_jit_x86_jcc_fwd(e, X86_CC_P);
+			const uint32_t nonzero = _vm_jit_x86_jcc_fwd(e, X86_CC_NE);
+			_vm_jit_x86_sse_rr(e, 0x66, false, 0x57, 0, 0); // xorpd xmm0, xmm0
+			const uint32_t done = _vm_jit_x86_jmp_fwd(e);
+			_vm_jit_x86_here(e, nan);
+			_vm_jit_x86_here(e, nonzero);
+			_vm_jit_x86_load(e, 0, X86_SLOTS, b);
+			if(inst->op == OP_DIV)
+				_vm_jit_x86_sse_rr(e, 0xf2, false, 0x5e, 0, 1); // divsd xmm0, xmm1
+			else
+				_vm_jit_x86_call(e, (vm_jit_call_t)fmod);
+			_vm_jit_x86_here(e, done);
+			_vm_jit_x86_store(e, 0, X86_SLOTS, b);
+		} break;
+		case OP_POW:
+		{
+			_vm_jit_x86_binary(e, (vm_jit_call_t)pow, a, b);
+		} break;
+
+		case OP_NEG:
+		case OP_ABS:
+		{
+			_vm_jit_x86_mov_load(e, X86_RAX, X86_SLOTS, a);
+			_vm_jit_u8(e, 0x48); // btc/btr rax, 63
+			_vm_jit_u8(e, 0x0f);
+			_vm_jit_u8(e, 0xba);
+			_vm_jit_u8(e, (inst->op == OP_NEG) ? 0xf8 : 0xf0);
+			_vm_jit_u8(e, 63);
+			_vm_jit_x86_mov_store(e, X86_RAX, X86_SLOTS, a);
+		} break;
+		case OP_SQRT:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)sqrt, a);
+		} break;
+		case OP_CBRT:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)cbrt, a);
+		} break;
+
+		case OP_FLOOR:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)floor, a);
+		} break;
+		case OP_CEIL:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)ceil, a);
+		} break;
+		case OP_ROUND:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)round, a);
+		} break;
+		case OP_RINT:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)rint, a);
+		} break;
+		case OP_TRUNC:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)trunc, a);
+		} break;
+		case OP_MODF:
+		{
+			_vm_jit_x86_load(e, 0, X86_SLOTS, a);
+			_vm_jit_x86_rex(e, true, X86_RDI, 0, X86_SLOTS); // lea rdi, [rbx + d]
+			_vm_jit_u8(e, 0x8d);
+			_vm_jit_x86_mem(e, X86_RDI, X86_SLOTS, d);
+			_vm_jit_x86_call(e, (vm_jit_call_t)modf);
+			_vm_jit_x86_store(e, 0, X86_SLOTS, a);
+		} break;
+
+		case OP_EXP:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)exp, a);
+		} break;
+		case OP_EXP_2:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)exp2, a);
+		} break;
+		case OP_LD_EXP:
+		{
+			_vm_jit_x86_load(e, 0, X86_SLOTS, b);
+			_vm_jit_x86_load(e, 1, X86_SLOTS, a);
+			_vm_jit_x86_sse_rr(e, 0xf2, false, 0x2c, X86_RDI, 1); // cvttsd2si edi, xmm1
+			_vm_jit_x86_call(e, (vm_jit_call_t)ldexp);
+			_vm_jit_x86_store(e, 0, X86_SLOTS, b);
+		} break;
+		case OP_FR_EXP:
+		{
+			_vm_jit_x86_load(e, 0, X86_SLOTS, a);
+			static const uint8_t lea [] = {0x48, 0x8d, 0x3c, 0x24}; // lea rdi, [rsp]
+			for(unsigned j = 0; j < sizeof(lea); j++)
+				_vm_jit_u8(e, lea[j]);
+			_vm_jit_x86_call(e, (vm_jit_call_t)frexp);
+			_vm_jit_x86_store(e, 0, X86_SLOTS, a);
+			static const uint8_t cvt [] = {0xf2, 0x0f, 0x2a, 0x04, 0x24}; // cvtsi2sd xmm0, dword [rsp]
+			for(unsigned j = 0; j < sizeof(cvt); j++)
+				_vm_jit_u8(e, cvt[j]);
+			_vm_jit_x86_store(e, 0, X86_SLOTS, d);
+		} break;
+		case OP_LOG:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)log, a);
+		} break;
+		case OP_LOG_2:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)log2, a);
+		} break;
+		case OP_LOG_10:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)log10, a);
+		} break;
+
+		case OP_PI:
+		{
+			_vm_jit_x86_mov_imm(e, X86_RAX, _vm_jit_bits(M_PI));
+			_vm_jit_x86_mov_store(e, X86_RAX, X86_SLOTS, d);
+		} break;
+		case OP_SIN:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)sin, a);
+		} break;
+		case OP_COS:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)cos, a);
+		} break;
+		case OP_TAN:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)tan, a);
+		} break;
+		case OP_ASIN:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)asin, a);
+		} break;
+		case OP_ACOS:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)acos, a);
+		} break;
+		case OP_ATAN:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)atan, a);
+		} break;
+		case OP_ATAN2:
+		{
+			_vm_jit_x86_binary(e, (vm_jit_call_t)atan2, a, b);
+		} break;
+		case OP_SINH:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)sinh, a);
+		} break;
+		case OP_COSH:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)cosh, a);
+		} break;
+		case OP_TANH:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)tanh, a);
+		} break;
+		case OP_ASINH:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)asinh, a);
+		} break;
+		case OP_ACOSH:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)acosh, a);
+		} break;
+		case OP_ATANH:
+		{
+			_vm_jit_x86_unary(e, (vm_jit_call_t)atanh, a);
+		} break;
+
+		case OP_EQ:
+		{
+			_vm_jit_x86_cmp(e, X86_CC_E, false, a, b);
+		} break;
+		case OP_LT:
+		{
+			_vm_jit_x86_cmp(e, X86_CC_A, true, a, b);
+		} break;
+		case OP_GT:
+		{
+			_vm_jit_x86_cmp(e, X86_CC_A, false, a, b);
+		} break;
+		case OP_LE:
+		{
+			_vm_jit_x86_cmp(e, X86_CC_AE, true, a, b);
+		} break;
+		case OP_GE:
+		{
+			_vm_jit_x86_cmp(e, X86_CC_AE, false, a, b);
+		} break;
+		case OP_TER:
+		{
+			_vm_jit_x86_load(e, 0, X86_SLOTS, a);
+			_vm_jit_x86_test(e);
+			const uint32_t nan = _vm_jit_x86_jcc_fwd(e, X86_CC_P);
+			const uint32_t keep = _vm_jit_x86_jcc_fwd(e, X86_CC_NE);
+			_vm_jit_x86_mov_load(e, X86_RAX, X86_SLOTS, b);
+			_vm_jit_x86_mov_store(e, X86_RAX, X86_SLOTS, c);
+			_vm_jit_x86_here(e, nan);
+			_vm_jit_x86_here(e, keep);
+		} break;
+		case OP_MINI:
+		case OP_MAXI:
+		{
+			_vm_jit_x86_load(e, 0, X86_SLOTS, b);
+			_vm_jit_x86_load(e, 1, X86_SLOTS, a);
+			_vm_jit_x86_call(e, (inst->op == OP_MINI)
+				? (vm_jit_call_t)vm_mini
+				: (vm_jit_call_t)vm_maxi);
+			_vm_jit_x86_store(e, 0, X86_SLOTS, b);
+		} break;
+
+		case OP_AND:
+		case OP_OR:
+		{
+			_vm_jit_x86_load(e, 0, X86_SLOTS, b);
+			_vm_jit_x86_truth(e, X86_RCX);
+			_vm_jit_x86_load(e, 0, X86_SLOTS, a);
+			_vm_jit_x86_truth(e, X86_RAX);
+			_vm_jit_u8(e, (inst->op == OP_AND) ? 0x20 : 0x08); // and/or al, cl
+			_vm_jit_u8(e, 0xc8);
+			_vm_jit_x86_from_bool(e, b);
+		} break;
+
+		case OP_NOT:
+		{
+			_vm_jit_x86_load(e, 0, X86_SLOTS, a);
+			_vm_jit_x86_sse_rr(e, 0xf2, false, 0x2c, X86_RAX, 0); // cvttsd2si eax, xmm0
+			static const uint8_t code [] = {
+				0x85, 0xc0, // test eax, eax
+				0x0f, 0x94, 0xc0 // sete al
+			};
+			for(unsigned j = 0; j < sizeof(code); j++)
+				_vm_jit_u8(e, code[j]);
+			_vm_jit_x86_from_bool(e, a);
+		} break;
+		case OP_BAND:
+		case OP_BOR:
+		case OP_LSHIFT:
+		case OP_RSHIFT:
+		{
+			_vm_jit_x86_u32s(e, a, b);
+			switch(inst->op)
+			{
+				case OP_BAND:
+				{
+					_vm_jit_u8(e, 0x21); // and eax, ecx
+					_vm_jit_u8(e, 0xc8);
+				} break;
+				case OP_BOR:
+				{
+					_vm_jit_u8(e, 0x09); // or eax, ecx
+					_vm_jit_u8(e, 0xc8);
+				} break;
+				case OP_LSHIFT:
+				{
+					_vm_jit_u8(e, 0xd3); // shl eax, cl
+					_vm_jit_u8(e, 0xe0);
+				} break;
+				case OP_RSHIFT:
+				{
+					_vm_jit_u8(e, 0xd3); // shr eax, cl
+					_vm_jit_u8(e, 0xe8);
+				} break;
+			}
+			_vm_jit_x86_from_u32(e, b);
+		} break;
+		case OP_BNOT:
+		{
+			_vm_jit_x86_load(e, 0, X86_SLOTS, a);
+			_vm_jit_x86_sse_rr(e, 0xf2, true, 0x2c, X86_RAX, 0); // cvttsd2si rax, xmm0
+			_vm_jit_u8(e, 0xf7); // not eax
+			_vm_jit_u8(e, 0xd0);
+			_vm_jit_x86_from_u32(e, a);
+		} break;
+
+		case OP_BAR_BEAT:
+		case OP_BAR:
+		case OP_BEAT:
+		case OP_BEAT_UNIT:
+		case OP_BPB:
+		case OP_BPM:
+		case OP_FRAME:
+		case OP_FPS:
+		case OP_SPEED:
+		{
+			_vm_jit_x86_mov_load(e, X86_RAX, X86_CLK, (inst->op - OP_BAR_BEAT)*sizeof(num_t));
+			_vm_jit_x86_mov_store(e, X86_RAX, X86_SLOTS, d);
+		} break;
+
+		case OP_NOP:
+		{
+			// no operation
+		} break;
+		default:
+		{
+			return false;
+		} break;
+	}
+
+	return true;
+}
+
+/*
+ * AArch64, AAPCS64
+ *
+ * x19: slots, x20: regs, x21: in, x22: clk, [sp, #48]: scratch
+ */
+
+enum {
+	A64_X0  = 0,
+	A64_X1  = 1,
+	A64_X16 = 16,
+	A64_X19 = 19,
+	A64_X20 = 20,
+	A64_X21 = 21,
+	A64_X22 = 22,
+	A64_X23 = 23,
+	A64_SP  = 31,
+	A64_XZR = 31
+};
+
+enum {
+	A64_CC_EQ = 0x0,
+	A64_CC_NE = 0x1,
+	A64_CC_HS = 0x2,
+	A64_CC_MI = 0x4,
+	A64_CC_LS = 0x9,
+	A64_CC_GE = 0xa,
+	A64_CC_GT = 0xc
+};
+
+#define A64_SLOTS A64_X19
+#define A64_REGS  A64_X20
+#define A64_IN    A64_X21
+#define A64_CLK   A64_X22
+
+static inline void
+_vm_jit_a64_load(vm_jit_emit_t *e, unsigned d, unsigned base, uint32_t disp)
+{
+	_vm_jit_u32(e, 0xfd400000 | ((disp / 8) << 10) | (base << 5) | d); // ldr d, [base, #disp]
+}
+
+static inline void
+_vm_jit_a64_store(vm_jit_emit_t *e, unsigned d, unsigned base, uint32_t disp)
+{
+	_vm_jit_u32(e, 0xfd000000 | ((disp / 8) << 10) | (base << 5) | d); // str d, [base, #disp]
+}
+
+static inline void
+_vm_jit_a64_mov_load(vm_jit_emit_t *e, unsigned x, unsigned base, uint32_t disp)
+{
+	_vm_jit_u32(e, 0xf9400000 | ((disp / 8) << 10) | (base << 5) | x); // ldr x, [base, #disp]
+}
+
+static inline void
+_vm_jit_a64_mov_store(vm_jit_emit_t *e, unsigned x, unsigned base, uint32_t disp)
+{
+	_vm_jit_u32(e, 0xf9000000 | ((disp / 8) << 10) | (base << 5) | x); // str x, [base, #disp]
+}
+
+static inline void
+_vm_jit_a64_mov_imm(vm_jit_emit_t *e, unsigned x, uint64_t imm)
+{
+	_vm_jit_u32(e, 0xd2800000 | ((imm & 0xffff) << 5) | x); // movz x, #imm
+	for(unsigned hw = 1; hw < 4; hw++)
+	{
+		const uint32_t part = (imm >> (hw*16)) & 0xffff;
+
+		if(part)
+			_vm_jit_u32(e, 0xf2800000 | (hw << 21) | (part << 5) | x); // movk x, #part, lsl #hw*16
+	}
+}
+
+static inline void
+_vm_jit_a64_call(vm_jit_emit_t *e, vm_jit_call_t fn)
+{
+	_vm_jit_a64_mov_imm(e, A64_X16, (uintptr_t)fn);
+	_vm_jit_u32(e, 0xd63f0000 | (A64_X16 << 5)); // blr x16
+}
+
+static inline void
+_vm_jit_a64_b(vm_jit_emit_t *e, uint32_t label)
+{
+	_vm_jit_fixup(e, e->off, label, VM_JIT_FIXUP_B);
+	_vm_jit_u32(e, 0x14000000); // b label
+}
+
+static inline void
+_vm_jit_a64_b_cond(vm_jit_emit_t *e, uint8_t cc, uint32_t label)
+{
+	_vm_jit_fixup(e, e->off, label, VM_JIT_FIXUP_B_COND);
+	_vm_jit_u32(e, 0x54000000 | cc); // b.cc label
+}
+
+static inline uint32_t
+_vm_jit_a64_b_cond_fwd(vm_jit_emit_t *e, uint8_t cc)
+{
+	const uint32_t at = e->off;
+	_vm_jit_u32(e, 0x54000000 | cc); // b.cc
+
+	return at;
+}
+
+static inline uint32_t
+_vm_jit_a64_b_fwd(vm_jit_emit_t *e)
+{
+	const uint32_t at = e->off;
+	_vm_jit_u32(e, 0x14000000); // b
+
+	return at;
+}
+
+static inline void
+_vm_jit_a64_here(vm_jit_emit_t *e, uint32_t at)
+{
+	const bool cond = (e->buf[at + 3] == 0x54);
+
+	_vm_jit_patch(e, at, e->off, cond ? VM_JIT_FIXUP_B_COND : VM_JIT_FIXUP_B);
+}
+
+static inline void
+_vm_jit_a64_test(vm_jit_emit_t *e, unsigned d)
+{
+	_vm_jit_u32(e, 0x1e602008 | (d << 5)); // fcmp d, #0.0
+}
+
+static inline void
+_vm_jit_a64_cset(vm_jit_emit_t *e, unsigned w, uint8_t cc)
+{
+	_vm_jit_u32(e, 0x1a9f07e0 | ((cc ^ 1) << 12) | w); // cset w, cc
+}
+
+static inline void
+_vm_jit_a64_from_u32(vm_jit_emit_t *e, uint32_t disp)
+{
+	_vm_jit_u32(e, 0x1e630000); // ucvtf d0, w0
+	_vm_jit_a64_store(e, 0, A64_SLOTS, disp);
+}
+
+static inline void
+_vm_jit_a64_unary(vm_jit_emit_t *e, vm_jit_call_t fn, uint32_t a)
+{
+	_vm_jit_a64_load(e, 0, A64_SLOTS, a);
+	_vm_jit_a64_call(e, fn);
+	_vm_jit_a64_store(e, 0, A64_SLOTS, a);
+}
+
+static inline void
+_vm_jit_a64_binary(vm_jit_emit_t *e, vm_jit_call_t fn, uint32_t a, uint32_t b)
+{
+	_vm_jit_a64_load(e, 0, A64_SLOTS, b);
+	_vm_jit_a64_load(e, 1, A64_SLOTS, a);
+	_vm_jit_a64_call(e, fn);
+	_vm_jit_a64_store(e, 0, A64_SLOTS, b);
+}
+
+static inline void
+_vm_jit_a64_arith(vm_jit_emit_t *e, uint32_t op, uint32_t a, uint32_t b)
+{
+	_vm_jit_a64_load(e, 0, A64_SLOTS, b);
+	_vm_jit_a64_load(e, 1, A64_SLOTS, a);
+	_vm_jit_u32(e, op | (1 << 16)); // fop d0, d0, d1
+	_vm_jit_a64_store(e, 0, A64_SLOTS, b);
+}
+
+// w0 = floorf(slot) & mask
+static inline void
+_vm_jit_a64_index_floorf(vm_jit_emit_t *e, uint32_t a, unsigned ones)
+{
+	_vm_jit_a64_load(e, 0, A64_SLOTS, a);
+	_vm_jit_u32(e, 0x1e624000); // fcvt s0, d0
+	_vm_jit_a64_call(e, (vm_jit_call_t)floorf);
+	_vm_jit_u32(e, 0x1e380000); // fcvtzs w0, s0
+	_vm_jit_u32(e, 0x12000000 | ((ones - 1) << 10)); // and w0, w0, #mask
+}
+
+// w0 = (unsigned)x, w1 = (unsigned)y
+static inline void
+_vm_jit_a64_u32s(vm_jit_emit_t *e, uint32_t a, uint32_t b)
+{
+	_vm_jit_a64_load(e, 0, A64_SLOTS, b);
+	_vm_jit_a64_load(e, 1, A64_SLOTS, a);
+	_vm_jit_u32(e, 0x1e790000); // fcvtzu w0, d0
+	_vm_jit_u32(e, 0x1e790021); // fcvtzu w1, d1
+}
+
+static inline void
+_vm_jit_a64_cmp(vm_jit_emit_t *e, uint8_t cc, uint32_t a, uint32_t b)
+{
+	_vm_jit_a64_load(e, 0, A64_SLOTS, b);
+	_vm_jit_a64_load(e, 1, A64_SLOTS, a);
+	_vm_jit_u32(e, 0x1e612000); // fcmp d0, d1
+	_vm_jit_a64_cset(e, A64_X0, cc);
+	_vm_jit_a64_from_u32(e, b);
+}
+
+static inline void
+_vm_jit_a64_exit(vm_jit_emit_t *e, int ptr)
+{
+	_vm_jit_u32(e, 0x52800000 | (ptr << 5)); // mov w0, #ptr
+	_vm_jit_a64_b(e, VM_JIT_LABEL_END);
+}
+
+static inline void
+_vm_jit_a64_prologue(vm_jit_emit_t *e)
+{
+	static const uint32_t code [] = {
+		0xa9bc7bfd, // stp x29, x30, [sp, #-64]!
+		0x910003fd, // mov x29, sp
+		0xa90153f3, // stp x19, x20, [sp, #16]
+		0xa9025bf5, // stp x21, x22, [sp, #32]
+		0xf9001bf7, // str x23, [sp, #48]
+		0xaa0003f3, // mov x19, x0
+		0xaa0103f4, // mov x20, x1
+		0xaa0203f5, // mov x21, x2
+		0xaa0303f6, // mov x22, x3
+		0x52800000 | (VM_BUDGET << 5) | A64_X23 // mov w23, #VM_BUDGET
+	};
+
+	for(unsigned i = 0; i < sizeof(code) / sizeof(uint32_t); i++)
+		_vm_jit_u32(e, code[i]);
+}
+
+static inline void
+_vm_jit_a64_epilogue(vm_jit_emit_t *e)
+{
+	static const uint32_t code [] = {
+		0xa94153f3, // ldp x19, x20, [sp, #16]
+		0xa9425bf5, // ldp x21, x22, [sp, #32]
+		0xf9401bf7, // ldr x23, [sp, #48]
+		0xa8c47bfd, // ldp x29, x30, [sp], #64
+		0xd65f03c0 // ret
+	};
+
+	for(unsigned i = 0; i < sizeof(code) / sizeof(uint32_t); i++)
+		_vm_jit_u32(e, code[i]);
+}
+
+static inline bool
+_vm_jit_a64_inst(vm_jit_emit_t *e, const vm_prog_t *prog, unsigned i)
+{
+	const vm_inst_t *inst = &prog->inst[i];
+	const int ptr = e->ptr[i];
+	const int end = (ptr + inst->npops - inst->npushs) & SLOT_MASK;
+	const uint32_t a = _vm_jit_disp(ptr, 0); // topmost
+	const uint32_t b = _vm_jit_disp(ptr, 1);
+	const uint32_t c = _vm_jit_disp(ptr, 2);
+	const uint32_t d = _vm_jit_disp(ptr, -1); // to be pushed
+
+	switch(inst->op)
+	{
+		case INST_IMM:
+		{
+			_vm_jit_a64_mov_imm(e, A64_X0, _vm_jit_bits(inst->imm));
+			_vm_jit_a64_mov_store(e, A64_X0, A64_SLOTS, d);
+		} break;
+		case INST_HLOAD:
+		{
+			_vm_jit_a64_mov_load(e, A64_X0, A64_REGS, (REG_MAX + inst->target) * sizeof(num_t));
+			_vm_jit_a64_mov_store(e, A64_X0, A64_SLOTS, d);
+		} break;
+		case INST_JMP:
+		{
+			_vm_jit_a64_load(e, 0, A64_SLOTS, a);
+			_vm_jit_a64_test(e, 0);
+			if(inst->target > i)
+			{
+				_vm_jit_a64_b_cond(e, A64_CC_NE, inst->target);
+				break;
+			}
+
+			// loop draws on budget, cut off once exhausted
+			const uint32_t skip = _vm_jit_a64_b_cond_fwd(e, A64_CC_EQ);
+			_vm_jit_u32(e, 0x71000000 | ((i + 1 - inst->target) << 10)
+				| (A64_X23 << 5) | A64_X23); // subs w23, w23, #cost
+			const uint32_t left = _vm_jit_a64_b_cond_fwd(e, A64_CC_HS);
+			_vm_jit_a64_exit(e, end | VM_JIT_OVERRUN);
+			_vm_jit_a64_here(e, left);
+			_vm_jit_a64_b(e, inst->target);
+			_vm_jit_a64_here(e, skip);
+		} break;
+
+		case OP_CTRL:
+		{
+			_vm_jit_a64_load(e, 0, A64_SLOTS, a);
+			_vm_jit_a64_call(e, (vm_jit_call_t)floor);
+			_vm_jit_u32(e, 0x1e780000); // fcvtzs w0, d0
+			_vm_jit_u32(e, 0x12000800); // and w0, w0, #CTRL_MASK
+			_vm_jit_u32(e, 0xbc607800 | (A64_X0 << 16) | (A64_IN << 5)); // ldr s0, [x21, x0, lsl #2]
+			_vm_jit_u32(e, 0x1e22c000); // fcvt d0, s0
+			_vm_jit_a64_store(e, 0, A64_SLOTS, a);
+		} break;
+		case OP_PUSH:
+		{
+			_vm_jit_a64_mov_load(e, A64_X0, A64_SLOTS, a);
+			_vm_jit_a64_mov_store(e, A64_X0, A64_SLOTS, d);
+		} break;
+		case OP_POP:
+		{
+			// nothing
+		} break;
+		case OP_SWAP:
+		{
+			_vm_jit_a64_mov_load(e, A64_X0, A64_SLOTS, a);
+			_vm_jit_a64_mov_load(e, A64_X1, A64_SLOTS, b);
+			_vm_jit_a64_mov_store(e, A64_X1, A64_SLOTS, a);
+			_vm_jit_a64_mov_store(e, A64_X0, A64_SLOTS, b);
+		} break;
+		case OP_STORE:
+		{
+			_vm_jit_a64_index_floorf(e, a, 5);
+			_vm_jit_a64_mov_load(e, A64_X1, A64_SLOTS, b);
+			_vm_jit_u32(e, 0xf8207800 | (A64_X0 << 16) | (A64_REGS << 5) | A64_X1); // str x1, [x20, x0, lsl #3]
+		} break;
+		case OP_LOAD:
+		{
+			_vm_jit_a64_index_floorf(e, a, 5);
+			_vm_jit_u32(e, 0xf8607800 | (A64_X0 << 16) | (A64_REGS << 5) | A64_X1); // ldr x1, [x20, x0, lsl #3]
+			_vm_jit_a64_mov_store(e, A64_X1, A64_SLOTS, a);
+		} break;
+		case OP_BREAK:
+		{
+			_vm_jit_a64_load(e, 0, A64_SLOTS, a);
+			_vm_jit_a64_test(e, 0);
+			const uint32_t skip = _vm_jit_a64_b_cond_fwd(e, A64_CC_EQ);
+			_vm_jit_a64_exit(e, end);
+			_vm_jit_a64_here(e, skip);
+		} break;
+		case OP_GOTO:
+		{
+			return false; // dynamic target
+		} break;
+
+		case OP_RAND:
+		{
+			if(!e->rand_cb)
+				return false;
+
+			_vm_jit_a64_mov_imm(e, A64_X0, (uintptr_t)e->rand_data);
+			_vm_jit_a64_call(e, (vm_jit_call_t)e->rand_cb);
+			_vm_jit_a64_store(e, 0, A64_SLOTS, d);
+		} break;
+
+		case OP_ADD:
+		{
+			_vm_jit_a64_arith(e, 0x1e602800, a, b); // fadd
+		} break;
+		case OP_SUB:
+		{
+			_vm_jit_a64_arith(e, 0x1e603800, a, b); // fsub
+		} break;
+		case OP_MUL:
+		{
+			_vm_jit_a64_arith(e, 0x1e600800, a, b); // fmul
+		} break;
+		case OP_DIV:
+		case OP_MOD:
+		{
+			_vm_jit_a64_load(e, 1, A64_SLOTS, a);
+			_vm_jit_a64_test(e, 1);
+			const uint32_t nonzero = _vm_jit_a64_b_cond_fwd(e, A64_CC_NE);
+			_vm_jit_u32(e, 0x9e6703e0); // fmov d0, xzr
+			const uint32_t done = _vm_jit_a64_b_fwd(e);
+			_vm_jit_a64_here(e, nonzero);
+			_vm_jit_a64_load(e, 0, A64_SLOTS, b);
+			if(inst->op == OP_DIV)
+				_vm_jit_u32(e, 0x1e611800); // fdiv d0, d0, d1
+			else
+				_vm_jit_a64_call(e, (vm_jit_call_t)fmod);
+			_vm_jit_a64_here(e, done);
+			_vm_jit_a64_store(e, 0, A64_SLOTS, b);
+		} break;
+		case OP_POW:
+		{
+			_vm_jit_a64_binary(e, (vm_jit_call_t)pow, a, b);
+		} break;
+
+		case OP_NEG:
+		{
+			_vm_jit_a64_load(e, 0, A64_SLOTS, a);
+			_vm_jit_u32(e, 0x1e614000); // fneg d0, d0
+			_vm_jit_a64_store(e, 0, A64_SLOTS, a);
+		} break;
+		case OP_ABS:
+		{
+			_vm_jit_a64_load(e, 0, A64_SLOTS, a);
+			_vm_jit_u32(e, 0x1e60c000); // fabs d0, d0
+			_vm_jit_a64_store(e, 0, A64_SLOTS, a);
+		} break;
+		case OP_SQRT:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)sqrt, a);
+		} break;
+		case OP_CBRT:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)cbrt, a);
+		} break;
+
+		case OP_FLOOR:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)floor, a);
+		} break;
+		case OP_CEIL:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)ceil, a);
+		} break;
+		case OP_ROUND:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)round, a);
+		} break;
+		case OP_RINT:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)rint, a);
+		} break;
+		case OP_TRUNC:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)trunc, a);
+		} break;
+		case OP_MODF:
+		{
+			_vm_jit_a64_load(e, 0, A64_SLOTS, a);
+			_vm_jit_u32(e, 0x91000000 | (d << 10) | (A64_SLOTS << 5) | A64_X0); // add x0, x19, #d
+			_vm_jit_a64_call(e, (vm_jit_call_t)modf);
+			_vm_jit_a64_store(e, 0, A64_SLOTS, a);
+		} break;
+
+		case OP_EXP:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)exp, a);
+		} break;
+		case OP_EXP_2:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)exp2, a);
+		} break;
+		case OP_LD_EXP:
+		{
+			_vm_jit_a64_load(e, 0, A64_SLOTS, b);
+			_vm_jit_a64_load(e, 1, A64_SLOTS, a);
+			_vm_jit_u32(e, 0x1e780020); // fcvtzs w0, d1
+			_vm_jit_a64_call(e, (vm_jit_call_t)ldexp);
+			_vm_jit_a64_store(e, 0, A64_SLOTS, b);
+		} break;
+		case OP_FR_EXP:
+		{
+			_vm_jit_a64_load(e, 0, A64_SLOTS, a);
+			_vm_jit_u32(e, 0x910003e0 | (48 << 10)); // add x0, sp, #48
+			_vm_jit_a64_call(e, (vm_jit_call_t)frexp);
+			_vm_jit_a64_store(e, 0, A64_SLOTS, a);
+			_vm_jit_u32(e, 0xb94033e0); // ldr w0, [sp, #48]
+			_vm_jit_u32(e, 0x1e620000); // scvtf d0, w0
+			_vm_jit_a64_store(e, 0, A64_SLOTS, d);
+		} break;
+		case OP_LOG:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)log, a);
+		} break;
+		case OP_LOG_2:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)log2, a);
+		} break;
+		case OP_LOG_10:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)log10, a);
+		} break;
+
+		case OP_PI:
+		{
+			_vm_jit_a64_mov_imm(e, A64_X0, _vm_jit_bits(M_PI));
+			_vm_jit_a64_mov_store(e, A64_X0, A64_SLOTS, d);
+		} break;
+		case OP_SIN:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)sin, a);
+		} break;
+		case OP_COS:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)cos, a);
+		} break;
+		case OP_TAN:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)tan, a);
+		} break;
+		case OP_ASIN:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)asin, a);
+		} break;
+		case OP_ACOS:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)acos, a);
+		} break;
+		case OP_ATAN:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)atan, a);
+		} break;
+		case OP_ATAN2:
+		{
+			_vm_jit_a64_binary(e, (vm_jit_call_t)atan2, a, b);
+		} break;
+		case OP_SINH:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)sinh, a);
+		} break;
+		case OP_COSH:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)cosh, a);
+		} break;
+		case OP_TANH:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)tanh, a);
+		} break;
+		case OP_ASINH:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)asinh, a);
+		} break;
+		case OP_ACOSH:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)acosh, a);
+		} break;
+		case OP_ATANH:
+		{
+			_vm_jit_a64_unary(e, (vm_jit_call_t)atanh, a);
+		} break;
+
+		case OP_EQ:
+		{
+			_vm_jit_a64_cmp(e, A64_CC_EQ, a, b);
+		} break;
+		case OP_LT:
+		{
+			_vm_jit_a64_cmp(e, A64_CC_MI, a, b);
+		} break;
+		case OP_GT:
+		{
+			_vm_jit_a64_cmp(e, A64_CC_GT, a, b);
+		} break;
+		case OP_LE:
+		{
+			_vm_jit_a64_cmp(e, A64_CC_LS, a, b);
+		} break;
+		case OP_GE:
+		{
+			_vm_jit_a64_cmp(e, A64_CC_GE, a, b);
+		} break;
+		case OP_TER:
+		{
+			_vm_jit_a64_load(e, 0, A64_SLOTS, a);
+			_vm_jit_a64_test(e, 0);
+			const uint32_t keep = _vm_jit_a64_b_cond_fwd(e, A64_CC_NE);
+			_vm_jit_a64_mov_load(e, A64_X0, A64_SLOTS, b);
+			_vm_jit_a64_mov_store(e, A64_X0, A64_SLOTS, c);
+			_vm_jit_a64_here(e, keep);
+		} break;
+		case OP_MINI:
+		{
+			_vm_jit_a64_arith(e, 0x1e607800, a, b); // fminnm, same as vm_mini
+		} break;
+		case OP_MAXI:
+		{
+			_vm_jit_a64_arith(e, 0x1e606800, a, b); // fmaxnm, same as vm_maxi
+		} break;
+
+		case OP_AND:
+		case OP_OR:
+		{
+			_vm_jit_a64_load(e, 0, A64_SLOTS, b);
+			_vm_jit_a64_load(e, 1, A64_SLOTS, a);
+			_vm_jit_a64_test(e, 0);
+			_vm_jit_a64_cset(e, A64_X0, A64_CC_NE);
+			_vm_jit_a64_test(e, 1);
+			_vm_jit_a64_cset(e, A64_X1, A64_CC_NE);
+			if(inst->op == OP_AND)
+				_vm_jit_u32(e, 0x0a010000); // and w0, w0, w1
+			else
+				_vm_jit_u32(e, 0x2a010000); // orr w0, w0, w1
+			_vm_jit_a64_from_u32(e, b);
+		} break;
+
+		case OP_NOT:
+		{
+			_vm_jit_a64_load(e, 0, A64_SLOTS, a);
+			_vm_jit_u32(e, 0x1e780000); // fcvtzs w0, d0
+			_vm_jit_u32(e, 0x7100001f); // cmp w0, #0
+			_vm_jit_a64_cset(e, A64_X0, A64_CC_EQ);
+			_vm_jit_a64_from_u32(e, a);
+		} break;
+		case OP_BAND:
+		{
+			_vm_jit_a64_u32s(e, a, b);
+			_vm_jit_u32(e, 0x0a010000); // and w0, w0, w1
+			_vm_jit_a64_from_u32(e, b);
+		} break;
+		case OP_BOR:
+		{
+			_vm_jit_a64_u32s(e, a, b);
+			_vm_jit_u32(e, 0x2a010000); // orr w0, w0, w1
+			_vm_jit_a64_from_u32(e, b);
+		} break;
+		case OP_LSHIFT:
+		{
+			_vm_jit_a64_u32s(e, a, b);
+			_vm_jit_u32(e, 0x1ac12000); // lsl w0, w0, w1
+			_vm_jit_a64_from_u32(e, b);
+		} break;
+		case OP_RSHIFT:
+		{
+			_vm_jit_a64_u32s(e, a, b);
+			_vm_jit_u32(e, 0x1ac12400); // lsr w0, w0, w1
+			_vm_jit_a64_from_u32(e, b);
+		} break;
+		case OP_BNOT:
+		{
+			_vm_jit_a64_load(e, 0, A64_SLOTS, a);
+			_vm_jit_u32(e, 0x1e790000); // fcvtzu w0, d0
+			_vm_jit_u32(e, 0x2a2003e0); // mvn w0, w0
+			_vm_jit_a64_from_u32(e, a);
+		} break;
+
+		case OP_BAR_BEAT:
+		case OP_BAR:
+		case OP_BEAT:
+		case OP_BEAT_UNIT:
+		case OP_BPB:
+		case OP_BPM:
+		case OP_FRAME:
+		case OP_FPS:
+		case OP_SPEED:
+		{
+			_vm_jit_a64_mov_load(e, A64_X0, A64_CLK, (inst->op - OP_BAR_BEAT)*sizeof(num_t));
+			_vm_jit_a64_mov_store(e, A64_X0, A64_SLOTS, d);
+		} break;
+
+		case OP_NOP:
+		{
+			// no operation
+		} break;
+		default:
+		{
+			return false;
+		} break;
+	}
+
+	return true;
+}
+
+// translate program into buf, returns code size or 0 if not supported
+static inline uint32_t
+vm_jit_emit(vm_jit_arch_t arch, uint8_t *buf, uint32_t size,
+	const vm_prog_t *prog, vm_jit_rand_t rand_cb, void *rand_data)
+{
+	VM_SCRATCH_SCOPE(prog);
+	vm_jit_emit_t *e = vm_arena_alloc(prog->scratch, sizeof(vm_jit_emit_t));
+
+	if(!e)
+		return 0;
+
+	memset(e, 0x0, sizeof(vm_jit_emit_t));
+	e->buf = buf;
+	e->size = size;
+	e->rand_cb = rand_cb;
+	e->rand_data = rand_data;
+
+	if( (prog->ninst > VM_JIT_ITEMS) || !vm_prog_depth(prog, e->ptr) )
+		return 0;
+
+	if(arch == VM_JIT_ARCH_X86_64)
+		_vm_jit_x86_prologue(e);
+	else
+		_vm_jit_a64_prologue(e);
+
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		e->label[i] = e->off;
+
+		if(e->ptr[i] == -1)
+			continue; // unreachable
+
+		const bool supported = (arch == VM_JIT_ARCH_X86_64)
+			? _vm_jit_x86_inst(e, prog, i)
+			: _vm_jit_a64_inst(e, prog, i);
+
+		if(!supported)
+			return 0;
+	}
+
+	// falling off or jumping past the end
+	e->label[prog->ninst] = e->off;
+	if(arch == VM_JIT_ARCH_X86_64)
+	{
+		_vm_jit_u8(e, 0xb8); // mov eax, imm32
+		_vm_jit_u32(e, e->ptr[prog->ninst] & SLOT_MASK);
+	}
+	else
+	{
+		_vm_jit_u32(e, 0x52800000 | ((e->ptr[prog->ninst] & SLOT_MASK) << 5)); // mov w0, #ptr
+	}
+
+	e->label[VM_JIT_LABEL_END] = e->off;
+	if(arch == VM_JIT_ARCH_X86_64)
+		_vm_jit_x86_epilogue(e);
+	else
+		_vm_jit_a64_epilogue(e);
+
+	for(unsigned i = 0; i < e->nfixups; i++)
+	{
+		const vm_jit_fixup_t *fixup = &e->fixups[i];
+
+		_vm_jit_patch(e, fixup->at, e->label[fixup->label], fixup->type);
+	}
+
+	if(e->overflow)
+		return 0;
+
+	return e->off;
+}
+
+// pages are never writable and executable at the same time
+static inline bool
+_vm_jit_writable(uint8_t *code, bool writable)
+{
+#if defined(VM_JIT_WRITE_PROTECT_NP)
+	(void)code;
+
+	pthread_jit_write_protect_np(!writable);
+
+	return true;
+#else
+	return mprotect(code, VM_JIT_SIZE, writable
+		? PROT_READ | PROT_WRITE
+		: PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+
+static inline bool
+vm_jit_init(vm_jit_t *jit)
+{
+	memset(jit, 0x0, sizeof(vm_jit_t));
+
+#if defined(VM_JIT_NATIVE)
+# if defined(VM_JIT_WRITE_PROTECT_NP)
+	const int prot = PROT_READ | PROT_WRITE | PROT_EXEC; // MAP_JIT requires it
+# else
+	const int prot = PROT_READ | PROT_WRITE; // made executable once emitted
+# endif
+	uint8_t *code = mmap(NULL, VM_JIT_SIZE*2, prot,
+		MAP_PRIVATE | MAP_ANONYMOUS | VM_JIT_MAP_JIT, -1, 0);
+	if(code == MAP_FAILED)
+		return false;
+
+	jit->code[0] = code;
+	jit->code[1] = code + VM_JIT_SIZE;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+static inline void
+vm_jit_deinit(vm_jit_t *jit)
+{
+	if(jit->code[0])
+		munmap(jit->code[0], VM_JIT_SIZE*2);
+
+	memset(jit, 0x0, sizeof(vm_jit_t));
+}
+
+// generate into the idle buffer and seal it before publishing fn,
+// fn is NULL if the interpreter has to be used
+static inline bool
+vm_jit_compile(vm_jit_t *jit, const vm_prog_t *prog, vm_jit_rand_t rand_cb,
+	void *rand_data)
+{
+#if defined(VM_JIT_NATIVE)
+	const unsigned nxt = !jit->cur;
+	uint8_t *code = jit->code[nxt];
+
+# if defined(__x86_64__)
+	const vm_jit_arch_t arch = VM_JIT_ARCH_X86_64;
+# else
+	const vm_jit_arch_t arch = VM_JIT_ARCH_AARCH64;
+# endif
+
+	jit->fn = NULL;
+
+	if(!code || !_vm_jit_writable(code, true))
+		return false;
+
+	const uint32_t size = vm_jit_emit(arch, code, VM_JIT_SIZE, prog,
+		rand_cb, rand_data);
+
+	if(!_vm_jit_writable(code, false) || !size)
+		return false;
+
+	__builtin___clear_cache((char *)code, (char *)code + size);
+
+	jit->time = 0;
+	for(unsigned i = 0; i < prog->ninst; i++)
+	{
+		const unsigned op = prog->inst[i].op;
+
+		if( (op >= OP_BAR_BEAT) && (op <= OP_SPEED) )
+			jit->time |= 1U << (op - OP_BAR_BEAT);
+	}
+
+	jit->fn = (vm_jit_fn_t)(uintptr_t)code;
+	jit->cur = nxt;
+
+	return true;
+#else
+	(void)prog;
+	(void)rand_cb;
+	(void)rand_data;
+
+	jit->fn = NULL;
+
+	return false;
+#endif
+}
+
+#endif // _VM_JIT_H
@@ -37,6 +37,7 @@
 typedef struct _lv2_atom_midi_t lv2_atom_midi_t;
 typedef struct _atom_ser_t atom_ser_t;
 typedef struct _plot_t plot_t;
+typedef struct _env_t env_t;
 typedef struct _plughandle_t plughandle_t;
 
 struct _lv2_atom_midi_t {
@@ -55,11 +56,21 @@ struct _atom_ser_t {
 };
 
 struct _plot_t {
-	float vals [PLOT_MAX];
+	float vals [PLOT_MAX]; // ring of maxima, oldest sample at head
+	float lows [PLOT_MAX]; // ring of minima
+	unsigned head;
+	unsigned run; // number of newest samples equal to newest
 	int window;
 	double pre;
 };
 
+// port envelope since last notification
+struct _env_t {
+	float min;
+	float max;
+	float rms;
+};
+
 struct _plughandle_t {
 	LV2_URID_Map *map;
 	LV2_URID_Unmap *unmap;
@@ -71,6 +82,10 @@ struct _plughandle_t {
 
 	LV2_URID atom_eventTransfer;
 	LV2_URID vm_graph;
+	LV2_URID vm_budget;
+	LV2_URID vm_updateRate;
+	LV2_URID vm_params [PARAM_MAX];
+	LV2_URID vm_decimation;
 	LV2_URID vm_sourceFilter;
 	LV2_URID vm_destinationFilter;
 	LV2_URID midi_MidiEvent;
@@ -91,10 +106,12 @@ struct _plughandle_t {
 	PROPS_T(props, MAX_NPROPS);
 	plugstate_t state;
 	plugstate_t stash;
+	uint8_t graph [2][GRAPH_SIZE]; // value and stash of vm:graph beyond GRAPH_PRE
 
 	uint32_t graph_size;
 	uint32_t sourceFilter_size;
 	uint32_t destinationFilter_size;
+	uint32_t decimation_size;
 
 	float dy;
 
@@ -103,6 +120,8 @@ struct _plughandle_t {
 	vm_filter_t sourceFilter [CTRL_MAX];
 	vm_filter_t destinationFilter [CTRL_MAX];
 	vm_filter_impl_t filt;
+	vm_decim_t decimation [CTRL_MAX];
+	vm_decim_impl_t decim;
 
 	float in0 [CTRL_MAX];
 	float out0 [CTRL_MAX];
@@ -113,13 +132,35 @@ struct _plughandle_t {
 	float in2 [CTRL_MAX];
 	float out2 [CTRL_MAX];
 
+	float in3 [CTRL_MAX]; // rms
+	float out3 [CTRL_MAX];
+
+	env_t inenv [CTRL_MAX];
+	env_t outenv [CTRL_MAX];
+
 	int64_t off;
 	plot_t inp [CTRL_MAX];
 	plot_t outp [CTRL_MAX];
 
 	float sample_rate;
+	uint32_t block_size;
+	float wcet; // worst-case cost of one evaluation in nanoseconds
+	uint8_t params; // parameter registers the graph stores into
 
 	vm_command_t cmds [ITEMS_MAX];
+	vm_command_t sent [ITEMS_MAX]; // graph as known to plugin, at graph_rev
+	vm_command_t pend [ITEMS_MAX]; // graph expected back from patch in flight
+	int32_t graph_rev; // revision of graph in plugin, 0 while unknown
+	int32_t patch_rev; // patch:sequenceNumber of message in port_event
+	bool inflight; // patch sent, waiting for its echo or whole graph
+	bool patch_spliced; // echoed patch applied to graph
+	bool patch_failed; // echoed patch does not follow on sent
+	vm_inst_t insts [ITEMS_MAX];
+	vm_arena_t scratch; // temporaries of analysis passes
+	uint32_t nrows; // commands listed, empty row to append to included
+	uint8_t rates [ITEMS_MAX]; // inferred rate of each command
+	int depth [ITEMS_MAX]; // stack depth after each command
+	uint8_t errs [ITEMS_MAX]; // verifier verdict of each command
 };
 
 static const char *command_labels [COMMAND_MAX] = {
@@ -130,6 +171,32 @@ static const char *command_labels [COMMAND_MAX] = {
 	[COMMAND_FLOAT]    = "Float",
 };
 
+static const char *rate_labels [VM_RATE_MAX] = {
+	[VM_RATE_CONST]    = "constant",
+	[VM_RATE_BLOCK]    = "block rate",
+	[VM_RATE_SAMPLE]   = "sample rate"
+};
+
+static const struct nk_color rate_colors [VM_RATE_MAX] = {
+	[VM_RATE_CONST]    = {0x7f, 0x7f, 0x7f, 0xff},
+	[VM_RATE_BLOCK]    = {0x00, 0xff, 0xff, 0xff},
+	[VM_RATE_SAMPLE]   = {0xff, 0xff, 0x00, 0xff}
+};
+
+static const char *verify_labels [VM_VERIFY_MAX] = {
+	[VM_VERIFY_OK]        = "stack depth",
+	[VM_VERIFY_DYNAMIC]   = "stack depth depends on path taken",
+	[VM_VERIFY_UNDERFLOW] = "stack underflow",
+	[VM_VERIFY_OVERFLOW]  = "stack overflow"
+};
+
+static const struct nk_color verify_colors [VM_VERIFY_MAX] = {
+	[VM_VERIFY_OK]        = {0x7f, 0x7f, 0x7f, 0xff},
+	[VM_VERIFY_DYNAMIC]   = {0xff, 0xff, 0x00, 0xff},
+	[VM_VERIFY_UNDERFLOW] = {0xff, 0x00, 0x00, 0xff},
+	[VM_VERIFY_OVERFLOW]  = {0xff, 0x00, 0x00, 0xff}
+};
+
 static const char *filter_labels [FILTER_MAX] = {
 	[FILTER_CONTROLLER]       = "Controller",
 	[FILTER_BENDER]           = "Bender",
@@ -139,6 +206,17 @@ static const char *filter_labels [FILTER_MAX] = {
 	[FILTER_NOTE_PRESSURE]    = "Note Pressure",
 };
 
+static const char *param_labels [PARAM_MAX] = {
+	"Reg 0:",
+	"Reg 1:",
+	"Reg 2:",
+	"Reg 3:",
+	"Reg 4:",
+	"Reg 5:",
+	"Reg 6:",
+	"Reg 7:",
+};
+
 static const char *input_labels [CTRL_MAX] = {
 	"In 0:",
 	"In 1:",
@@ -162,10 +240,38 @@ static const struct nk_color plot_fg2_color = {
 	.r = 0xbb, .g = 0x66, .b = 0x00, .a = 0x7f
 };
 
+static const struct nk_color warn_color = {
+	.r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff
+};
+
 static const char *ms_label = "#ms:";
 static const char *nil_label = "#";
 static const char *chn_label = "#chn:";
 static const char *val_label = "#val:";
+static const char *share_label = "#share %:";
+static const char *rate_label = "#Hz:";
+static const char *gap_label = "#gap ms:";
+static const char *band_label = "#band:";
+
+static void
+_update_rates(plughandle_t *handle)
+{
+	vm_prog_t prog;
+
+	vm_prog_init(&prog, handle->insts, ITEMS_MAX, &handle->scratch);
+	memset(handle->rates, VM_RATE_SAMPLE, sizeof(handle->rates));
+	vm_graph_compile(&prog, handle->cmds, VM_STATUS_STATIC);
+	vm_prog_rates(&prog, false, handle->rates);
+	vm_prog_verify(&prog, handle->depth, handle->errs);
+	handle->wcet = vm_prog_wcet(&prog);
+	handle->params = prog.params;
+
+	handle->nrows = (prog.ninst < ITEMS_PRE)
+		? ITEMS_PRE
+		: (prog.ninst < ITEMS_MAX)
+			? prog.ninst + 1
+			: ITEMS_MAX;
+}
 
 static void
 _intercept_graph(void *data, int64_t frames __attribute__((unused)),
@@ -174,9 +280,59 @@ _intercept_graph(void *data, int64_t frames __attribute__((unused)),
 	plughandle_t *handle = data;
 
 	handle->graph_size = impl->value.size;
+	handle->graph_rev = handle->patch_rev; // edits in flight or not yet sent get dropped
+	handle->inflight = false;
 
-	vm_graph_deserialize(handle->api, &handle->forge, handle->cmds,
+	vm_graph_deserialize(handle->api, &handle->forge, handle->cmds, ITEMS_MAX,
 		impl->value.size, impl->value.body);
+	memcpy(handle->sent, handle->cmds, sizeof(handle->sent));
+	_update_rates(handle);
+}
+
+// echoed graph edits, applied to graph of plugin in props
+static void
+_graph_patch(void *data, props_dyn_ev_t ev, LV2_URID subj __attribute__((unused)),
+	LV2_URID property, const LV2_Atom *value)
+{
+	plughandle_t *handle = data;
+	props_impl_t *impl = _props_impl_get(&handle->props, handle->vm_graph);
+
+	if( !impl || (property != handle->vm_graph) || (ev == PROPS_DYN_EV_SET) )
+		return;
+
+	if(!handle->graph_rev || handle->patch_failed) // resync requested or rest of failed patch
+		return;
+
+	const int32_t next = (handle->graph_rev < INT32_MAX) ? handle->graph_rev + 1 : 1;
+	uint32_t size = impl->value.size;
+
+	if(  (handle->patch_rev != next)
+		|| !vm_graph_patch(&handle->forge, ev, value, impl->value.body, &size,
+			GRAPH_SIZE, NULL) )
+	{
+		handle->patch_failed = true;
+		return;
+	}
+
+	impl->value.size = size;
+	handle->patch_spliced = true;
+}
+
+static const props_dyn_t dyn = {
+	.prop = _graph_patch
+};
+
+static void
+_intercept_decimation(void *data, int64_t frames __attribute__((unused)),
+	props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	handle->decimation_size = impl->value.size;
+
+	const int status = vm_decim_deserialize(&handle->forge, &handle->decim,
+		handle->decimation, impl->value.size, impl->value.body);
+	(void)status; //FIXME
 }
 
 static void
@@ -213,6 +369,74 @@ static const props_def_t defs [MAX_NPROPS] = {
 		.max_size = GRAPH_SIZE,
 		.event_cb = _intercept_graph
 	},
+	{
+		.property = VM__seed,
+		.offset = offsetof(plugstate_t, seed),
+		.type = LV2_ATOM__Long
+	},
+	{
+		.property = VM__budget,
+		.offset = offsetof(plugstate_t, budget),
+		.type = LV2_ATOM__Float
+	},
+	{
+		.property = VM__overruns,
+		.offset = offsetof(plugstate_t, overruns),
+		.type = LV2_ATOM__Int,
+		.access = LV2_PATCH__readable
+	},
+	{
+		.property = VM__updateRate,
+		.offset = offsetof(plugstate_t, update_rate),
+		.type = LV2_ATOM__Float
+	},
+	{
+		.property = VM__param0,
+		.offset = offsetof(plugstate_t, params[0]),
+		.type = LV2_ATOM__Float
+	},
+	{
+		.property = VM__param1,
+		.offset = offsetof(plugstate_t, params[1]),
+		.type = LV2_ATOM__Float
+	},
+	{
+		.property = VM__param2,
+		.offset = offsetof(plugstate_t, params[2]),
+		.type = LV2_ATOM__Float
+	},
+	{
+		.property = VM__param3,
+		.offset = offsetof(plugstate_t, params[3]),
+		.type = LV2_ATOM__Float
+	},
+	{
+		.property = VM__param4,
+		.offset = offsetof(plugstate_t, params[4]),
+		.type = LV2_ATOM__Float
+	},
+	{
+		.property = VM__param5,
+		.offset = offsetof(plugstate_t, params[5]),
+		.type = LV2_ATOM__Float
+	},
+	{
+		.property = VM__param6,
+		.offset = offsetof(plugstate_t, params[6]),
+		.type = LV2_ATOM__Float
+	},
+	{
+		.property = VM__param7,
+		.offset = offsetof(plugstate_t, params[7]),
+		.type = LV2_ATOM__Float
+	},
+	{
+		.property = VM__decimation,
+		.offset = offsetof(plugstate_t, decimation),
+		.type = LV2_ATOM__Tuple,
+		.max_size = DECIM_SIZE,
+		.event_cb = _intercept_decimation,
+	},
 	{
 		.property = VM__sourceFilter,
 		.offset = offsetof(plugstate_t, sourceFilter),
@@ -281,6 +505,24 @@ _restore_state(plughandle_t *handle)
 		handle->atom_eventTransfer, atom);
 }
 
+static void
+_get_property(plughandle_t *handle, LV2_URID property)
+{
+	atom_ser_t *ser = &handle->ser;
+	ser->offset = 0;
+	lv2_atom_forge_set_sink(&handle->forge, _sink, _deref, ser);
+
+	LV2_Atom_Forge_Frame frame;
+	lv2_atom_forge_object(&handle->forge, &frame, 0, handle->props.urid.patch_get);
+	lv2_atom_forge_key(&handle->forge, handle->props.urid.patch_property);
+	lv2_atom_forge_urid(&handle->forge, property);
+	lv2_atom_forge_pop(&handle->forge, &frame);
+
+	const LV2_Atom *atom = ser->atom;
+	handle->writer(handle->controller, 0, lv2_atom_total_size(atom),
+		handle->atom_eventTransfer, atom);
+}
+
 static void
 _set_property(plughandle_t *handle, LV2_URID property)
 {
@@ -297,8 +539,197 @@ _set_property(plughandle_t *handle, LV2_URID property)
 		handle->atom_eventTransfer, atom);
 }
 
+// send changed range of graph only, as removal and insertion at its index,
+// one patch at a time, with revision of graph it refers to
+static void
+_patch_graph(plughandle_t *handle)
+{
+	uint32_t idx;
+	uint32_t nrem;
+	uint32_t nadd;
+
+	if(handle->inflight || !handle->graph_rev) // edits pile up in cmds meanwhile
+		return;
+
+	if(!vm_graph_diff(handle->sent, handle->cmds, &idx, &nrem, &nadd))
+		return;
+
+	// patch indices refer to items of serialized graph, not to command rows
+	const uint32_t item = vm_graph_item(handle->api, handle->sent, idx);
+	const uint32_t nrem_items = vm_graph_item(handle->api, handle->sent, idx + nrem) - item;
+	const uint32_t nadd_items = vm_graph_item(handle->api, handle->cmds, idx + nadd) - item;
+
+	if(!nrem_items && !nadd_items) // only unserializable commands changed
+		return;
+
+	atom_ser_t *ser = &handle->ser;
+	ser->offset = 0;
+	lv2_atom_forge_set_sink(&handle->forge, _sink, _deref, ser);
+
+	LV2_Atom_Forge_Frame obj_frame;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Frame tup_frame;
+
+	LV2_Atom_Forge_Ref ref = lv2_atom_forge_object(&handle->forge, &obj_frame,
+		0, handle->props.urid.patch_patch);
+
+	if(ref)
+		ref = lv2_atom_forge_key(&handle->forge, handle->props.urid.patch_sequence);
+	if(ref)
+		ref = lv2_atom_forge_int(&handle->forge, handle->graph_rev);
+	if(ref)
+		ref = lv2_atom_forge_key(&handle->forge, handle->props.urid.patch_remove);
+	if(ref)
+		ref = lv2_atom_forge_object(&handle->forge, &frame, 0, 0);
+	if(ref && nrem_items)
+	{
+		ref = lv2_atom_forge_key(&handle->forge, handle->vm_graph);
+		if(ref)
+			ref = lv2_atom_forge_tuple(&handle->forge, &tup_frame);
+		if(ref)
+			ref = lv2_atom_forge_int(&handle->forge, item);
+		if(ref)
+			ref = lv2_atom_forge_int(&handle->forge, nrem_items);
+		if(ref)
+			lv2_atom_forge_pop(&handle->forge, &tup_frame);
+	}
+	if(ref)
+		lv2_atom_forge_pop(&handle->forge, &frame);
+
+	if(ref)
+		ref = lv2_atom_forge_key(&handle->forge, handle->props.urid.patch_add);
+	if(ref)
+		ref = lv2_atom_forge_object(&handle->forge, &frame, 0, 0);
+	if(ref && nadd_items)
+	{
+		ref = lv2_atom_forge_key(&handle->forge, handle->vm_graph);
+		if(ref)
+			ref = lv2_atom_forge_tuple(&handle->forge, &tup_frame);
+		if(ref)
+			ref = lv2_atom_forge_int(&handle->forge, item);
+		for(uint32_t i = idx; ref && (i < idx + nadd); i++)
+			ref = vm_command_serialize(handle->api, &handle->forge, &handle->cmds[i]);
+		if(ref)
+			lv2_atom_forge_pop(&handle->forge, &tup_frame);
+	}
+	if(ref)
+		lv2_atom_forge_pop(&handle->forge, &frame);
+
+	if(ref)
+		lv2_atom_forge_pop(&handle->forge, &obj_frame);
+
+	if(ref)
+	{
+		const LV2_Atom *atom = ser->atom;
+		handle->writer(handle->controller, 0, lv2_atom_total_size(atom),
+			handle->atom_eventTransfer, atom);
+
+		// as deserialized from graph of plugin, once patch is echoed
+		uint32_t n = 0;
+		memset(handle->pend, 0x0, sizeof(handle->pend));
+		for(uint32_t i = 0; (i < ITEMS_MAX) && (handle->cmds[i].type != COMMAND_NOP); i++)
+		{
+			if(_vm_command_is_item(handle->api, &handle->cmds[i]))
+				handle->pend[n++] = handle->cmds[i];
+		}
+
+		handle->inflight = true;
+	}
+}
+
+// whole graphs and echoed patches carry revision of graph in plugin as
+// patch:sequenceNumber, a patch not following on sent one triggers a resync
+static int
+_control_advance(plughandle_t *handle, const LV2_Atom_Object *obj)
+{
+	const LV2_Atom_Int *sequence = NULL;
+	LV2_Atom_Forge_Ref ref = 0;
+
+	if(lv2_atom_forge_is_object_type(&handle->forge, obj->atom.type))
+		lv2_atom_object_get(obj, handle->props.urid.patch_sequence, &sequence, 0);
+
+	handle->patch_rev = (sequence && (sequence->atom.type == handle->forge.Int))
+		? sequence->body
+		: 0;
+	handle->patch_spliced = false;
+	handle->patch_failed = false;
+
+	const int handled = props_advance(&handle->props, &handle->forge, 0, obj, &ref);
+
+	if(handle->patch_failed)
+	{
+		handle->graph_rev = 0;
+		_get_property(handle, handle->vm_graph);
+	}
+	else if(handle->patch_spliced)
+	{
+		props_impl_t *impl = _props_impl_get(&handle->props, handle->vm_graph);
+		uint32_t idx;
+		uint32_t nrem;
+		uint32_t nadd;
+
+		handle->graph_rev = handle->patch_rev;
+		handle->graph_size = impl->value.size;
+		vm_graph_deserialize(handle->api, &handle->forge, handle->sent, ITEMS_MAX,
+			impl->value.size, impl->value.body);
+
+		if(!handle->inflight) // patch of another sender
+		{
+			memcpy(handle->cmds, handle->sent, sizeof(handle->cmds));
+			_update_rates(handle);
+		}
+		else if(!vm_graph_diff(handle->pend, handle->sent, &idx, &nrem, &nadd))
+		{
+			handle->inflight = false;
+			_patch_graph(handle); // edits piled up meanwhile
+		}
+		// else another sender came first, own patch gets rejected as stale
+	}
+
+	return handled;
+}
+
 static inline void
-_draw_plot(struct nk_context *ctx, const float *vals, vm_plug_enum_t vm_plug)
+_plot_clear(plot_t *plot)
+{
+	memset(plot->vals, 0x0, sizeof(float)*PLOT_MAX);
+	memset(plot->lows, 0x0, sizeof(float)*PLOT_MAX);
+	plot->head = 0;
+	plot->run = PLOT_MAX;
+}
+
+// append samples of current value for elapsed time, returns whether plot changed
+static inline bool
+_plot_advance(plot_t *plot, float dts, float low, float val)
+{
+	plot->pre += PLOT_MAX * dts / plot->window;
+	double intp;
+	plot->pre = modf(plot->pre, &intp);
+
+	if(intp <= 0)
+		return false;
+
+	const unsigned n = (intp < PLOT_MAX) ? intp : PLOT_MAX;
+	const unsigned last = (plot->head - 1) & PLOT_MASK;
+	const bool same = (plot->vals[last] == val) && (plot->lows[last] == low);
+	const bool flat = (plot->run >= PLOT_MAX) && same;
+
+	for(unsigned j = 0; j < n; j++)
+	{
+		plot->vals[plot->head] = val;
+		plot->lows[plot->head] = low;
+		plot->head = (plot->head + 1) & PLOT_MASK;
+	}
+
+	plot->run = same ? plot->run + n : n;
+	if(plot->run > PLOT_MAX)
+		plot->run = PLOT_MAX;
+
+	return !flat;
+}
+
+static inline void
+_draw_plot(struct nk_context *ctx, const plot_t *plot, vm_plug_enum_t vm_plug)
 {
 	struct nk_command_buffer *canvas = nk_window_get_canvas(ctx);
 
@@ -317,8 +748,10 @@ _draw_plot(struct nk_context *ctx, const float *vals, vm_plug_enum_t vm_plug)
 		nk_stroke_rect(canvas, bounds, 0.f, 1.f, ctx->style.window.border_color);
 
 		float mem [PLOT_MAX*4];
+		float *low = &mem[PLOT_MAX*2];
 		float x0 = -1.f;
 		unsigned J = 0;
+		bool has_low = false;
 
 		const float yh = bounds.y + 0.5f*bounds.h;
 
@@ -329,7 +762,8 @@ _draw_plot(struct nk_context *ctx, const float *vals, vm_plug_enum_t vm_plug)
 			if(x1 - x0 < 1.f)
 				continue;
 
-			const float sy = vals[i] / VM_VIS;
+			const unsigned idx = (plot->head + i) & PLOT_MASK;
+			const float sy = plot->vals[idx] / VM_VIS;
 
 			if(vm_plug == VM_PLUG_AUDIO)
 			{
@@ -340,7 +774,13 @@ _draw_plot(struct nk_context *ctx, const float *vals, vm_plug_enum_t vm_plug)
 			else
 			{
 				const float dy = sy*bounds.h;
+				const float dl = plot->lows[idx] / VM_VIS * bounds.h;
+
+				if(plot->lows[idx] != plot->vals[idx])
+					has_low = true;
 
+				low[J] = x1;
+				low[J + 1] = yh - dl;
 				mem[J++] = x1;
 				mem[J++] = yh - dy;
 				x0 = x1;
@@ -368,6 +808,10 @@ _draw_plot(struct nk_context *ctx, const float *vals, vm_plug_enum_t vm_plug)
 
 			nk_stroke_polyline(canvas, &mem[J], J/2, 1.f, plot_fg2_color);
 		}
+		else if(has_low) // envelope of cv
+		{
+			nk_stroke_polyline(canvas, low, J/2, 1.f, plot_fg2_color);
+		}
 
 		nk_stroke_polyline(canvas, mem, J/2, 1.f, plot_fg_color);
 
@@ -392,7 +836,7 @@ dBFS6(float peak)
 }
 
 static inline void
-_draw_mixer(struct nk_context *ctx, float peak)
+_draw_mixer(struct nk_context *ctx, float peak, float rms)
 {
 	struct nk_rect bounds;
 	const enum nk_widget_layout_states states = nk_widget(&bounds, ctx);
@@ -449,6 +893,14 @@ _draw_mixer(struct nk_context *ctx, float peak)
 			}
 		}
 
+		if(rms > 0.f)
+		{
+			const float x = outline.x + outline.w * rms;
+
+			nk_stroke_line(canvas, x, orig.y + 2.f, x, orig.y + orig.h - 2.f, 2.f,
+				nk_rgba(0xff, 0xff, 0xff, alph));
+		}
+
 		// draw 6dBFS lines from -60 to +6
 		for(unsigned i = 0; i <= dBFS6_rng; i += dBFS6_max)
 		{
@@ -547,7 +999,7 @@ _expose(struct nk_context *ctx, struct nk_rect wbounds, void *data)
 			for(unsigned i = 0; i < CTRL_MAX; i++)
 			{
 				nk_layout_row_dynamic(ctx, dy*4, 1);
-				_draw_plot(ctx, handle->inp[i].vals, handle->vm_plug);
+				_draw_plot(ctx, &handle->inp[i], handle->vm_plug);
 
 				nk_layout_row_dynamic(ctx, dy, 2);
 				if(  (handle->vm_plug == VM_PLUG_CONTROL)
@@ -710,7 +1162,7 @@ _expose(struct nk_context *ctx, struct nk_rect wbounds, void *data)
 				}
 				else if(handle->vm_plug == VM_PLUG_AUDIO)
 				{
-					_draw_mixer(ctx, handle->in1[i]);
+					_draw_mixer(ctx, handle->in1[i], handle->in3[i]);
 
 					if(handle->in2[i] > handle->in1[i])
 						handle->in1[i] = handle->in2[i];
@@ -722,7 +1174,7 @@ _expose(struct nk_context *ctx, struct nk_rect wbounds, void *data)
 				_wheel_int(ctx, &handle->inp[i].window);
 				nk_property_int(ctx, ms_label, 10, &handle->inp[i].window, 100000, 1, 1.f);
 				if(old_window != handle->inp[i].window)
-					memset(handle->inp[i].vals, 0x0, sizeof(float)*PLOT_MAX);
+					_plot_clear(&handle->inp[i]);
 
 				if(handle->vm_plug == VM_PLUG_MIDI)
 				{
@@ -785,28 +1237,94 @@ _expose(struct nk_context *ctx, struct nk_rect wbounds, void *data)
 
 		if(nk_group_begin(ctx, "Program", NK_WINDOW_TITLE | NK_WINDOW_BORDER))
 		{
-			const float ratio2 [6] = {
-				0.1, 0.05, 0.05, 0.05, 0.3, 0.45
+			// estimated worst case against configured share of period
+			const float period = 1e9f * handle->block_size / handle->sample_rate;
+			const float evals = ( (handle->vm_plug == VM_PLUG_CV) || (handle->vm_plug == VM_PLUG_AUDIO) )
+				? handle->block_size
+				: 1.f;
+			const float load = handle->wcet * evals / period;
+
+			nk_layout_row_dynamic(ctx, dy, 4);
+			if(nk_widget_is_hovered(ctx))
+				nk_tooltip(ctx, "worst-case execution time per evaluation");
+			if(load > handle->state.budget)
+				nk_labelf_colored(ctx, NK_TEXT_LEFT, warn_color, "WCET: %.2f us (%.0f%%)", handle->wcet * 1e-3f, load * 100.f);
+			else
+				nk_labelf(ctx, NK_TEXT_LEFT, "WCET: %.2f us (%.0f%%)", handle->wcet * 1e-3f, load * 100.f);
+
+			const float old_share = handle->state.budget * 100.f;
+			const float share = nk_propertyf(ctx, share_label, 1.f, old_share, 100.f, 1.f, 1.f);
+			if(share != old_share)
+			{
+				handle->state.budget = share / 100.f;
+				_set_property(handle, handle->vm_budget);
+			}
+
+			if(nk_widget_is_hovered(ctx))
+				nk_tooltip(ctx, "maximal rate of notifications to the UI");
+			const float old_rate = handle->state.update_rate;
+			const float rate = nk_propertyf(ctx, rate_label, 1.f, old_rate, 1000.f, 1.f, 1.f);
+			if(rate != old_rate)
+			{
+				handle->state.update_rate = rate;
+				_set_property(handle, handle->vm_updateRate);
+			}
+
+			nk_labelf(ctx, NK_TEXT_RIGHT, "Overruns: %"PRIi32, handle->state.overruns);
+
+			// registers set without recompiling the graph
+			nk_layout_row_dynamic(ctx, dy, PARAM_MAX/2);
+			for(unsigned p = 0; p < PARAM_MAX; p++)
+			{
+				float *param = &handle->state.params[p];
+				const float old_param = *param;
+				const float stp = scl * VM_STP;
+				const float fpp = scl * VM_RNG / nk_widget_width(ctx);
+
+				const bool stored = handle->params & (1U << p);
+
+				if(nk_widget_is_hovered(ctx))
+					nk_tooltip(ctx, stored
+						? "overridden by 'store' of graph until set again"
+						: "read by graph via 'load' of register index");
+				if(stored)
+					nk_style_push_color(ctx, &ctx->style.property.label_normal, warn_color);
+				_wheel_float(ctx, param, stp);
+				nk_property_float(ctx, param_labels[p], VM_MIN, param, VM_MAX, stp, fpp);
+				if(stored)
+					nk_style_pop_color(ctx);
+				if(*param != old_param)
+					_set_property(handle, handle->vm_params[p]);
+			}
+
+			const float ratio2 [7] = {
+				0.1, 0.05, 0.05, 0.05, 0.05, 0.3, 0.4
 			};
-			nk_layout_row(ctx, NK_DYNAMIC, dy, 6, ratio2);
+			nk_layout_row(ctx, NK_DYNAMIC, dy, 7, ratio2);
 
 			bool sync = false;
 
 			const float stp = scl * VM_STP;
 			const float fpp = scl * VM_RNG / nk_widget_width(ctx);
 
-			for(unsigned i = 0; i < ITEMS_MAX; i++)
+			for(unsigned i = 0; i < handle->nrows; i++)
 			{
 				vm_command_t *cmd = &handle->cmds[i];
 				bool terminate = false;
 
-				nk_labelf(ctx, NK_TEXT_CENTERED, "%03u", i);
 				if(cmd->type == COMMAND_NOP)
 				{
-					nk_spacing(ctx, 3);
+					nk_labelf(ctx, NK_TEXT_CENTERED, "%03u", i);
+					nk_spacing(ctx, 4);
 				}
 				else
 				{
+					const vm_rate_t rate = handle->rates[i];
+
+					if(nk_widget_is_hovered(ctx))
+						nk_tooltip(ctx, rate_labels[rate]);
+					nk_labelf_colored(ctx, NK_TEXT_CENTERED, rate_colors[rate], "%03u", i);
+
 					if(nk_button_image_label(ctx, handle->icons.plus, "", NK_TEXT_RIGHT)) // insert cmd
 					{
 						for(unsigned j = ITEMS_MAX - 1; j > i; j--)
@@ -837,6 +1355,15 @@ _expose(struct nk_context *ctx, struct nk_rect wbounds, void *data)
 
 						sync = true;
 					}
+
+					const vm_verify_t err = handle->errs[i];
+
+					if(nk_widget_is_hovered(ctx))
+						nk_tooltip(ctx, verify_labels[err]);
+					if(handle->depth[i] == INT_MIN)
+						nk_label_colored(ctx, "?", NK_TEXT_CENTERED, verify_colors[err]);
+					else
+						nk_labelf_colored(ctx, NK_TEXT_CENTERED, verify_colors[err], "%i", handle->depth[i]);
 				}
 
 				const vm_command_enum_t old_cmd_type = cmd->type;
@@ -985,15 +1512,8 @@ _expose(struct nk_context *ctx, struct nk_rect wbounds, void *data)
 
 			if(sync)
 			{
-				atom_ser_t *ser = &handle->ser;
-				ser->offset = 0;
-				lv2_atom_forge_set_sink(&handle->forge, _sink, _deref, ser);
-				vm_graph_serialize(handle->api, &handle->forge, handle->cmds);
-				props_impl_t *impl = _props_impl_get(&handle->props, handle->vm_graph);
-				if(impl)
-					_props_impl_set(&handle->props, impl, ser->atom->type, ser->atom->size, LV2_ATOM_BODY_CONST(ser->atom));
-
-				_set_property(handle, handle->vm_graph);
+				_update_rates(handle);
+				_patch_graph(handle);
 			}
 
 			nk_group_end(ctx);
@@ -1002,11 +1522,12 @@ _expose(struct nk_context *ctx, struct nk_rect wbounds, void *data)
 		if(nk_group_begin(ctx, "Outputs", NK_WINDOW_TITLE | NK_WINDOW_BORDER))
 		{
 			bool sync = false;
+			bool decimate = false;
 
 			for(unsigned i = 0; i < CTRL_MAX; i++)
 			{
 				nk_layout_row_dynamic(ctx, dy*4, 1);
-				_draw_plot(ctx, handle->outp[i].vals, handle->vm_plug);
+				_draw_plot(ctx, &handle->outp[i], handle->vm_plug);
 
 				nk_layout_row_dynamic(ctx, dy, 2);
 				if(  (handle->vm_plug == VM_PLUG_CONTROL)
@@ -1018,7 +1539,7 @@ _expose(struct nk_context *ctx, struct nk_rect wbounds, void *data)
 				}
 				else if(handle->vm_plug == VM_PLUG_AUDIO)
 				{
-					_draw_mixer(ctx, handle->out1[i]);
+					_draw_mixer(ctx, handle->out1[i], handle->out3[i]);
 
 					if(handle->out2[i] > handle->out1[i])
 						handle->out1[i] = handle->out2[i];
@@ -1030,7 +1551,33 @@ _expose(struct nk_context *ctx, struct nk_rect wbounds, void *data)
 				_wheel_int(ctx, &handle->outp[i].window);
 				nk_property_int(ctx, ms_label, 10, &handle->outp[i].window, 100000, 1, 1.f);
 				if(old_window != handle->outp[i].window)
-					memset(handle->outp[i].vals, 0x0, sizeof(float)*PLOT_MAX);
+					_plot_clear(&handle->outp[i]);
+
+				if(  (handle->vm_plug == VM_PLUG_ATOM)
+					|| (handle->vm_plug == VM_PLUG_MIDI) )
+				{
+					vm_decim_t *decim = &handle->decimation[i];
+
+					nk_layout_row_dynamic(ctx, dy, 3);
+
+					const float old_interval = decim->interval;
+					decim->interval = nk_propertyf(ctx, gap_label, 0.f, old_interval, 1000.f, 1.f, 1.f);
+					if(old_interval != decim->interval)
+						decimate = true;
+
+					const float old_deadband = decim->deadband;
+					decim->deadband = nk_propertyf(ctx, band_label, 0.f, old_deadband, VM_RNG, VM_STP, VM_STP);
+					if(old_deadband != decim->deadband)
+						decimate = true;
+
+					if(handle->vm_plug == VM_PLUG_MIDI)
+					{
+						const bool old_quantized = decim->quantized;
+						decim->quantized = nk_check_label(ctx, "quantized", old_quantized);
+						if(old_quantized != decim->quantized)
+							decimate = true;
+					}
+				}
 
 				if(handle->vm_plug == VM_PLUG_MIDI)
 				{
@@ -1088,6 +1635,19 @@ _expose(struct nk_context *ctx, struct nk_rect wbounds, void *data)
 				_set_property(handle, handle->vm_destinationFilter);
 			}
 
+			if(decimate)
+			{
+				atom_ser_t *ser = &handle->ser;
+				ser->offset = 0;
+				lv2_atom_forge_set_sink(&handle->forge, _sink, _deref, ser);
+				vm_decim_serialize(&handle->forge, &handle->decim, handle->decimation);
+				props_impl_t *impl = _props_impl_get(&handle->props, handle->vm_decimation);
+				if(impl)
+					_props_impl_set(&handle->props, impl, ser->atom->type, ser->atom->size, LV2_ATOM_BODY_CONST(ser->atom));
+
+				_set_property(handle, handle->vm_decimation);
+			}
+
 			nk_group_end(ctx);
 		}
 	}
@@ -1162,6 +1722,11 @@ instantiate(const LV2UI_Descriptor *descriptor, const char *plugin_uri,
 		LV2_PARAMETERS__sampleRate);
 	const LV2_URID ui_scaleFactor = handle->map->map(handle->map->handle,
 		LV2_UI__scaleFactor);
+	const LV2_URID bufsz_nominalBlockLength = handle->map->map(handle->map->handle,
+		LV2_BUF_SIZE__nominalBlockLength);
+	const LV2_URID bufsz_maxBlockLength = handle->map->map(handle->map->handle,
+		LV2_BUF_SIZE__maxBlockLength);
+	uint32_t max_block_size = 0;
 
 	for(LV2_Options_Option *opt = opts;
 		(opt->key != 0) && (opt->value != NULL);
@@ -1175,6 +1740,21 @@ instantiate(const LV2UI_Descriptor *descriptor, const char *plugin_uri,
 		{
 			handle->scale = *(const float*)opt->value;
 		}
+		else if( (opt->key == bufsz_nominalBlockLength) && (opt->type == handle->forge.Int) )
+		{
+			handle->block_size = *(const int32_t *)opt->value;
+		}
+		else if( (opt->key == bufsz_maxBlockLength) && (opt->type == handle->forge.Int) )
+		{
+			max_block_size = *(const int32_t *)opt->value;
+		}
+	}
+
+	if(!handle->block_size)
+	{
+		handle->block_size = max_block_size
+			? max_block_size
+			: 1024; // fall-back
 	}
 
 	if(!handle->sample_rate)
@@ -1191,7 +1771,13 @@ instantiate(const LV2UI_Descriptor *descriptor, const char *plugin_uri,
 
 	const int nprops = handle->vm_plug == VM_PLUG_MIDI
 		? MAX_NPROPS
-		: 1;
+		: handle->vm_plug == VM_PLUG_ATOM
+			? MAX_NPROPS - 2
+			: MAX_NPROPS - 3;
+
+	handle->state.budget = VM_SHARE;
+	handle->state.update_rate = VM_UPDATE_RATE;
+	handle->nrows = ITEMS_PRE;
 
 	if(!props_init(&handle->props, plugin_uri,
 		defs, nprops,
@@ -1202,8 +1788,36 @@ instantiate(const LV2UI_Descriptor *descriptor, const char *plugin_uri,
 		return NULL;
 	}
 
+	// graphs longer than inline state, UI memory is not per plugin instance
+	props_impl_t *graph = _props_impl_get(&handle->props, props_map(&handle->props, VM__graph));
+	if(graph)
+	{
+		graph->value.body = handle->graph[0];
+		graph->stash.body = handle->graph[1];
+	}
+
+	props_dyn(&handle->props, &dyn); // patches echoed by plugin
+
+	if(!vm_arena_reserve(&handle->scratch, SCRATCH_SIZE(ITEMS_MAX)))
+	{
+		fprintf(stderr, "vm_arena_reserve failed\n");
+		free(handle);
+		return NULL;
+	}
+
 	handle->atom_eventTransfer = handle->map->map(handle->map->handle, LV2_ATOM__eventTransfer);
 	handle->vm_graph = handle->map->map(handle->map->handle, VM__graph);
+	handle->vm_budget = handle->map->map(handle->map->handle, VM__budget);
+	handle->vm_updateRate = handle->map->map(handle->map->handle, VM__updateRate);
+	handle->vm_params[0] = handle->map->map(handle->map->handle, VM__param0);
+	handle->vm_params[1] = handle->map->map(handle->map->handle, VM__param1);
+	handle->vm_params[2] = handle->map->map(handle->map->handle, VM__param2);
+	handle->vm_params[3] = handle->map->map(handle->map->handle, VM__param3);
+	handle->vm_params[4] = handle->map->map(handle->map->handle, VM__param4);
+	handle->vm_params[5] = handle->map->map(handle->map->handle, VM__param5);
+	handle->vm_params[6] = handle->map->map(handle->map->handle, VM__param6);
+	handle->vm_params[7] = handle->map->map(handle->map->handle, VM__param7);
+	handle->vm_decimation = handle->map->map(handle->map->handle, VM__decimation);
 	handle->vm_sourceFilter = handle->map->map(handle->map->handle, VM__sourceFilter);
 	handle->vm_destinationFilter = handle->map->map(handle->map->handle, VM__destinationFilter);
 	handle->midi_MidiEvent = handle->map->map(handle->map->handle, LV2_MIDI__MidiEvent);
@@ -1219,6 +1833,11 @@ instantiate(const LV2UI_Descriptor *descriptor, const char *plugin_uri,
 	handle->filt.midi_noteNumber = handle->map->map(handle->map->handle, LV2_MIDI__noteNumber);
 	handle->filt.midi_velocity = handle->map->map(handle->map->handle, LV2_MIDI__velocity);
 
+	handle->decim.vm_Decimation = handle->map->map(handle->map->handle, VM__Decimation);
+	handle->decim.vm_interval = handle->map->map(handle->map->handle, VM__interval);
+	handle->decim.vm_deadband = handle->map->map(handle->map->handle, VM__deadband);
+	handle->decim.vm_quantized = handle->map->map(handle->map->handle, VM__quantized);
+
 	handle->controller = controller;
 	handle->writer = write_function;
 
@@ -1269,6 +1888,8 @@ instantiate(const LV2UI_Descriptor *descriptor, const char *plugin_uri,
 	{
 		handle->inp[i].window = 1000; // 1 second window
 		handle->outp[i].window = 1000; // 1 second window
+		_plot_clear(&handle->inp[i]);
+		_plot_clear(&handle->outp[i]);
 	}
 
 	return handle;
@@ -1288,9 +1909,50 @@ cleanup(LV2UI_Handle instance)
 	if(ser->buf)
 		free(ser->buf);
 
+	vm_arena_deinit(&handle->scratch);
 	free(handle);
 }
 
+// scroll plots by frames elapsed since last notification
+static void
+_advance(plughandle_t *handle, int64_t off)
+{
+	const int64_t dt = off - handle->off;
+	handle->off = off;
+	const float dts = 1000.f * dt / handle->sample_rate; // in seconds
+
+	bool needs_refresh = false;
+
+	//FIXME can get out of sync
+
+	for(unsigned i = 0; i < CTRL_MAX; i++)
+	{
+		const env_t *inenv = &handle->inenv[i];
+		const env_t *outenv = &handle->outenv[i];
+
+		if(handle->vm_plug == VM_PLUG_AUDIO) // plot peaks
+		{
+			const float inpeak = fmaxf(fabsf(inenv->min), fabsf(inenv->max));
+			const float outpeak = fmaxf(fabsf(outenv->min), fabsf(outenv->max));
+
+			if(_plot_advance(&handle->inp[i], dts, inpeak, inpeak))
+				needs_refresh = true;
+			if(_plot_advance(&handle->outp[i], dts, outpeak, outpeak))
+				needs_refresh = true;
+		}
+		else
+		{
+			if(_plot_advance(&handle->inp[i], dts, inenv->min, inenv->max))
+				needs_refresh = true;
+			if(_plot_advance(&handle->outp[i], dts, outenv->min, outenv->max))
+				needs_refresh = true;
+		}
+	}
+
+	if(needs_refresh)
+		nk_pugl_post_redisplay(&handle->win);
+}
+
 static void
 port_event(LV2UI_Handle instance, uint32_t index,
 	uint32_t size __attribute__((unused)), uint32_t protocol, const void *buf)
@@ -1306,103 +1968,74 @@ port_event(LV2UI_Handle instance, uint32_t index,
 			{
 				const LV2_Atom *atom = buf;
 
-				if(atom->type == handle->forge.Long)
+				if(atom->type == handle->forge.Tuple)
 				{
-					const LV2_Atom_Long *off = (const LV2_Atom_Long *)atom;
-
-					const int64_t dt = off->body - handle->off;
-					handle->off = off->body;
-					const float dts = 1000.f * dt / handle->sample_rate; // in seconds
+					// frame counter, mask of changed ports and all port values
+					const LV2_Atom_Tuple *tup = (const LV2_Atom_Tuple *)atom;
 
-					float mem [PLOT_MAX];
-					bool needs_refresh = false;
+					const LV2_Atom *itr = lv2_atom_tuple_begin(tup);
+					const LV2_Atom_Long *off = (const LV2_Atom_Long *)itr;
 
-					//FIXME can get out of sync
+					itr = lv2_atom_tuple_next(itr);
+					const LV2_Atom_Int *dirty = (const LV2_Atom_Int *)itr;
 
-					for(unsigned i = 0; i < CTRL_MAX; i++)
+					itr = lv2_atom_tuple_next(itr);
+					const LV2_Atom_Vector *vec = (const LV2_Atom_Vector *)itr;
+					const float *vals = LV2_ATOM_CONTENTS_CONST(LV2_Atom_Vector, vec);
+
+					if(  (off->atom.type != handle->forge.Long)
+						|| (dirty->atom.type != handle->forge.Int)
+						|| (vec->atom.type != handle->forge.Vector)
+						|| (vec->body.child_type != handle->forge.Float)
+						|| (vec->atom.size < sizeof(LV2_Atom_Vector_Body) + sizeof(float)*CTRL_MAX*2) )
 					{
-						// inputs
-						{
-							handle->inp[i].pre += PLOT_MAX * dts / handle->inp[i].window;
-							double intp;
-							const double frac = modf(handle->inp[i].pre, &intp);
-
-							if(intp > 0)
-							{
-								handle->inp[i].pre = frac;
+						break;
+					}
 
-								unsigned pre = floorf(intp);
-								pre &= PLOT_MASK;
-								const unsigned post = PLOT_MAX - pre;
+					const uint32_t nvals = (vec->atom.size - sizeof(LV2_Atom_Vector_Body)) / sizeof(float);
+					const bool has_env = nvals >= NOTIFY_ENV_MAX*CTRL_MAX*2;
 
-								memcpy(mem, &handle->inp[i].vals[pre], sizeof(float)*post);
-								for(unsigned j = post; j < PLOT_MAX; j++)
-									mem[j] = handle->in0[i];
+					for(unsigned j = 0; j < CTRL_MAX*2; j++)
+					{
+						const bool is_in = j < CTRL_MAX;
+						const unsigned k = is_in ? j : j - CTRL_MAX;
+						float *val0 = is_in ? &handle->in0[k] : &handle->out0[k];
+						env_t *env = is_in ? &handle->inenv[k] : &handle->outenv[k];
 
-								//FIXME can be made more efficient
-								if(memcmp(handle->inp[i].vals, mem, sizeof(float)*PLOT_MAX))
-									needs_refresh = true;
+						if(dirty->body & (1U << j))
+							*val0 = vals[j];
 
-								memcpy(handle->inp[i].vals, mem, sizeof(float)*PLOT_MAX);
-							}
+						if(has_env)
+						{
+							env->min = vals[NOTIFY_MIN*CTRL_MAX*2 + j];
+							env->max = vals[NOTIFY_MAX*CTRL_MAX*2 + j];
+							env->rms = vals[NOTIFY_RMS*CTRL_MAX*2 + j];
+						}
+						else
+						{
+							env->min = *val0;
+							env->max = *val0;
+							env->rms = fabsf(*val0);
 						}
 
-						// outputs
+						if(handle->vm_plug == VM_PLUG_AUDIO)
 						{
-							handle->outp[i].pre += PLOT_MAX * dts / handle->outp[i].window;
-							double intp;
-							const double frac = modf(handle->outp[i].pre, &intp);
+							const float peak = fmaxf(fabsf(env->min), fabsf(env->max));
 
-							if(intp > 0)
+							if(is_in)
 							{
-								handle->outp[i].pre = frac;
-
-								unsigned pre = floorf(intp);
-								pre &= PLOT_MASK;
-								const unsigned post = PLOT_MAX - pre;
-
-								memcpy(mem, &handle->outp[i].vals[pre], sizeof(float)*post);
-								for(unsigned j = post; j < PLOT_MAX; j++)
-									mem[j] = handle->out0[i];
-
-								//FIXME can be made more efficient
-								if(memcmp(handle->outp[i].vals, mem, sizeof(float)*PLOT_MAX))
-									needs_refresh = true;
-
-								memcpy(handle->outp[i].vals, mem, sizeof(float)*PLOT_MAX);
+								handle->in2[k] = dBFS6(peak);
+								handle->in3[k] = dBFS6(env->rms);
+							}
+							else
+							{
+								handle->out2[k] = dBFS6(peak);
+								handle->out3[k] = dBFS6(env->rms);
 							}
 						}
 					}
 
-					if(needs_refresh)
-						nk_pugl_post_redisplay(&handle->win);
-				}
-				else if(atom->type == handle->forge.Tuple)
-				{
-					const LV2_Atom_Tuple *tup = (const LV2_Atom_Tuple *)atom;
-
-					const LV2_Atom *itr = lv2_atom_tuple_begin(tup);
-					const LV2_Atom_Int *idx = (const LV2_Atom_Int *)itr;
-
-					itr = lv2_atom_tuple_next(itr);
-					const LV2_Atom_Float *val = (const LV2_Atom_Float *)itr;
-
-					if(idx->body < 10)
-					{
-						const unsigned j = idx->body - 2;
-						handle->in0[j] = val->body;
-
-						if(handle->vm_plug == VM_PLUG_AUDIO)
-							handle->in2[j] = dBFS6(val->body);
-					}
-					else
-					{
-						const unsigned j = idx->body - 10;
-						handle->out0[j] = val->body;
-
-						if(handle->vm_plug == VM_PLUG_AUDIO)
-							handle->out2[j] = dBFS6(val->body);
-					}
+					_advance(handle, off->body);
 				}
 				else // !tuple
 				{
@@ -1412,8 +2045,7 @@ port_event(LV2UI_Handle instance, uint32_t index,
 					ser->offset = 0;
 					lv2_atom_forge_set_sink(&handle->forge, _sink, _deref, ser);
 
-					LV2_Atom_Forge_Ref ref = 0;
-					if(props_advance(&handle->props, &handle->forge, 0, obj, &ref))
+					if(_control_advance(handle, obj))
 					{
 						nk_pugl_post_redisplay(&handle->win);
 					}